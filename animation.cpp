@@ -0,0 +1,258 @@
+#include "animation.h"
+#include "scene_graph.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <unordered_set>
+
+namespace
+{
+	//	moves key on to the last one at or before time, a time before the first key stays on it
+	GLuint seek(const std::vector<float>& times, float time, GLuint& key)
+	{
+		while (key + 1 < times.size() && times[key + 1] <= time)
+		{
+			key++;
+		}
+		return key;
+	}
+
+	//	how far time is from key towards the next one
+	float getFactor(const std::vector<float>& times, GLuint key, float time)
+	{
+		if (key + 1 >= times.size())
+		{
+			return 0.0f;
+		}
+		float span = times[key + 1] - times[key];
+		return span > 0.0f ? std::min(std::max((time - times[key]) / span, 0.0f), 1.0f) : 0.0f;
+	}
+
+	//	close enough to slerp between keys and neighbouring poses, and cheaper
+	glm::quat nlerp(const glm::quat& a, const glm::quat& b, float t)
+	{
+		glm::quat c = glm::dot(a, b) < 0.0f ? -b : b;
+		return glm::normalize(a * (1.0f - t) + c * t);
+	}
+
+	//	a node is kept when a bone of some mesh names it, when it holds meshes or when a kept node is below it
+	bool markUsed(const aiNode* node, const std::unordered_set<std::string>& boneNames, std::unordered_set<const aiNode*>& used)
+	{
+		bool keep = node->mNumMeshes > 0 || boneNames.count(node->mName.C_Str()) > 0;
+		for (size_t i = 0; i < node->mNumChildren; i++)
+		{
+			keep = markUsed(node->mChildren[i], boneNames, used) || keep;
+		}
+		if (keep)
+		{
+			used.insert(node);
+		}
+		return keep;
+	}
+
+	void addNodes(const aiNode* node, GLuint parent, const std::unordered_set<const aiNode*>& used, Skeleton& skeleton,
+		std::vector<std::pair<GLuint, GLuint> >& meshBones)
+	{
+		if (!used.count(node))
+		{
+			return;
+		}
+		aiVector3D scale, position;
+		aiQuaternion rotation;
+		node->mTransformation.Decompose(scale, rotation, position);
+		boneTransform bind;
+		bind.translation = glm::vec3(position.x, position.y, position.z);
+		bind.rotation = glm::quat(rotation.w, rotation.x, rotation.y, rotation.z);
+		bind.scale = glm::vec3(scale.x, scale.y, scale.z);
+		GLuint bone = skeleton.addBone(node->mName.C_Str(), parent, bind);
+		for (size_t i = 0; i < node->mNumMeshes; i++)
+		{
+			meshBones.push_back(std::make_pair(node->mMeshes[i], bone));
+		}
+		for (size_t i = 0; i < node->mNumChildren; i++)
+		{
+			addNodes(node->mChildren[i], bone, used, skeleton, meshBones);
+		}
+	}
+}
+
+//	the parent has to be added already; the inverse bind matrix starts as identity
+GLuint Skeleton::addBone(const std::string& name, GLuint parent, const boneTransform& bind)
+{
+	names.push_back(name);
+	parents.push_back(parent);
+	bindPose.push_back(bind);
+	inverseBinds.push_back(glm::mat4(1.0f));
+	return parents.size() - 1;
+}
+
+GLuint Skeleton::findBone(const std::string& name) const
+{
+	std::vector<std::string>::const_iterator it = std::find(names.begin(), names.end(), name);
+	return it != names.end() ? it - names.begin() : SKELETON_NO_BONE;
+}
+
+void Skeleton::setInverseBind(GLuint bone, const glm::mat4& inverseBind)
+{
+	inverseBinds[bone] = inverseBind;
+}
+
+size_t Skeleton::getBoneCount() const
+{
+	return parents.size();
+}
+
+const std::vector<boneTransform>& Skeleton::getBindPose() const
+{
+	return bindPose;
+}
+
+//	pose has room for every bone; a cursor only moves forward, it starts over when the clip wraps or is rewound
+void Skeleton::sample(const animationClip& clip, float time, animationCursor& cursor, boneTransform* pose) const
+{
+	float t = clip.duration > 0.0f ? std::fmod(time, clip.duration) : 0.0f;
+	if (t < 0.0f)
+	{
+		t += clip.duration;
+	}
+	if (cursor.keys.size() != parents.size() * 3 || t < cursor.time)
+	{
+		cursor.keys.assign(parents.size() * 3, 0);
+	}
+	cursor.time = t;
+
+	for (size_t i = 0; i < parents.size(); i++)
+	{
+		pose[i] = bindPose[i];
+		if (i >= clip.channels.size())
+		{
+			continue;
+		}
+		const animationChannel& channel = clip.channels[i];
+		GLuint* keys = &cursor.keys[i * 3];
+		if (!channel.translationTimes.empty())
+		{
+			GLuint key = seek(channel.translationTimes, t, keys[0]);
+			GLuint next = std::min<GLuint>(key + 1, channel.translations.size() - 1);
+			pose[i].translation = glm::mix(channel.translations[key], channel.translations[next], getFactor(channel.translationTimes, key, t));
+		}
+		if (!channel.rotationTimes.empty())
+		{
+			GLuint key = seek(channel.rotationTimes, t, keys[1]);
+			GLuint next = std::min<GLuint>(key + 1, channel.rotations.size() - 1);
+			pose[i].rotation = nlerp(channel.rotations[key], channel.rotations[next], getFactor(channel.rotationTimes, key, t));
+		}
+		if (!channel.scaleTimes.empty())
+		{
+			GLuint key = seek(channel.scaleTimes, t, keys[2]);
+			GLuint next = std::min<GLuint>(key + 1, channel.scales.size() - 1);
+			pose[i].scale = glm::mix(channel.scales[key], channel.scales[next], getFactor(channel.scaleTimes, key, t));
+		}
+	}
+}
+
+//	worlds is scratch with room for every bone, palette receives the skinning matrices
+void Skeleton::buildPalette(const boneTransform* pose, glm::mat4* worlds, glm::mat4* palette) const
+{
+	for (size_t i = 0; i < parents.size(); i++)
+	{
+		glm::mat4 local = compose(pose[i]);
+		if (parents[i] == SKELETON_NO_BONE)
+		{
+			worlds[i] = local;
+		}
+		else
+		{
+			SceneGraph::multiply(worlds[parents[i]], local, worlds[i]);
+		}
+		SceneGraph::multiply(worlds[i], inverseBinds[i], palette[i]);
+	}
+}
+
+//	weight is that of the second pose; out may be either of the two
+void Skeleton::blend(const boneTransform* a, const boneTransform* b, float weight, size_t count, boneTransform* out)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i].translation = glm::mix(a[i].translation, b[i].translation, weight);
+		out[i].rotation = nlerp(a[i].rotation, b[i].rotation, weight);
+		out[i].scale = glm::mix(a[i].scale, b[i].scale, weight);
+	}
+}
+
+glm::mat4 Skeleton::compose(const boneTransform& transform)
+{
+	glm::mat4 res = glm::mat4_cast(transform.rotation);
+	res[0] *= transform.scale.x;
+	res[1] *= transform.scale.y;
+	res[2] *= transform.scale.z;
+	res[3] = glm::vec4(transform.translation, 1.0f);
+	return res;
+}
+
+//	meshBones receives every scene mesh with the bone of the node holding it
+bool importAnimation(const aiScene* scene, Skeleton& skeleton, std::vector<animationClip>& clips, std::vector<std::pair<GLuint, GLuint> >& meshBones)
+{
+	std::unordered_set<std::string> boneNames;
+	for (size_t i = 0; i < scene->mNumMeshes; i++)
+	{
+		for (size_t b = 0; b < scene->mMeshes[i]->mNumBones; b++)
+		{
+			boneNames.insert(scene->mMeshes[i]->mBones[b]->mName.C_Str());
+		}
+	}
+	std::unordered_set<const aiNode*> used;
+	markUsed(scene->mRootNode, boneNames, used);
+	addNodes(scene->mRootNode, SKELETON_NO_BONE, used, skeleton, meshBones);
+	if (skeleton.getBoneCount() > SKELETON_MAX_BONES)
+	{
+		std::cerr << "Skeleton of " << skeleton.getBoneCount() << " bones, at most " << SKELETON_MAX_BONES << " are supported\n";
+		return false;
+	}
+
+	clips.resize(scene->mNumAnimations);
+	for (size_t a = 0; a < scene->mNumAnimations; a++)
+	{
+		const aiAnimation* animation = scene->mAnimations[a];
+		double ticks = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : ANIMATION_TICKS_DEFAULT;
+		animationClip& clip = clips[a];
+		clip.name = animation->mName.C_Str();
+		clip.duration = (float)(animation->mDuration / ticks);
+		clip.channels.resize(skeleton.getBoneCount());
+		for (size_t c = 0; c < animation->mNumChannels; c++)
+		{
+			const aiNodeAnim* nodeAnim = animation->mChannels[c];
+			GLuint bone = skeleton.findBone(nodeAnim->mNodeName.C_Str());
+			if (bone == SKELETON_NO_BONE)
+			{
+				continue;
+			}
+			animationChannel& channel = clip.channels[bone];
+			for (size_t k = 0; k < nodeAnim->mNumPositionKeys; k++)
+			{
+				const aiVectorKey& key = nodeAnim->mPositionKeys[k];
+				channel.translationTimes.push_back((float)(key.mTime / ticks));
+				channel.translations.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			for (size_t k = 0; k < nodeAnim->mNumRotationKeys; k++)
+			{
+				const aiQuatKey& key = nodeAnim->mRotationKeys[k];
+				channel.rotationTimes.push_back((float)(key.mTime / ticks));
+				channel.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			for (size_t k = 0; k < nodeAnim->mNumScalingKeys; k++)
+			{
+				const aiVectorKey& key = nodeAnim->mScalingKeys[k];
+				channel.scaleTimes.push_back((float)(key.mTime / ticks));
+				channel.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+		}
+	}
+	return true;
+}
+
+//	aiMatrix4x4 is row major
+glm::mat4 toMat4(const aiMatrix4x4& m)
+{
+	return glm::mat4(glm::vec4(m.a1, m.b1, m.c1, m.d1), glm::vec4(m.a2, m.b2, m.c2, m.d2), glm::vec4(m.a3, m.b3, m.c3, m.d3), glm::vec4(m.a4, m.b4, m.c4, m.d4));
+}
@@ -0,0 +1,81 @@
+#ifndef _ANIMATION_H
+#define _ANIMATION_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <assimp/scene.h>
+#include <string>
+#include <vector>
+
+#define SKELETON_NO_BONE		(~0u)	//	parent of a root
+#define SKELETON_MAX_BONES		256		//	skinned vertices keep a byte per bone index
+#define ANIMATION_TICKS_DEFAULT	25.0	//	ticks per second of clips that do not say
+
+//	local transform of a bone; a pose is one per bone, in skeleton order
+struct boneTransform
+{
+	glm::vec3 translation;
+	glm::quat rotation;
+	glm::vec3 scale;
+};
+
+//	keys of one bone, each track sorted by time in seconds; a bone with no keys in a track keeps its bind pose there
+struct animationChannel
+{
+	std::vector<float> translationTimes, rotationTimes, scaleTimes;
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+};
+
+struct animationClip
+{
+	std::string name;
+	float duration;								//	seconds, sampling wraps around
+	std::vector<animationChannel> channels;		//	one per bone of the skeleton
+};
+
+//	the keys sampling last stopped at, three per bone; a later time only searches on from there
+struct animationCursor
+{
+	std::vector<GLuint> keys;
+	float time;
+};
+
+/**
+ * Bones as flat arrays in topological order, like SceneGraph: a bone can only be added below
+ * one that exists, so building the palette is a single forward pass of SceneGraph::multiply.
+ * sample() reads a pose from a clip; an animationCursor per played clip keeps the key found
+ * last for every track, so a clip played forward finds its keys in constant time per bone
+ * instead of searching them every frame. Poses are blended per bone (translations and scales
+ * mixed, rotations normalized-lerped along the shorter arc) before buildPalette() turns them
+ * into skinning matrices: bone to model space times the inverse bind matrix.
+ */
+class Skeleton
+{
+	public:
+		GLuint addBone(const std::string&, GLuint, const boneTransform&);
+		GLuint findBone(const std::string&) const;
+		void setInverseBind(GLuint, const glm::mat4&);
+		size_t getBoneCount() const;
+		const std::vector<boneTransform>& getBindPose() const;
+
+		void sample(const animationClip&, float, animationCursor&, boneTransform*) const;
+		void buildPalette(const boneTransform*, glm::mat4*, glm::mat4*) const;
+		static void blend(const boneTransform*, const boneTransform*, float, size_t, boneTransform*);
+		static glm::mat4 compose(const boneTransform&);
+
+	private:
+		std::vector<std::string> names;
+		std::vector<GLuint> parents;
+		std::vector<boneTransform> bindPose;
+		std::vector<glm::mat4> inverseBinds;
+};
+
+//	nodes named by an aiBone or holding meshes become bones, with their ancestors; every aiAnimation becomes a clip.
+//	Inverse bind matrices stay identity for the caller to set
+bool importAnimation(const aiScene*, Skeleton&, std::vector<animationClip>&, std::vector<std::pair<GLuint, GLuint> >&);
+glm::mat4 toMat4(const aiMatrix4x4&);
+
+#endif
@@ -0,0 +1,197 @@
+#include "asset_cook.h"
+#include "ktx_file.h"
+#include "texture_compressor.h"
+#include "texture_loader.h"
+#include "utils.h"
+#include <SOIL.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <dirent.h>
+#include <sys/stat.h>
+
+AssetCook::AssetCook(ThreadPool& _threadPool) : threadPool(_threadPool), skipped(0), failed(0)
+{
+}
+
+//	false when any image could not be cooked, the others are still written
+bool AssetCook::cook(const std::string& root)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t cooked = 0;
+	skipped = failed = 0;
+	cookDirectory(root, cooked);
+	_log("Cooked " << cooked << " textures in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+		<< " s, " << skipped << " up to date, " << failed << " failed");
+	return failed == 0;
+}
+
+std::string AssetCook::getCookedPath(const std::string& source)
+{
+	return source + COOK_EXTENSION;
+}
+
+//	a cooked file stands in for its source unless the source has changed since, or is shipped without one
+bool AssetCook::isCooked(const std::string& source)
+{
+	struct stat cooked, original;
+	if (stat(getCookedPath(source).c_str(), &cooked) != 0)
+	{
+		return false;
+	}
+	return stat(source.c_str(), &original) != 0 || cooked.st_mtime >= original.st_mtime;
+}
+
+//	sorted, so the log reads the same from run to run
+void AssetCook::cookDirectory(const std::string& path, size_t& cooked)
+{
+	DIR* dir = opendir(path.c_str());
+	if (!dir)
+	{
+		std::cerr << "Could not open directory " << path << '\n';
+		failed++;
+		return;
+	}
+	std::vector<std::string> entries;
+	while (dirent* entry = readdir(dir))
+	{
+		if (entry->d_name[0] != '.')
+		{
+			entries.push_back(path + '/' + entry->d_name);
+		}
+	}
+	closedir(dir);
+	std::sort(entries.begin(), entries.end());
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		struct stat st;
+		if (stat(entries[i].c_str(), &st) != 0)
+		{
+			continue;
+		}
+		if (S_ISDIR(st.st_mode))
+		{
+			cookDirectory(entries[i], cooked);
+		}
+		else if (isImagePath(entries[i]))
+		{
+			if (isCooked(entries[i]))
+			{
+				skipped++;
+			}
+			else if (cookFile(entries[i]))
+			{
+				cooked++;
+			}
+			else
+			{
+				failed++;
+			}
+		}
+	}
+}
+
+//	mips are filtered from the RGBA image before compression, each level is compressed on its own
+bool AssetCook::cookFile(const std::string& path)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int width = 0, height = 0;
+	unsigned char* loaded = SOIL_load_image(path.c_str(), &width, &height, 0, SOIL_LOAD_RGBA);
+	if (!loaded)
+	{
+		std::cerr << "Could not load texture " << path << '\n';
+		return false;
+	}
+	std::vector<unsigned char> pixels(loaded, loaded + (size_t)width * height * 4);
+	SOIL_free_image_data(loaded);
+
+	std::string name = path.substr(path.find_last_of('/') + 1);
+	GLenum format = TEXTURE_FORMAT_BC1;
+	if (name.find(COOK_NORMAL_SUFFIX) != std::string::npos)
+	{
+		format = TEXTURE_FORMAT_BC5;
+	}
+	else
+	{
+		for (size_t i = 3; i < pixels.size(); i += 4)
+		{
+			if (pixels[i] < 255)
+			{
+				format = TEXTURE_FORMAT_BC3;
+				break;
+			}
+		}
+	}
+
+	std::vector<size_t> pixelOffsets;
+	TextureLoader::buildMipChain(pixels, pixelOffsets, width, height, 4);
+	ktxLayout layout = { format, width, height, std::vector<size_t>() };
+	std::vector<unsigned char> blocks;
+	for (size_t level = 0; level < pixelOffsets.size(); level++)
+	{
+		GLsizei levelWidth = std::max(width >> level, 1), levelHeight = std::max(height >> level, 1);
+		if (format == TEXTURE_FORMAT_BC5)
+		{
+			renormalize(&pixels[pixelOffsets[level]], (size_t)levelWidth * levelHeight);
+		}
+		layout.levelOffsets.push_back(blocks.size());
+		blocks.resize(blocks.size() + getImageBytes(format, levelWidth, levelHeight));
+		compressImage(format, &pixels[pixelOffsets[level]], levelWidth, levelHeight, &blocks[layout.levelOffsets.back()], threadPool);
+	}
+
+	if (!writeKtxFile(getCookedPath(path), layout, blocks))
+	{
+		std::cerr << "Could not write " << getCookedPath(path) << '\n';
+		return false;
+	}
+	double ms = elapsedMs(start, std::chrono::steady_clock::now());
+	_log(path << ": " << getTextureFormatName(format) << ", " << width << 'x' << height << ", " << layout.levelOffsets.size() << " levels, "
+		<< pixels.size() / 1024 << " KB to " << blocks.size() / 1024 << " KB in " << ms << " ms");
+	return true;
+}
+
+bool AssetCook::isImagePath(const std::string& path)
+{
+	static const char* extensions[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos)
+	{
+		return false;
+	}
+	std::string extension = path.substr(dot);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+	{
+		if (extension == extensions[i])
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//	box filtered normals come out short; BC5 keeps X and Y only, Z is rebuilt from them when sampled
+void AssetCook::renormalize(unsigned char* pixels, size_t count)
+{
+	for (size_t i = 0; i < count; i++, pixels += 4)
+	{
+		float x = pixels[0] / 127.5f - 1.0f, y = pixels[1] / 127.5f - 1.0f, z = pixels[2] / 127.5f - 1.0f;
+		float length = std::sqrt(x * x + y * y + z * z);
+		if (length < 1e-4f)
+		{
+			continue;
+		}
+		pixels[0] = (unsigned char)std::floor((x / length + 1.0f) * 127.5f + 0.5f);
+		pixels[1] = (unsigned char)std::floor((y / length + 1.0f) * 127.5f + 0.5f);
+		pixels[2] = (unsigned char)std::floor((z / length + 1.0f) * 127.5f + 0.5f);
+	}
+}
+
+int runAssetCook(const std::string& root)
+{
+	ThreadPool threadPool;
+	AssetCook cook(threadPool);
+	return cook.cook(root) ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+#ifndef _ASSET_COOK_H
+#define _ASSET_COOK_H
+
+#include "thread_pool.h"
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+
+#define COOK_EXTENSION		".ktx"		//	appended to the source path, as the mesh cache does
+#define COOK_NORMAL_SUFFIX	"_ddn"		//	tangent space normal maps, cooked to BC5
+
+/**
+ * Offline texture cook: every image below a directory is written next to itself as a KTX file
+ * holding its full mip chain, block compressed so the runtime only maps it and hands the
+ * levels to GL. Normal maps go to BC5 with X and Y renormalised on every level, images with
+ * any translucent texel to BC3 and everything else to BC1. A file whose cooked copy is not
+ * older than it is skipped, so the cook can be run after every asset change.
+ */
+class AssetCook
+{
+	public:
+		explicit AssetCook(ThreadPool&);
+		bool cook(const std::string&);
+
+		static std::string getCookedPath(const std::string&);
+		static bool isCooked(const std::string&);
+
+	private:
+		ThreadPool& threadPool;
+		size_t skipped, failed;
+
+		void cookDirectory(const std::string&, size_t&);
+		bool cookFile(const std::string&);
+		static bool isImagePath(const std::string&);
+		static void renormalize(unsigned char*, size_t);
+};
+
+//	./openglDemo --cook <dir>
+int runAssetCook(const std::string&);
+
+#endif
@@ -0,0 +1,714 @@
+#include "bench.h"
+#include "headless_context.h"
+#include "shader_permutations.h"
+#include "render_queue.h"
+#include "light_clusters.h"
+#include "frame_uniforms.h"
+#include "profiler.h"
+#include "obj_loader.h"
+#include "skinned_model.h"
+#include "utils.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	typedef std::chrono::steady_clock benchClock;
+
+	//	nearest rank on an already sorted series
+	double percentile(const std::vector<double>& sorted, double p)
+	{
+		size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+		return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+	}
+
+	void writeSeries(std::ofstream& ofs, const char* name, std::vector<double> values, bool last)
+	{
+		ofs << "\t\"" << name << "\": {";
+		if (!values.empty())
+		{
+			std::sort(values.begin(), values.end());
+			double sum = 0.0;
+			for (size_t i = 0; i < values.size(); i++)
+			{
+				sum += values[i];
+			}
+			ofs << "\"mean\": " << sum / values.size() << ", \"p50\": " << percentile(values, 50.0) << ", \"p90\": " << percentile(values, 90.0)
+				<< ", \"p95\": " << percentile(values, 95.0) << ", \"p99\": " << percentile(values, 99.0)
+				<< ", \"min\": " << values.front() << ", \"max\": " << values.back();
+		}
+		ofs << "}" << (last ? "\n" : ",\n");
+	}
+
+	//	a wavy BENCH_OBJ_PATCH square per object, written the way Blender exports: quads, v/vt/vn, four materials
+	bool writeBenchObj(const std::string& path, size_t bytes)
+	{
+		FILE* file = fopen(path.c_str(), "w");
+		if (!file)
+		{
+			return false;
+		}
+		const int n = BENCH_OBJ_PATCH;
+		size_t base = 1;
+		for (int object = 0; ftell(file) < (long)bytes; object++, base += n * n)
+		{
+			fprintf(file, "o patch_%d\nusemtl material_%d\ns 1\n", object, object % 4);
+			for (int i = 0; i < n * n; i++)
+			{
+				float x = (float)(i % n) / (n - 1), z = (float)(i / n) / (n - 1);
+				fprintf(file, "v %.6f %.6f %.6f\n", x * 10.0f + object * 11.0f, std::sin(x * 12.0f + object) * std::cos(z * 9.0f), z * 10.0f);
+			}
+			for (int i = 0; i < n * n; i++)
+			{
+				fprintf(file, "vt %.6f %.6f\n", (float)(i % n) / (n - 1), (float)(i / n) / (n - 1));
+			}
+			for (int i = 0; i < n * n; i++)
+			{
+				float x = (float)(i % n) / (n - 1), z = (float)(i / n) / (n - 1);
+				glm::vec3 normal = glm::normalize(glm::vec3(-12.0f * std::cos(x * 12.0f + object) * std::cos(z * 9.0f), 10.0f,
+					9.0f * std::sin(x * 12.0f + object) * std::sin(z * 9.0f)));
+				fprintf(file, "vn %.6f %.6f %.6f\n", normal.x, normal.y, normal.z);
+			}
+			for (int z = 0; z + 1 < n; z++)
+			{
+				for (int x = 0; x + 1 < n; x++)
+				{
+					size_t a = base + z * n + x, b = a + 1, c = a + n + 1, d = a + n;
+					fprintf(file, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n", a, a, a, b, b, b, c, c, c, d, d, d);
+				}
+			}
+		}
+		bool written = !ferror(file);
+		return fclose(file) == 0 && written;
+	}
+
+	//	the OBJ loader against Assimp on a generated file, no GL context needed
+	int runObjBenchmark(const benchOptions& options)
+	{
+		ThreadPool threadPool(options.threads > 1 ? options.threads - 1 : options.threads);
+		threadPool.setParallelism(options.threads);
+		std::string path = options.output + ".obj";
+		if (!writeBenchObj(path, (size_t)options.objMegabytes << 20))
+		{
+			std::cerr << "Could not write " << path << '\n';
+			return 1;
+		}
+
+		std::vector<double> objMs, objMBs, parseMs, mergeMs, assimpMs, assimpMBs;
+		objLoadStats stats;
+		size_t triangles = 0;
+		for (int run = 0; run < BENCH_OBJ_RUNS; run++)
+		{
+			std::vector<meshData> meshes;
+			ObjLoader loader(threadPool);
+			benchClock::time_point start = benchClock::now();
+			if (!loader.load(path, meshes))
+			{
+				std::remove(path.c_str());
+				return 1;
+			}
+			objMs.push_back(elapsedMs(start, benchClock::now()));
+			stats = loader.getStats();
+			objMBs.push_back(stats.bytes / 1048576.0 / (objMs.back() / 1000.0));
+			parseMs.push_back(stats.parseMs);
+			mergeMs.push_back(stats.mergeMs);
+			triangles = stats.corners / 3;
+		}
+		for (int run = 0; run < BENCH_OBJ_RUNS; run++)
+		{
+			Assimp::Importer importer;
+			benchClock::time_point start = benchClock::now();
+			const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+			assimpMs.push_back(elapsedMs(start, benchClock::now()));
+			assimpMBs.push_back(stats.bytes / 1048576.0 / (assimpMs.back() / 1000.0));
+			if (!scene)
+			{
+				std::cerr << "ERROR::ASSIMP::" << importer.GetErrorString() << '\n';
+				break;
+			}
+		}
+		std::remove(path.c_str());
+
+		std::ofstream ofs(options.output);
+		if (!ofs.is_open())
+		{
+			std::cerr << "Could not write " << options.output << '\n';
+			return 1;
+		}
+		ofs << "{\n"
+			<< "\t\"bytes\": " << stats.bytes << ",\n"
+			<< "\t\"chunks\": " << stats.chunks << ",\n"
+			<< "\t\"triangles\": " << triangles << ",\n"
+			<< "\t\"vertices\": " << stats.vertices << ",\n"
+			<< "\t\"threads\": " << (options.threads > 0 ? options.threads : threadPool.size() + 1) << ",\n";
+		writeSeries(ofs, "obj_ms", objMs, false);
+		writeSeries(ofs, "obj_parse_ms", parseMs, false);
+		writeSeries(ofs, "obj_merge_ms", mergeMs, false);
+		writeSeries(ofs, "obj_mb_per_s", objMBs, false);
+		writeSeries(ofs, "assimp_ms", assimpMs, false);
+		writeSeries(ofs, "assimp_mb_per_s", assimpMBs, true);
+		ofs << "}\n";
+
+		std::sort(objMBs.begin(), objMBs.end());
+		std::sort(assimpMBs.begin(), assimpMBs.end());
+		_log("OBJ benchmark: " << stats.bytes / 1048576.0 << " MB, ObjLoader " << objMBs.back() << " MB/s, Assimp " << assimpMBs.back()
+			<< " MB/s, written to " << options.output);
+		return 0;
+	}
+
+	std::string jsonEscape(const char* str)
+	{
+		std::string res;
+		for (; str && *str; str++)
+		{
+			if (*str == '"' || *str == '\\')
+			{
+				res += '\\';
+			}
+			res += *str;
+		}
+		return res;
+	}
+
+	//	a tapering tube standing on y = 0 over a chain of BENCH_SKIN_BONES bones, every ring shared by the two nearest, with a sway and a twist clip
+	void buildBenchRig(Skeleton& skeleton, std::vector<animationClip>& clips, std::vector<skinnedMeshData>& meshes)
+	{
+		const int bones = BENCH_SKIN_BONES, rings = BENCH_SKIN_RINGS, sides = BENCH_SKIN_SIDES;
+		const float height = 10.0f, radius = 0.8f, segment = height / bones, pi = 3.14159265f;
+		GLuint parent = SKELETON_NO_BONE;
+		for (int b = 0; b < bones; b++)
+		{
+			boneTransform bind = { glm::vec3(0.0f, b == 0 ? 0.0f : segment, 0.0f), glm::quat(), glm::vec3(1.0f) };
+			parent = skeleton.addBone("bone_" + std::to_string(b), parent, bind);
+			skeleton.setInverseBind(parent, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -b * segment, 0.0f)));
+		}
+
+		meshes.resize(1);
+		skinnedMeshData& mesh = meshes[0];
+		for (int r = 0; r <= rings; r++)
+		{
+			float y = height * r / rings, ringRadius = radius * (1.0f - 0.7f * y / height);
+			float f = std::min(std::max(y / segment - 0.5f, 0.0f), bones - 1.0f);
+			GLuint ringBones[2] = { (GLuint)f, std::min((GLuint)f + 1, (GLuint)bones - 1) };
+			float ringWeights[2] = { 1.0f - (f - ringBones[0]), f - ringBones[0] };
+			for (int i = 0; i < sides; i++)
+			{
+				float angle = 2.0f * pi * i / sides;
+				skinnedVertex v;
+				v.position = glm::vec3(ringRadius * std::cos(angle), y, ringRadius * std::sin(angle));
+				v.normal = glm::vec3(std::cos(angle), 0.0f, std::sin(angle));
+				v.texCoord = glm::vec2((float)i / sides, (float)r / rings);
+				setInfluences(v, ringBones, ringWeights, 2);
+				mesh.vertices.push_back(v);
+			}
+		}
+		for (int r = 0; r < rings; r++)
+		{
+			for (int i = 0; i < sides; i++)
+			{
+				GLuint a = r * sides + i, b = r * sides + (i + 1) % sides, c = b + sides, d = a + sides;
+				const GLuint quad[6] = { a, d, c, a, c, b };
+				mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+			}
+		}
+
+		//	the last key repeats the first, so both clips loop seamlessly
+		const char* names[2] = { "sway", "twist" };
+		const glm::vec3 axes[2] = { glm::vec3(0.0f, 0.0f, 1.0f), glm::normalize(glm::vec3(1.0f, 1.0f, 0.0f)) };
+		clips.resize(2);
+		for (int c = 0; c < 2; c++)
+		{
+			clips[c].name = names[c];
+			clips[c].duration = 2.0f + c;
+			clips[c].channels.resize(bones);
+			for (int b = 1; b < bones; b++)
+			{
+				animationChannel& channel = clips[c].channels[b];
+				for (int k = 0; k <= BENCH_SKIN_KEYS; k++)
+				{
+					float phase = 2.0f * pi * k / BENCH_SKIN_KEYS;
+					channel.rotationTimes.push_back(clips[c].duration * k / BENCH_SKIN_KEYS);
+					channel.rotations.push_back(glm::angleAxis(0.12f * std::sin(phase + b * (0.3f + 0.2f * c)), axes[c]));
+				}
+			}
+		}
+	}
+
+	//	the same frames drawn skinned in the vertex shader, then on the pool
+	int runSkinBenchmark(const benchOptions& options)
+	{
+		HeadlessContext headless(options.width, options.height);
+		if (!headless.isValid())
+		{
+			return 1;
+		}
+		glEnable(GL_DEPTH_TEST);
+
+		ThreadPool threadPool(options.threads > 1 ? options.threads - 1 : options.threads);
+		threadPool.setParallelism(options.threads);
+		RenderState renderState;
+		renderState.setViewport(0, 0, options.width, options.height);
+
+		//	the CPU path skins every instance into the ring buffer, next to what a frame streams anyway
+		GLsizeiptr skinnedBytes = (GLsizeiptr)options.skinnedInstances * (BENCH_SKIN_RINGS + 1) * BENCH_SKIN_SIDES * sizeof(vertex);
+		RingBuffer stream(RING_BUFFER_SIZE + skinnedBytes);
+		TextureLibrary textures(threadPool, renderState, stream);
+		MeshArena meshArena(options.format);
+		MaterialLibrary materials(textures);
+		renderContext context = { threadPool, textures, meshArena, materials, renderState, stream };
+
+		ProgramCache programs;
+		sceneFeatures features = { 1, false, VERTEX_FORMAT_FULL };
+		ShaderPermutations permutations(programs, "shaders/vshader", "shaders/fshader", textures.getShaderDefines() + SkinnedModel::getShaderDefines(), features);
+		FrameUniforms frameBlock(context);
+		programs.finish();
+		programSet skinnedPrograms;
+		permutations.getPrograms(skinnedPrograms);
+		for (int v = 0; v < MATERIAL_VARIANTS; v++)
+		{
+			GLuint program = skinnedPrograms.programs[v];
+			if (!program)
+			{
+				continue;
+			}
+			MaterialLibrary::resolveProgram(program);
+			FrameUniforms::resolveProgram(program);
+			SkinnedModel::resolveProgram(program);
+		}
+
+		Skeleton skeleton;
+		std::vector<animationClip> clips;
+		std::vector<skinnedMeshData> meshes;
+		buildBenchRig(skeleton, clips, meshes);
+		SkinnedModel rig(context, std::move(skeleton), std::move(clips), std::move(meshes));
+
+		//	a square field of instances, each at its own phase and blend of the two clips
+		size_t count = options.skinnedInstances;
+		int side = (int)std::ceil(std::sqrt((double)count));
+		std::vector<animationInstance> instances(count);
+		std::vector<glm::mat4> transforms(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			animationInstance& instance = instances[i];
+			instance.clips[0] = 0;
+			instance.clips[1] = 1;
+			instance.times[0] = instance.times[1] = i * 0.37f;
+			instance.blend = (i % 5) / 4.0f;
+			transforms[i] = glm::translate(glm::mat4(1.0f), glm::vec3((i % side - (side - 1) * 0.5f) * 3.0f, -5.0f, -(float)(i / side) * 3.0f));
+		}
+		frameUniforms uniforms = {};
+		uniforms.dirLights[0].position = glm::vec4(-3.0f, 15.0f, 1.0f, 0.0f);
+		uniforms.dirLights[0].ambient = uniforms.dirLights[0].diffuse = uniforms.dirLights[0].specular = glm::vec4(1.0f);
+		glm::vec3 eye(0.0f, 10.0f, 12.0f + side * 1.5f), center(0.0f, 0.0f, -side * 1.5f);
+		uniforms.view = glm::lookAt(eye, center, glm::vec3(0.0, 1.0, 0.0));
+		uniforms.viewProjection = glm::perspective(0.785f, (float)options.width / options.height, 0.1f, 10000.0f) * uniforms.view;
+		uniforms.cameraPosition = glm::vec4(eye, 1.0f);
+
+		std::vector<GLQuery> queries(BENCH_QUERY_LATENCY);
+		for (size_t i = 0; i < queries.size(); i++)
+		{
+			queries[i] = GLQuery::create();
+		}
+		double vertices = (double)count * rig.getVertexCount();
+		std::vector<double> animateMs, skinMs, cpuMs[2], gpuMs[2], verticesPerS[2];
+		int total = BENCH_WARMUP_FRAMES + options.frames;
+		for (int mode = SKINNING_GPU; mode <= SKINNING_CPU; mode++)
+		{
+			for (int frame = 0; frame < total; frame++)
+			{
+				stream.beginFrame();
+				GLuint query = queries[frame % BENCH_QUERY_LATENCY].get();
+				if (frame >= BENCH_QUERY_LATENCY)
+				{
+					GLuint64 ns = 0;
+					glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+					if (frame - BENCH_QUERY_LATENCY >= BENCH_WARMUP_FRAMES)
+					{
+						gpuMs[mode].push_back(ns / 1.0e6);
+					}
+				}
+
+				benchClock::time_point cpuStart = benchClock::now();
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				for (size_t i = 0; i < count; i++)
+				{
+					instances[i].times[0] += 1.0f / 60.0f;
+					instances[i].times[1] += 1.0f / 60.0f;
+				}
+				rig.animate(instances);
+				glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				frameBlock.update(uniforms);
+				rig.draw(skinnedPrograms, transforms.data(), count, (skinningMode)mode);
+				glEndQuery(GL_TIME_ELAPSED);
+				stream.endFrame();
+				benchClock::time_point cpuEnd = benchClock::now();
+				glFlush();
+
+				if (frame >= BENCH_WARMUP_FRAMES)
+				{
+					cpuMs[mode].push_back(elapsedMs(cpuStart, cpuEnd));
+					if (mode == SKINNING_GPU)
+					{
+						animateMs.push_back(rig.getStats().animateMs);
+					}
+					else
+					{
+						skinMs.push_back(rig.getStats().skinMs);
+						verticesPerS[mode].push_back(vertices / (std::max(rig.getStats().skinMs, 0.001) / 1000.0));
+					}
+				}
+			}
+			for (int frame = std::max(total - BENCH_QUERY_LATENCY, BENCH_WARMUP_FRAMES); frame < total; frame++)
+			{
+				GLuint64 ns = 0;
+				glGetQueryObjectui64v(queries[frame % BENCH_QUERY_LATENCY].get(), GL_QUERY_RESULT, &ns);
+				gpuMs[mode].push_back(ns / 1.0e6);
+			}
+		}
+
+		//	the vertex shader path is measured by GPU time, which includes rasterizing
+		for (size_t i = 0; i < gpuMs[SKINNING_GPU].size(); i++)
+		{
+			verticesPerS[SKINNING_GPU].push_back(vertices / (std::max(gpuMs[SKINNING_GPU][i], 0.001) / 1000.0));
+		}
+
+		std::ofstream ofs(options.output);
+		if (!ofs.is_open())
+		{
+			std::cerr << "Could not write " << options.output << '\n';
+			return 1;
+		}
+		ofs << "{\n"
+			<< "\t\"renderer\": \"" << jsonEscape((const char*)glGetString(GL_RENDERER)) << "\",\n"
+			<< "\t\"frames\": " << options.frames << ",\n"
+			<< "\t\"instances\": " << count << ",\n"
+			<< "\t\"bones\": " << rig.getSkeleton().getBoneCount() << ",\n"
+			<< "\t\"vertices_per_instance\": " << rig.getVertexCount() << ",\n"
+			<< "\t\"threads\": " << (options.threads > 0 ? options.threads : threadPool.size() + 1) << ",\n"
+			<< "\t\"ring_overflows\": " << stream.getOverflows() << ",\n";
+		writeSeries(ofs, "animate_ms", animateMs, false);
+		writeSeries(ofs, "gpu_skinning_cpu_ms", cpuMs[SKINNING_GPU], false);
+		writeSeries(ofs, "gpu_skinning_gpu_ms", gpuMs[SKINNING_GPU], false);
+		writeSeries(ofs, "gpu_skinning_vertices_per_s", verticesPerS[SKINNING_GPU], false);
+		writeSeries(ofs, "cpu_skinning_skin_ms", skinMs, false);
+		writeSeries(ofs, "cpu_skinning_cpu_ms", cpuMs[SKINNING_CPU], false);
+		writeSeries(ofs, "cpu_skinning_gpu_ms", gpuMs[SKINNING_CPU], false);
+		writeSeries(ofs, "cpu_skinning_vertices_per_s", verticesPerS[SKINNING_CPU], true);
+		ofs << "}\n";
+
+		std::sort(verticesPerS[SKINNING_GPU].begin(), verticesPerS[SKINNING_GPU].end());
+		std::sort(verticesPerS[SKINNING_CPU].begin(), verticesPerS[SKINNING_CPU].end());
+		double gpuRate = percentile(verticesPerS[SKINNING_GPU], 50.0) / 1.0e6, cpuRate = percentile(verticesPerS[SKINNING_CPU], 50.0) / 1.0e6;
+		_log("Skinning benchmark: " << count << " instances of " << rig.getVertexCount() << " vertices, vertex shader " << gpuRate
+			<< " M vertices/s, CPU " << cpuRate << " M vertices/s, written to " << options.output);
+		return 0;
+	}
+}
+
+//	true when --bench is given; the other options only override the defaults
+bool parseBenchOptions(int argc, char** argv, benchOptions& options)
+{
+	options.frames = BENCH_DEFAULT_FRAMES;
+	options.width = 1200;
+	options.height = 800;
+	options.grid = BENCH_DEFAULT_GRID;
+	options.format = VERTEX_FORMAT_DEFAULT;
+	options.lights = 0;
+	options.threads = 0;
+	options.output = "bench.json";
+	options.objMegabytes = 0;
+	options.skinnedInstances = 0;
+
+	bool bench = false;
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--bench"))
+		{
+			bench = true;
+		}
+		else if (!strcmp(argv[i], "--frames") && hasValue)
+		{
+			options.frames = std::max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--grid") && hasValue)
+		{
+			options.grid = std::max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--size") && hasValue)
+		{
+			if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+			{
+				std::cerr << "--size expects WIDTHxHEIGHT\n";
+				options.width = 1200;
+				options.height = 800;
+			}
+		}
+		else if (!strcmp(argv[i], "--vertex-format") && hasValue)
+		{
+			if (!parseVertexFormat(argv[++i], options.format))
+			{
+				std::cerr << "--vertex-format expects full, compact or quantized\n";
+			}
+		}
+		else if (!strcmp(argv[i], "--lights") && hasValue)
+		{
+			options.lights = std::max(0, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--threads") && hasValue)
+		{
+			options.threads = std::max(0, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--out") && hasValue)
+		{
+			options.output = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--bench-obj") && hasValue)
+		{
+			bench = true;
+			options.objMegabytes = std::max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--bench-skin") && hasValue)
+		{
+			bench = true;
+			options.skinnedInstances = std::max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--trace") && hasValue)
+		{
+			options.trace = argv[++i];
+		}
+	}
+	return bench;
+}
+
+int runBenchmark(const benchOptions& options)
+{
+	if (options.objMegabytes > 0)
+	{
+		return runObjBenchmark(options);
+	}
+	if (options.skinnedInstances > 0)
+	{
+		return runSkinBenchmark(options);
+	}
+	HeadlessContext headless(options.width, options.height);
+	if (!headless.isValid())
+	{
+		return 1;
+	}
+	glEnable(GL_DEPTH_TEST);
+
+	//	declared after the context so every GL object is released while it is still current
+	ThreadPool threadPool(options.threads > 1 ? options.threads - 1 : options.threads);
+	threadPool.setParallelism(options.threads);
+	RenderState renderState;
+	renderState.setViewport(0, 0, options.width, options.height);
+	RingBuffer stream;
+	TextureLibrary textures(threadPool, renderState, stream);
+	MeshArena meshArena(options.format);
+	MaterialLibrary materials(textures);
+	renderContext context = { threadPool, textures, meshArena, materials, renderState, stream };
+
+	ProgramCache programs;
+	sceneFeatures features = { 1, true, meshArena.getFormat() };
+	ShaderPermutations permutations(programs, "shaders/vshader", "shaders/fshader", textures.getShaderDefines(), features);
+	LightClusters lightClusters(context);
+	FrameUniforms frameBlock(context);
+	programs.finish();
+	programSet scenePrograms;
+	permutations.getPrograms(scenePrograms);
+
+	Model nanosuit("models/nanosuit/nanosuit.obj", context);
+	Model handgun("models/Handgun/Handgun_Obj/Handgun_obj.obj", context);
+	RenderQueue renderQueue(context);
+	while (!textures.idle())
+	{
+		textures.pump(100.0);
+	}
+
+	//	the same grid main draws, the handgun scaled to about 5 units in front of it
+	std::vector<glm::mat4> suits;
+	glm::mat4 base = glm::translate(glm::mat4(1.0), glm::vec3(0.0, -10.0, 0.0));
+	for (int z = 0; z < options.grid; z++)
+	{
+		for (int x = 0; x < options.grid; x++)
+		{
+			suits.push_back(glm::translate(base, glm::vec3((x - (options.grid - 1) * 0.5f) * 12.0f, 0.0, -z * 12.0f)));
+		}
+	}
+	const boundingVolume& gunBounds = handgun.getBounds();
+	float gunScale = 5.0f / std::max(gunBounds.radius * 2.0f, 0.001f);
+	glm::mat4 gun = glm::scale(glm::translate(glm::mat4(1.0), glm::vec3(0.0, 0.0, 12.0)), glm::vec3(gunScale));
+	gun = glm::translate(gun, -gunBounds.center);
+
+	//	spread over the grid the way main does
+	std::vector<pointLight> lights;
+	std::vector<glm::vec3> lightAnchors;
+	float gridHalfWidth = options.grid * 6.0f;
+	scatterLights(options.lights, glm::vec3(-gridHalfWidth, -9.0f, -options.grid * 12.0f + 6.0f), glm::vec3(gridHalfWidth, 6.0f, 6.0f), lights, lightAnchors);
+
+	for (int v = 0; v < MATERIAL_VARIANTS; v++)
+	{
+		GLuint program = scenePrograms.programs[v];
+		if (!program)
+		{
+			continue;
+		}
+		MaterialLibrary::resolveProgram(program);
+		LightClusters::resolveProgram(program);
+		FrameUniforms::resolveProgram(program);
+	}
+	frameUniforms uniforms = {};
+	uniforms.dirLights[0].position = glm::vec4(-3.0f, 15.0f, 1.0f, 0.0f);
+	uniforms.dirLights[0].ambient = uniforms.dirLights[0].diffuse = uniforms.dirLights[0].specular = glm::vec4(1.0f);
+
+#ifndef PROFILER_ENABLED
+	if (!options.trace.empty())
+	{
+		std::cerr << "--trace needs the profiler, build with PROFILER=1\n";
+	}
+#endif
+	PROFILE_THREAD("main");
+	Profiler& profiler = Profiler::get();
+	profiler.attachGpu();
+	std::vector<GLQuery> queries(BENCH_QUERY_LATENCY);
+	for (size_t i = 0; i < queries.size(); i++)
+	{
+		queries[i] = GLQuery::create();
+	}
+
+	std::vector<double> cpuMs, frameMs, gpuMs, drawCalls, triangles, clusterMs, lightReferences, recordMs, mergeMs, submitMs, droppedDraws;
+	int total = BENCH_WARMUP_FRAMES + options.frames;
+	glm::vec3 center(0.0f, -2.0f, -(options.grid - 1) * 6.0f);
+	float radius = 20.0f + options.grid * 8.0f;
+	glm::mat4 projection = glm::perspective(0.785f, (float)options.width / options.height, 0.1f, 10000.0f);
+	for (int frame = 0; frame < total; frame++)
+	{
+		benchClock::time_point frameStart = benchClock::now();
+		profiler.beginFrame();
+		if (frame == BENCH_WARMUP_FRAMES && !options.trace.empty())
+		{
+			profiler.startCapture(options.trace, options.frames);
+		}
+		stream.beginFrame();
+
+		//	results are read BENCH_QUERY_LATENCY frames late so the read rarely waits on the GPU
+		GLuint query = queries[frame % BENCH_QUERY_LATENCY].get();
+		if (frame >= BENCH_QUERY_LATENCY)
+		{
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+			if (frame - BENCH_QUERY_LATENCY >= BENCH_WARMUP_FRAMES)
+			{
+				gpuMs.push_back(ns / 1.0e6);
+			}
+		}
+
+		//	cpu time is submission only, waits on fences and queries above are part of the frame time
+		benchClock::time_point cpuStart = benchClock::now();
+		glBeginQuery(GL_TIME_ELAPSED, query);
+
+		//	one orbit over the whole run, bobbing up and down twice
+		float t = 2.0f * 3.14159265f * frame / total;
+		glm::vec3 eye = center + glm::vec3(radius * std::cos(t), 8.0f + 6.0f * std::sin(2.0f * t), radius * std::sin(t));
+		glm::mat4 view = glm::lookAt(eye, center, glm::vec3(0.0, 1.0, 0.0));
+		glm::mat4 viewProjection = projection * view;
+		moveLights(lightAnchors, frame / 60.0f, lights);
+		lightClusters.update(lights, view, projection);
+
+		glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		uniforms.view = view;
+		uniforms.viewProjection = viewProjection;
+		uniforms.cameraPosition = glm::vec4(eye, 1.0f);
+		frameBlock.update(uniforms);
+		renderState.resetCounters();
+		renderQueue.add(nanosuit, suits);
+		renderQueue.add(handgun, gun);
+		{
+			PROFILE_GPU_ZONE("scene");
+			renderQueue.execute(scenePrograms, viewProjection);
+		}
+		PROFILE_COUNT(COUNTER_DRAW_CALLS, renderState.getDrawCalls());
+		PROFILE_COUNT(COUNTER_STATE_CHANGES, renderState.getIssued());
+		PROFILE_COUNT(COUNTER_TRIANGLES, renderState.getTriangles());
+
+		glEndQuery(GL_TIME_ELAPSED);
+		stream.endFrame();
+		benchClock::time_point cpuEnd = benchClock::now();
+		glFlush();
+		profiler.endFrame();
+
+		if (frame >= BENCH_WARMUP_FRAMES)
+		{
+			cpuMs.push_back(elapsedMs(cpuStart, cpuEnd));
+			frameMs.push_back(elapsedMs(frameStart, benchClock::now()));
+			drawCalls.push_back(renderState.getDrawCalls());
+			triangles.push_back((double)renderState.getTriangles());
+			clusterMs.push_back(lightClusters.getStats().binMs);
+			lightReferences.push_back(lightClusters.getStats().references);
+			recordMs.push_back(renderQueue.getStats().recordMs);
+			mergeMs.push_back(renderQueue.getStats().mergeMs);
+			submitMs.push_back(renderQueue.getStats().submitMs);
+			droppedDraws.push_back(renderQueue.getStats().dropped);
+		}
+	}
+	for (int frame = std::max(total - BENCH_QUERY_LATENCY, BENCH_WARMUP_FRAMES); frame < total; frame++)
+	{
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(queries[frame % BENCH_QUERY_LATENCY].get(), GL_QUERY_RESULT, &ns);
+		gpuMs.push_back(ns / 1.0e6);
+	}
+
+	//	the trace is written once the GPU zones of the last measured frame are read back
+	while (profiler.isCapturing())
+	{
+		profiler.beginFrame();
+		profiler.endFrame();
+	}
+	profiler.detachGpu();
+
+	std::ofstream ofs(options.output);
+	if (!ofs.is_open())
+	{
+		std::cerr << "Could not write " << options.output << '\n';
+		return 1;
+	}
+	ofs << "{\n"
+		<< "\t\"renderer\": \"" << jsonEscape((const char*)glGetString(GL_RENDERER)) << "\",\n"
+		<< "\t\"frames\": " << options.frames << ",\n"
+		<< "\t\"width\": " << options.width << ",\n"
+		<< "\t\"height\": " << options.height << ",\n"
+		<< "\t\"instances\": " << suits.size() + 1 << ",\n"
+		<< "\t\"lights\": " << options.lights << ",\n"
+		<< "\t\"threads\": " << (options.threads > 0 ? options.threads : threadPool.size() + 1) << ",\n"
+		<< "\t\"vertex_format\": \"" << getVertexFormatName(options.format) << "\",\n"
+		<< "\t\"ring_overflows\": " << stream.getOverflows() << ",\n"
+		<< "\t\"texture_bucket_misses\": " << textures.getBucketMisses() << ",\n";
+	writeSeries(ofs, "cpu_ms", cpuMs, false);
+	writeSeries(ofs, "frame_ms", frameMs, false);
+	writeSeries(ofs, "gpu_ms", gpuMs, false);
+	writeSeries(ofs, "draw_calls", drawCalls, false);
+	writeSeries(ofs, "triangles", triangles, false);
+	writeSeries(ofs, "cluster_ms", clusterMs, false);
+	writeSeries(ofs, "light_references", lightReferences, false);
+	writeSeries(ofs, "record_ms", recordMs, false);
+	writeSeries(ofs, "merge_ms", mergeMs, false);
+	writeSeries(ofs, "submit_ms", submitMs, false);
+	writeSeries(ofs, "dropped_draws", droppedDraws, true);
+	ofs << "}\n";
+
+	std::sort(cpuMs.begin(), cpuMs.end());
+	std::sort(gpuMs.begin(), gpuMs.end());
+	_log("Benchmark: " << options.frames << " frames, cpu p50 " << percentile(cpuMs, 50.0) << " ms, gpu p50 "
+		<< percentile(gpuMs, 50.0) << " ms, written to " << options.output);
+	return 0;
+}
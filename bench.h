@@ -0,0 +1,49 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include "vertex_format.h"
+#include <string>
+
+#define BENCH_DEFAULT_FRAMES	600
+#define BENCH_WARMUP_FRAMES		20		//	rendered but not recorded
+#define BENCH_QUERY_LATENCY		4		//	frames between issuing a timer query and reading it back
+#define BENCH_DEFAULT_GRID		8
+#define BENCH_OBJ_RUNS			3		//	loads of the generated OBJ per importer
+#define BENCH_OBJ_PATCH			128		//	vertices along each side of a generated object
+#define BENCH_SKIN_BONES		32		//	bones along the generated tentacle
+#define BENCH_SKIN_RINGS		128		//	rings of vertices along it, BENCH_SKIN_SIDES each
+#define BENCH_SKIN_SIDES		32
+#define BENCH_SKIN_KEYS			30		//	keys per bone and clip
+
+struct benchOptions
+{
+	int frames;
+	int width, height;
+	int grid;
+	int lights;
+	int threads;			//	recording threads, the GL thread included; 0 for one per core
+	vertexFormat format;
+	std::string output;
+	std::string trace;		//	Chrome trace of the measured frames when not empty
+	int objMegabytes;		//	--bench-obj: size of the generated OBJ, 0 for the rendering benchmark
+	int skinnedInstances;	//	--bench-skin: animated instances of the generated rig, 0 for the rendering benchmark
+};
+
+/**
+ * Headless benchmark: renders the bundled models (an N x N nanosuit grid and the handgun)
+ * along a scripted orbit for a fixed number of frames, lit by --lights moving point lights,
+ * then writes CPU time, GPU time (GL_TIME_ELAPSED queries), draw calls, triangles, light
+ * binning time, light references and the record, merge and submit times of the render queue
+ * per frame as percentiles in JSON. --trace FILE also captures the profiler zones of the
+ * measured frames as a Chrome trace.
+ * --bench-obj MB instead generates an OBJ of about MB megabytes and loads it with ObjLoader and
+ * with Assimp, writing the load times and throughput in MB/s of both.
+ * --bench-skin N instead animates N instances of a generated rig, blending two clips each, and
+ * draws them skinned in the vertex shader, then skinned on the pool, writing animation and
+ * skinning times and skinned vertices per second of both paths.
+ * Returns the process exit code.
+ */
+int runBenchmark(const benchOptions&);
+bool parseBenchOptions(int, char**, benchOptions&);
+
+#endif
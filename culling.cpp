@@ -0,0 +1,326 @@
+#include "culling.h"
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <xmmintrin.h>
+#endif
+
+boundingVolume computeBounds(const glm::vec3* positions, size_t count, size_t stride)
+{
+	boundingVolume res;
+	res.min = res.max = res.center = glm::vec3(0.0f);
+	res.radius = 0.0f;
+	if (count == 0)
+	{
+		return res;
+	}
+
+	const unsigned char* p = (const unsigned char*)positions;
+	res.min = res.max = *positions;
+	for (size_t i = 1; i < count; i++)
+	{
+		const glm::vec3& v = *(const glm::vec3*)(p + i * stride);
+		res.min = glm::min(res.min, v);
+		res.max = glm::max(res.max, v);
+	}
+
+	//	sphere around the box centre, tighter than half the diagonal
+	res.center = (res.min + res.max) * 0.5f;
+	float radius2 = 0.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 d = *(const glm::vec3*)(p + i * stride) - res.center;
+		radius2 = std::max(radius2, glm::dot(d, d));
+	}
+	res.radius = std::sqrt(radius2);
+	return res;
+}
+
+//	box around all boxes, sphere around the merged box centre that holds every sphere
+boundingVolume mergeBounds(const std::vector<boundingVolume>& volumes)
+{
+	boundingVolume res;
+	res.min = res.max = res.center = glm::vec3(0.0f);
+	res.radius = 0.0f;
+	if (volumes.empty())
+	{
+		return res;
+	}
+
+	res.min = volumes[0].min;
+	res.max = volumes[0].max;
+	for (size_t i = 1; i < volumes.size(); i++)
+	{
+		res.min = glm::min(res.min, volumes[i].min);
+		res.max = glm::max(res.max, volumes[i].max);
+	}
+	res.center = (res.min + res.max) * 0.5f;
+	for (size_t i = 0; i < volumes.size(); i++)
+	{
+		res.radius = std::max(res.radius, glm::length(volumes[i].center - res.center) + volumes[i].radius);
+	}
+	return res;
+}
+
+//	Arvo: the extent of a transformed box is the original extent through the absolute 3x3 part
+boundingVolume transformBounds(const boundingVolume& bv, const glm::mat4& m)
+{
+	glm::vec3 center = (bv.min + bv.max) * 0.5f, extent = (bv.max - bv.min) * 0.5f;
+	glm::vec3 c = glm::vec3(m * glm::vec4(center, 1.0f));
+	glm::vec3 e(std::fabs(m[0][0]) * extent.x + std::fabs(m[1][0]) * extent.y + std::fabs(m[2][0]) * extent.z,
+		std::fabs(m[0][1]) * extent.x + std::fabs(m[1][1]) * extent.y + std::fabs(m[2][1]) * extent.z,
+		std::fabs(m[0][2]) * extent.x + std::fabs(m[1][2]) * extent.y + std::fabs(m[2][2]) * extent.z);
+	float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+
+	boundingVolume res;
+	res.min = c - e;
+	res.max = c + e;
+	res.center = glm::vec3(m * glm::vec4(bv.center, 1.0f));
+	res.radius = bv.radius * scale;
+	return res;
+}
+
+Frustum::Frustum(const glm::mat4& m)
+{
+	//	glm is column major: row i is (m[0][i], m[1][i], m[2][i], m[3][i]); planes are row3 +- row0..2
+	for (int i = 0; i < 6; i++)
+	{
+		int row = i / 2;
+		float sign = (i & 1) ? -1.0f : 1.0f;
+		for (int c = 0; c < 3; c++)
+		{
+			normal[i][c] = m[c][3] + sign * m[c][row];
+			absNormal[i][c] = std::fabs(normal[i][c]);
+		}
+		distance[i] = m[3][3] + sign * m[3][row];
+	}
+}
+
+//	conservative: true unless the box is entirely behind one plane
+bool Frustum::intersects(const boundingVolume& bv) const
+{
+	glm::vec3 center = (bv.min + bv.max) * 0.5f, extent = (bv.max - bv.min) * 0.5f;
+	for (int i = 0; i < 6; i++)
+	{
+		float d = normal[i][0] * center.x + normal[i][1] * center.y + normal[i][2] * center.z + distance[i];
+		float r = absNormal[i][0] * extent.x + absNormal[i][1] * extent.y + absNormal[i][2] * extent.z;
+		if (d + r < 0.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//	four boxes at once as centre/extent; bit i of outside/inside is set when box i is fully outside/inside
+void Frustum::classify(const float* cx, const float* cy, const float* cz, const float* ex, const float* ey, const float* ez,
+	int& outside, int& inside) const
+{
+#ifdef __SSE2__
+	__m128 centerX = _mm_loadu_ps(cx), centerY = _mm_loadu_ps(cy), centerZ = _mm_loadu_ps(cz);
+	__m128 extentX = _mm_loadu_ps(ex), extentY = _mm_loadu_ps(ey), extentZ = _mm_loadu_ps(ez);
+	__m128 zero = _mm_setzero_ps();
+	__m128 out = zero, in = _mm_cmpeq_ps(zero, zero);
+	for (int i = 0; i < 6; i++)
+	{
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(normal[i][0]), centerX), _mm_mul_ps(_mm_set1_ps(normal[i][1]), centerY)),
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(normal[i][2]), centerZ), _mm_set1_ps(distance[i])));
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(absNormal[i][0]), extentX), _mm_mul_ps(_mm_set1_ps(absNormal[i][1]), extentY)),
+			_mm_mul_ps(_mm_set1_ps(absNormal[i][2]), extentZ));
+		out = _mm_or_ps(out, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+		in = _mm_and_ps(in, _mm_cmpge_ps(_mm_sub_ps(d, r), zero));
+	}
+	outside = _mm_movemask_ps(out);
+	inside = _mm_movemask_ps(in);
+#else
+	outside = 0;
+	inside = 0;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		bool out = false, in = true;
+		for (int i = 0; i < 6; i++)
+		{
+			float d = normal[i][0] * cx[lane] + normal[i][1] * cy[lane] + normal[i][2] * cz[lane] + distance[i];
+			float r = absNormal[i][0] * ex[lane] + absNormal[i][1] * ey[lane] + absNormal[i][2] * ez[lane];
+			out = out || d + r < 0.0f;
+			in = in && d - r >= 0.0f;
+		}
+		outside |= out << lane;
+		inside |= in << lane;
+	}
+#endif
+}
+
+void BoundingVolumeHierarchy::build(const std::vector<boundingVolume>& volumes)
+{
+	nodes.clear();
+	items.resize(volumes.size());
+	centroids.resize(volumes.size());
+	for (size_t i = 0; i < volumes.size(); i++)
+	{
+		items[i] = i;
+		centroids[i] = (volumes[i].min + volumes[i].max) * 0.5f;
+	}
+	if (!volumes.empty())
+	{
+		nodes.reserve(volumes.size() / 2 + 1);
+		buildNode(volumes, 0, volumes.size());
+	}
+	centroids.clear();
+}
+
+//	children always come after their parent, so walking the nodes backwards visits them first
+void BoundingVolumeHierarchy::refit(const std::vector<boundingVolume>& volumes)
+{
+	for (size_t i = nodes.size(); i-- > 0;)
+	{
+		node& n = nodes[i];
+		for (GLuint lane = 0; lane < n.count; lane++)
+		{
+			glm::vec3 lo, hi;
+			if (n.child[lane] < 0)
+			{
+				lo = volumes[items[n.laneFirst[lane]]].min;
+				hi = volumes[items[n.laneFirst[lane]]].max;
+			}
+			else
+			{
+				const node& c = nodes[n.child[lane]];
+				lo = glm::vec3(c.centerX[0] - c.extentX[0], c.centerY[0] - c.extentY[0], c.centerZ[0] - c.extentZ[0]);
+				hi = glm::vec3(c.centerX[0] + c.extentX[0], c.centerY[0] + c.extentY[0], c.centerZ[0] + c.extentZ[0]);
+				for (GLuint l = 1; l < c.count; l++)
+				{
+					lo = glm::min(lo, glm::vec3(c.centerX[l] - c.extentX[l], c.centerY[l] - c.extentY[l], c.centerZ[l] - c.extentZ[l]));
+					hi = glm::max(hi, glm::vec3(c.centerX[l] + c.extentX[l], c.centerY[l] + c.extentY[l], c.centerZ[l] + c.extentZ[l]));
+				}
+			}
+			setLane(n, lane, lo, hi);
+		}
+	}
+}
+
+//	appends the indices of every item whose box is not entirely outside the frustum
+void BoundingVolumeHierarchy::cull(const Frustum& frustum, std::vector<GLuint>& visible) const
+{
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	GLuint stack[BVH_MAX_DEPTH * (BVH_WIDTH - 1) + 1];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const node& n = nodes[stack[--top]];
+		int outside, inside;
+		frustum.classify(n.centerX, n.centerY, n.centerZ, n.extentX, n.extentY, n.extentZ, outside, inside);
+		for (GLuint lane = 0; lane < n.count; lane++)
+		{
+			if (outside & (1 << lane))
+			{
+				continue;
+			}
+			if ((inside & (1 << lane)) || n.child[lane] < 0)
+			{
+				visible.insert(visible.end(), items.begin() + n.laneFirst[lane], items.begin() + n.laneFirst[lane] + n.laneCount[lane]);
+			}
+			else
+			{
+				stack[top++] = n.child[lane];
+			}
+		}
+	}
+}
+
+size_t BoundingVolumeHierarchy::getItemCount() const
+{
+	return items.size();
+}
+
+//	up to four items become lanes directly, larger ranges are split in four by two median splits
+GLuint BoundingVolumeHierarchy::buildNode(const std::vector<boundingVolume>& volumes, GLuint begin, GLuint end)
+{
+	GLuint index = nodes.size();
+	nodes.push_back(node());
+
+	GLuint bounds[BVH_WIDTH + 1];
+	GLuint count;
+	if (end - begin <= BVH_WIDTH)
+	{
+		count = end - begin;
+		for (GLuint i = 0; i <= count; i++)
+		{
+			bounds[i] = begin + i;
+		}
+	}
+	else
+	{
+		count = BVH_WIDTH;
+		bounds[0] = begin;
+		bounds[4] = end;
+		split(begin, end, bounds[2]);
+		split(begin, bounds[2], bounds[1]);
+		split(bounds[2], end, bounds[3]);
+	}
+
+	for (GLuint lane = 0; lane < BVH_WIDTH; lane++)
+	{
+		glm::vec3 lo(0.0f), hi(0.0f);
+		GLint child = -1;
+		if (lane < count)
+		{
+			lo = volumes[items[bounds[lane]]].min;
+			hi = volumes[items[bounds[lane]]].max;
+			for (GLuint i = bounds[lane] + 1; i < bounds[lane + 1]; i++)
+			{
+				lo = glm::min(lo, volumes[items[i]].min);
+				hi = glm::max(hi, volumes[items[i]].max);
+			}
+			if (bounds[lane + 1] - bounds[lane] > 1)
+			{
+				child = buildNode(volumes, bounds[lane], bounds[lane + 1]);
+			}
+		}
+
+		//	nodes may have been reallocated by the recursion
+		node& n = nodes[index];
+		setLane(n, lane, lo, hi);
+		n.child[lane] = child;
+		n.laneFirst[lane] = lane < count ? bounds[lane] : 0;
+		n.laneCount[lane] = lane < count ? bounds[lane + 1] - bounds[lane] : 0;
+	}
+	nodes[index].count = count;
+	return index;
+}
+
+//	median split on the longest axis of the centroids
+void BoundingVolumeHierarchy::split(GLuint begin, GLuint end, GLuint& mid)
+{
+	glm::vec3 lo = centroids[items[begin]], hi = lo;
+	for (GLuint i = begin + 1; i < end; i++)
+	{
+		lo = glm::min(lo, centroids[items[i]]);
+		hi = glm::max(hi, centroids[items[i]]);
+	}
+	glm::vec3 size = hi - lo;
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+	mid = (begin + end) / 2;
+	const std::vector<glm::vec3>& c = centroids;
+	std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end, [&c, axis](GLuint a, GLuint b)
+	{
+		return c[a][axis] < c[b][axis];
+	});
+}
+
+void BoundingVolumeHierarchy::setLane(node& n, GLuint lane, const glm::vec3& lo, const glm::vec3& hi)
+{
+	glm::vec3 center = (lo + hi) * 0.5f, extent = (hi - lo) * 0.5f;
+	n.centerX[lane] = center.x;
+	n.centerY[lane] = center.y;
+	n.centerZ[lane] = center.z;
+	n.extentX[lane] = extent.x;
+	n.extentY[lane] = extent.y;
+	n.extentZ[lane] = extent.z;
+}
@@ -0,0 +1,83 @@
+#ifndef _CULLING_H
+#define _CULLING_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#define BVH_WIDTH		4	//	children per node, one SIMD lane each
+#define BVH_MAX_DEPTH	64
+
+//	axis aligned box and the sphere around its centre, in the space of whatever owns it
+struct boundingVolume
+{
+	glm::vec3 min;
+	glm::vec3 max;
+	glm::vec3 center;
+	float radius;
+};
+
+struct cullingStats
+{
+	unsigned int visible;
+	unsigned int culled;
+};
+
+//	positions are read with a byte stride so vertex arrays can be passed directly
+boundingVolume computeBounds(const glm::vec3*, size_t, size_t);
+boundingVolume mergeBounds(const std::vector<boundingVolume>&);
+boundingVolume transformBounds(const boundingVolume&, const glm::mat4&);
+
+/**
+ * The six clip planes of a view-projection matrix (Gribb/Hartmann). Planes are left
+ * unnormalised, which is fine for sign tests. Extracting them from projection * view * model
+ * gives the frustum in model space, so model-space boxes can be tested without transforming them.
+ */
+class Frustum
+{
+	public:
+		explicit Frustum(const glm::mat4&);
+		bool intersects(const boundingVolume&) const;
+		void classify(const float*, const float*, const float*, const float*, const float*, const float*, int&, int&) const;
+
+	private:
+		float normal[6][3], absNormal[6][3], distance[6];
+};
+
+/**
+ * Static 4-wide bounding volume hierarchy. Each node stores the boxes of its four children
+ * as centre/extent in SoA form, so one Frustum::classify call tests all of them; children that
+ * are entirely inside the frustum are accepted with their whole subtree without further tests.
+ * Items are referred to by their index in the vector given to build(). refit() takes new boxes
+ * for the same items and only recomputes the node boxes, keeping the tree; cheap for items
+ * that move, but the tree gets looser the further they move from where it was built.
+ */
+class BoundingVolumeHierarchy
+{
+	public:
+		void build(const std::vector<boundingVolume>&);
+		void refit(const std::vector<boundingVolume>&);
+		void cull(const Frustum&, std::vector<GLuint>&) const;
+		size_t getItemCount() const;
+
+	private:
+		struct node
+		{
+			float centerX[BVH_WIDTH], centerY[BVH_WIDTH], centerZ[BVH_WIDTH];
+			float extentX[BVH_WIDTH], extentY[BVH_WIDTH], extentZ[BVH_WIDTH];
+			GLint child[BVH_WIDTH];			//	node index, -1 when the lane holds a single item
+			GLuint laneFirst[BVH_WIDTH];	//	lane's range in items
+			GLuint laneCount[BVH_WIDTH];
+			GLuint count;
+		};
+
+		std::vector<node> nodes;
+		std::vector<GLuint> items;			//	item indices, every subtree is a contiguous range
+		std::vector<glm::vec3> centroids;
+
+		GLuint buildNode(const std::vector<boundingVolume>&, GLuint, GLuint);
+		void split(GLuint, GLuint, GLuint&);
+		static void setLane(node&, GLuint, const glm::vec3&, const glm::vec3&);
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "frame_scheduler.h"
+#include "profiler.h"
+#include <algorithm>
+
+FrameScheduler::FrameScheduler(double tickRate) :
+	epoch(clock::now()),
+	step(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / tickRate))),
+	framePeriod(clock::duration::zero()),
+	frameDeadline(epoch),
+	running(false),
+	ticks(0)
+{
+}
+
+FrameScheduler::~FrameScheduler()
+{
+	stop();
+}
+
+//	calls fn(step, due time) on the simulation thread until stop()
+void FrameScheduler::start(std::function<void(double, double)> fn)
+{
+	stop();
+	tick = std::move(fn);
+	running = true;
+	simulation = std::thread(&FrameScheduler::simulate, this);
+}
+
+void FrameScheduler::stop()
+{
+	running = false;
+	if (simulation.joinable())
+	{
+		simulation.join();
+	}
+}
+
+//	frames per second the render thread is held to, 0 for none
+void FrameScheduler::setFrameCap(double fps)
+{
+	framePeriod = fps > 0.0 ? std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / fps)) : clock::duration::zero();
+	frameDeadline = clock::now();
+}
+
+void FrameScheduler::waitForFrame()
+{
+	if (framePeriod == clock::duration::zero())
+	{
+		return;
+	}
+	clock::time_point now = clock::now();
+	if (now > frameDeadline + framePeriod)
+	{
+		frameDeadline = now;	//	a frame was missed, start a new cadence rather than rush to catch up
+	}
+	else
+	{
+		sleepUntil(frameDeadline);
+	}
+	frameDeadline += framePeriod;
+}
+
+double FrameScheduler::getTime() const
+{
+	return std::chrono::duration<double>(clock::now() - epoch).count();
+}
+
+double FrameScheduler::getStep() const
+{
+	return std::chrono::duration<double>(step).count();
+}
+
+//	how far from the step before to the step due at the given time the render thread is
+double FrameScheduler::getAlpha(double dueTime) const
+{
+	return std::min(1.0, std::max(0.0, (getTime() - dueTime) / getStep()));
+}
+
+unsigned long long FrameScheduler::getTicks() const
+{
+	return ticks.load(std::memory_order_relaxed);
+}
+
+void FrameScheduler::simulate()
+{
+	PROFILE_THREAD("simulation");
+	double stepSeconds = getStep();
+	clock::time_point due = clock::now();
+	while (running.load(std::memory_order_relaxed))
+	{
+		clock::time_point now = clock::now();
+		if (now < due)
+		{
+			//	late wakeups are fine, results are placed by their due time and not by when they ran
+			std::this_thread::sleep_until(due);
+			continue;
+		}
+		if (now - due > step * SCHEDULER_MAX_CATCHUP)
+		{
+			due = now - step * SCHEDULER_MAX_CATCHUP;
+		}
+		PROFILE_ZONE("simulation step");
+		tick(stepSeconds, std::chrono::duration<double>(due - epoch).count());
+		ticks.fetch_add(1, std::memory_order_relaxed);
+		due += step;
+	}
+}
+
+//	sleeps most of the way and spins the rest, sleep alone overshoots by up to a scheduler quantum
+void FrameScheduler::sleepUntil(clock::time_point deadline) const
+{
+	clock::duration spin = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(SCHEDULER_SPIN_MS));
+	if (deadline - clock::now() > spin)
+	{
+		std::this_thread::sleep_until(deadline - spin);
+	}
+	while (clock::now() < deadline)
+	{
+		std::this_thread::yield();
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef _FRAME_SCHEDULER_H
+#define _FRAME_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#define SCHEDULER_TICK_RATE		120.0	//	simulation steps per second
+#define SCHEDULER_MAX_CATCHUP	8		//	steps run back to back after a stall before the rest is dropped
+#define SCHEDULER_SPIN_MS		1.0		//	the end of a frame cap wait spins, sleeps overshoot by about that much
+
+/**
+ * Runs the simulation on its own thread at a fixed timestep and paces the render thread.
+ * The step function is called with the step length and the time the step is due at, which is
+ * also when its result becomes current: the render thread blends the last two results with
+ * getAlpha() of that time, so motion stays smooth at any frame rate and does not depend on it.
+ * waitForFrame() holds the render thread to the frame cap against absolute deadlines; it
+ * returns just before a frame starts, so input read after it is as fresh as it can be.
+ * Times are in seconds since the scheduler was created.
+ */
+class FrameScheduler
+{
+	public:
+		explicit FrameScheduler(double = SCHEDULER_TICK_RATE);
+		~FrameScheduler();
+		FrameScheduler(const FrameScheduler&) = delete;
+		FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+		void start(std::function<void(double, double)>);
+		void stop();
+		void setFrameCap(double);
+		void waitForFrame();
+		double getTime() const;
+		double getStep() const;
+		double getAlpha(double) const;
+		unsigned long long getTicks() const;
+
+	private:
+		typedef std::chrono::steady_clock clock;
+
+		clock::time_point epoch;
+		clock::duration step;
+		clock::duration framePeriod;		//	zero when uncapped
+		clock::time_point frameDeadline;
+		std::function<void(double, double)> tick;
+		std::thread simulation;
+		std::atomic<bool> running;
+		std::atomic<unsigned long long> ticks;
+
+		void simulate();
+		void sleepUntil(clock::time_point) const;
+};
+
+#endif
@@ -0,0 +1,37 @@
+#include "frame_uniforms.h"
+#include <cstring>
+
+static_assert(sizeof(frameUniforms) == 2 * 64 + 16 + FRAME_DIR_LIGHTS * 64, "frameUniforms has to match the std140 FrameBlock");
+
+FrameUniforms::FrameUniforms(renderContext& _context) : context(_context)
+{
+}
+
+//	once per frame between RingBuffer::beginFrame() and the first draw
+void FrameUniforms::update(const frameUniforms& uniforms)
+{
+	RingBuffer& stream = context.stream;
+	GLintptr offset = 0;
+	void* data = stream.allocate(sizeof(frameUniforms), stream.getUniformAlignment(), offset);
+	if (!data)
+	{
+		return;
+	}
+	memcpy(data, &uniforms, sizeof(frameUniforms));
+	context.state.bindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, stream.getBuffer(), offset, sizeof(frameUniforms));
+}
+
+std::string FrameUniforms::getShaderDefines()
+{
+	return "#define FRAME_DIR_LIGHTS " + std::to_string(FRAME_DIR_LIGHTS) + "\n";
+}
+
+//	both shader stages declare FrameBlock, the program has one block to point at the ring buffer range
+void FrameUniforms::resolveProgram(GLuint program)
+{
+	GLuint block = glGetUniformBlockIndex(program, "FrameBlock");
+	if (block != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, block, FRAME_BLOCK_BINDING);
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef _FRAME_UNIFORMS_H
+#define _FRAME_UNIFORMS_H
+
+#include "render_context.h"
+#include <glm/glm.hpp>
+#include <string>
+
+#define FRAME_BLOCK_BINDING		0	//	uniform buffer binding, storage blocks count their own
+#define FRAME_DIR_LIGHTS		4	//	room in the block, the shaders read DIR_LIGHTS_NUM of them
+
+//	std140: every vec3 of the shader's view is stored as a vec4
+struct dirLight
+{
+	glm::vec4 position;
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+};
+
+//	std140 layout of the FrameBlock
+struct frameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 viewProjection;
+	glm::vec4 cameraPosition;
+	dirLight dirLights[FRAME_DIR_LIGHTS];
+};
+
+/**
+ * Camera and directional lights of a frame as one uniform block: written once per frame into
+ * the ring buffer, whose fences keep it from overwriting a block the GPU may still read, and
+ * bound by offset for every program at once. This replaces a uniform call per value and per
+ * material variant, and programs reloaded at runtime need nothing but resolveProgram().
+ */
+class FrameUniforms
+{
+	public:
+		explicit FrameUniforms(renderContext&);
+		FrameUniforms(const FrameUniforms&) = delete;
+		FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+		void update(const frameUniforms&);
+		static std::string getShaderDefines();
+		static void resolveProgram(GLuint);
+
+	private:
+		renderContext& context;
+};
+
+#endif
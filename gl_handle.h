@@ -0,0 +1,91 @@
+#ifndef _GL_HANDLE_H
+#define _GL_HANDLE_H
+
+#include <GL/glew.h>
+
+/**
+ * Move-only owner of a single GL object name. The traits type knows how to create and
+ * delete that kind of object, so a VAO is never passed to glDeleteBuffers and a moved-from
+ * handle (name 0) deletes nothing.
+ */
+template <typename Traits>
+class GLHandle
+{
+	public:
+		GLHandle() : id(0) {}
+		explicit GLHandle(GLuint _id) : id(_id) {}
+		~GLHandle() { reset(); }
+		GLHandle(const GLHandle&) = delete;
+		GLHandle& operator=(const GLHandle&) = delete;
+
+		GLHandle(GLHandle&& other) : id(other.id) { other.id = 0; }
+		GLHandle& operator=(GLHandle&& other)
+		{
+			if (this != &other)
+			{
+				reset(other.id);
+				other.id = 0;
+			}
+			return *this;
+		}
+
+		static GLHandle create() { return GLHandle(Traits::create()); }
+		GLuint get() const { return id; }
+		GLuint release() { GLuint res = id; id = 0; return res; }
+		void reset(GLuint newID = 0)
+		{
+			if (id != 0)
+			{
+				Traits::destroy(id);
+			}
+			id = newID;
+		}
+
+	private:
+		GLuint id;
+};
+
+struct glBufferTraits
+{
+	static GLuint create() { GLuint id; glCreateBuffers(1, &id); return id; }
+	static void destroy(GLuint id) { glDeleteBuffers(1, &id); }
+};
+
+struct glVertexArrayTraits
+{
+	static GLuint create() { GLuint id; glCreateVertexArrays(1, &id); return id; }
+	static void destroy(GLuint id) { glDeleteVertexArrays(1, &id); }
+};
+
+struct glTextureTraits
+{
+	static GLuint create() { GLuint id; glGenTextures(1, &id); return id; }
+	static void destroy(GLuint id) { glDeleteTextures(1, &id); }
+};
+
+struct glFramebufferTraits
+{
+	static GLuint create() { GLuint id; glCreateFramebuffers(1, &id); return id; }
+	static void destroy(GLuint id) { glDeleteFramebuffers(1, &id); }
+};
+
+struct glRenderbufferTraits
+{
+	static GLuint create() { GLuint id; glCreateRenderbuffers(1, &id); return id; }
+	static void destroy(GLuint id) { glDeleteRenderbuffers(1, &id); }
+};
+
+struct glQueryTraits
+{
+	static GLuint create() { GLuint id; glGenQueries(1, &id); return id; }
+	static void destroy(GLuint id) { glDeleteQueries(1, &id); }
+};
+
+typedef GLHandle<glBufferTraits>		GLBuffer;
+typedef GLHandle<glVertexArrayTraits>	GLVertexArray;
+typedef GLHandle<glTextureTraits>		GLTexture;
+typedef GLHandle<glFramebufferTraits>	GLFramebuffer;
+typedef GLHandle<glRenderbufferTraits>	GLRenderbuffer;
+typedef GLHandle<glQueryTraits>			GLQuery;
+
+#endif
@@ -0,0 +1,98 @@
+#include "headless_context.h"
+#include <EGL/eglext.h>
+#include <iostream>
+
+HeadlessContext::HeadlessContext(GLsizei width, GLsizei height) :
+	display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT), valid(false)
+{
+	if (!createContext())
+	{
+		return;
+	}
+
+	//	GLEW built against GLX reports a missing X display, but the GL entry points are loaded by then
+	glewExperimental = GL_TRUE;
+	GLenum res = glewInit();
+	if (res != GLEW_OK && res != GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		std::cerr << "glewInit failed in the headless context\n";
+		return;
+	}
+
+	framebuffer = GLFramebuffer::create();
+	colorBuffer = GLRenderbuffer::create();
+	depthBuffer = GLRenderbuffer::create();
+	glNamedRenderbufferStorage(colorBuffer.get(), GL_RGBA8, width, height);
+	glNamedRenderbufferStorage(depthBuffer.get(), GL_DEPTH_COMPONENT24, width, height);
+	glNamedFramebufferRenderbuffer(framebuffer.get(), GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer.get());
+	glNamedFramebufferRenderbuffer(framebuffer.get(), GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer.get());
+	if (glCheckNamedFramebufferStatus(framebuffer.get(), GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cerr << "Headless framebuffer is incomplete\n";
+		return;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+	valid = true;
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	//	GL objects have to go while the context is still current
+	if (context != EGL_NO_CONTEXT)
+	{
+		framebuffer.reset();
+		colorBuffer.reset();
+		depthBuffer.reset();
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+	}
+	if (display != EGL_NO_DISPLAY)
+	{
+		eglTerminate(display);
+	}
+}
+
+bool HeadlessContext::isValid() const
+{
+	return valid;
+}
+
+GLuint HeadlessContext::getFramebuffer() const
+{
+	return framebuffer.get();
+}
+
+bool HeadlessContext::createContext()
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+	{
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	if (display == EGL_NO_DISPLAY)
+	{
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cerr << "Could not initialise EGL\n";
+		display = EGL_NO_DISPLAY;
+		return false;
+	}
+
+	//	no surface is ever created, so no config is needed either (EGL_KHR_no_config_context)
+	const EGLint attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		std::cerr << "Could not create a headless OpenGL 4.5 core context\n";
+		return false;
+	}
+	return true;
+}
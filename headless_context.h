@@ -0,0 +1,34 @@
+#ifndef _HEADLESS_CONTEXT_H
+#define _HEADLESS_CONTEXT_H
+
+#include "gl_handle.h"
+#include <EGL/egl.h>
+
+/**
+ * OpenGL 4.5 core context without a window: EGL on Mesa's surfaceless platform (or the
+ * default display where that is missing), rendering into an offscreen framebuffer with a
+ * colour and a depth renderbuffer. Works on GPU-less hosts through llvmpipe.
+ * The framebuffer is bound once the context is current, so callers render as usual once they
+ * have set the viewport to its size (RenderState::setViewport).
+ */
+class HeadlessContext
+{
+	public:
+		HeadlessContext(GLsizei, GLsizei);
+		~HeadlessContext();
+		HeadlessContext(const HeadlessContext&) = delete;
+		HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+		bool isValid() const;
+		GLuint getFramebuffer() const;
+
+	private:
+		EGLDisplay display;
+		EGLContext context;
+		GLFramebuffer framebuffer;
+		GLRenderbuffer colorBuffer, depthBuffer;
+		bool valid;
+		bool createContext();
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "ktx_file.h"
+#include "texture_compressor.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#define KTX_ENDIANNESS	0x04030201	//	as written by a little endian machine, the only kind read back
+
+namespace
+{
+	const unsigned char identifier[12] = { 0xab, 'K', 'T', 'X', ' ', '1', '1', 0xbb, '\r', '\n', 0x1a, '\n' };
+
+	struct header
+	{
+		unsigned char identifier[12];
+		uint32_t endianness;
+		uint32_t glType;			//	0 for compressed formats
+		uint32_t glTypeSize;
+		uint32_t glFormat;			//	0 for compressed formats
+		uint32_t glInternalFormat;
+		uint32_t glBaseInternalFormat;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t numberOfArrayElements;
+		uint32_t numberOfFaces;
+		uint32_t numberOfMipmapLevels;
+		uint32_t bytesOfKeyValueData;
+	};
+}
+
+//	levels are written in the order of levelOffsets, each one as long as its format says, into a
+//	temporary file renamed over path so a reader never maps a half written texture
+bool writeKtxFile(const std::string& path, const ktxLayout& layout, const std::vector<unsigned char>& data)
+{
+	std::string tmpPath = path + ".tmp";
+	std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+	if (!ofs)
+	{
+		return false;
+	}
+	header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.identifier, identifier, sizeof(identifier));
+	h.endianness = KTX_ENDIANNESS;
+	h.glTypeSize = 1;
+	h.glInternalFormat = layout.format;
+	h.glBaseInternalFormat = getBaseFormat(layout.format);
+	h.pixelWidth = layout.width;
+	h.pixelHeight = layout.height;
+	h.numberOfFaces = 1;
+	h.numberOfMipmapLevels = layout.levelOffsets.size();
+	ofs.write((const char*)&h, sizeof(h));
+
+	static const char zeros[4] = {0, 0, 0, 0};
+	for (size_t level = 0; level < layout.levelOffsets.size(); level++)
+	{
+		uint32_t size = getImageBytes(layout.format, std::max(layout.width >> level, 1), std::max(layout.height >> level, 1));
+		ofs.write((const char*)&size, sizeof(size));
+		ofs.write((const char*)&data[layout.levelOffsets[level]], size);
+		ofs.write(zeros, ((size + 3) & ~3u) - size);
+	}
+	ofs.close();
+	if (!ofs || std::rename(tmpPath.c_str(), path.c_str()) != 0)
+	{
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+//	false for anything the cook would not have written, or a file cut short
+bool readKtxFile(const mappedFile& file, ktxLayout& layout)
+{
+	if (!file.data || file.size < sizeof(header))
+	{
+		return false;
+	}
+	const header* h = (const header*)file.data;
+	if (memcmp(h->identifier, identifier, sizeof(identifier)) || h->endianness != KTX_ENDIANNESS || h->glType != 0 ||
+		!isCompressedFormat(h->glInternalFormat) || h->pixelWidth == 0 || h->pixelHeight == 0 || h->pixelDepth > 1 ||
+		h->numberOfArrayElements != 0 || h->numberOfFaces != 1 || h->numberOfMipmapLevels == 0 || h->numberOfMipmapLevels > 32)
+	{
+		return false;
+	}
+
+	layout.format = h->glInternalFormat;
+	layout.width = h->pixelWidth;
+	layout.height = h->pixelHeight;
+	layout.levelOffsets.clear();
+	size_t offset = sizeof(header) + h->bytesOfKeyValueData;
+	for (uint32_t level = 0; level < h->numberOfMipmapLevels; level++)
+	{
+		if (offset + sizeof(uint32_t) > file.size)
+		{
+			return false;
+		}
+		uint32_t size;
+		memcpy(&size, file.data + offset, sizeof(size));
+		offset += sizeof(uint32_t);
+		if ((GLsizeiptr)size != getImageBytes(layout.format, std::max(layout.width >> level, 1), std::max(layout.height >> level, 1)) ||
+			offset + size > file.size)
+		{
+			return false;
+		}
+		layout.levelOffsets.push_back(offset);
+		offset += (size + 3) & ~3u;
+	}
+	return true;
+}
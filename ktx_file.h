@@ -0,0 +1,27 @@
+#ifndef _KTX_FILE_H
+#define _KTX_FILE_H
+
+#include "mapped_file.h"
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+
+//	a block compressed 2D texture with its mip chain, offsets are into the file or the buffer written
+struct ktxLayout
+{
+	GLenum format;
+	GLsizei width, height;
+	std::vector<size_t> levelOffsets;
+};
+
+/**
+ * KTX 1.1 container for cooked textures: the header, then per level a 32 bit image size and
+ * the blocks as GL takes them, padded to 4 bytes. Only what the cook writes is read back,
+ * one face, no array layers and no key/value data, in BC1, BC3 or BC5. Every level is checked
+ * against the size its format implies, so a level can go from the mapping straight into
+ * glCompressedTextureSubImage without a look at the blocks.
+ */
+bool writeKtxFile(const std::string&, const ktxLayout&, const std::vector<unsigned char>&);
+bool readKtxFile(const mappedFile&, ktxLayout&);
+
+#endif
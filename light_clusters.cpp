@@ -0,0 +1,271 @@
+#include "light_clusters.h"
+#include "profiler.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#ifdef __SSE2__
+#include <xmmintrin.h>
+#endif
+
+#define LIGHT_SCATTER_SEED	1		//	the same lights every run, so benchmarks compare
+#define LIGHT_ORBIT_RADIUS	2.0f
+
+static_assert(CLUSTER_TILES_X % 4 == 0, "cluster rows are tested four tiles at a time");
+
+LightClusters::LightClusters(renderContext& _context) :
+	context(_context), projection(0.0f), viewportWidth(0), viewportHeight(0), nearPlane(0.0f), farPlane(0.0f), sliceScale(0.0f), sliceBias(0.0f)
+{
+	stats.lights = stats.references = stats.maxPerCluster = 0;
+	stats.binMs = 0.0;
+}
+
+/**
+ * Once per frame between RingBuffer::beginFrame() and the first draw; binds the three light
+ * blocks for every program that reads them. view and projection are the camera's, the
+ * projection has to be a symmetric perspective one.
+ */
+void LightClusters::update(const std::vector<pointLight>& lights, const glm::mat4& view, const glm::mat4& _projection)
+{
+	PROFILE_ZONE("light binning");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	RenderState& state = context.state;
+	if (_projection != projection || state.getViewportWidth() != viewportWidth || state.getViewportHeight() != viewportHeight)
+	{
+		buildClusters(_projection);
+	}
+
+	stats.lights = 0;
+	counts.assign(CLUSTER_COUNT, 0);
+	hits.clear();
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		binLight(i, lights[i], view);
+	}
+	offsets.resize(CLUSTER_COUNT);
+	GLuint total = 0;
+	stats.maxPerCluster = 0;
+	for (size_t i = 0; i < CLUSTER_COUNT; i++)
+	{
+		offsets[i] = total;
+		total += counts[i];
+		stats.maxPerCluster = std::max(stats.maxPerCluster, counts[i]);
+	}
+	stats.references = total;
+
+	//	blocks are never bound empty, a range of zero bytes is an error
+	RingBuffer& stream = context.stream;
+	GLintptr clustersOffset = 0, lightsOffset = 0, indicesOffset = 0;
+	GLsizeiptr clustersSize = sizeof(clusterHeader) + CLUSTER_COUNT * 2 * sizeof(GLuint),
+		lightsSize = std::max<size_t>(lights.size(), 1) * sizeof(pointLight), indicesSize = std::max<GLuint>(total, 1) * sizeof(GLuint);
+	unsigned char* clusters = (unsigned char*)stream.allocate(clustersSize, stream.getStorageAlignment(), clustersOffset);
+	pointLight* frameLights = (pointLight*)stream.allocate(lightsSize, stream.getStorageAlignment(), lightsOffset);
+	GLuint* frameIndices = (GLuint*)stream.allocate(indicesSize, stream.getStorageAlignment(), indicesOffset);
+	if (!clusters || !frameLights || !frameIndices)
+	{
+		return;
+	}
+
+	clusterHeader header;
+	header.scale[0] = sliceScale;
+	header.scale[1] = sliceBias;
+	header.scale[2] = (float)CLUSTER_TILES_X / std::max(viewportWidth, 1);
+	header.scale[3] = (float)CLUSTER_TILES_Y / std::max(viewportHeight, 1);
+	header.planes[0] = nearPlane;
+	header.planes[1] = farPlane;
+	header.planes[2] = header.planes[3] = 0.0f;
+	memcpy(clusters, &header, sizeof(header));
+	GLuint* ranges = (GLuint*)(clusters + sizeof(header));
+	for (size_t i = 0; i < CLUSTER_COUNT; i++)
+	{
+		ranges[i * 2] = offsets[i];
+		ranges[i * 2 + 1] = counts[i];
+	}
+	if (!lights.empty())
+	{
+		memcpy(frameLights, lights.data(), lights.size() * sizeof(pointLight));
+	}
+
+	//	scattered on the CPU side, the mapping is write-combined and wants sequential writes
+	indices.resize(total);
+	for (size_t i = 0; i < hits.size(); i += 2)
+	{
+		indices[offsets[hits[i]]++] = hits[i + 1];
+	}
+	if (total > 0)
+	{
+		memcpy(frameIndices, indices.data(), total * sizeof(GLuint));
+	}
+
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, CLUSTER_BLOCK_BINDING, stream.getBuffer(), clustersOffset, clustersSize);
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, LIGHT_BLOCK_BINDING, stream.getBuffer(), lightsOffset, lightsSize);
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_BLOCK_BINDING, stream.getBuffer(), indicesOffset, indicesSize);
+	stats.binMs = elapsedMs(start, std::chrono::steady_clock::now());
+}
+
+const clusterStats& LightClusters::getStats() const
+{
+	return stats;
+}
+
+std::string LightClusters::getShaderDefines()
+{
+	return "#define CLUSTER_TILES_X " + std::to_string(CLUSTER_TILES_X) + "\n"
+		"#define CLUSTER_TILES_Y " + std::to_string(CLUSTER_TILES_Y) + "\n"
+		"#define CLUSTER_SLICES " + std::to_string(CLUSTER_SLICES) + "\n";
+}
+
+//	blocks the program leaves out (no lighting in it) are skipped
+void LightClusters::resolveProgram(GLuint program)
+{
+	const char* names[3] = { "LightBlock", "ClusterBlock", "LightIndexBlock" };
+	const GLuint bindings[3] = { LIGHT_BLOCK_BINDING, CLUSTER_BLOCK_BINDING, LIGHT_INDEX_BLOCK_BINDING };
+	for (int i = 0; i < 3; i++)
+	{
+		GLuint block = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, names[i]);
+		if (block != GL_INVALID_INDEX)
+		{
+			glShaderStorageBlockBinding(program, block, bindings[i]);
+		}
+	}
+}
+
+/**
+ * Boxes are in view space with depth made positive. Slices are spaced logarithmically from
+ * the near plane to CLUSTER_FAR so they stay about as deep as they are wide; the last one
+ * reaches to the far plane.
+ */
+void LightClusters::buildClusters(const glm::mat4& _projection)
+{
+	projection = _projection;
+	viewportWidth = context.state.getViewportWidth();
+	viewportHeight = context.state.getViewportHeight();
+	nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+	farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+	float clusterFar = CLUSTER_FAR < farPlane && CLUSTER_FAR > nearPlane ? CLUSTER_FAR : farPlane;
+	float logRange = std::log(clusterFar / nearPlane);
+	sliceScale = CLUSTER_SLICES / logRange;
+	sliceBias = -CLUSTER_SLICES * std::log(nearPlane) / logRange;
+
+	for (int s = 0; s < CLUSTER_SLICES; s++)
+	{
+		sliceNear[s] = nearPlane * std::exp(logRange * s / CLUSTER_SLICES);
+		sliceFar[s] = s + 1 < CLUSTER_SLICES ? nearPlane * std::exp(logRange * (s + 1) / CLUSTER_SLICES) : farPlane;
+		for (int x = 0; x < CLUSTER_TILES_X; x++)
+		{
+			float ndc0 = -1.0f + 2.0f * x / CLUSTER_TILES_X, ndc1 = -1.0f + 2.0f * (x + 1) / CLUSTER_TILES_X;
+			minX[s][x] = std::min(ndc0 * sliceNear[s], ndc0 * sliceFar[s]) / projection[0][0];
+			maxX[s][x] = std::max(ndc1 * sliceNear[s], ndc1 * sliceFar[s]) / projection[0][0];
+		}
+		for (int y = 0; y < CLUSTER_TILES_Y; y++)
+		{
+			float ndc0 = -1.0f + 2.0f * y / CLUSTER_TILES_Y, ndc1 = -1.0f + 2.0f * (y + 1) / CLUSTER_TILES_Y;
+			minY[s][y] = std::min(ndc0 * sliceNear[s], ndc0 * sliceFar[s]) / projection[1][1];
+			maxY[s][y] = std::max(ndc1 * sliceNear[s], ndc1 * sliceFar[s]) / projection[1][1];
+		}
+	}
+}
+
+int LightClusters::getSlice(float depth) const
+{
+	int slice = (int)std::floor(std::log(depth) * sliceScale + sliceBias);
+	return std::min(std::max(slice, 0), CLUSTER_SLICES - 1);
+}
+
+//	appends (cluster, light) to hits for every cluster box the light's sphere touches
+void LightClusters::binLight(GLuint id, const pointLight& light, const glm::mat4& view)
+{
+	glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+	float depth = -center.z, radius = light.radius, radius2 = radius * radius;
+	if (radius <= 0.0f || depth + radius < nearPlane || depth - radius > farPlane)
+	{
+		return;
+	}
+
+	//	screen rectangle of the sphere's box, projected at both ends of its depth range
+	float zNear = std::max(depth - radius, nearPlane), zFar = depth + radius;
+	float x0 = std::min((center.x - radius) / zNear, (center.x - radius) / zFar) * projection[0][0];
+	float x1 = std::max((center.x + radius) / zNear, (center.x + radius) / zFar) * projection[0][0];
+	float y0 = std::min((center.y - radius) / zNear, (center.y - radius) / zFar) * projection[1][1];
+	float y1 = std::max((center.y + radius) / zNear, (center.y + radius) / zFar) * projection[1][1];
+	if (x1 < -1.0f || x0 > 1.0f || y1 < -1.0f || y0 > 1.0f)
+	{
+		return;
+	}
+	int tileX0 = std::max((int)std::floor((x0 * 0.5f + 0.5f) * CLUSTER_TILES_X), 0);
+	int tileX1 = std::min((int)std::floor((x1 * 0.5f + 0.5f) * CLUSTER_TILES_X), CLUSTER_TILES_X - 1);
+	int tileY0 = std::max((int)std::floor((y0 * 0.5f + 0.5f) * CLUSTER_TILES_Y), 0);
+	int tileY1 = std::min((int)std::floor((y1 * 0.5f + 0.5f) * CLUSTER_TILES_Y), CLUSTER_TILES_Y - 1);
+	int slice0 = getSlice(zNear), slice1 = getSlice(zFar);
+
+	size_t first = hits.size();
+	for (int s = slice0; s <= slice1; s++)
+	{
+		float dz = std::max(std::max(sliceNear[s] - depth, depth - sliceFar[s]), 0.0f);
+		for (int y = tileY0; y <= tileY1; y++)
+		{
+			float dy = std::max(std::max(minY[s][y] - center.y, center.y - maxY[s][y]), 0.0f);
+			float rest = radius2 - dy * dy - dz * dz;
+			if (rest < 0.0f)
+			{
+				continue;
+			}
+
+			//	a lane is in when its squared distance along x fits in what y and z leave of the radius
+			GLuint row = (s * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X;
+			for (int x = tileX0 & ~3; x <= tileX1; x += 4)
+			{
+				int mask = 0;
+#ifdef __SSE2__
+				__m128 cx = _mm_set1_ps(center.x);
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[s][x]), cx), _mm_sub_ps(cx, _mm_loadu_ps(&maxX[s][x]))), _mm_setzero_ps());
+				mask = _mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(dx, dx), _mm_set1_ps(rest)));
+#else
+				for (int lane = 0; lane < 4; lane++)
+				{
+					float dx = std::max(std::max(minX[s][x + lane] - center.x, center.x - maxX[s][x + lane]), 0.0f);
+					mask |= (dx * dx <= rest) << lane;
+				}
+#endif
+				for (int lane = 0; lane < 4; lane++)
+				{
+					if ((mask & (1 << lane)) && x + lane >= tileX0 && x + lane <= tileX1)
+					{
+						hits.push_back(row + x + lane);
+						hits.push_back(id);
+						counts[row + x + lane]++;
+					}
+				}
+			}
+		}
+	}
+	stats.lights += hits.size() > first;
+}
+
+//	demo and benchmark lights: random colours and sizes over a box, each circling its own anchor
+void scatterLights(size_t count, const glm::vec3& min, const glm::vec3& max, std::vector<pointLight>& lights, std::vector<glm::vec3>& anchors)
+{
+	std::mt19937 random(LIGHT_SCATTER_SEED);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	lights.resize(count);
+	anchors.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		anchors[i] = min + (max - min) * glm::vec3(unit(random), unit(random), unit(random));
+		lights[i].position = anchors[i];
+		lights[i].radius = 2.0f + 2.0f * unit(random);
+		lights[i].color = glm::vec3(0.2f) + 0.8f * glm::vec3(unit(random), unit(random), unit(random));
+		lights[i].intensity = 2.0f;
+	}
+}
+
+void moveLights(const std::vector<glm::vec3>& anchors, float time, std::vector<pointLight>& lights)
+{
+	for (size_t i = 0; i < anchors.size() && i < lights.size(); i++)
+	{
+		float angle = time * (0.5f + 0.1f * (i % 7)) + i * 2.39996f;
+		lights[i].position = anchors[i] + LIGHT_ORBIT_RADIUS * glm::vec3(std::cos(angle), 0.25f * std::sin(2.0f * angle), std::sin(angle));
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef _LIGHT_CLUSTERS_H
+#define _LIGHT_CLUSTERS_H
+
+#include "render_context.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+#define CLUSTER_TILES_X				16
+#define CLUSTER_TILES_Y				9
+#define CLUSTER_SLICES				24		//	logarithmic in view depth
+#define CLUSTER_COUNT				(CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+#define CLUSTER_FAR					500.0f	//	depth where the last slice starts growing to the far plane
+#define LIGHT_BLOCK_BINDING			4
+#define CLUSTER_BLOCK_BINDING		5
+#define LIGHT_INDEX_BLOCK_BINDING	6
+
+//	std430 layout of one LightBlock entry; the light has no effect beyond its radius
+struct pointLight
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+	float intensity;
+};
+
+struct clusterStats
+{
+	unsigned int lights;		//	touching at least one cluster
+	unsigned int references;	//	light indices over all clusters
+	unsigned int maxPerCluster;
+	double binMs;
+};
+
+/**
+ * Clustered forward lighting: the view frustum is cut into CLUSTER_TILES_X x CLUSTER_TILES_Y
+ * screen tiles and CLUSTER_SLICES depth slices, and every frame each point light is binned
+ * into the clusters its sphere touches, on the CPU: the tile and slice range of the sphere is
+ * found first, then the clusters of each row in that range are tested against it four at a
+ * time with SSE. Lights, the per-cluster ranges and the light index lists are streamed through
+ * the ring buffer; the fragment shader finds its cluster from gl_FragCoord and only shades the
+ * lights listed there. Cluster boxes are rebuilt when the projection or the viewport changes.
+ */
+class LightClusters
+{
+	public:
+		explicit LightClusters(renderContext&);
+		LightClusters(const LightClusters&) = delete;
+		LightClusters& operator=(const LightClusters&) = delete;
+
+		void update(const std::vector<pointLight>&, const glm::mat4&, const glm::mat4&);
+		const clusterStats& getStats() const;
+		static std::string getShaderDefines();
+		static void resolveProgram(GLuint);
+
+	private:
+		//	std430 head of the ClusterBlock, the cluster ranges follow
+		struct clusterHeader
+		{
+			float scale[4];		//	slice scale and bias on log(depth), tiles per pixel in x and y
+			float planes[4];	//	near and far plane
+		};
+
+		renderContext& context;
+		glm::mat4 projection;
+		GLsizei viewportWidth, viewportHeight;
+		float nearPlane, farPlane, sliceScale, sliceBias;
+
+		//	view space cluster boxes; x only depends on the slice and tile column, y on the slice and row
+		float minX[CLUSTER_SLICES][CLUSTER_TILES_X], maxX[CLUSTER_SLICES][CLUSTER_TILES_X];
+		float minY[CLUSTER_SLICES][CLUSTER_TILES_Y], maxY[CLUSTER_SLICES][CLUSTER_TILES_Y];
+		float sliceNear[CLUSTER_SLICES], sliceFar[CLUSTER_SLICES];
+
+		std::vector<GLuint> counts, offsets, hits, indices;
+		clusterStats stats;
+
+		void buildClusters(const glm::mat4&);
+		int getSlice(float) const;
+		void binLight(GLuint, const pointLight&, const glm::mat4&);
+};
+
+void scatterLights(size_t, const glm::vec3&, const glm::vec3&, std::vector<pointLight>&, std::vector<glm::vec3>&);
+void moveLights(const std::vector<glm::vec3>&, float, std::vector<pointLight>&);
+
+#endif
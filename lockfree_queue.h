@@ -0,0 +1,111 @@
+#ifndef _LOCKFREE_QUEUE_H
+#define _LOCKFREE_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Bounded multi-producer/multi-consumer queue (Vyukov). Every cell carries a sequence
+ * number which tells producers and consumers whose turn it is, so push/pop are a single
+ * CAS on the shared position in the common case and never take a lock.
+ * Capacity is rounded up to a power of two; push fails instead of blocking when full.
+ */
+template <typename T>
+class LockFreeQueue
+{
+	public:
+		explicit LockFreeQueue(size_t capacity) : enqueuePos(0), dequeuePos(0)
+		{
+			size_t size = 2;
+			while (size < capacity)
+			{
+				size <<= 1;
+			}
+			mask = size - 1;
+			cells = std::vector<cell>(size);
+			for (size_t i = 0; i < size; i++)
+			{
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		bool push(T&& value)
+		{
+			size_t pos = enqueuePos.load(std::memory_order_relaxed);
+			cell* c;
+			for (;;)
+			{
+				c = &cells[pos & mask];
+				size_t seq = c->sequence.load(std::memory_order_acquire);
+				intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+				if (diff == 0)
+				{
+					if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						break;
+					}
+				}
+				else if (diff < 0)
+				{
+					return false;	//	full
+				}
+				else
+				{
+					pos = enqueuePos.load(std::memory_order_relaxed);
+				}
+			}
+			c->data = std::move(value);
+			c->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool pop(T& value)
+		{
+			size_t pos = dequeuePos.load(std::memory_order_relaxed);
+			cell* c;
+			for (;;)
+			{
+				c = &cells[pos & mask];
+				size_t seq = c->sequence.load(std::memory_order_acquire);
+				intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+				if (diff == 0)
+				{
+					if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						break;
+					}
+				}
+				else if (diff < 0)
+				{
+					return false;	//	empty
+				}
+				else
+				{
+					pos = dequeuePos.load(std::memory_order_relaxed);
+				}
+			}
+			value = std::move(c->data);
+			c->sequence.store(pos + mask + 1, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		struct cell
+		{
+			std::atomic<size_t> sequence;
+			T data;
+
+			cell() : sequence(0), data() {}
+			cell(const cell&) : sequence(0), data() {}
+		};
+
+		//	keep the two hot positions on separate cache lines
+		alignas(64) std::atomic<size_t> enqueuePos;
+		alignas(64) std::atomic<size_t> dequeuePos;
+		alignas(64) std::vector<cell> cells;
+		size_t mask;
+};
+
+#endif
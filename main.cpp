@@ -28,23 +28,77 @@ TODO:
 #include <cassert>
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
 
-#include "shader_manager.h"
+#include "shader_permutations.h"
 #include "camera.h"
 #include "model.h"
+#include "residency_manager.h"
+#include "light_clusters.h"
+#include "frame_uniforms.h"
+#include "frame_scheduler.h"
+#include "triple_buffer.h"
+#include "profiler_overlay.h"
+#include "bench.h"
+#include "asset_cook.h"
+#include "utils.h"
 
 
 glm::vec2 WINDOW_SIZE(1200, 800);
 glm::vec2 lastMousePos(WINDOW_SIZE.x/2.0, WINDOW_SIZE.y/2.0);
 glm::vec3 cameraPosition(0.0, 0.0, 25.0), lightPosition(-3.0, 15.0, 1.0);
 
+#define INSTANCE_GRID_SPACING 12.0f
+#define STREAMED_MODEL_SPACING 20.0f
+#define DEMO_LIGHTS_PER_INSTANCE 4
+#define TRACE_PATH "trace.json"        //  F2 writes the next TRACE_FRAMES frames here
+#define TRACE_FRAMES 120
+#define SUMMARY_FRAMES 30              //  frames between window title updates while the overlay is shown
+
+//	looking around happens on the render thread, moving on the simulation thread (FrameScheduler)
 Camera camera(cameraPosition, glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, 1.0, 0.0));
 
+//	what the simulation needs from the render thread: the held movement keys and the view direction
+struct movementInput
+{
+    unsigned int directions;    //  bit per Directions value
+    glm::vec3 front;
+    glm::vec3 up;
+};
+
+//	the render thread blends the two latest steps, both are published together
+struct simulationState
+{
+    glm::vec3 cameraPosition;
+    double time;
+};
+
+struct sceneSnapshot
+{
+    simulationState previous;
+    simulationState current;
+    double dueTime;             //  when current takes over from previous
+};
+
+//	./openglDemo [N] [model...] [--lights L] [--no-vsync] [--fps-cap F]
+struct demoOptions
+{
+    int gridSize;               //  N x N instances, only taken from a leading number
+    int lights;                 //  point lights, -1 for DEMO_LIGHTS_PER_INSTANCE per instance
+    bool vsync;
+    double frameCap;            //  frames per second, 0 for none
+    std::vector<std::string> streamedPaths;
+};
+
 bool keys[1024];
+bool showOverlay = false, captureRequested = false;
 void key_callback(GLFWwindow* window, int, int, int, int);
-void do_movement(const GLfloat&);
+movementInput sample_input();
+void do_movement(const movementInput&, Camera&, const GLdouble&);
 void mouse_callback(GLFWwindow* window, double, double);
 void scroll_callback(GLFWwindow* window, double, double);
+void parseDemoOptions(int, char**, demoOptions&);
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
 {
@@ -52,6 +106,16 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     {
         glfwSetWindowShouldClose(window, GL_TRUE);
     }
+#ifdef PROFILER_ENABLED
+    if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
+    {
+        showOverlay = !showOverlay;
+    }
+    if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+    {
+        captureRequested = true;
+    }
+#endif
     if (action == GLFW_PRESS)
     {
         keys[key] = true;
@@ -62,23 +126,39 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     }
 }
 
-void do_movement(const GLdouble& dt)
+movementInput sample_input()
 {
+    movementInput input = { 0, camera.front, camera.up };
     if (keys[GLFW_KEY_W])  //  forward
     {
-        camera.handleKeyInput(FORWARD, dt);
+        input.directions |= 1 << FORWARD;
     }
     if (keys[GLFW_KEY_S])  //  backward
     {
-        camera.handleKeyInput(BACKWARD, dt);
+        input.directions |= 1 << BACKWARD;
     }
     if (keys[GLFW_KEY_A])  //  left
     {
-        camera.handleKeyInput(LEFT, dt);
+        input.directions |= 1 << LEFT;
     }
     if (keys[GLFW_KEY_D])  //  right
     {
-        camera.handleKeyInput(RIGHT, dt);
+        input.directions |= 1 << RIGHT;
+    }
+    return input;
+}
+
+void do_movement(const movementInput& input, Camera& simulated, const GLdouble& dt)
+{
+    simulated.front = input.front;
+    simulated.up = input.up;
+    const Directions directions[] = { FORWARD, BACKWARD, LEFT, RIGHT };
+    for (int i = 0; i < 4; i++)
+    {
+        if (input.directions & (1 << directions[i]))
+        {
+            simulated.handleKeyInput(directions[i], dt);
+        }
     }
 }
 
@@ -96,9 +176,67 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     camera.handleMouseScrollInput(xoffset, yoffset);
 }
 
+//	flags may come anywhere, whatever else is not a flag's value is a model to stream in
+void parseDemoOptions(int argc, char** argv, demoOptions& options)
+{
+    options.gridSize = 1;
+    options.lights = -1;
+    options.vsync = true;
+    options.frameCap = 0.0;
+    options.streamedPaths.clear();
+
+    int first = 1;
+    if (argc > 1 && argv[1][0] != '\0' && strspn(argv[1], "0123456789") == strlen(argv[1]))
+    {
+        options.gridSize = std::max(1, atoi(argv[1]));
+        first = 2;
+    }
+    for (int i = first; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--no-vsync"))
+        {
+            options.vsync = false;
+        }
+        else if (!strcmp(argv[i], "--fps-cap") && hasValue)
+        {
+            options.frameCap = std::max(0.0, atof(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--lights") && hasValue)
+        {
+            options.lights = std::max(0, atoi(argv[++i]));
+        }
+        else if (!strncmp(argv[i], "--", 2))
+        {
+            std::cerr << "Unknown option " << argv[i] << '\n';
+        }
+        else
+        {
+            options.streamedPaths.push_back(argv[i]);
+        }
+    }
+}
+
 
 int main(int argc, char *argv[])
 {
+    //	--cook DIR compresses the textures below DIR offline, no GL needed
+    if (argc == 3 && !strcmp(argv[1], "--cook"))
+    {
+        return runAssetCook(argv[2]);
+    }
+
+    //	--bench runs headless and never opens a window
+    benchOptions options;
+    if (parseBenchOptions(argc, argv, options))
+    {
+        return runBenchmark(options);
+    }
+
+    //	the window's options, in one pass over the arguments
+    demoOptions demo;
+    parseDemoOptions(argc, argv, demo);
+
     //	initialise GLFW
     if (!glfwInit())
     {
@@ -117,12 +255,12 @@ int main(int argc, char *argv[])
         throw std::runtime_error("glfwOpenWindow failed. Can your hardware handle OpenGL 4.5?");
     }
     glfwMakeContextCurrent(window);
+    glfwSwapInterval(demo.vsync ? 1 : 0);
     glfwSetKeyCallback(window, key_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
     glfwSetWindowPos(window, 10, 50);
-    glViewport(0, 0, (GLsizei)WINDOW_SIZE.x, (GLsizei)WINDOW_SIZE.y);
 	glEnable(GL_MULTISAMPLE);
     glEnable(GL_DEPTH_TEST);
 
@@ -133,80 +271,216 @@ int main(int argc, char *argv[])
         throw std::runtime_error("glewInit failed");
     }
 
-    ShaderManager shaderManager;
-    Shader vshader(GL_VERTEX_SHADER,   "shaders/vshader");
-    Shader fshader(GL_FRAGMENT_SHADER, "shaders/fshader");
-    Shader gshader(GL_GEOMETRY_SHADER, "shaders/gshader");
+    PROFILE_THREAD("main");
+    Profiler& profiler = Profiler::get();
+    profiler.attachGpu();
+    ThreadPool threadPool;
+    RenderState renderState;
+    renderState.setViewport(0, 0, (GLsizei)WINDOW_SIZE.x, (GLsizei)WINDOW_SIZE.y);
+    RingBuffer stream;
+    TextureLibrary textures(threadPool, renderState, stream);
+    MeshArena meshArena;
+    MaterialLibrary materials(textures);
+    renderContext context = { threadPool, textures, meshArena, materials, renderState, stream };
+
+    //	every variant is added before the first finish() so they all compile at once
+    ProgramCache programs;
+    sceneFeatures features = { 1, true, meshArena.getFormat() };
+    ShaderPermutations permutations(programs, "shaders/vshader", "shaders/fshader", textures.getShaderDefines(), features);
+    LightClusters lightClusters(context);
+    FrameUniforms frameBlock(context);
+#ifdef PROFILER_ENABLED
+    ProfilerOverlay overlay(context, programs);
+#endif
+    programs.finish();
+    programs.watch("shaders");
+    programSet scenePrograms;
+    _log("Textures: " << (textures.getBackend() == TEXTURE_BACKEND_BINDLESS ? "bindless" : "size-bucketed arrays")
+        << ", draw ids: " << (GLEW_ARB_shader_draw_parameters ? "gl_DrawIDARB" : "uniform fallback"));
+
+	//Model handgun("models/Handgun/Handgun_Obj/Handgun_obj.obj", context);
+	Model nanosuit("models/nanosuit/nanosuit.obj", context);
 
-    GLuint shaderProgram = shaderManager.buildProgram(vshader, fshader, gshader);
-    shaderManager.use(shaderProgram);
+	//	./openglDemo N draws an N x N grid of instances, further models are streamed in, placed in a row behind the grid
+	int gridSize = demo.gridSize;
+	int lightCount = demo.lights >= 0 ? demo.lights : gridSize * gridSize * DEMO_LIGHTS_PER_INSTANCE;
+	const std::vector<std::string>& streamedPaths = demo.streamedPaths;
+	ResidencyManager residency(context);
+	RenderQueue renderQueue(context);
+	for (size_t i = 0; i < streamedPaths.size(); i++)
+	{
+		glm::vec3 offset((i - (streamedPaths.size() - 1) * 0.5f) * STREAMED_MODEL_SPACING, -10.0, -(gridSize + 1) * INSTANCE_GRID_SPACING);
+		residency.add(streamedPaths[i], glm::translate(glm::mat4(1.0), offset));
+	}
 
-	//Model handgun("models/Handgun/Handgun_Obj/Handgun_obj.obj");
-	Model nanosuit("models/nanosuit/nanosuit.obj");
+	//	point lights drift over the grid, a little above the floor the models stand on
+	std::vector<pointLight> lights;
+	std::vector<glm::vec3> lightAnchors;
+	float gridHalfWidth = gridSize * INSTANCE_GRID_SPACING * 0.5f;
+	scatterLights(lightCount, glm::vec3(-gridHalfWidth, -9.0f, -gridSize * INSTANCE_GRID_SPACING + INSTANCE_GRID_SPACING * 0.5f),
+		glm::vec3(gridHalfWidth, 6.0f, INSTANCE_GRID_SPACING * 0.5f), lights, lightAnchors);
+
+	//	the grid hangs below one dynamic root; its cells are added in a row, so their world matrices are the instance array
+	SceneGraph sceneGraph;
+	GLuint gridRoot = sceneGraph.addNode(glm::translate(glm::mat4(1.0), glm::vec3(0.0, -10.0, 0.0)), SCENE_NODE_NONE, true);
+	GLuint firstGridNode = SCENE_NODE_NONE;
+	for (int z = 0; z < gridSize; z++)
+	{
+		for (int x = 0; x < gridSize; x++)
+		{
+			glm::vec3 offset((x - (gridSize - 1) * 0.5f) * INSTANCE_GRID_SPACING, 0.0, -z * INSTANCE_GRID_SPACING);
+			GLuint node = sceneGraph.addNode(glm::translate(glm::mat4(1.0), offset), gridRoot);
+			firstGridNode = std::min(firstGridNode, node);
+		}
+	}
 	
     glm::mat4 
 	projection,
 	view,
-	model,
-	T = glm::translate(glm::mat4(1.0), glm::vec3(0.0, 0.0, 0.0)), 
-	Tback = glm::translate(Tback, glm::vec3(0.0, 10.0, 0.0)),
-	R = glm::mat4(1.0),
-	S = glm::mat4(1.0),
-	mvp, pv, freeTranslate, normalMatrix;
+	pv;
 
     projection = glm::perspective(camera.getZOOM(), WINDOW_SIZE.x/WINDOW_SIZE.y, 0.1f, 10000.0f);
 	
-	GLuint cameraPositionLoc = glGetUniformLocation(shaderProgram, "cameraPosition"),
-			lightPositonLoc	 = glGetUniformLocation(shaderProgram, "dirLigh1.position"),
-			lightAmbientLoc  = glGetUniformLocation(shaderProgram, "dirLigh1.ambient"),
-			lightDiffuseLoc	 = glGetUniformLocation(shaderProgram, "dirLigh1.diffuse"),
-			lightSpecularLoc = glGetUniformLocation(shaderProgram, "dirLigh1.specular"),
-			modelLoc		 = glGetUniformLocation(shaderProgram, "model"), 	
-			viewLoc			 = glGetUniformLocation(shaderProgram, "view"),
-			mvpLoc			 = glGetUniformLocation(shaderProgram, "mvp"),
-			normalMatrixLoc  = glGetUniformLocation(shaderProgram, "normalMatrix");
-
-    GLdouble currentFrame = 0.0f, 
-			 lastFrame = 0.0f,
-			 dt = 0.0f;
+	//	block bindings are per program, set again whenever a reloaded program replaces one
+	auto resolvePrograms = [&]()
+	{
+		permutations.getPrograms(scenePrograms);
+		for (int v = 0; v < MATERIAL_VARIANTS; v++)
+		{
+			GLuint program = scenePrograms.programs[v];
+			if (!program)
+			{
+				continue;
+			}
+			MaterialLibrary::resolveProgram(program);
+			LightClusters::resolveProgram(program);
+			FrameUniforms::resolveProgram(program);
+		}
+	};
+	resolvePrograms();
+	frameUniforms uniforms = {};
+	uniforms.dirLights[0].position = glm::vec4(lightPosition, 0.0f);
+	uniforms.dirLights[0].ambient = uniforms.dirLights[0].diffuse = uniforms.dirLights[0].specular = glm::vec4(1.0f);
+
+	//	the simulation thread steps the camera at a fixed rate from the latest input the render thread sampled
+	Camera simulatedCamera = camera;
+	simulationState simulated = { camera.position, 0.0 };
+	sceneSnapshot firstSnapshot = { simulated, simulated, 0.0 };
+	TripleBuffer<movementInput> inputs(sample_input());
+	TripleBuffer<sceneSnapshot> snapshots(firstSnapshot);
+	FrameScheduler scheduler;
+	scheduler.setFrameCap(demo.frameCap);
+	scheduler.start([&](double step, double dueTime)
+	{
+		movementInput input;
+		inputs.read(input);
+		sceneSnapshot snapshot;
+		snapshot.previous = simulated;
+		do_movement(input, simulatedCamera, step);
+		simulated.cameraPosition = simulatedCamera.position;
+		simulated.time += step;
+		snapshot.current = simulated;
+		snapshot.dueTime = dueTime;
+		snapshots.write(snapshot);
+	});
 
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	cullingStats shownCulling = { ~0u, ~0u };
+	unsigned int summaryFrame = 0;
 
 	while (!glfwWindowShouldClose(window))
     {
+        //	every wait comes before input is read: the frame cap, then the GPU freeing a ring region
+        profiler.beginFrame();
+        {
+            PROFILE_ZONE("wait");
+            scheduler.waitForFrame();
+            stream.beginFrame();
+        }
+        if (programs.update())
+        {
+            resolvePrograms();
+            renderState.invalidate();
+        }
         glfwPollEvents();
-        glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        inputs.write(sample_input());
+        if (captureRequested && !profiler.isCapturing())
+        {
+            profiler.startCapture(TRACE_PATH, TRACE_FRAMES);
+        }
+        captureRequested = false;
 
-        currentFrame = glfwGetTime();
-        dt = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        //	mouse look was applied by the callbacks just now, the position is blended between steps
+        sceneSnapshot snapshot;
+        snapshots.read(snapshot);
+        float alpha = (float)scheduler.getAlpha(snapshot.dueTime);
+        camera.position = glm::mix(snapshot.previous.cameraPosition, snapshot.current.cameraPosition, alpha);
+        double time = snapshot.previous.time + (snapshot.current.time - snapshot.previous.time) * alpha;
+
+        {
+            PROFILE_GPU_ZONE("clear");
+            glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
 
-		do_movement(dt);
         projection = glm::perspective(camera.getZOOM(), WINDOW_SIZE.x/WINDOW_SIZE.y, 0.1f, 10000.0f);
         view = camera.getViewMatrix();
 		pv = projection * view;
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));		
-		
-		//R = glm::rotate(glm::mat4(1.0), (GLfloat)glfwGetTime(), glm::vec3(0.0, 1.0, 0.0));
-		T = glm::translate(glm::mat4(1.0), glm::vec3(0.0, -10, 0.0));
-		model = R * T;
-		mvp = pv * model;
-		normalMatrix = glm::transpose(glm::inverse(model));
-
-		glUniform3f(cameraPositionLoc, camera.position.x, camera.position.y, camera.position.z);
-		glUniform3f(lightPositonLoc,  lightPosition.x, lightPosition.y, lightPosition.z);
-		glUniform3f(lightAmbientLoc, 1.0, 1.0, 1.0);
-		glUniform3f(lightDiffuseLoc, 1.0, 1.0, 1.0);
-		glUniform3f(lightSpecularLoc, 1.0, 1.0, 1.0);
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-		glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(mvp));
-		glUniformMatrix4fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-		
-		nanosuit.render(shaderProgram);
-        glfwSwapBuffers(window);
+		residency.update(camera, pv);
+		textures.pump();
+		moveLights(lightAnchors, (float)time, lights);
+		lightClusters.update(lights, view, projection);
+
+		sceneGraph.update();
+
+		uniforms.view = view;
+		uniforms.viewProjection = pv;
+		uniforms.cameraPosition = glm::vec4(camera.position, 1.0f);
+		frameBlock.update(uniforms);
+
+		renderQueue.add(nanosuit, sceneGraph.getWorlds(firstGridNode), gridSize * gridSize);
+		residency.enqueue(renderQueue);
+		cullingStats culling;
+		{
+			PROFILE_GPU_ZONE("scene");
+			culling = renderQueue.execute(scenePrograms, pv);
+		}
+#ifdef PROFILER_ENABLED
+		if (showOverlay)
+		{
+			PROFILE_GPU_ZONE("overlay");
+			overlay.draw(profiler);
+		}
+#endif
+		PROFILE_COUNT(COUNTER_DRAW_CALLS, renderState.getDrawCalls());
+		PROFILE_COUNT(COUNTER_STATE_CHANGES, renderState.getIssued());
+		PROFILE_COUNT(COUNTER_TRIANGLES, renderState.getTriangles());
+		renderState.resetCounters();
+
+		//	the overlay has no text, so its numbers go into the title while it is shown
+		if (showOverlay && ++summaryFrame >= SUMMARY_FRAMES)
+		{
+			summaryFrame = 0;
+			shownCulling.visible = shownCulling.culled = ~0u;
+			std::string title = "Opengl demo | " + ProfilerOverlay::getSummary(profiler);
+			glfwSetWindowTitle(window, title.c_str());
+		}
+		else if (!showOverlay && (culling.visible != shownCulling.visible || culling.culled != shownCulling.culled))
+		{
+			shownCulling = culling;
+			std::string title = "Opengl demo | visible " + std::to_string(culling.visible) + ", culled " + std::to_string(culling.culled);
+			glfwSetWindowTitle(window, title.c_str());
+		}
+        stream.endFrame();
+        {
+            PROFILE_ZONE("swap");
+            glfwSwapBuffers(window);
+        }
+        profiler.endFrame();
     }
 
+    scheduler.stop();
+    profiler.detachGpu();
 
     glfwTerminate();
     return EXIT_SUCCESS;
@@ -0,0 +1,48 @@
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//	read-only mapping of a whole file, unmapped on scope exit; data is null when the file is missing or empty
+struct mappedFile
+{
+	const unsigned char* data;
+	size_t size;
+
+	explicit mappedFile(const std::string& path) : data(nullptr), size(0)
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return;
+		}
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr != MAP_FAILED)
+			{
+				data = (const unsigned char*)ptr;
+				size = st.st_size;
+			}
+		}
+		close(fd);
+	}
+
+	~mappedFile()
+	{
+		if (data)
+		{
+			munmap((void*)data, size);
+		}
+	}
+
+	mappedFile(const mappedFile&) = delete;
+	mappedFile& operator=(const mappedFile&) = delete;
+};
+
+#endif
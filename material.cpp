@@ -0,0 +1,130 @@
+#include "material.h"
+#include "model_mesh.h"
+#include <algorithm>
+#include <cstring>
+
+MaterialLibrary::MaterialLibrary(TextureLibrary& _textures) : textures(_textures), capacity(0), dirty(false), texturesGeneration(~0u)
+{
+}
+
+//	returns the index of an equal material if there is one already; texture IDs are library slots
+GLuint MaterialLibrary::add(const std::vector<texture>& textureRefs, float shininess)
+{
+	material m;
+	m.diffuseSlot = TEXTURE_PLACEHOLDER_SLOT;
+	m.specularSlot = TEXTURE_PLACEHOLDER_SLOT;
+	m.shininess = shininess;
+	for (size_t i = 0; i < textureRefs.size(); i++)
+	{
+		if (textureRefs[i].type == "diffuseTexture" && m.diffuseSlot == TEXTURE_PLACEHOLDER_SLOT)
+		{
+			m.diffuseSlot = textureRefs[i].ID;
+		}
+		if (textureRefs[i].type == "specularTexture" && m.specularSlot == TEXTURE_PLACEHOLDER_SLOT)
+		{
+			m.specularSlot = textureRefs[i].ID;
+		}
+	}
+
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		if (materials[i].diffuseSlot == m.diffuseSlot && materials[i].specularSlot == m.specularSlot &&
+			materials[i].shininess == m.shininess)
+		{
+			return i;
+		}
+	}
+	materials.push_back(m);
+	dirty = true;
+	return materials.size() - 1;
+}
+
+GLuint MaterialLibrary::getVariant(GLuint id) const
+{
+	const material& m = materials[id];
+	return (m.diffuseSlot != TEXTURE_PLACEHOLDER_SLOT ? MATERIAL_DIFFUSE_MAP : 0) |
+		(m.specularSlot != TEXTURE_PLACEHOLDER_SLOT ? MATERIAL_SPECULAR_MAP : 0);
+}
+
+//	once per frame (or per program switch): the records and, with texture arrays, the buckets
+void MaterialLibrary::bind(RenderState& state)
+{
+	if (materials.empty())
+	{
+		return;
+	}
+	if (dirty || texturesGeneration != textures.getGeneration())
+	{
+		upload(state);
+	}
+	textures.bind();
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, MATERIAL_BLOCK_BINDING, recordsBuffer.get(), 0,
+		materials.size() * sizeof(materialRecord));
+}
+
+//	only the run of records from the first to the last that changed goes to the buffer
+void MaterialLibrary::upload(RenderState& state)
+{
+	size_t first = materials.size(), last = 0, known = records.size();
+	records.resize(materials.size());
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		materialRecord r;
+		textures.getReference(materials[i].diffuseSlot, r.diffuse);
+		textures.getReference(materials[i].specularSlot, r.specular);
+		r.shininess = materials[i].shininess;
+		r.padding[0] = r.padding[1] = r.padding[2] = 0.0f;
+		if (i >= known || memcmp(&r, &records[i], sizeof(r)) != 0)
+		{
+			records[i] = r;
+			first = std::min(first, i);
+			last = i + 1;
+		}
+	}
+
+	if (materials.size() > capacity)
+	{
+		capacity = std::max<size_t>(std::max(capacity * 2, materials.size()), MATERIAL_INITIAL_CAPACITY);
+		state.forget(recordsBuffer.get());
+		recordsBuffer = GLBuffer::create();
+		glNamedBufferStorage(recordsBuffer.get(), capacity * sizeof(materialRecord), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		first = 0;
+		last = materials.size();
+	}
+	if (first < last)
+	{
+		glNamedBufferSubData(recordsBuffer.get(), first * sizeof(materialRecord), (last - first) * sizeof(materialRecord), &records[first]);
+	}
+	dirty = false;
+	texturesGeneration = textures.getGeneration();
+}
+
+//	done once after linking: bucket sampler units and block bindings never change afterwards
+void MaterialLibrary::resolveProgram(GLuint program)
+{
+	GLint location = glGetUniformLocation(program, "textureBuckets[0]");
+	if (location >= 0)
+	{
+		GLint units[TEXTURE_BUCKETS];
+		for (int i = 0; i < TEXTURE_BUCKETS; i++)
+		{
+			units[i] = i;
+		}
+		glProgramUniform1iv(program, location, TEXTURE_BUCKETS, units);
+	}
+	GLuint block = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, "MaterialBlock");
+	if (block != GL_INVALID_INDEX)
+	{
+		glShaderStorageBlockBinding(program, block, MATERIAL_BLOCK_BINDING);
+	}
+	block = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, "DrawBlock");
+	if (block != GL_INVALID_INDEX)
+	{
+		glShaderStorageBlockBinding(program, block, DRAW_BLOCK_BINDING);
+	}
+	block = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, "InstanceBlock");
+	if (block != GL_INVALID_INDEX)
+	{
+		glShaderStorageBlockBinding(program, block, INSTANCE_BLOCK_BINDING);
+	}
+}
@@ -0,0 +1,88 @@
+#ifndef _MATERIAL_H
+#define _MATERIAL_H
+
+#include "gl_handle.h"
+#include "render_state.h"
+#include "texture_library.h"
+#include <vector>
+
+#define MATERIAL_BLOCK_BINDING		1
+#define DRAW_BLOCK_BINDING			2
+#define INSTANCE_BLOCK_BINDING		3
+#define DRAW_ID_FALLBACK_LOC		0	//	uniform location of the draw index when gl_DrawIDARB is missing
+#define MATERIAL_DEFAULT_SHININESS	16.0f
+#define MATERIAL_DIFFUSE_MAP		1	//	variant bits, a material without the map reads the placeholder colour
+#define MATERIAL_SPECULAR_MAP		2
+#define MATERIAL_VARIANTS			4
+#define MATERIAL_INITIAL_CAPACITY	64	//	records the buffer has room for before it first grows
+
+struct texture;
+
+//	std430 layout of one MaterialBlock entry; textures are TextureLibrary references
+struct materialRecord
+{
+	GLuint diffuse[2];
+	GLuint specular[2];
+	float shininess;
+	float padding[3];
+};
+
+//	std430 layout of one DrawBlock entry, indexed by the draw id of a multi-draw
+struct drawRecord
+{
+	GLuint materialID;
+	GLuint firstInstance;		//	added to gl_InstanceID, a draw per level of detail reads its own range of instances
+	GLuint boneCount;			//	palette matrices per instance of a draw skinned in the vertex shader, else 0
+	GLuint padding;
+	float positionScale[4];		//	vertexDequantization of the part, w unused
+	float positionOffset[4];
+	float texCoordTransform[4];	//	scale in xy, offset in zw
+};
+
+//	a linked program per material variant, filled by ShaderPermutations; 0 where a variant failed to link
+struct programSet
+{
+	GLuint programs[MATERIAL_VARIANTS];
+};
+
+/**
+ * Every material used by loaded models, kept as one shader storage buffer of records. A draw
+ * picks its material by index through the DrawBlock, so a whole model with any number of
+ * materials is one multi-draw; nothing is bound per material. Records that changed are
+ * re-uploaded when materials are added or the texture library has changed references; the
+ * buffer is only reallocated, at twice the size, when the materials outgrow it.
+ * Sampler units and block bindings are assigned once per program by resolveProgram().
+ * getVariant() tells which textures a material really has, draws are grouped by it so each
+ * group uses the program that samples only those.
+ */
+class MaterialLibrary
+{
+	public:
+		explicit MaterialLibrary(TextureLibrary&);
+		MaterialLibrary(const MaterialLibrary&) = delete;
+		MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+		GLuint add(const std::vector<texture>&, float = MATERIAL_DEFAULT_SHININESS);
+		GLuint getVariant(GLuint) const;
+		void bind(RenderState&);
+		static void resolveProgram(GLuint);
+
+	private:
+		struct material
+		{
+			GLuint diffuseSlot;
+			GLuint specularSlot;
+			float shininess;
+		};
+
+		TextureLibrary& textures;
+		std::vector<material> materials;
+		GLBuffer recordsBuffer;
+		std::vector<materialRecord> records;		//	as in the buffer
+		size_t capacity;
+		bool dirty;
+		unsigned int texturesGeneration;
+		void upload(RenderState&);
+};
+
+#endif
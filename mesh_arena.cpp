@@ -0,0 +1,278 @@
+#include "mesh_arena.h"
+#include "profiler.h"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+RangeAllocator::RangeAllocator(GLuint _capacity) : capacity(0), used(0)
+{
+	reset(_capacity, 0);
+}
+
+bool RangeAllocator::allocate(GLuint count, GLuint& offset)
+{
+	for (std::map<GLuint, GLuint>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it)
+	{
+		if (it->second >= count)
+		{
+			offset = it->first;
+			GLuint remaining = it->second - count;
+			freeRanges.erase(it);
+			if (remaining > 0)
+			{
+				freeRanges[offset + count] = remaining;
+			}
+			used += count;
+			return true;
+		}
+	}
+	return false;
+}
+
+void RangeAllocator::free(GLuint offset, GLuint count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	used -= count;
+
+	std::map<GLuint, GLuint>::iterator next = freeRanges.lower_bound(offset);
+	if (next != freeRanges.begin())
+	{
+		std::map<GLuint, GLuint>::iterator prev = next;
+		--prev;
+		if (prev->first + prev->second == offset)
+		{
+			offset = prev->first;
+			count += prev->second;
+			freeRanges.erase(prev);
+		}
+	}
+	if (next != freeRanges.end() && offset + count == next->first)
+	{
+		count += next->second;
+		freeRanges.erase(next);
+	}
+	freeRanges[offset] = count;
+}
+
+//	everything below usedPrefix is taken, the rest is one free range
+void RangeAllocator::reset(GLuint _capacity, GLuint usedPrefix)
+{
+	capacity = _capacity;
+	used = usedPrefix;
+	freeRanges.clear();
+	if (capacity > usedPrefix)
+	{
+		freeRanges[usedPrefix] = capacity - usedPrefix;
+	}
+}
+
+GLuint RangeAllocator::getCapacity() const
+{
+	return capacity;
+}
+
+GLuint RangeAllocator::getUsed() const
+{
+	return used;
+}
+
+GLuint RangeAllocator::getLargestFree() const
+{
+	GLuint largest = 0;
+	for (std::map<GLuint, GLuint>::const_iterator it = freeRanges.begin(); it != freeRanges.end(); ++it)
+	{
+		largest = std::max(largest, it->second);
+	}
+	return largest;
+}
+
+
+MeshArena::MeshArena(vertexFormat _format, GLuint vertexCapacity, GLuint indexCapacity) :
+	format(_format), stride(getVertexStride(_format)), vertexRanges(vertexCapacity), indexRanges(indexCapacity), generation(0)
+{
+	vao = GLVertexArray::create();
+	createBuffers(vertexCapacity, indexCapacity, vbo, ebo);
+	setupVertexArray();
+}
+
+void MeshArena::createBuffers(GLuint vertexCapacity, GLuint indexCapacity, GLBuffer& vertexBuffer, GLBuffer& indexBuffer)
+{
+	vertexBuffer = GLBuffer::create();
+	glNamedBufferStorage(vertexBuffer.get(), (GLsizeiptr)vertexCapacity * stride, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	indexBuffer = GLBuffer::create();
+	glNamedBufferStorage(indexBuffer.get(), (GLsizeiptr)indexCapacity * sizeof(GLuint), nullptr, GL_DYNAMIC_STORAGE_BIT);
+}
+
+//	direct state access only, so setting up (or re-pointing) the VAO never disturbs current bindings
+void MeshArena::setupVertexArray()
+{
+	GLuint id = vao.get();
+	glVertexArrayVertexBuffer(id, 0, vbo.get(), 0, stride);
+	glVertexArrayElementBuffer(id, ebo.get());
+	setupVertexAttributes(id, format);
+}
+
+GLuint MeshArena::allocate(const void* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount)
+{
+	allocation a;
+	a.vertexOffset = 0;
+	a.indexOffset = 0;
+	a.vertexCount = vertexCount;
+	a.indexCount = indexCount;
+	a.live = true;
+
+	if (vertexRanges.getLargestFree() < vertexCount || indexRanges.getLargestFree() < indexCount)
+	{
+		//	compaction alone is enough when the total free space fits, otherwise grow too
+		GLuint vertexCapacity = vertexRanges.getCapacity(), indexCapacity = indexRanges.getCapacity();
+		if (!growCapacity(vertexCapacity, vertexRanges.getUsed(), vertexCount) || !growCapacity(indexCapacity, indexRanges.getUsed(), indexCount))
+		{
+			std::cerr << "Mesh arena cannot hold " << vertexCount << " more vertices and " << indexCount << " more indices\n";
+			return ARENA_NO_ALLOCATION;
+		}
+		relocate(vertexCapacity, indexCapacity);
+	}
+	if (vertexCount > 0)
+	{
+		vertexRanges.allocate(vertexCount, a.vertexOffset);
+	}
+	if (indexCount > 0)
+	{
+		indexRanges.allocate(indexCount, a.indexOffset);
+	}
+
+	glNamedBufferSubData(vbo.get(), (GLintptr)a.vertexOffset * stride, (GLsizeiptr)vertexCount * stride, vertices);
+	glNamedBufferSubData(ebo.get(), (GLintptr)a.indexOffset * sizeof(GLuint), (GLsizeiptr)indexCount * sizeof(GLuint), indices);
+	PROFILE_COUNT(COUNTER_UPLOAD_BYTES, (uint64_t)vertexCount * stride + (uint64_t)indexCount * sizeof(GLuint));
+
+	GLuint id;
+	if (!freeIDs.empty())
+	{
+		id = freeIDs.back();
+		freeIDs.pop_back();
+		allocations[id] = a;
+	}
+	else
+	{
+		id = allocations.size();
+		allocations.push_back(a);
+	}
+	return id;
+}
+
+void MeshArena::free(GLuint id)
+{
+	allocation& a = allocations[id];
+	vertexRanges.free(a.vertexOffset, a.vertexCount);
+	indexRanges.free(a.indexOffset, a.indexCount);
+	a.live = false;
+	freeIDs.push_back(id);
+}
+
+//	doubles capacity until count more than used fit, clamped to the largest GLuint; false when even that is not enough
+bool MeshArena::growCapacity(GLuint& capacity, GLuint used, GLuint count)
+{
+	const GLuint limit = std::numeric_limits<GLuint>::max();
+	if (count > limit - used)
+	{
+		return false;
+	}
+	GLuint required = used + count;
+	while (capacity < required)
+	{
+		capacity = capacity > limit / 2 ? limit : std::max(capacity * 2, 1u);
+	}
+	return true;
+}
+
+void MeshArena::compact()
+{
+	relocate(vertexRanges.getCapacity(), indexRanges.getCapacity());
+}
+
+/**
+ * Copies every live allocation, packed in offset order, into freshly created buffers of the
+ * given capacity and swaps them in. Indices are relative to baseVertex so they move verbatim,
+ * and the VAO keeps its name so nobody has to rebind it.
+ */
+void MeshArena::relocate(GLuint vertexCapacity, GLuint indexCapacity)
+{
+	GLBuffer newVbo, newEbo;
+	createBuffers(vertexCapacity, indexCapacity, newVbo, newEbo);
+
+	std::vector<GLuint> order;
+	for (GLuint i = 0; i < allocations.size(); i++)
+	{
+		if (allocations[i].live)
+		{
+			order.push_back(i);
+		}
+	}
+	std::sort(order.begin(), order.end(), [this](GLuint a, GLuint b)
+	{
+		return allocations[a].vertexOffset < allocations[b].vertexOffset;
+	});
+
+	GLuint vertexEnd = 0, indexEnd = 0;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		allocation& a = allocations[order[i]];
+		glCopyNamedBufferSubData(vbo.get(), newVbo.get(), (GLintptr)a.vertexOffset * stride,
+			(GLintptr)vertexEnd * stride, (GLsizeiptr)a.vertexCount * stride);
+		a.vertexOffset = vertexEnd;
+		vertexEnd += a.vertexCount;
+	}
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		allocation& a = allocations[order[i]];
+		glCopyNamedBufferSubData(ebo.get(), newEbo.get(), (GLintptr)a.indexOffset * sizeof(GLuint),
+			(GLintptr)indexEnd * sizeof(GLuint), (GLsizeiptr)a.indexCount * sizeof(GLuint));
+		a.indexOffset = indexEnd;
+		indexEnd += a.indexCount;
+	}
+
+	vbo = std::move(newVbo);
+	ebo = std::move(newEbo);
+	vertexRanges.reset(vertexCapacity, vertexEnd);
+	indexRanges.reset(indexCapacity, indexEnd);
+	setupVertexArray();
+	generation++;
+}
+
+drawElementsIndirectCommand MeshArena::getDrawCommand(GLuint id) const
+{
+	const allocation& a = allocations[id];
+	drawElementsIndirectCommand cmd;
+	cmd.count = a.indexCount;
+	cmd.instanceCount = 1;
+	cmd.firstIndex = a.indexOffset;
+	cmd.baseVertex = a.vertexOffset;
+	cmd.baseInstance = 0;
+	return cmd;
+}
+
+//	vertex and index bytes one allocation holds in the buffers
+GLsizeiptr MeshArena::getAllocationBytes(GLuint id) const
+{
+	const allocation& a = allocations[id];
+	return (GLsizeiptr)a.vertexCount * stride + (GLsizeiptr)a.indexCount * sizeof(GLuint);
+}
+
+GLuint MeshArena::getVAO() const
+{
+	return vao.get();
+}
+
+unsigned int MeshArena::getGeneration() const
+{
+	return generation;
+}
+
+vertexFormat MeshArena::getFormat() const
+{
+	return format;
+}
@@ -0,0 +1,133 @@
+#ifndef _MESH_ARENA_H
+#define _MESH_ARENA_H
+
+#include "gl_handle.h"
+#include "vertex_format.h"
+#include <map>
+#include <vector>
+
+#define ARENA_INITIAL_VERTICES	(1 << 18)
+#define ARENA_INITIAL_INDICES	(1 << 20)
+#define ARENA_NO_ALLOCATION		(~0u)	//	allocate() could not make room
+
+//	layout of one glMultiDrawElementsIndirect record
+struct drawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint  baseVertex;
+	GLuint baseInstance;
+};
+
+/**
+ * First-fit allocator over [0, capacity) elements. Free ranges are kept ordered by
+ * offset and merged with their neighbours on free, so the free list never fragments
+ * into adjacent pieces.
+ */
+class RangeAllocator
+{
+	public:
+		explicit RangeAllocator(GLuint);
+		bool allocate(GLuint, GLuint&);
+		void free(GLuint, GLuint);
+		void reset(GLuint, GLuint);
+		GLuint getCapacity() const;
+		GLuint getUsed() const;
+		GLuint getLargestFree() const;
+
+	private:
+		std::map<GLuint, GLuint> freeRanges;	//	offset -> count
+		GLuint capacity, used;
+};
+
+/**
+ * One vertex buffer and one index buffer shared by every mesh, with a single VAO over them.
+ * Meshes refer to their data through a stable allocation id; when the arena runs out of
+ * room it compacts live allocations (GPU side copy) and grows if that is not enough,
+ * bumping the generation so cached draw commands know to rebuild. Capacities double up to
+ * what a GLuint can count; an allocation that would need more fails instead.
+ * Every vertex in the arena has the same vertexFormat, allocate() takes them already packed.
+ */
+class MeshArena
+{
+	public:
+		MeshArena(vertexFormat = VERTEX_FORMAT_DEFAULT, GLuint = ARENA_INITIAL_VERTICES, GLuint = ARENA_INITIAL_INDICES);
+		MeshArena(const MeshArena&) = delete;
+		MeshArena& operator=(const MeshArena&) = delete;
+
+		GLuint allocate(const void*, GLuint, const GLuint*, GLuint);
+		void free(GLuint);
+		void compact();
+		drawElementsIndirectCommand getDrawCommand(GLuint) const;
+		GLsizeiptr getAllocationBytes(GLuint) const;
+		GLuint getVAO() const;
+		unsigned int getGeneration() const;
+		vertexFormat getFormat() const;
+
+	private:
+		struct allocation
+		{
+			GLuint vertexOffset, vertexCount;
+			GLuint indexOffset, indexCount;
+			bool live;
+		};
+
+		vertexFormat format;
+		GLsizeiptr stride;
+		GLVertexArray vao;
+		GLBuffer vbo, ebo;
+		RangeAllocator vertexRanges, indexRanges;
+		std::vector<allocation> allocations;
+		std::vector<GLuint> freeIDs;
+		unsigned int generation;
+
+		void createBuffers(GLuint, GLuint, GLBuffer&, GLBuffer&);
+		void setupVertexArray();
+		static bool growCapacity(GLuint&, GLuint, GLuint);
+		void relocate(GLuint, GLuint);
+};
+
+/**
+ * Move-only ownership of one MeshArena allocation; frees it on destruction.
+ */
+class ArenaAllocation
+{
+	public:
+		ArenaAllocation() : arena(nullptr), id(0) {}
+		ArenaAllocation(MeshArena& _arena, GLuint _id) : arena(&_arena), id(_id) {}
+		~ArenaAllocation() { reset(); }
+		ArenaAllocation(const ArenaAllocation&) = delete;
+		ArenaAllocation& operator=(const ArenaAllocation&) = delete;
+
+		ArenaAllocation(ArenaAllocation&& other) : arena(other.arena), id(other.id) { other.arena = nullptr; }
+		ArenaAllocation& operator=(ArenaAllocation&& other)
+		{
+			if (this != &other)
+			{
+				reset();
+				arena = other.arena;
+				id = other.id;
+				other.arena = nullptr;
+			}
+			return *this;
+		}
+
+		void reset()
+		{
+			if (arena)
+			{
+				arena->free(id);
+				arena = nullptr;
+			}
+		}
+
+		MeshArena* getArena() const { return arena; }
+		GLuint getID() const { return id; }
+
+	private:
+		MeshArena* arena;
+		GLuint id;
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include "mesh_cache.h"
+#include "mapped_file.h"
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace
+{
+	uint64_t fnv1a(const std::string& str)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < str.size(); i++)
+		{
+			hash ^= (unsigned char)str[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	//	bounds checked cursor over the mapping, every field stays 4 byte aligned
+	struct reader
+	{
+		const unsigned char* ptr;
+		const unsigned char* end;
+
+		const void* take(size_t bytes)
+		{
+			bytes = (bytes + 3) & ~size_t(3);
+			if ((size_t)(end - ptr) < bytes)
+			{
+				return nullptr;
+			}
+			const void* res = ptr;
+			ptr += bytes;
+			return res;
+		}
+
+		bool takeString(std::string& str)
+		{
+			const uint32_t* len = (const uint32_t*)take(sizeof(uint32_t));
+			if (!len)
+			{
+				return false;
+			}
+			const char* chars = (const char*)take(*len);
+			if (!chars)
+			{
+				return false;
+			}
+			str.assign(chars, *len);
+			return true;
+		}
+	};
+
+	void writePadded(std::ofstream& ofs, const void* data, size_t bytes)
+	{
+		static const char zeros[4] = {0, 0, 0, 0};
+		ofs.write((const char*)data, bytes);
+		ofs.write(zeros, ((bytes + 3) & ~size_t(3)) - bytes);
+	}
+
+	void writeString(std::ofstream& ofs, const std::string& str)
+	{
+		uint32_t len = str.size();
+		ofs.write((const char*)&len, sizeof(len));
+		writePadded(ofs, str.data(), len);
+	}
+}
+
+MeshCache::MeshCache(const std::string& _sourcePath, unsigned int _importFlags) :
+	sourcePath(_sourcePath), cachePath(_sourcePath + ".meshcache"), importFlags(_importFlags),
+	sourceFound(false), sourceMTime(0), sourceSize(0)
+{
+	sourceFound = getFileStamp(sourcePath, sourceMTime, sourceSize);
+}
+
+MeshCache::header MeshCache::makeHeader(uint32_t meshCount, uint32_t dependencyCount, double coldImportMs) const
+{
+	header h;
+	h.magic = MESH_CACHE_MAGIC;
+	h.version = MESH_CACHE_VERSION;
+	h.importFlags = importFlags;
+	h.meshCount = meshCount;
+	h.dependencyCount = dependencyCount;
+	h.padding = 0;
+	h.sourceMTime = sourceMTime;
+	h.sourceSize = sourceSize;
+	h.pathHash = fnv1a(sourcePath);
+	h.coldImportMs = coldImportMs;
+	return h;
+}
+
+bool MeshCache::load(std::vector<meshData>& meshes, double& coldImportMs) const
+{
+	if (!sourceFound)
+	{
+		return false;
+	}
+
+	mappedFile file(cachePath);
+	if (!file.data)
+	{
+		return false;
+	}
+
+	reader in = { file.data, file.data + file.size };
+	const header* h = (const header*)in.take(sizeof(header));
+	header expected = makeHeader(h ? h->meshCount : 0, h ? h->dependencyCount : 0, 0.0);
+	if (!h || h->magic != expected.magic || h->version != expected.version || h->importFlags != expected.importFlags ||
+		h->sourceMTime != expected.sourceMTime || h->sourceSize != expected.sourceSize || h->pathHash != expected.pathHash)
+	{
+		return false;
+	}
+
+	//	a material library or texture that changed, appeared or went away since makes the cache stale
+	for (uint32_t i = 0; i < h->dependencyCount; i++)
+	{
+		std::string path;
+		const uint64_t* stamp = in.takeString(path) ? (const uint64_t*)in.take(2 * sizeof(uint64_t)) : nullptr;
+		uint64_t mtime = 0, size = 0;
+		getFileStamp(path, mtime, size);
+		if (!stamp || stamp[0] != mtime || stamp[1] != size)
+		{
+			return false;
+		}
+	}
+
+	std::vector<meshData> res(h->meshCount);
+	for (size_t i = 0; i < res.size(); i++)
+	{
+		const meshHeader* mh = (const meshHeader*)in.take(sizeof(meshHeader));
+		const boundingVolume* bounds = (const boundingVolume*)in.take(sizeof(boundingVolume));
+		if (!mh || !bounds)
+		{
+			return false;
+		}
+		res[i].bounds = *bounds;
+
+		res[i].textures.resize(mh->textureCount);
+		for (size_t t = 0; t < res[i].textures.size(); t++)
+		{
+			res[i].textures[t].ID = 0;
+			if (!in.takeString(res[i].textures[t].type) || !in.takeString(res[i].textures[t].filename))
+			{
+				return false;
+			}
+		}
+
+		const vertex* vertices = (const vertex*)in.take(mh->vertexCount * sizeof(vertex));
+		const GLuint* indices = (const GLuint*)in.take(mh->indexCount * sizeof(GLuint));
+		const meshLod* lods = (const meshLod*)in.take(mh->lodCount * sizeof(meshLod));
+		if (!vertices || !indices || !lods)
+		{
+			return false;
+		}
+		res[i].vertices.assign(vertices, vertices + mh->vertexCount);
+		res[i].indices.assign(indices, indices + mh->indexCount);
+		res[i].lods.assign(lods, lods + mh->lodCount);
+	}
+
+	coldImportMs = h->coldImportMs;
+	meshes.swap(res);
+	return true;
+}
+
+//	dependencies are the other files the import read, each is stamped as it is now
+bool MeshCache::store(const std::vector<meshData>& meshes, const std::vector<std::string>& dependencies, double coldImportMs) const
+{
+	if (!sourceFound)
+	{
+		return false;
+	}
+
+	//	write next to the final file and rename, so a crash never leaves a torn cache behind
+	std::string tmpPath = cachePath + ".tmp";
+	std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+	if (!ofs.is_open())
+	{
+		std::cerr << "Could not write mesh cache " << cachePath << '\n';
+		return false;
+	}
+
+	header h = makeHeader(meshes.size(), dependencies.size(), coldImportMs);
+	ofs.write((const char*)&h, sizeof(h));
+	for (size_t i = 0; i < dependencies.size(); i++)
+	{
+		uint64_t stamp[2] = { 0, 0 };
+		getFileStamp(dependencies[i], stamp[0], stamp[1]);
+		writeString(ofs, dependencies[i]);
+		ofs.write((const char*)stamp, sizeof(stamp));
+	}
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const meshData& mesh = meshes[i];
+		meshHeader mh;
+		mh.vertexCount = mesh.vertices.size();
+		mh.indexCount = mesh.indices.size();
+		mh.textureCount = mesh.textures.size();
+		mh.lodCount = mesh.lods.size();
+		ofs.write((const char*)&mh, sizeof(mh));
+		writePadded(ofs, &mesh.bounds, sizeof(boundingVolume));
+
+		for (size_t t = 0; t < mesh.textures.size(); t++)
+		{
+			writeString(ofs, mesh.textures[t].type);
+			writeString(ofs, mesh.textures[t].filename);
+		}
+		writePadded(ofs, mesh.vertices.data(), mesh.vertices.size() * sizeof(vertex));
+		writePadded(ofs, mesh.indices.data(), mesh.indices.size() * sizeof(GLuint));
+		writePadded(ofs, mesh.lods.data(), mesh.lods.size() * sizeof(meshLod));
+	}
+	ofs.close();
+
+	if (!ofs || std::rename(tmpPath.c_str(), cachePath.c_str()) != 0)
+	{
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+const std::string& MeshCache::getCachePath() const
+{
+	return cachePath;
+}
+
+//	mtime in nanoseconds and size; both stay 0 for a missing file
+bool MeshCache::getFileStamp(const std::string& path, uint64_t& mtime, uint64_t& size)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+	{
+		mtime = size = 0;
+		return false;
+	}
+	mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+	size = st.st_size;
+	return true;
+}
@@ -0,0 +1,58 @@
+#ifndef _MESH_CACHE_H
+#define _MESH_CACHE_H
+
+#include "model_mesh.h"
+#include <cstdint>
+
+#define MESH_CACHE_MAGIC	0x48534d4f	//	"OMSH"
+#define MESH_CACHE_VERSION	7
+
+/**
+ * Binary cache of an imported model, stored next to the source as <source>.meshcache.
+ * The file is keyed on the source path, its mtime and size, and the Assimp post-process
+ * flags; any mismatch (or a different MESH_CACHE_VERSION) makes it stale and it is rebuilt.
+ * The other files the import read (material libraries, the textures they name) are stored
+ * with their mtime and size as well, and checked the same way when the cache is loaded.
+ *
+ * layout: header | per dependency: path, mtime, size | per mesh: meshHeader, bounds, texture refs, vertex array, index array, lods
+ */
+class MeshCache
+{
+	public:
+		MeshCache(const std::string&, unsigned int);
+		bool load(std::vector<meshData>&, double&) const;
+		bool store(const std::vector<meshData>&, const std::vector<std::string>&, double) const;
+		const std::string& getCachePath() const;
+
+	private:
+		struct header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t importFlags;
+			uint32_t meshCount;
+			uint32_t dependencyCount;
+			uint32_t padding;
+			uint64_t sourceMTime;
+			uint64_t sourceSize;
+			uint64_t pathHash;
+			double   coldImportMs;
+		};
+
+		struct meshHeader
+		{
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			uint32_t textureCount;
+			uint32_t lodCount;
+		};
+
+		std::string sourcePath, cachePath;
+		unsigned int importFlags;
+		bool sourceFound;
+		uint64_t sourceMTime, sourceSize;
+		header makeHeader(uint32_t, uint32_t, double) const;
+		static bool getFileStamp(const std::string&, uint64_t&, uint64_t&);
+};
+
+#endif
@@ -0,0 +1,412 @@
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	/**
+	 * FIFO cache through timestamps: a vertex is cached while fewer than VERTEX_CACHE_SIZE misses
+	 * happened since its own. Bumping time by more than the cache size flushes it.
+	 */
+	class cacheSimulator
+	{
+		public:
+			explicit cacheSimulator(size_t vertexCount) : timestamps(vertexCount, 0), time(VERTEX_CACHE_SIZE + 1) {}
+
+			unsigned int triangleMisses(const GLuint* triangle)
+			{
+				unsigned int misses = 0;
+				for (int k = 0; k < 3; k++)
+				{
+					if (time - timestamps[triangle[k]] > VERTEX_CACHE_SIZE)
+					{
+						timestamps[triangle[k]] = time++;
+						misses++;
+					}
+				}
+				return misses;
+			}
+
+			void flush()
+			{
+				time += VERTEX_CACHE_SIZE + 1;
+			}
+
+		private:
+			std::vector<unsigned int> timestamps;
+			unsigned int time;
+	};
+
+	size_t countMisses(const GLuint* indices, size_t indexCount, size_t vertexCount)
+	{
+		cacheSimulator cache(vertexCount);
+		size_t misses = 0;
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			misses += cache.triangleMisses(&indices[i]);
+		}
+		return misses;
+	}
+
+	size_t hashVertex(const vertex& v)
+	{
+		GLuint words[sizeof(vertex) / sizeof(GLuint)];
+		memcpy(words, &v, sizeof(vertex));
+		size_t hash = 2166136261u;
+		for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+		{
+			hash = (hash ^ words[i]) * 16777619u;
+		}
+		return hash ^ (hash >> 15);
+	}
+
+	//	open addressing over a power of two table, at most half full
+	void deduplicateVertices(meshData& mesh)
+	{
+		std::vector<vertex>& vertices = mesh.vertices;
+		size_t tableSize = 1;
+		while (tableSize < vertices.size() * 2)
+		{
+			tableSize *= 2;
+		}
+		const GLuint empty = ~0u;
+		std::vector<GLuint> table(tableSize, empty), remap(vertices.size());
+		GLuint unique = 0;
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			size_t slot = hashVertex(vertices[i]) & (tableSize - 1);
+			while (table[slot] != empty && memcmp(&vertices[table[slot]], &vertices[i], sizeof(vertex)))
+			{
+				slot = (slot + 1) & (tableSize - 1);
+			}
+			if (table[slot] == empty)
+			{
+				//	unique vertices are compacted in place, earlier slots are never written again
+				table[slot] = unique;
+				vertices[unique++] = vertices[i];
+			}
+			remap[i] = table[slot];
+		}
+		vertices.resize(unique);
+		for (size_t i = 0; i < mesh.indices.size(); i++)
+		{
+			mesh.indices[i] = remap[mesh.indices[i]];
+		}
+	}
+
+	//	Forsyth: recently used vertices score high, the last triangle's three equally, and vertices
+	//	with few triangles left get a boost so they are finished off instead of orphaned
+	float vertexScore(int cachePosition, GLuint remaining)
+	{
+		if (remaining == 0)
+		{
+			return -1.0f;
+		}
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			score = cachePosition < 3 ? 0.75f : std::pow(1.0f - (cachePosition - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5f);
+		}
+		return score + 2.0f / std::sqrt((float)remaining);
+	}
+
+	void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount)
+	{
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+		{
+			return;
+		}
+
+		//	triangles of each vertex, the live ones kept in front of its range
+		std::vector<GLuint> remaining(vertexCount, 0), offsets(vertexCount + 1, 0), adjacency(triangleCount * 3);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+		{
+			remaining[indices[i]]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			offsets[v + 1] = offsets[v] + remaining[v];
+		}
+		std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+		{
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+
+		std::vector<int> cachePositions(vertexCount, -1);
+		std::vector<float> vertexScores(vertexCount), triangleScores(triangleCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			vertexScores[v] = vertexScore(-1, remaining[v]);
+		}
+		size_t best = 0;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			const GLuint* tri = &indices[t * 3];
+			triangleScores[t] = vertexScores[tri[0]] + vertexScores[tri[1]] + vertexScores[tri[2]];
+			if (triangleScores[t] > triangleScores[best])
+			{
+				best = t;
+			}
+		}
+
+		std::vector<char> emitted(triangleCount, 0);
+		std::vector<GLuint> result, cache, nextCache;
+		result.reserve(triangleCount * 3);
+		size_t cursor = 0;
+		while (result.size() < triangleCount * 3)
+		{
+			if (best == triangleCount)
+			{
+				//	nothing left around the cache, restart from the first triangle not drawn yet
+				while (emitted[cursor])
+				{
+					cursor++;
+				}
+				best = cursor;
+			}
+			const GLuint* tri = &indices[best * 3];
+			emitted[best] = 1;
+			result.insert(result.end(), tri, tri + 3);
+
+			nextCache.assign(tri, tri + 3);
+			for (size_t i = 0; i < cache.size(); i++)
+			{
+				if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+				{
+					nextCache.push_back(cache[i]);
+				}
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint v = tri[k];
+				GLuint* begin = &adjacency[offsets[v]];
+				GLuint* last = begin + remaining[v] - 1;
+				std::iter_swap(std::find(begin, last, (GLuint)best), last);
+				remaining[v]--;
+			}
+
+			//	vertices pushed past the end are rescored once as evicted, then dropped
+			for (size_t i = 0; i < nextCache.size(); i++)
+			{
+				GLuint v = nextCache[i];
+				cachePositions[v] = i < FORSYTH_CACHE_SIZE ? (int)i : -1;
+				vertexScores[v] = vertexScore(cachePositions[v], remaining[v]);
+			}
+			best = triangleCount;
+			float bestScore = -1.0f;
+			for (size_t i = 0; i < nextCache.size(); i++)
+			{
+				GLuint v = nextCache[i];
+				for (GLuint j = offsets[v]; j < offsets[v] + remaining[v]; j++)
+				{
+					GLuint t = adjacency[j];
+					const GLuint* other = &indices[t * 3];
+					triangleScores[t] = vertexScores[other[0]] + vertexScores[other[1]] + vertexScores[other[2]];
+					if (triangleScores[t] > bestScore)
+					{
+						bestScore = triangleScores[t];
+						best = t;
+					}
+				}
+			}
+			if (nextCache.size() > FORSYTH_CACHE_SIZE)
+			{
+				nextCache.resize(FORSYTH_CACHE_SIZE);
+			}
+			cache.swap(nextCache);
+		}
+		indices.swap(result);
+	}
+
+	/**
+	 * Cluster starts: wherever all three vertices of a triangle miss (the ordering started over),
+	 * and inside those wherever the cluster so far is already within the threshold of the whole
+	 * cluster's ACMR. Every cluster starts on a cold cache, so drawing them in any order keeps
+	 * the ACMR within the threshold.
+	 */
+	std::vector<size_t> findClusters(const std::vector<GLuint>& indices, size_t vertexCount)
+	{
+		size_t triangleCount = indices.size() / 3;
+		std::vector<size_t> hard;
+		cacheSimulator cache(vertexCount);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			if (cache.triangleMisses(&indices[t * 3]) == 3)
+			{
+				hard.push_back(t);
+			}
+		}
+		hard.push_back(triangleCount);
+
+		std::vector<size_t> starts;
+		for (size_t c = 0; c + 1 < hard.size(); c++)
+		{
+			size_t begin = hard[c], end = hard[c + 1], misses = 0;
+			cache.flush();
+			for (size_t t = begin; t < end; t++)
+			{
+				misses += cache.triangleMisses(&indices[t * 3]);
+			}
+			float threshold = OVERDRAW_CLUSTER_THRESHOLD * misses / (end - begin);
+
+			cache.flush();
+			starts.push_back(begin);
+			size_t start = begin;
+			misses = 0;
+			for (size_t t = begin; t + 1 < end; t++)
+			{
+				misses += cache.triangleMisses(&indices[t * 3]);
+				if (misses <= threshold * (t + 1 - start))
+				{
+					starts.push_back(t + 1);
+					start = t + 1;
+					misses = 0;
+					cache.flush();
+				}
+			}
+		}
+		starts.push_back(triangleCount);
+		return starts;
+	}
+
+	//	view independent occlusion potential: how far out of the mesh centre a cluster faces
+	size_t optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<vertex>& vertices)
+	{
+		std::vector<size_t> starts = findClusters(indices, vertices.size());
+		size_t clusterCount = starts.size() - 1;
+		std::vector<glm::vec3> centroids(clusterCount), normals(clusterCount);
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+		for (size_t c = 0; c < clusterCount; c++)
+		{
+			glm::vec3 centroid(0.0f), normal(0.0f);
+			float area = 0.0f;
+			for (size_t t = starts[c]; t < starts[c + 1]; t++)
+			{
+				const glm::vec3& a = vertices[indices[t * 3]].position;
+				const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+				const glm::vec3& d = vertices[indices[t * 3 + 2]].position;
+				glm::vec3 n = glm::cross(b - a, d - a);
+				float triangleArea = glm::length(n);
+				centroid += (a + b + d) * (triangleArea / 3.0f);
+				normal += n;
+				area += triangleArea;
+			}
+			meshCentroid += centroid;
+			meshArea += area;
+			centroids[c] = area > 0.0f ? centroid / area : vertices[indices[starts[c] * 3]].position;
+			float length = glm::length(normal);
+			normals[c] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+		}
+		if (meshArea > 0.0f)
+		{
+			meshCentroid /= meshArea;
+		}
+
+		std::vector<float> keys(clusterCount);
+		std::vector<size_t> order(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++)
+		{
+			keys[c] = glm::dot(centroids[c] - meshCentroid, normals[c]);
+			order[c] = c;
+		}
+		std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b)
+		{
+			return keys[a] > keys[b];
+		});
+
+		std::vector<GLuint> result;
+		result.reserve(indices.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			result.insert(result.end(), indices.begin() + starts[order[i]] * 3, indices.begin() + starts[order[i] + 1] * 3);
+		}
+		indices.swap(result);
+		return clusterCount;
+	}
+
+	//	each level starts from the one before, so errors only grow along the chain
+	void buildLods(meshData& mesh)
+	{
+		meshLod full = { 0, (GLuint)mesh.indices.size(), 0.0f };
+		mesh.lods.assign(1, full);
+		if (mesh.indices.size() < LOD_MIN_TRIANGLES * 3)
+		{
+			return;
+		}
+
+		MeshSimplifier simplifier(mesh.vertices, mesh.indices);
+		std::vector<GLuint> levels;
+		size_t previous = mesh.indices.size();
+		while (mesh.lods.size() < MESH_LOD_MAX)
+		{
+			size_t target = (size_t)(previous / 3 * LOD_REDUCTION) * 3;
+			float error = simplifier.simplify(target);
+			std::vector<GLuint> level = simplifier.getIndices();
+			if (level.empty() || level.size() > previous * LOD_MIN_GAIN)
+			{
+				break;
+			}
+			optimizeVertexCache(level, mesh.vertices.size());
+			meshLod lod = { (GLuint)(mesh.indices.size() + levels.size()), (GLuint)level.size(), error };
+			mesh.lods.push_back(lod);
+			levels.insert(levels.end(), level.begin(), level.end());
+			previous = level.size();
+		}
+		mesh.indices.insert(mesh.indices.end(), levels.begin(), levels.end());
+	}
+
+	//	first use order; vertices no triangle references are dropped on the way
+	void optimizeVertexFetch(meshData& mesh)
+	{
+		const GLuint unused = ~0u;
+		std::vector<GLuint> remap(mesh.vertices.size(), unused);
+		std::vector<vertex> vertices;
+		vertices.reserve(mesh.vertices.size());
+		for (size_t i = 0; i < mesh.indices.size(); i++)
+		{
+			GLuint& index = mesh.indices[i];
+			if (remap[index] == unused)
+			{
+				remap[index] = vertices.size();
+				vertices.push_back(mesh.vertices[index]);
+			}
+			index = remap[index];
+		}
+		mesh.vertices.swap(vertices);
+	}
+}
+
+void optimizeMesh(meshData& mesh, meshOptimizationStats& stats)
+{
+	stats.verticesBefore = mesh.vertices.size();
+	stats.triangles = mesh.indices.size() / 3;
+	stats.missesBefore = countMisses(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+	stats.clusters = 0;
+	mesh.lods.clear();
+
+	//	processMesh only emits triangles, anything else is left alone
+	if (mesh.indices.size() % 3 == 0)
+	{
+		deduplicateVertices(mesh);
+		optimizeVertexCache(mesh.indices, mesh.vertices.size());
+		if (stats.triangles > 0)
+		{
+			stats.clusters = optimizeOverdraw(mesh.indices, mesh.vertices);
+		}
+		buildLods(mesh);
+		optimizeVertexFetch(mesh);
+	}
+
+	size_t fullIndices = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount;
+	stats.verticesAfter = mesh.vertices.size();
+	stats.missesAfter = countMisses(mesh.indices.data(), fullIndices, mesh.vertices.size());
+	for (size_t i = 0; i < MESH_LOD_MAX; i++)
+	{
+		stats.lodTriangles[i] = mesh.lods.empty() ? stats.triangles : mesh.lods[std::min(i, mesh.lods.size() - 1)].indexCount / 3;
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef _MESH_OPTIMIZER_H
+#define _MESH_OPTIMIZER_H
+
+#include "model_mesh.h"
+
+#define VERTEX_CACHE_SIZE			16		//	FIFO entries of the post-transform cache the statistics simulate
+#define FORSYTH_CACHE_SIZE			32		//	LRU entries the reordering scores against
+#define OVERDRAW_CLUSTER_THRESHOLD	1.05f	//	ACMR a cluster may give up so it can be drawn out of order
+#define LOD_MIN_TRIANGLES			64		//	smaller meshes only have their full resolution level
+#define LOD_REDUCTION				0.5f	//	triangles each level aims for, relative to the one before
+#define LOD_MIN_GAIN				0.8f	//	a level keeping more than this of the one before is dropped, and the chain ends
+
+//	ACMR is misses per triangle, ATVR misses per vertex; 1.0 is the ideal for ATVR, about 0.5 for ACMR
+struct meshOptimizationStats
+{
+	size_t verticesBefore, verticesAfter;
+	size_t triangles;
+	size_t missesBefore, missesAfter;
+	size_t clusters;
+	size_t lodTriangles[MESH_LOD_MAX];	//	levels a mesh does not have count as its coarsest
+};
+
+/**
+ * Import-time pass over one mesh, safe to run on pool threads:
+ * - merges bitwise identical vertices through a hash table
+ * - reorders triangles for the post-transform cache (Forsyth's linear speed algorithm)
+ * - cuts the result into clusters where the cache restarts or can afford to, and draws the
+ *   outward facing clusters first so they occlude the rest (Sander et al., Tipsify)
+ * - simplifies the result into a chain of coarser levels (MeshSimplifier), each cache optimized
+ *   and appended to the same index buffer
+ * - renumbers vertices in first use order so vertex fetch walks memory linearly
+ */
+void optimizeMesh(meshData&, meshOptimizationStats&);
+
+#endif
@@ -0,0 +1,397 @@
+#include "mesh_simplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+MeshSimplifier::MeshSimplifier(const std::vector<vertex>& _vertices, const std::vector<GLuint>& _indices) :
+	vertices(_vertices), canonical(_vertices.size()), indices(_indices), quadrics(_vertices.size()),
+	kinds(_vertices.size(), KIND_LOCKED), remap(_vertices.size()), error(0.0f)
+{
+	//	weld by exact position through an open addressing table, at most half full
+	size_t tableSize = 1;
+	while (tableSize < vertices.size() * 2)
+	{
+		tableSize *= 2;
+	}
+	const GLuint empty = ~0u;
+	std::vector<GLuint> table(tableSize, empty);
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		GLuint words[3];
+		memcpy(words, &vertices[i].position, sizeof(words));
+		size_t slot = ((words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u)) & (tableSize - 1);
+		while (table[slot] != empty && memcmp(&vertices[table[slot]].position, &vertices[i].position, sizeof(words)))
+		{
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		if (table[slot] == empty)
+		{
+			table[slot] = i;
+		}
+		canonical[i] = table[slot];
+		remap[i] = i;
+	}
+
+	memset(quadrics.data(), 0, quadrics.size() * sizeof(quadric));
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		const glm::vec3& p0 = position(indices[t]);
+		glm::vec3 normal = glm::cross(position(indices[t + 1]) - p0, position(indices[t + 2]) - p0);
+		float length = glm::length(normal);
+		if (length > 0.0f)
+		{
+			normal /= length;
+			for (int k = 0; k < 3; k++)
+			{
+				addPlane(quadrics[canonical[indices[t + k]]], normal, -glm::dot(normal, p0), length * 0.5);
+			}
+		}
+	}
+	analyze();
+	addBorderQuadrics();
+}
+
+/**
+ * Collapses the cheapest edges until at most the given number of indices is left or nothing
+ * more can go. Each pass ranks every allowed collapse by its quadric error, then applies them
+ * in order while they do not touch a neighbourhood already changed in the same pass.
+ * Returns the largest error so far, an object space distance.
+ */
+float MeshSimplifier::simplify(size_t targetIndexCount)
+{
+	std::vector<collapse> candidates;
+	while (indices.size() > targetIndexCount)
+	{
+		candidates.clear();
+		for (std::unordered_map<unsigned long long, edgeWedges>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+		{
+			GLuint a = (GLuint)(it->first >> 32), b = (GLuint)it->first;
+			std::unordered_map<unsigned long long, edgeWedges>::const_iterator reverse = edges.find(edgeKey(b, a));
+			bool open = reverse == edges.end();
+			bool seam = !open && (reverse->second.from != it->second.to || reverse->second.to != it->second.from);
+
+			//	closed edges come up once per direction, open ones only once
+			GLuint ends[2][2] = { { a, b }, { b, a } };
+			for (int d = 0; d < (open ? 2 : 1); d++)
+			{
+				GLuint from = ends[d][0], to = ends[d][1];
+				bool allowed = kinds[from] == KIND_MANIFOLD ||
+					(kinds[from] == KIND_BORDER && open && (kinds[to] == KIND_BORDER || kinds[to] == KIND_LOCKED)) ||
+					(kinds[from] == KIND_SEAM && seam && (kinds[to] == KIND_SEAM || kinds[to] == KIND_LOCKED));
+				if (allowed)
+				{
+					quadric q = quadrics[from];
+					addQuadric(q, quadrics[to]);
+					collapse c = { from, to, evaluate(q, position(to)) };
+					candidates.push_back(c);
+				}
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(), [](const collapse& a, const collapse& b)
+		{
+			return a.cost < b.cost;
+		});
+
+		touched.assign(vertices.size(), 0);
+		size_t indexCount = indices.size();
+		bool progress = false;
+		for (size_t i = 0; i < candidates.size() && indexCount > targetIndexCount; i++)
+		{
+			progress |= tryCollapse(candidates[i], indexCount);
+		}
+		if (!progress)
+		{
+			break;
+		}
+
+		size_t kept = 0;
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			GLuint i0 = remap[indices[t]], i1 = remap[indices[t + 1]], i2 = remap[indices[t + 2]];
+			GLuint c0 = canonical[i0], c1 = canonical[i1], c2 = canonical[i2];
+			if (c0 != c1 && c1 != c2 && c0 != c2)
+			{
+				indices[kept++] = i0;
+				indices[kept++] = i1;
+				indices[kept++] = i2;
+			}
+		}
+		indices.resize(kept);
+		for (size_t v = 0; v < remap.size(); v++)
+		{
+			remap[v] = v;
+		}
+		analyze();
+	}
+	return error;
+}
+
+const std::vector<GLuint>& MeshSimplifier::getIndices() const
+{
+	return indices;
+}
+
+//	rebuilds triangle adjacency, the directed edge map and the kind of every vertex
+void MeshSimplifier::analyze()
+{
+	size_t vertexCount = vertices.size(), indexCount = indices.size() / 3 * 3;
+	offsets.assign(vertexCount + 1, 0);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		offsets[canonical[indices[i]] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		offsets[v + 1] += offsets[v];
+	}
+	adjacency.resize(indexCount);
+	std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		adjacency[fill[canonical[indices[i]]]++] = i / 3;
+	}
+
+	//	up to two distinct vertices per position are a seam, more are locked
+	const GLuint none = ~0u;
+	std::vector<GLuint> wedges[2] = { std::vector<GLuint>(vertexCount, none), std::vector<GLuint>(vertexCount, none) };
+	std::vector<unsigned char> open(vertexCount, 0), locked(vertexCount, 0);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		GLuint v = indices[i], c = canonical[v];
+		if (wedges[0][c] == none || wedges[0][c] == v)
+		{
+			wedges[0][c] = v;
+		}
+		else if (wedges[1][c] == none || wedges[1][c] == v)
+		{
+			wedges[1][c] = v;
+		}
+		else
+		{
+			locked[c] = 1;
+		}
+	}
+
+	edges.clear();
+	edges.reserve(indexCount);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		GLuint from = indices[i], to = indices[i - i % 3 + (i + 1) % 3];
+		edgeWedges e = { from, to, (GLuint)(i / 3) };
+		if (!edges.insert(std::make_pair(edgeKey(canonical[from], canonical[to]), e)).second)
+		{
+			//	the same directed edge twice is non-manifold or folded, leave it alone
+			locked[canonical[from]] = locked[canonical[to]] = 1;
+		}
+	}
+	for (std::unordered_map<unsigned long long, edgeWedges>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+	{
+		GLuint a = (GLuint)(it->first >> 32), b = (GLuint)it->first;
+		if (edges.find(edgeKey(b, a)) == edges.end())
+		{
+			open[a] = open[b] = 1;
+		}
+	}
+
+	for (size_t c = 0; c < vertexCount; c++)
+	{
+		if (locked[c] || wedges[0][c] == none || canonical[c] != c)
+		{
+			kinds[c] = KIND_LOCKED;
+		}
+		else if (wedges[1][c] == none)
+		{
+			kinds[c] = open[c] ? KIND_BORDER : KIND_MANIFOLD;
+		}
+		else
+		{
+			kinds[c] = open[c] ? KIND_LOCKED : KIND_SEAM;
+		}
+	}
+}
+
+//	planes through open and seam edges, perpendicular to their triangle, keep their outline in place
+void MeshSimplifier::addBorderQuadrics()
+{
+	for (std::unordered_map<unsigned long long, edgeWedges>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+	{
+		GLuint a = (GLuint)(it->first >> 32), b = (GLuint)it->first;
+		std::unordered_map<unsigned long long, edgeWedges>::const_iterator reverse = edges.find(edgeKey(b, a));
+		if (reverse != edges.end() && reverse->second.from == it->second.to && reverse->second.to == it->second.from)
+		{
+			continue;
+		}
+
+		const GLuint* tri = &indices[it->second.triangle * 3];
+		glm::vec3 normal = glm::cross(position(tri[1]) - position(tri[0]), position(tri[2]) - position(tri[0]));
+		glm::vec3 edge = position(b) - position(a);
+		glm::vec3 plane = glm::cross(edge, normal);
+		float length = glm::length(plane);
+		if (length > 0.0f)
+		{
+			plane /= length;
+			double weight = glm::dot(edge, edge) * SIMPLIFY_BORDER_WEIGHT;
+			addPlane(quadrics[a], plane, -glm::dot(plane, position(a)), weight);
+			addPlane(quadrics[b], plane, -glm::dot(plane, position(a)), weight);
+		}
+	}
+}
+
+/**
+ * Moves every vertex at the position of c.from onto the vertex at c.to that it shares a
+ * triangle with, provided each of them finds exactly one and no remaining triangle flips.
+ * indexCount is lowered by the triangles that degenerate.
+ */
+bool MeshSimplifier::tryCollapse(const collapse& c, size_t& indexCount)
+{
+	GLuint a = c.from, b = c.to;
+	if (touched[a] || touched[b])
+	{
+		return false;
+	}
+
+	GLuint wedgeFrom[2], wedgeTo[2];
+	int mapped = 0;
+	size_t removed = 0;
+	for (GLuint j = offsets[a]; j < offsets[a + 1]; j++)
+	{
+		const GLuint* tri = &indices[adjacency[j] * 3];
+		int ka = -1, kb = -1;
+		for (int k = 0; k < 3; k++)
+		{
+			if (canonical[tri[k]] == a)
+			{
+				ka = k;
+			}
+			else if (canonical[tri[k]] == b)
+			{
+				kb = k;
+			}
+		}
+		if (kb < 0)
+		{
+			continue;
+		}
+		removed++;
+		int m = 0;
+		while (m < mapped && wedgeFrom[m] != tri[ka])
+		{
+			m++;
+		}
+		if (m == mapped)
+		{
+			if (mapped == 2)
+			{
+				return false;
+			}
+			wedgeFrom[mapped] = tri[ka];
+			wedgeTo[mapped++] = tri[kb];
+		}
+		else if (wedgeTo[m] != tri[kb])
+		{
+			return false;
+		}
+	}
+	if (removed == 0)
+	{
+		return false;
+	}
+
+	for (GLuint j = offsets[a]; j < offsets[a + 1]; j++)
+	{
+		const GLuint* tri = &indices[adjacency[j] * 3];
+		glm::vec3 before[3], after[3];
+		int ka = -1;
+		bool shared = false;
+		for (int k = 0; k < 3; k++)
+		{
+			before[k] = after[k] = position(tri[k]);
+			ka = canonical[tri[k]] == a ? k : ka;
+			shared |= canonical[tri[k]] == b;
+		}
+		if (shared)
+		{
+			continue;
+		}
+		int m = 0;
+		while (m < mapped && wedgeFrom[m] != tri[ka])
+		{
+			m++;
+		}
+		if (m == mapped)
+		{
+			return false;
+		}
+		after[ka] = position(b);
+		glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+		glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+		if (glm::dot(normalBefore, normalAfter) <= 0.0f)
+		{
+			return false;
+		}
+	}
+
+	for (int m = 0; m < mapped; m++)
+	{
+		remap[wedgeFrom[m]] = wedgeTo[m];
+	}
+	for (GLuint j = offsets[a]; j < offsets[a + 1]; j++)
+	{
+		const GLuint* tri = &indices[adjacency[j] * 3];
+		touched[canonical[tri[0]]] = touched[canonical[tri[1]]] = touched[canonical[tri[2]]] = 1;
+	}
+	addQuadric(quadrics[b], quadrics[a]);
+	error = std::max(error, std::sqrt(c.cost));
+	indexCount -= std::min(indexCount, removed * 3);
+	return true;
+}
+
+//	weighted mean squared distance of a point to the planes of a quadric
+float MeshSimplifier::evaluate(const quadric& q, const glm::vec3& p) const
+{
+	double x = p.x, y = p.y, z = p.z;
+	double res = q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x
+		+ q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y
+		+ q.c2 * z * z + 2.0 * q.cd * z + q.d2;
+	return (float)(std::max(res, 0.0) / std::max(q.weight, 1.0e-12));
+}
+
+const glm::vec3& MeshSimplifier::position(GLuint v) const
+{
+	return vertices[v].position;
+}
+
+void MeshSimplifier::addPlane(quadric& q, const glm::vec3& n, float d, double weight)
+{
+	q.a2 += weight * n.x * n.x;
+	q.ab += weight * n.x * n.y;
+	q.ac += weight * n.x * n.z;
+	q.ad += weight * n.x * d;
+	q.b2 += weight * n.y * n.y;
+	q.bc += weight * n.y * n.z;
+	q.bd += weight * n.y * d;
+	q.c2 += weight * n.z * n.z;
+	q.cd += weight * n.z * d;
+	q.d2 += weight * d * d;
+	q.weight += weight;
+}
+
+void MeshSimplifier::addQuadric(quadric& q, const quadric& other)
+{
+	q.a2 += other.a2;
+	q.ab += other.ab;
+	q.ac += other.ac;
+	q.ad += other.ad;
+	q.b2 += other.b2;
+	q.bc += other.bc;
+	q.bd += other.bd;
+	q.c2 += other.c2;
+	q.cd += other.cd;
+	q.d2 += other.d2;
+	q.weight += other.weight;
+}
+
+unsigned long long MeshSimplifier::edgeKey(GLuint a, GLuint b)
+{
+	return (unsigned long long)a << 32 | b;
+}
@@ -0,0 +1,76 @@
+#ifndef _MESH_SIMPLIFIER_H
+#define _MESH_SIMPLIFIER_H
+
+#include "vertex_format.h"
+#include <unordered_map>
+#include <vector>
+
+#define SIMPLIFY_BORDER_WEIGHT	10.0f	//	how strongly open borders and attribute seams keep their shape
+
+/**
+ * Quadric error metric simplification (Garland & Heckbert) by half edge collapses: a vertex only
+ * ever moves onto one of its neighbours, so every level indexes the original vertex buffer.
+ * Topology is taken from positions, so vertices split for normals or texture coordinates
+ * collapse together along their seam instead of tearing it open; open borders only collapse
+ * along themselves and collapses that would flip a triangle are rejected.
+ * Calls to simplify() continue from the previous result, building a chain of levels.
+ */
+class MeshSimplifier
+{
+	public:
+		MeshSimplifier(const std::vector<vertex>&, const std::vector<GLuint>&);
+
+		float simplify(size_t);
+		const std::vector<GLuint>& getIndices() const;
+
+	private:
+		//	symmetric 4x4 matrix of summed plane equations, weighted by area
+		struct quadric
+		{
+			double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+			double weight;
+		};
+
+		//	the vertices a triangle uses along one of its edges, differing ones across an edge make a seam
+		struct edgeWedges
+		{
+			GLuint from, to;
+			GLuint triangle;
+		};
+
+		struct collapse
+		{
+			GLuint from, to;
+			float cost;
+		};
+
+		enum vertexKind
+		{
+			KIND_MANIFOLD,
+			KIND_BORDER,
+			KIND_SEAM,
+			KIND_LOCKED
+		};
+
+		const std::vector<vertex>& vertices;
+		std::vector<GLuint> canonical;		//	lowest vertex with the same position
+		std::vector<GLuint> indices;
+		std::vector<quadric> quadrics;		//	by canonical vertex
+		std::vector<unsigned char> kinds;
+		std::unordered_map<unsigned long long, edgeWedges> edges;	//	directed canonical edge -> vertices that carry it
+		std::vector<GLuint> offsets, adjacency;						//	canonical vertex -> triangles
+		std::vector<GLuint> remap;
+		std::vector<unsigned char> touched;
+		float error;
+
+		void analyze();
+		void addBorderQuadrics();
+		bool tryCollapse(const collapse&, size_t&);
+		float evaluate(const quadric&, const glm::vec3&) const;
+		const glm::vec3& position(GLuint) const;
+		static void addPlane(quadric&, const glm::vec3&, float, double);
+		static void addQuadric(quadric&, const quadric&);
+		static unsigned long long edgeKey(GLuint, GLuint);
+};
+
+#endif
@@ -1,138 +1,715 @@
 #include "model.h"
+#include "animation.h"
+#include "mesh_cache.h"
+#include "obj_loader.h"
+#include "profiler.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 
-Model::Model(const std::string& _absPath) : absPath(_absPath)
+namespace
 {
-	import();
+	//	pixels one object space unit covers at the nearest point of the bounds, negative once the camera is inside them
+	float pixelsPerUnit(const glm::mat4& viewProjection, const glm::mat4& model, const boundingVolume& bounds, float projectionScale)
+	{
+		glm::mat3 basis(model);
+		float scale = std::max(glm::length(basis[0]), std::max(glm::length(basis[1]), glm::length(basis[2])));
+		float distance = (viewProjection * model * glm::vec4(bounds.center, 1.0f)).w - bounds.radius * scale;
+		if (distance <= 0.0f)
+		{
+			return -1.0f;
+		}
+		return projectionScale * scale / distance;
+	}
+
+	//	coarsest level within the pixel error; going coarser than the current level needs some margin so levels do not flicker
+	unsigned char selectLod(const float* errors, float pixels, unsigned char current)
+	{
+		unsigned char lod = 0;
+		for (unsigned char i = 1; pixels >= 0.0f && i < MESH_LOD_MAX; i++)
+		{
+			float limit = i > current ? LOD_PIXEL_ERROR / LOD_HYSTERESIS : LOD_PIXEL_ERROR;
+			if (errors[i] * pixels > limit)
+			{
+				break;
+			}
+			lod = i;
+		}
+		return lod;
+	}
+}
+
+Model::Model(const std::string& _absPath, renderContext& _context, bool deferred) :
+	absPath(_absPath), context(_context), scene(nullptr), commandsGeneration(~0u), instanceRefits(0), queued(false)
+{
+	bounds.min = bounds.max = bounds.center = glm::vec3(0.0f);
+	bounds.radius = 0.0f;
+	std::fill(modelLodErrors, modelLodErrors + MESH_LOD_MAX, 0.0f);
+	if (!deferred)
+	{
+		import();
+	}
+}
+
+//	RenderQueue marks the model while it holds it, false when it is queued already
+bool Model::enqueue()
+{
+	if (queued)
+	{
+		return false;
+	}
+	queued = true;
+	return true;
+}
+
+void Model::dequeue()
+{
+	queued = false;
+}
+
+//	on the GL thread before a frame's recording: afterwards record() only reads shared state
+/**
+ * Called on the GL thread before the frame's record() calls. A set of several instances is
+ * culled here as a whole through a hierarchy over the world bounds of its instances, so whole
+ * blocks of a large set are kept or dropped with one test; culled instances are added to the
+ * stats. Returns the range record() is then called over: the visible instances of a set, or
+ * the one instance, which is culled per part while recording.
+ */
+size_t Model::prepareRecording(const glm::mat4& viewProjection, const glm::mat4* transforms, size_t instanceCount, cullingStats& culling)
+{
+	if (commandsGeneration != context.meshArena.getGeneration())
+	{
+		buildDrawCommands();
+	}
+	instanceLods.resize(instanceCount, 0);
+	if (instanceCount <= 1 || modelParts.empty())
+	{
+		return modelParts.empty() ? 0 : instanceCount;
+	}
+
+	updateInstanceHierarchy(transforms, instanceCount);
+	visibleInstances.clear();
+	instanceHierarchy.cull(Frustum(viewProjection), visibleInstances);
+	culling.culled += modelParts.size() * (instanceCount - visibleInstances.size());
+	return visibleInstances.size();
+}
+
+//	only instances whose transform changed get new bounds; the tree is refit, or built anew when the set changed size
+void Model::updateInstanceHierarchy(const glm::mat4* transforms, size_t count)
+{
+	bool rebuild = instanceBounds.size() != count || instanceRefits >= INSTANCE_REFITS;
+	if (rebuild)
+	{
+		instanceTransforms.assign(transforms, transforms + count);
+		instanceBounds.resize(count);
+	}
+	size_t chunks = (count + INSTANCE_CHUNK - 1) / INSTANCE_CHUNK;
+	movedChunks.assign(chunks, 0);
+	context.threadPool.parallelFor(chunks, [this, transforms, count, rebuild](size_t c)
+	{
+		for (size_t i = c * INSTANCE_CHUNK; i < std::min(count, (c + 1) * INSTANCE_CHUNK); i++)
+		{
+			if (rebuild || memcmp(&instanceTransforms[i], &transforms[i], sizeof(glm::mat4)) != 0)
+			{
+				instanceTransforms[i] = transforms[i];
+				instanceBounds[i] = transformBounds(bounds, transforms[i]);
+				movedChunks[c] = 1;
+			}
+		}
+	});
+
+	if (rebuild)
+	{
+		instanceHierarchy.build(instanceBounds);
+		instanceRefits = 0;
+	}
+	else if (std::find(movedChunks.begin(), movedChunks.end(), 1) != movedChunks.end())
+	{
+		instanceHierarchy.refit(instanceBounds);
+		instanceRefits++;
+	}
+}
+
+/**
+ * Records the range [first, last) given by prepareRecording() for the frame. A set of one
+ * instance is culled and given a level of detail per part through the hierarchy; the visible
+ * instances of a larger set are given a level per instance against the model bounds, then
+ * grouped by level so each level is one draw per part carrying its instance count. No GL calls
+ * and no shared writes other than the levels of the instances in range, so disjoint ranges of
+ * a set and different models can be recorded on several threads at once.
+ */
+cullingStats Model::record(const glm::mat4& viewProjection, float projectionScale, const glm::mat4* transforms,
+	size_t instanceCount, size_t first, size_t last, drawBatch& batch)
+{
+	batch.commands.clear();
+	batch.records.clear();
+	batch.instances.clear();
+	std::fill(batch.variantDraws, batch.variantDraws + MATERIAL_VARIANTS + 1, 0);
+	std::fill(batch.triangles, batch.triangles + MATERIAL_VARIANTS, 0);
+	cullingStats& stats = batch.culling;
+	stats.visible = stats.culled = 0;
+	if (modelParts.empty() || first >= last)
+	{
+		return stats;
+	}
+
+	batch.visible.clear();
+	size_t visibleParts = 0;
+	const GLuint* parts = partsByVariant.data();
+	const GLuint* partRanges = variantParts;
+	if (instanceCount == 1)
+	{
+		//	planes taken from the full mvp are the frustum in model space, so part bounds are tested untransformed
+		batch.parts.clear();
+		partsHierarchy.cull(Frustum(viewProjection * transforms[0]), batch.parts);
+		for (size_t i = 0; i < batch.parts.size(); i++)
+		{
+			GLuint part = batch.parts[i];
+			float pixels = pixelsPerUnit(viewProjection, transforms[0], modelParts[part].getBounds(), projectionScale);
+			partLods[part] = selectLod(&lodErrors[part * MESH_LOD_MAX], pixels, partLods[part]);
+		}
+		groupPartsByVariant(batch.parts, batch.grouped, batch.partRanges);
+		parts = batch.grouped.data();
+		partRanges = batch.partRanges;
+		visibleParts = batch.parts.size();
+		if (visibleParts > 0)
+		{
+			batch.visible.push_back(0);
+		}
+	}
+	else
+	{
+		batch.visible.assign(visibleInstances.begin() + first, visibleInstances.begin() + last);
+		visibleParts = batch.visible.empty() ? 0 : modelParts.size();
+		sortInstancesByLod(viewProjection, transforms, projectionScale, batch);
+	}
+	stats.visible = visibleParts * batch.visible.size();
+	stats.culled = instanceCount == 1 ? modelParts.size() - stats.visible : 0;
+	if (stats.visible == 0)
+	{
+		return stats;
+	}
+
+	writeInstances(transforms, batch);
+	for (size_t v = 0; v < MATERIAL_VARIANTS; v++)
+	{
+		batch.variantDraws[v] = batch.commands.size();
+		for (size_t i = partRanges[v]; instanceCount == 1 && i < partRanges[v + 1]; i++)
+		{
+			GLuint part = parts[i];
+			batch.commands.push_back(commands[part * MESH_LOD_MAX + partLods[part]]);
+			batch.commands.back().instanceCount = 1;
+			batch.records.push_back(records[part]);
+			batch.triangles[v] += batch.commands.back().count / 3;
+		}
+		for (size_t lod = 0; instanceCount > 1 && lod < MESH_LOD_MAX; lod++)
+		{
+			GLuint firstInstance = batch.lodInstances[lod], count = batch.lodInstances[lod + 1] - firstInstance;
+			for (size_t i = partRanges[v]; count > 0 && i < partRanges[v + 1]; i++)
+			{
+				GLuint part = parts[i];
+				batch.commands.push_back(commands[part * MESH_LOD_MAX + lod]);
+				batch.commands.back().instanceCount = count;
+				batch.records.push_back(records[part]);
+				batch.records.back().firstInstance = firstInstance;
+				batch.triangles[v] += (unsigned long long)(batch.commands.back().count / 3) * count;
+			}
+		}
+	}
+	batch.variantDraws[MATERIAL_VARIANTS] = batch.commands.size();
+	return stats;
 }
 
-void Model::render(GLuint programm)
+const boundingVolume& Model::getBounds() const
 {
+	return bounds;
+}
+
+//	commands only change when parts are added or the arena relocates its buffers
+void Model::buildDrawCommands()
+{
+	commands.resize(modelParts.size() * MESH_LOD_MAX);
+	records.resize(modelParts.size());
+	partVariants.resize(modelParts.size());
 	for (size_t i = 0; i < modelParts.size(); i++)
 	{
-		modelParts[i].render(programm);
+		partVariants[i] = context.materials.getVariant(modelParts[i].getMaterialID());
+		for (size_t lod = 0; lod < MESH_LOD_MAX; lod++)
+		{
+			commands[i * MESH_LOD_MAX + lod] = modelParts[i].getDrawCommand(lod);
+		}
+		records[i].materialID = modelParts[i].getMaterialID();
+		records[i].firstInstance = 0;
+		records[i].boneCount = records[i].padding = 0;
+		const vertexDequantization& dequantization = modelParts[i].getDequantization();
+		for (int c = 0; c < 3; c++)
+		{
+			records[i].positionScale[c] = dequantization.positionScale[c];
+			records[i].positionOffset[c] = dequantization.positionOffset[c];
+		}
+		records[i].positionScale[3] = records[i].positionOffset[3] = 0.0f;
+		records[i].texCoordTransform[0] = dequantization.texCoordScale.x;
+		records[i].texCoordTransform[1] = dequantization.texCoordScale.y;
+		records[i].texCoordTransform[2] = dequantization.texCoordOffset.x;
+		records[i].texCoordTransform[3] = dequantization.texCoordOffset.y;
+	}
+	std::vector<GLuint> parts(modelParts.size());
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		parts[i] = i;
+	}
+	groupPartsByVariant(parts, partsByVariant, variantParts);
+	commandsGeneration = context.meshArena.getGeneration();
+}
+
+//	counting sort of parts by material variant, stable so the hierarchy order is kept within a variant
+void Model::groupPartsByVariant(const std::vector<GLuint>& parts, std::vector<GLuint>& grouped, GLuint* ranges) const
+{
+	GLuint counts[MATERIAL_VARIANTS] = { 0 };
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		counts[partVariants[parts[i]]]++;
+	}
+	GLuint next[MATERIAL_VARIANTS];
+	ranges[0] = 0;
+	for (size_t v = 0; v < MATERIAL_VARIANTS; v++)
+	{
+		next[v] = ranges[v];
+		ranges[v + 1] = ranges[v] + counts[v];
+	}
+	grouped.resize(parts.size());
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		grouped[next[partVariants[parts[i]]]++] = parts[i];
+	}
+}
+
+//	a model level is as coarse as its coarsest part at that level, so one level fits every part of an instance
+void Model::buildLodErrors()
+{
+	lodErrors.resize(modelParts.size() * MESH_LOD_MAX);
+	std::fill(modelLodErrors, modelLodErrors + MESH_LOD_MAX, 0.0f);
+	for (size_t i = 0; i < modelParts.size(); i++)
+	{
+		const std::vector<meshLod>& lods = modelParts[i].getLods();
+		for (size_t lod = 0; lod < MESH_LOD_MAX; lod++)
+		{
+			float error = lods[std::min(lod, lods.size() - 1)].error;
+			lodErrors[i * MESH_LOD_MAX + lod] = error;
+			modelLodErrors[lod] = std::max(modelLodErrors[lod], error);
+		}
+	}
+	partLods.assign(modelParts.size(), 0);
+}
+
+//	counting sort of the visible instances by level, stable so instances keep their order within a level
+void Model::sortInstancesByLod(const glm::mat4& viewProjection, const glm::mat4* transforms, float projectionScale, drawBatch& batch)
+{
+	GLuint counts[MESH_LOD_MAX] = { 0 };
+	for (size_t i = 0; i < batch.visible.size(); i++)
+	{
+		GLuint instance = batch.visible[i];
+		float pixels = pixelsPerUnit(viewProjection, transforms[instance], bounds, projectionScale);
+		instanceLods[instance] = selectLod(modelLodErrors, pixels, instanceLods[instance]);
+		counts[instanceLods[instance]]++;
+	}
+
+	GLuint next[MESH_LOD_MAX];
+	batch.lodInstances[0] = 0;
+	for (size_t lod = 0; lod < MESH_LOD_MAX; lod++)
+	{
+		next[lod] = batch.lodInstances[lod];
+		batch.lodInstances[lod + 1] = batch.lodInstances[lod] + counts[lod];
+	}
+	batch.sorted.resize(batch.visible.size());
+	for (size_t i = 0; i < batch.visible.size(); i++)
+	{
+		batch.sorted[next[instanceLods[batch.visible[i]]]++] = batch.visible[i];
+	}
+	batch.visible.swap(batch.sorted);
+}
+
+//	normal matrices are derived on the recording thread
+void Model::writeInstances(const glm::mat4* transforms, drawBatch& batch) const
+{
+	batch.instances.resize(batch.visible.size());
+	for (size_t i = 0; i < batch.visible.size(); i++)
+	{
+		const glm::mat4& model = transforms[batch.visible[i]];
+		batch.instances[i].model = model;
+		batch.instances[i].normalMatrix = getNormalMatrix(model);
 	}
 }
 
+//	the cofactors of the upper 3x3 are its inverse transpose times the determinant, so no division is needed;
+//	the fragment shader normalizes the scale away
+glm::mat4 Model::getNormalMatrix(const glm::mat4& model)
+{
+	glm::mat3 basis(model);
+	glm::vec3 x = glm::cross(basis[1], basis[2]), y = glm::cross(basis[2], basis[0]), z = glm::cross(basis[0], basis[1]);
+	float sign = glm::dot(basis[0], x) < 0.0f ? -1.0f : 1.0f;
+	return glm::mat4(glm::mat3(x * sign, y * sign, z * sign));
+}
+
 void Model::import()
 {
-	Assimp::Importer importer;
-	scene = importer.ReadFile(absPath, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
-	if (!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) 
-    {
-        std::cerr << "ERROR::ASSIMP::" << importer.GetErrorString() << '\n';
-        return;
-    }
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<meshData> meshes;
+	if (!importMeshes(meshes))
+	{
+		return;
+	}
+	packMeshes(meshes);
+	upload(meshes);
+	double totalMs = elapsedMs(start, std::chrono::steady_clock::now());
+	_log("Model " << absPath << ": loaded in " << totalMs << " ms");
+}
+
+//	runs on any thread: reads the mesh cache or imports (ObjLoader, else Assimp) and optimizes, no GL calls
+bool Model::importMeshes(std::vector<meshData>& meshes)
+{
+	PROFILE_ZONE("import model");
+	directory = absPath.substr(0, absPath.find_last_of('/'));
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	MeshCache cache(absPath, MODEL_IMPORT_FLAGS);
+	double coldImportMs = 0.0;
+	bool warm = cache.load(meshes, coldImportMs);
+	std::vector<std::string> dependencies;
+	if (!warm)
+	{
+		//	OBJ files are read natively, anything else or an OBJ the reader gives up on goes through Assimp
+		ObjLoader objLoader(context.threadPool);
+		if (ObjLoader::isObjPath(absPath) && objLoader.load(absPath, meshes))
+		{
+			dependencies = objLoader.getLibraries();
+		}
+		else
+		{
+			Assimp::Importer importer;
+			scene = importer.ReadFile(absPath, MODEL_IMPORT_FLAGS);
+			if (!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) 
+			{
+				std::cerr << "ERROR::ASSIMP::" << importer.GetErrorString() << '\n';
+				scene = nullptr;
+				return false;
+			}
 
-    directory = absPath.substr(0, absPath.find_last_of('/'));
-    processNode(scene->mRootNode);
+			//	walk the hierarchy serially, then convert every aiMesh on the pool with its node's transform baked in
+			SceneGraph graph;
+			std::vector<aiMesh*> sceneMeshes;
+			std::vector<GLuint> meshNodes;
+			processNode(scene->mRootNode, SCENE_NODE_NONE, graph, sceneMeshes, meshNodes);
+			graph.update();
+			meshes.resize(sceneMeshes.size());
+			context.threadPool.parallelFor(sceneMeshes.size(), [&](size_t i)
+			{
+				processMesh(sceneMeshes[i], graph.getWorld(meshNodes[i]), meshes[i]);
+			});
+			scene = nullptr;
+		}
+
+		std::vector<meshOptimizationStats> stats(meshes.size());
+		context.threadPool.parallelFor(meshes.size(), [&](size_t i)
+		{
+			optimizeMesh(meshes[i], stats[i]);
+			if (!meshes[i].vertices.empty())
+			{
+				meshes[i].bounds = computeBounds(&meshes[i].vertices[0].position, meshes[i].vertices.size(), sizeof(vertex));
+			}
+		});
+		reportOptimization(stats);
+
+		//	a mesh of degenerate triangles only has nothing left to draw
+		meshes.erase(std::remove_if(meshes.begin(), meshes.end(), [](const meshData& mesh)
+		{
+			return mesh.vertices.empty() || mesh.indices.empty();
+		}), meshes.end());
+
+		//	the cache goes stale with the textures the materials name, as with the material libraries
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			for (size_t t = 0; t < meshes[i].textures.size(); t++)
+			{
+				std::string path = directory + '/' + meshes[i].textures[t].filename;
+				if (std::find(dependencies.begin(), dependencies.end(), path) == dependencies.end())
+				{
+					dependencies.push_back(path);
+				}
+			}
+		}
+	}
+	double importMs = elapsedMs(start, std::chrono::steady_clock::now());
+	if (warm)
+	{
+		_log("Model " << absPath << ": warm start from " << cache.getCachePath() << ", import " << importMs
+			<< " ms (cold " << coldImportMs << " ms, x" << coldImportMs / std::max(importMs, 0.001) << ")");
+	}
+	else
+	{
+		cache.store(meshes, dependencies, importMs);
+		_log("Model " << absPath << ": cold import " << importMs << " ms");
+	}
+	return true;
 }
 
-void Model::processNode(aiNode* node)
+//	runs on any thread: vertices are packed for the arena on the pool too, checking what the format lost on the way
+void Model::packMeshes(std::vector<meshData>& meshes) const
 {
-	for (size_t i = 0; i < node->mNumMeshes; i++)
+	vertexFormat format = context.meshArena.getFormat();
+	std::vector<vertexErrorReport> errors(meshes.size());
+	context.threadPool.parallelFor(meshes.size(), [&](size_t i)
 	{
-		processMesh(scene->mMeshes[node->mMeshes[i]]);
+		errors[i].position = errors[i].normal = errors[i].texCoord = 0.0f;
+		packVertices(format, meshes[i].vertices.data(), meshes[i].vertices.size(), meshes[i].packed);
+		measureVertexError(format, meshes[i].vertices.data(), meshes[i].vertices.size(), meshes[i].packed, errors[i]);
+	});
+	reportVertexFormat(format, meshes, errors);
+}
+
+//	context thread only: mesh data is moved into the parts; ordering by material keeps texture fetches coherent
+void Model::upload(std::vector<meshData>& meshes)
+{
+	PROFILE_ZONE("upload model");
+	std::vector<GLuint> materialIDs(meshes.size());
+	std::vector<size_t> order(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		loadTextures(context.textures, directory, loadedTextures, meshes[i].textures);
+		materialIDs[i] = context.materials.add(meshes[i].textures);
+		order[i] = i;
 	}
-	
-	for (size_t i = 0; i < node->mNumChildren; i++)
+	std::stable_sort(order.begin(), order.end(), [&materialIDs](size_t a, size_t b)
 	{
-		processNode(node->mChildren[i]);
+		return materialIDs[a] < materialIDs[b];
+	});
+	modelParts.reserve(modelParts.size() + meshes.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		modelParts.emplace_back(std::move(meshes[order[i]]), context.meshArena, materialIDs[order[i]]);
+	}
+	meshes.clear();
+	commandsGeneration = ~0u;
+
+	std::vector<boundingVolume> partBounds(modelParts.size());
+	for (size_t i = 0; i < modelParts.size(); i++)
+	{
+		partBounds[i] = modelParts[i].getBounds();
 	}
+	partsHierarchy.build(partBounds);
+	bounds = mergeBounds(partBounds);
+	instanceBounds.clear();
+	buildLodErrors();
 }
 
-void Model::processMesh(aiMesh* mesh)
+//	frees the arena allocations and texture references, the CPU side data goes back into meshes; bounds stay known
+void Model::unload(std::vector<meshData>& meshes)
 {
-	std::vector<vertex> vertices;
-	std::vector<texture> textures;
-	std::vector<GLuint> indices;
+	meshes.resize(modelParts.size());
+	for (size_t i = 0; i < modelParts.size(); i++)
+	{
+		modelParts[i].unload(meshes[i]);
+	}
+	modelParts.clear();
+	loadedTextures.clear();
+	partsHierarchy.build(std::vector<boundingVolume>());
+	commandsGeneration = ~0u;
+}
 
-	for (size_t i = 0; i < mesh->mNumVertices; i++)
+bool Model::isResident() const
+{
+	return !modelParts.empty();
+}
+
+GLsizeiptr Model::getResidentBytes() const
+{
+	GLsizeiptr bytes = 0;
+	for (size_t i = 0; i < modelParts.size(); i++)
+	{
+		bytes += modelParts[i].getResidentBytes();
+	}
+	return bytes;
+}
+
+size_t Model::getHostBytes() const
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < modelParts.size(); i++)
+	{
+		bytes += modelParts[i].getHostBytes();
+	}
+	return bytes;
+}
+
+//	TextureLibrary slots the model holds a reference on
+void Model::getTextureSlots(std::vector<GLuint>& slots) const
+{
+	for (std::unordered_map<std::string, TextureSlot>::const_iterator it = loadedTextures.begin(); it != loadedTextures.end(); ++it)
 	{
-		vertex v;
-		v.position.x = mesh->mVertices[i].x;
-		v.position.y = mesh->mVertices[i].y;
-		v.position.z = mesh->mVertices[i].z;
+		slots.push_back(it->second.getID());
+	}
+}
 
-		v.normal.x = mesh->mNormals[i].x;
-		v.normal.y = mesh->mNormals[i].y;
-		v.normal.z = mesh->mNormals[i].z;
-		if (mesh->mTextureCoords[0]) 
+void Model::reportOptimization(const std::vector<meshOptimizationStats>& stats) const
+{
+	meshOptimizationStats total = { 0, 0, 0, 0, 0, 0, { 0 } };
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		total.verticesBefore += stats[i].verticesBefore;
+		total.verticesAfter += stats[i].verticesAfter;
+		total.triangles += stats[i].triangles;
+		total.missesBefore += stats[i].missesBefore;
+		total.missesAfter += stats[i].missesAfter;
+		total.clusters += stats[i].clusters;
+		for (size_t lod = 0; lod < MESH_LOD_MAX; lod++)
 		{
-			v.texCoord.x = mesh->mTextureCoords[0][i].x;
-			v.texCoord.y = mesh->mTextureCoords[0][i].y;
-		} else {
-			v.texCoord = glm::vec2(0.0f, 0.0f);
+			total.lodTriangles[lod] += stats[i].lodTriangles[lod];
 		}
+	}
+	double triangles = std::max(total.triangles, (size_t)1);
+	_log("Model " << absPath << ": " << total.verticesBefore << " -> " << total.verticesAfter << " vertices, ACMR "
+		<< total.missesBefore / triangles << " -> " << total.missesAfter / triangles << ", ATVR "
+		<< total.missesBefore / (double)std::max(total.verticesBefore, (size_t)1) << " -> "
+		<< total.missesAfter / (double)std::max(total.verticesAfter, (size_t)1) << ", " << total.clusters << " overdraw clusters");
+	std::string levels = std::to_string(total.lodTriangles[0]);
+	for (size_t lod = 1; lod < MESH_LOD_MAX; lod++)
+	{
+		levels += " / " + std::to_string(total.lodTriangles[lod]);
+	}
+	_log("Model " << absPath << ": levels of detail " << levels << " triangles");
+}
 
-		vertices.push_back(v);
+void Model::reportVertexFormat(vertexFormat format, const std::vector<meshData>& meshes, const std::vector<vertexErrorReport>& errors) const
+{
+	vertexErrorReport worst = { 0.0f, 0.0f, 0.0f };
+	size_t packedBytes = 0, fullBytes = 0;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		worst.position = std::max(worst.position, errors[i].position);
+		worst.normal = std::max(worst.normal, errors[i].normal);
+		worst.texCoord = std::max(worst.texCoord, errors[i].texCoord);
+		packedBytes += meshes[i].packed.data.size();
+		fullBytes += meshes[i].vertices.size() * sizeof(vertex);
 	}
+	_log("Model " << absPath << ": " << getVertexFormatName(format) << " vertices, " << packedBytes / 1024 << " KiB (full "
+		<< fullBytes / 1024 << " KiB), max error position " << worst.position << " of extent, normal " << worst.normal
+		<< " deg, texture coordinates " << worst.texCoord);
+	if (!withinTolerance(worst))
+	{
+		std::cerr << "Model " << absPath << " loses more precision than tolerated in the " << getVertexFormatName(format) << " vertex format\n";
+	}
+}
 
-	if (mesh->mMaterialIndex >= 0) 
+//	depth first, so every node is added after its parent
+void Model::processNode(aiNode* node, GLuint parent, SceneGraph& graph, std::vector<aiMesh*>& meshes, std::vector<GLuint>& meshNodes)
+{
+	GLuint id = graph.addNode(toMat4(node->mTransformation), parent);
+	for (size_t i = 0; i < node->mNumMeshes; i++)
+	{
+		meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+		meshNodes.push_back(id);
+	}
+	
+	for (size_t i = 0; i < node->mNumChildren; i++)
 	{
-		aiMaterial* mat = scene->mMaterials[mesh->mMaterialIndex];
-		std::vector<texture> diffuseMaps = loadMaterialTextures(mat, aiTextureType_DIFFUSE, "diffuseTexture");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+		processNode(node->mChildren[i], id, graph, meshes, meshNodes);
+	}
+}
 
-		std::vector<texture> specularMaps = loadMaterialTextures(mat, aiTextureType_SPECULAR, "specularTexture");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+//	runs on pool threads: only reads the scene and writes into its own, exactly sized meshData
+void Model::processMesh(const aiMesh* mesh, const glm::mat4& transform, meshData& data) const
+{
+	data.vertices.resize(mesh->mNumVertices);
+	vertex* vertices = data.vertices.data();
+	const aiVector3D* texCoords = mesh->mTextureCoords[0];
+	for (size_t i = 0; i < mesh->mNumVertices; i++)
+	{
+		vertex& v = vertices[i];
+		v.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+		v.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+		v.texCoord = texCoords ? glm::vec2(texCoords[i].x, texCoords[i].y) : glm::vec2(0.0f, 0.0f);
 	}
 
+	//	every part of the model shares the instance transforms, so the node transforms go into the vertices
+	bool mirrored = false;
+	if (transform != glm::mat4(1.0f))
+	{
+		glm::mat3 linear(transform);
+		glm::vec3 x = glm::cross(linear[1], linear[2]), y = glm::cross(linear[2], linear[0]), z = glm::cross(linear[0], linear[1]);
+		mirrored = glm::dot(linear[0], x) < 0.0f;
+		float sign = mirrored ? -1.0f : 1.0f;
+		glm::mat3 cofactor(x * sign, y * sign, z * sign);
+		for (size_t i = 0; i < mesh->mNumVertices; i++)
+		{
+			vertex& v = vertices[i];
+			v.position = glm::vec3(transform * glm::vec4(v.position, 1.0f));
+			v.normal = glm::normalize(cofactor * v.normal);
+		}
+	}
+
+	const aiMaterial* mat = scene->mMaterials[mesh->mMaterialIndex];
+	data.textures = loadMaterialTextures(mat, aiTextureType_DIFFUSE, "diffuseTexture");
+	std::vector<texture> specularMaps = loadMaterialTextures(mat, aiTextureType_SPECULAR, "specularTexture");
+	data.textures.insert(data.textures.end(), specularMaps.begin(), specularMaps.end());
+
+	size_t indexCount = 0;
+	for (size_t i = 0; i < mesh->mNumFaces; i++)
+	{
+		indexCount += mesh->mFaces[i].mNumIndices;
+	}
+	data.indices.resize(indexCount);
+	GLuint* indices = data.indices.data();
 	for (size_t i = 0; i < mesh->mNumFaces; i++)
 	{
-		aiFace face = mesh->mFaces[i];
+		const aiFace& face = mesh->mFaces[i];
 		for (size_t j = 0; j < face.mNumIndices; j++)
 		{
-			indices.push_back(face.mIndices[j]);
+			*indices++ = face.mIndices[j];
 		}
 	}
 
-	ModelMesh m(vertices, textures, indices);
-	this->modelParts.push_back(m);
+	//	a mirroring node turns the triangles inside out
+	if (mirrored)
+	{
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			std::swap(data.indices[i + 1], data.indices[i + 2]);
+		}
+	}
 }
 
-std::vector<texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType textureType, const std::string& textureTypeStr)
+//	collects texture references only, library slots are acquired by loadTextures once the mesh is built
+std::vector<texture> Model::loadMaterialTextures(const aiMaterial* mat, aiTextureType textureType, const std::string& textureTypeStr)
 {
 	std::vector<texture> textures;
 	for (size_t i = 0; i < mat->GetTextureCount(textureType); i++)
 	{
 		aiString filename;
 		mat->GetTexture(textureType, i, &filename);
-		const char* filenameStr = filename.C_Str();
-		if (loadedTextures.find(filenameStr) == loadedTextures.end())
-		{
-			texture texture;
-			texture.ID = getTextureImageID(filenameStr);
-			texture.type = textureTypeStr;
-			texture.filename = filenameStr;
-			loadedTextures[filename.C_Str()] = texture;
-			textures.push_back(texture);
-		} 
-		else 
-		{
-			textures.push_back(loadedTextures[filenameStr]);
-		}	
+		texture texture;
+		texture.ID = 0;
+		texture.type = textureTypeStr;
+		texture.filename = filename.C_Str();
+		textures.push_back(texture);
 	}
 
 	return textures;
 }
 
-GLint Model::getTextureImageID(const std::string& filename)
-{
-	std::string path = directory + '/' + filename;
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    int width,height;
-    unsigned char* image = SOIL_load_image(path.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    glGenerateMipmap(GL_TEXTURE_2D);	
-
-    // params
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SOIL_free_image_data(image);
-    return textureID;
-}
\ No newline at end of file
+//	slots are shared through the library, a model only holds one reference per file in loaded, paths are relative to directory
+void Model::loadTextures(TextureLibrary& library, const std::string& directory, std::unordered_map<std::string, TextureSlot>& loaded,
+	std::vector<texture>& textures)
+{
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		const std::string& filename = textures[i].filename;
+		std::unordered_map<std::string, TextureSlot>::iterator it = loaded.find(filename);
+		if (it == loaded.end())
+		{
+			TextureSlot slot(library, library.acquire(directory + '/' + filename));
+			it = loaded.emplace(filename, std::move(slot)).first;
+		}
+		textures[i].ID = it->second.getID();
+	}
+}
@@ -2,25 +2,112 @@
 #define _MODEL_H
 
 #include "model_mesh.h"
-#include <SOIL.h>
+#include "mesh_optimizer.h"
+#include "render_context.h"
+#include "scene_graph.h"
 #include <unordered_map>
 
+#define MODEL_IMPORT_FLAGS (aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals)
+#define INSTANCE_CHUNK		64		//	instances of a set recorded per task
+#define INSTANCE_REFITS		64		//	frames with moving instances before a set's hierarchy is built anew
+#define LOD_PIXEL_ERROR		1.0f	//	screen space error in pixels a level of detail may show
+#define LOD_HYSTERESIS		1.25f	//	switching to a coarser level needs an error this much below the limit
+
+//	std430 layout of one InstanceBlock entry
+struct instanceData
+{
+	glm::mat4 model;
+	glm::mat4 normalMatrix;
+};
+
+/**
+ * What recording a model, or a range of its instances, adds to a frame, grouped by material
+ * variant. Written by one thread without GL calls; firstInstance of the records is relative
+ * to the batch's own instances until RenderQueue places them. Scratch of the recording thread
+ * is kept here as well, so a batch reused every frame stops allocating once warm.
+ */
+struct drawBatch
+{
+	std::vector<drawElementsIndirectCommand> commands;
+	std::vector<drawRecord> records;
+	std::vector<instanceData> instances;
+	GLuint variantDraws[MATERIAL_VARIANTS + 1];		//	ranges of commands
+	unsigned long long triangles[MATERIAL_VARIANTS];
+	cullingStats culling;
+
+	std::vector<GLuint> visible, sorted, parts, grouped;
+	GLuint partRanges[MATERIAL_VARIANTS + 1];
+	GLuint lodInstances[MESH_LOD_MAX + 1];
+};
+
 class Model 
 {
 	public:
 		std::string absPath, directory;
-		Model(const std::string&);
-		void render(GLuint);
+		Model(const std::string&, renderContext&, bool = false);
+		bool enqueue();
+		void dequeue();
+		size_t prepareRecording(const glm::mat4&, const glm::mat4*, size_t, cullingStats&);
+		cullingStats record(const glm::mat4&, float, const glm::mat4*, size_t, size_t, size_t, drawBatch&);
+		const boundingVolume& getBounds() const;
+
+		//	loading in steps, for a deferred Model: the first two are safe on pool threads, the others need the context
+		bool importMeshes(std::vector<meshData>&);
+		void packMeshes(std::vector<meshData>&) const;
+		void upload(std::vector<meshData>&);
+		void unload(std::vector<meshData>&);
+		bool isResident() const;
+		GLsizeiptr getResidentBytes() const;
+		size_t getHostBytes() const;
+		void getTextureSlots(std::vector<GLuint>&) const;
+		static glm::mat4 getNormalMatrix(const glm::mat4&);
+		static std::vector<texture> loadMaterialTextures(const aiMaterial*, aiTextureType, const std::string&);
+		static void loadTextures(TextureLibrary&, const std::string&, std::unordered_map<std::string, TextureSlot>&, std::vector<texture>&);
+
+		Model(Model&&) = default;
+		Model(const Model&) = delete;
+		Model& operator=(const Model&) = delete;
 	
 	private:
-		std::unordered_map<std::string, texture> loadedTextures;
+		renderContext& context;
+		std::unordered_map<std::string, TextureSlot> loadedTextures;
 		const aiScene* scene;
 		std::vector<ModelMesh> modelParts;
+
+		//	templates for the commands and draw records of visible parts, rebuilt when the arena relocates
+		unsigned int commandsGeneration;
+		std::vector<drawElementsIndirectCommand> commands;	//	by part * MESH_LOD_MAX + level
+		std::vector<drawRecord> records;
+		boundingVolume bounds;
+		BoundingVolumeHierarchy partsHierarchy;
+		std::vector<unsigned char> partVariants;
+		std::vector<GLuint> partsByVariant;
+		GLuint variantParts[MATERIAL_VARIANTS + 1];		//	ranges of partsByVariant
+
+		//	object space error of each level, parts repeat their coarsest level up to MESH_LOD_MAX
+		std::vector<float> lodErrors;
+		float modelLodErrors[MESH_LOD_MAX];
+		std::vector<unsigned char> partLods, instanceLods;	//	last selection, for hysteresis
+
+		//	sets of instances: world bounds of every instance in a hierarchy, refit while they move
+		BoundingVolumeHierarchy instanceHierarchy;
+		std::vector<boundingVolume> instanceBounds;
+		std::vector<glm::mat4> instanceTransforms;			//	as last seen, to find the instances that moved
+		std::vector<unsigned char> movedChunks;
+		std::vector<GLuint> visibleInstances;
+		unsigned int instanceRefits;
+		bool queued;										//	in a RenderQueue that has not recorded yet
+		void buildDrawCommands();
+		void buildLodErrors();
+		void groupPartsByVariant(const std::vector<GLuint>&, std::vector<GLuint>&, GLuint*) const;
+		void updateInstanceHierarchy(const glm::mat4*, size_t);
+		void sortInstancesByLod(const glm::mat4&, const glm::mat4*, float, drawBatch&);
+		void writeInstances(const glm::mat4*, drawBatch&) const;
 		void import();
-		void processNode(aiNode*);
-		void processMesh(aiMesh*);
-		std::vector<texture> loadMaterialTextures(aiMaterial*, aiTextureType, const std::string&); 
-		GLint getTextureImageID(const std::string&);
+		void reportOptimization(const std::vector<meshOptimizationStats>&) const;
+		void reportVertexFormat(vertexFormat, const std::vector<meshData>&, const std::vector<vertexErrorReport>&) const;
+		void processNode(aiNode*, GLuint, SceneGraph&, std::vector<aiMesh*>&, std::vector<GLuint>&);
+		void processMesh(const aiMesh*, const glm::mat4&, meshData&) const;
 };
 
 #endif
\ No newline at end of file
@@ -1,73 +1,88 @@
 #include "model_mesh.h"
+#include <algorithm>
 
-ModelMesh::ModelMesh(std::vector<vertex>& vertices, std::vector<texture>& textures, std::vector<GLuint>& indices) :
-	vertices(vertices), textures(textures), indices(indices)
+ModelMesh::ModelMesh(meshData&& data, MeshArena& arena, GLuint _materialID) :
+	materialID(_materialID), bounds(data.bounds), vertices(std::move(data.vertices)), textures(std::move(data.textures)), indices(std::move(data.indices)), lods(std::move(data.lods))
 {
-	loadMesh();
+	if (lods.empty())
+	{
+		meshLod full = { 0, (GLuint)indices.size(), 0.0f };
+		lods.push_back(full);
+	}
+	loadMesh(arena, data.packed);
 }
 
-void ModelMesh::loadMesh()
+//	packs here unless the importer already did, the packed copy is dropped once uploaded
+void ModelMesh::loadMesh(MeshArena& arena, packedVertices& packed)
 {
-	loadVertexAttribs();
+	if (packed.data.empty() || packed.data.size() != vertices.size() * getVertexStride(arena.getFormat()))
+	{
+		packVertices(arena.getFormat(), vertices.data(), vertices.size(), packed);
+	}
+	dequantization = packed.dequantization;
+	GLuint id = arena.allocate(packed.data.data(), vertices.size(), indices.data(), indices.size());
+	if (id != ARENA_NO_ALLOCATION)
+	{
+		allocation = ArenaAllocation(arena, id);
+	}
+	std::vector<unsigned char>().swap(packed.data);
 }
 
-void ModelMesh::loadVertexAttribs()
+//	gives the CPU side data back, ready to be uploaded again, and frees the arena allocation
+void ModelMesh::unload(meshData& data)
 {
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-		glGenBuffers(1, &vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(vertex), &vertices[0], GL_STATIC_DRAW);
-
-		glGenBuffers(1, &ebo);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
-
-		glVertexAttribPointer(POSITION_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid*)0);
-		glEnableVertexAttribArray(POSITION_LOC);
-
-		glVertexAttribPointer(NORMAL_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid*)offsetof(vertex, normal));	//	offsetof(vertex, normal)
-		glEnableVertexAttribArray(NORMAL_LOC);
-
-		glVertexAttribPointer(TEXTCOORD_LOC, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid*)offsetof(vertex, texCoord));
-		glEnableVertexAttribArray(TEXTCOORD_LOC);
-	glBindVertexArray(0);
+	data.vertices = std::move(vertices);
+	data.textures = std::move(textures);
+	data.indices = std::move(indices);
+	data.lods = std::move(lods);
+	data.bounds = bounds;
+	allocation.reset();
 }
 
-void ModelMesh::render(GLuint programm)
+//	the arena command covers every level, narrowed here to the indices of one; a mesh the arena had no room for draws nothing
+drawElementsIndirectCommand ModelMesh::getDrawCommand(size_t lod) const
 {
-	std::string textureTypeStr, number;
-	int diffTexCount = 0, specTexCount = 0;
-	for (size_t i = 0, texturesSize = textures.size(); i < texturesSize; i++)
+	if (!allocation.getArena())
 	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		textureTypeStr = textures[i].type;
+		drawElementsIndirectCommand none = { 0, 0, 0, 0, 0 };
+		return none;
+	}
+	drawElementsIndirectCommand cmd = allocation.getArena()->getDrawCommand(allocation.getID());
+	const meshLod& level = lods[std::min(lod, lods.size() - 1)];
+	cmd.firstIndex += level.firstIndex;
+	cmd.count = level.indexCount;
+	return cmd;
+}
+
+const std::vector<meshLod>& ModelMesh::getLods() const
+{
+	return lods;
+}
 
-		if (textureTypeStr == "diffuseTexture") {
-			diffTexCount++;
-			number = std::to_string(diffTexCount);
-		}
+GLuint ModelMesh::getMaterialID() const
+{
+	return materialID;
+}
 
-		if (textureTypeStr == "specularTexture") {
-			specTexCount++;
-			number = std::to_string(specTexCount);
-		}
+const boundingVolume& ModelMesh::getBounds() const
+{
+	return bounds;
+}
 
-		glBindTexture(GL_TEXTURE_2D, textures[i].ID);
-		glUniform1i(glGetUniformLocation(programm, ("material." + textureTypeStr + number).c_str()), i);
-		glUniform1f(glGetUniformLocation(programm, "material.shininess"), 16.0);
-	}
-	glActiveTexture(GL_TEXTURE0);
+const vertexDequantization& ModelMesh::getDequantization() const
+{
+	return dequantization;
+}
 
-	glBindVertexArray(vao);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+GLsizeiptr ModelMesh::getResidentBytes() const
+{
+	return allocation.getArena() ? allocation.getArena()->getAllocationBytes(allocation.getID()) : 0;
+}
 
-	for (size_t i = 0; i < textures.size(); i++)
-	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, 0);	//	unbind
-	}
+//	the CPU copies kept next to the arena allocation
+size_t ModelMesh::getHostBytes() const
+{
+	return vertices.size() * sizeof(vertex) + indices.size() * sizeof(GLuint);
 }
 
 const std::vector<vertex>& ModelMesh::getVertices() const
@@ -79,10 +94,3 @@ const std::vector<texture>& ModelMesh::getTextures() const
 {
 	return textures;
 }
-	
-ModelMesh::~ModelMesh()
-{
-	glDeleteBuffers(1, &vao);
-	glDeleteBuffers(1, &vbo);
-	glDeleteBuffers(1, &ebo);
-}
\ No newline at end of file
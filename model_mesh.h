@@ -1,6 +1,9 @@
 #ifndef _MODEL_MESH
 #define _MODEL_MESH
 
+#include "mesh_arena.h"
+#include "culling.h"
+#include "vertex_format.h"
 #include <GL/glew.h>
 #include <iostream>
 #include <string>
@@ -10,17 +13,7 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-#define POSITION_LOC  0
-#define NORMAL_LOC	  1
-#define TEXTCOORD_LOC 2
-
-struct vertex 
-{
-	glm::vec3 position;
-	glm::vec3 normal;
-	glm::vec2 texCoord;
-};
-
+//	ID is a TextureLibrary slot, the reference on it is held by the Model
 struct texture
 {
 	GLuint ID;
@@ -28,23 +21,57 @@ struct texture
 	std::string filename;
 };
 
+#define MESH_LOD_MAX	4	//	full resolution and up to three simplified levels
+
+//	one level of detail: a range of the mesh's indices, every level indexes the same vertices
+struct meshLod
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+	float error;	//	object space distance to the full resolution surface
+};
+
+//	CPU side result of importing one mesh, before any GL objects exist
+struct meshData
+{
+	std::vector<vertex>  vertices;
+	std::vector<texture> textures;
+	std::vector<GLuint>  indices;	//	every level back to back, finest first
+	std::vector<meshLod> lods;
+	boundingVolume bounds;
+	packedVertices packed;	//	GPU layout of vertices, filled by packVertices before upload and not cached
+};
+
 class ModelMesh
 {
 	private:
-		GLuint vbo, vao, ebo;
-		void loadMesh();
-		void loadVertexAttribs();
+		ArenaAllocation allocation;
+		GLuint materialID;
+		boundingVolume bounds;
+		vertexDequantization dequantization;
+		void loadMesh(MeshArena&, packedVertices&);
 		std::vector<vertex>  vertices;
 		std::vector<texture> textures;
 		std::vector<GLuint>  indices;
+		std::vector<meshLod> lods;
 
 	public:
-		ModelMesh(std::vector<vertex>&, std::vector<texture>&, std::vector<GLuint>&);
+		ModelMesh(meshData&&, MeshArena&, GLuint);
+		void unload(meshData&);
 		const std::vector<vertex>& getVertices() const;
 		const std::vector<texture>& getTextures() const;
-		void render(GLuint);
+		drawElementsIndirectCommand getDrawCommand(size_t = 0) const;
+		const std::vector<meshLod>& getLods() const;
+		GLuint getMaterialID() const;
+		const boundingVolume& getBounds() const;
+		const vertexDequantization& getDequantization() const;
+		GLsizeiptr getResidentBytes() const;
+		size_t getHostBytes() const;
 
-		~ModelMesh();
+		ModelMesh(ModelMesh&&) = default;
+		ModelMesh& operator=(ModelMesh&&) = default;
+		ModelMesh(const ModelMesh&) = delete;
+		ModelMesh& operator=(const ModelMesh&) = delete;
 };
 
 #endif
\ No newline at end of file
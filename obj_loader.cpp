@@ -0,0 +1,646 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+#include "profiler.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const double powersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	//	first '\n' in [p, end) or end, sixteen bytes at a time where SSE2 is there
+	const char* findLineEnd(const char* p, const char* end)
+	{
+#ifdef __SSE2__
+		const __m128i newline = _mm_set1_epi8('\n');
+		for (; end - p >= 16; p += 16)
+		{
+			int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), newline));
+			if (mask)
+			{
+				return p + __builtin_ctz(mask);
+			}
+		}
+#endif
+		while (p < end && *p != '\n')
+		{
+			p++;
+		}
+		return p;
+	}
+
+	bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	bool isDigit(char c)
+	{
+		return (unsigned char)(c - '0') < 10;
+	}
+
+	const char* skipSpaces(const char* p, const char* end)
+	{
+		while (p < end && isSpace(*p))
+		{
+			p++;
+		}
+		return p;
+	}
+
+	//	true when the line continues after keyword with a space
+	bool hasKeyword(const char* p, const char* end, const char* keyword)
+	{
+		size_t length = strlen(keyword);
+		return (size_t)(end - p) > length && !memcmp(p, keyword, length) && isSpace(p[length]);
+	}
+
+	std::string trim(const char* begin, const char* end)
+	{
+		begin = skipSpaces(begin, end);
+		while (end > begin && isSpace(end[-1]))
+		{
+			end--;
+		}
+		return std::string(begin, end);
+	}
+
+	//	decimal with optional sign, fraction and exponent: up to 19 significant digits are kept
+	//	and scaled by an exact power of ten, nullptr when there are no digits
+	const char* parseFloat(const char* p, const char* end, float& value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p++ == '-';
+		}
+		uint64_t mantissa = 0;
+		int significant = 0, exponent = 0;
+		bool digits = false;
+		for (; p < end && isDigit(*p); p++)
+		{
+			digits = true;
+			if (significant < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				significant += mantissa != 0;
+			}
+			else
+			{
+				exponent++;
+			}
+		}
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && isDigit(*p); p++)
+			{
+				digits = true;
+				if (significant < 19)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					significant += mantissa != 0;
+					exponent--;
+				}
+			}
+		}
+		if (!digits)
+		{
+			return nullptr;
+		}
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			p++;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				negativeExponent = *p++ == '-';
+			}
+			if (p == end || !isDigit(*p))
+			{
+				return nullptr;
+			}
+			int e = 0;
+			for (; p < end && isDigit(*p); p++)
+			{
+				e = std::min(e * 10 + (*p - '0'), 1000);
+			}
+			exponent += negativeExponent ? -e : e;
+		}
+
+		double result = (double)mantissa;
+		if (exponent < 0)
+		{
+			result = exponent >= -22 ? result / powersOf10[-exponent] : result * std::pow(10.0, exponent);
+		}
+		else if (exponent > 0)
+		{
+			result = exponent <= 22 ? result * powersOf10[exponent] : result * std::pow(10.0, exponent);
+		}
+		value = (float)(negative ? -result : result);
+		return p;
+	}
+
+	const char* parseInt(const char* p, const char* end, int64_t& value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p++ == '-';
+		}
+		if (p == end || !isDigit(*p))
+		{
+			return nullptr;
+		}
+		int64_t result = 0;
+		for (; p < end && isDigit(*p); p++)
+		{
+			result = std::min<int64_t>(result * 10 + (*p - '0'), INT32_MAX);
+		}
+		value = negative ? -result : result;
+		return p;
+	}
+
+	//	up to count floats, the ones the line does not have are 0
+	bool parseFloats(const char* p, const char* end, int count, std::vector<float>& out)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			p = skipSpaces(p, end);
+			float value = 0.0f;
+			if (p < end)
+			{
+				p = parseFloat(p, end, value);
+				if (!p || (p < end && !isSpace(*p)))
+				{
+					return false;
+				}
+			}
+			else if (i == 0)
+			{
+				return false;
+			}
+			out.push_back(value);
+		}
+		return true;
+	}
+
+	//	material files written on Windows use backslashes, sometimes doubled
+	std::string normalizePath(const std::string& path)
+	{
+		std::string res;
+		for (size_t i = 0; i < path.size(); i++)
+		{
+			char c = path[i] == '\\' ? '/' : path[i];
+			if (c != '/' || res.empty() || res.back() != '/')
+			{
+				res += c;
+			}
+		}
+		return res;
+	}
+
+	//	the last word of a map_ line, past any options such as -s or -bm
+	std::string mapFilename(const char* p, const char* end)
+	{
+		std::string value = trim(p, end);
+		if (!value.empty() && value[0] == '-')
+		{
+			size_t space = value.find_last_of(" \t");
+			value = space == std::string::npos ? std::string() : value.substr(space + 1);
+		}
+		return normalizePath(value);
+	}
+}
+
+ObjLoader::ObjLoader(ThreadPool& _threadPool) : threadPool(_threadPool)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+bool ObjLoader::isObjPath(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos || path.size() - dot != 4)
+	{
+		return false;
+	}
+	std::string extension = path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == "obj";
+}
+
+/**
+ * Replaces meshes with one entry per object and material of the file, without bounds or
+ * optimization. False when the file cannot be read or has a line this reader does not
+ * understand, so the caller can fall back to Assimp.
+ */
+bool ObjLoader::load(const std::string& path, std::vector<meshData>& meshes)
+{
+	PROFILE_ZONE("parse obj");
+	memset(&stats, 0, sizeof(stats));
+	libraries.clear();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	mappedFile file(path);
+	if (!file.data)
+	{
+		return false;
+	}
+	const char* data = (const char*)file.data;
+	const char* dataEnd = data + file.size;
+	stats.bytes = file.size;
+
+	//	cut after the line end closest past every OBJ_CHUNK_BYTES
+	std::vector<chunk> chunks;
+	for (const char* begin = data; begin < dataEnd;)
+	{
+		const char* end = dataEnd;
+		if ((size_t)(dataEnd - begin) > OBJ_CHUNK_BYTES)
+		{
+			end = std::min(findLineEnd(begin + OBJ_CHUNK_BYTES, dataEnd) + 1, dataEnd);
+		}
+		chunks.push_back(chunk());
+		chunks.back().begin = begin;
+		chunks.back().end = end;
+		begin = end;
+	}
+	stats.chunks = chunks.size();
+	threadPool.parallelFor(chunks.size(), [&chunks](size_t i)
+	{
+		parseChunk(chunks[i]);
+	});
+	size_t line = 1;
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		if (chunks[i].failed)
+		{
+			std::cerr << "OBJ " << path << ": could not read line " << line + chunks[i].lines - 1 << '\n';
+			return false;
+		}
+		line += chunks[i].lines;
+	}
+	std::chrono::steady_clock::time_point parsed = std::chrono::steady_clock::now();
+	stats.parseMs = elapsedMs(start, parsed);
+
+	//	chunks go back to back, indices counted from a chunk's end move by what came before it
+	std::vector<size_t> cornerBases(chunks.size() + 1, 0);
+	std::vector<size_t> attributeBases((chunks.size() + 1) * 3, 0);
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		cornerBases[i + 1] = cornerBases[i] + chunks[i].corners.size();
+		attributeBases[(i + 1) * 3 + 0] = attributeBases[i * 3 + 0] + chunks[i].positions.size() / 3;
+		attributeBases[(i + 1) * 3 + 1] = attributeBases[i * 3 + 1] + chunks[i].texCoords.size() / 2;
+		attributeBases[(i + 1) * 3 + 2] = attributeBases[i * 3 + 2] + chunks[i].normals.size() / 3;
+	}
+	const size_t* counts = &attributeBases[chunks.size() * 3];
+	std::vector<float> positions(counts[0] * 3), texCoords(counts[1] * 2), normals(counts[2] * 3);
+	std::vector<corner> corners(cornerBases[chunks.size()]);
+	threadPool.parallelFor(chunks.size(), [&](size_t i)
+	{
+		chunk& c = chunks[i];
+		std::copy(c.positions.begin(), c.positions.end(), positions.begin() + attributeBases[i * 3 + 0] * 3);
+		std::copy(c.texCoords.begin(), c.texCoords.end(), texCoords.begin() + attributeBases[i * 3 + 1] * 2);
+		std::copy(c.normals.begin(), c.normals.end(), normals.begin() + attributeBases[i * 3 + 2] * 3);
+		corner* out = corners.data() + cornerBases[i];
+		std::copy(c.corners.begin(), c.corners.end(), out);
+		for (size_t r = 0; r < c.relative.size(); r++)
+		{
+			out[c.relative[r] / 3].index[c.relative[r] % 3] += attributeBases[i * 3 + c.relative[r] % 3];
+		}
+		std::vector<float>().swap(c.positions);
+		std::vector<float>().swap(c.texCoords);
+		std::vector<float>().swap(c.normals);
+		std::vector<corner>().swap(c.corners);
+	});
+
+	//	a mesh per run of faces with the same object and material
+	std::unordered_map<std::string, std::vector<texture> > materials;
+	std::string directory = path.substr(0, path.find_last_of('/'));
+	struct segment
+	{
+		size_t first, last;
+		std::string material;
+	};
+	std::vector<segment> segments(1);
+	segments[0].first = 0;
+	std::string object;
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		for (size_t l = 0; l < chunks[i].libraries.size(); l++)
+		{
+			libraries.push_back(directory + '/' + normalizePath(chunks[i].libraries[l]));
+			parseMaterials(libraries.back(), materials);
+		}
+		for (size_t s = 0; s < chunks[i].switches.size(); s++)
+		{
+			const meshSwitch& sw = chunks[i].switches[s];
+			const std::string& current = sw.material ? segments.back().material : object;
+			if (sw.name == current)
+			{
+				continue;
+			}
+			size_t at = cornerBases[i] + sw.corner;
+			if (at > segments.back().first)
+			{
+				segment next = { at, 0, segments.back().material };
+				segments.back().last = at;
+				segments.push_back(next);
+			}
+			if (sw.material)
+			{
+				segments.back().material = sw.name;
+			}
+			else
+			{
+				object = sw.name;
+			}
+		}
+	}
+	segments.back().last = corners.size();
+	if (segments.back().first == segments.back().last)
+	{
+		segments.pop_back();
+	}
+	if (segments.empty())
+	{
+		std::cerr << "OBJ " << path << ": no faces\n";
+		return false;
+	}
+
+	//	welds corners with the same index triple; corners without a normal get their face's and stay apart
+	meshes.clear();
+	meshes.resize(segments.size());
+	std::atomic<bool> outOfRange(false);
+	threadPool.parallelFor(segments.size(), [&](size_t s)
+	{
+		const segment& seg = segments[s];
+		meshData& mesh = meshes[s];
+		std::unordered_map<std::string, std::vector<texture> >::const_iterator material = materials.find(seg.material);
+		if (material != materials.end())
+		{
+			mesh.textures = material->second;
+		}
+		size_t count = seg.last - seg.first, capacity = 16;
+		while (capacity < count * 2)
+		{
+			capacity *= 2;
+		}
+		std::vector<GLuint> table(capacity, ~0u), vertexCorners;
+		mesh.indices.resize(count);
+		mesh.vertices.reserve(count / 2);
+		vertexCorners.reserve(count / 2);
+		for (size_t i = seg.first; i < seg.last; i++)
+		{
+			const corner& c = corners[i];
+			if (c.index[0] < 0 || (size_t)c.index[0] >= counts[0] || c.index[1] >= (int32_t)counts[1] || c.index[2] >= (int32_t)counts[2]
+				|| c.index[1] < OBJ_ABSENT || c.index[2] < OBJ_ABSENT)
+			{
+				outOfRange = true;
+				return;
+			}
+
+			GLuint* slot = nullptr;
+			if (c.index[2] != OBJ_ABSENT)
+			{
+				uint32_t hash = ((uint32_t)c.index[0] * 73856093u) ^ ((uint32_t)c.index[1] * 19349663u) ^ ((uint32_t)c.index[2] * 83492791u);
+				for (size_t probe = hash & (capacity - 1);; probe = (probe + 1) & (capacity - 1))
+				{
+					slot = &table[probe];
+					if (*slot == ~0u || !memcmp(corners[vertexCorners[*slot]].index, c.index, sizeof(c.index)))
+					{
+						break;
+					}
+				}
+				if (*slot != ~0u)
+				{
+					mesh.indices[i - seg.first] = *slot;
+					continue;
+				}
+			}
+
+			vertex v;
+			v.position = glm::vec3(positions[c.index[0] * 3], positions[c.index[0] * 3 + 1], positions[c.index[0] * 3 + 2]);
+			v.texCoord = c.index[1] == OBJ_ABSENT ? glm::vec2(0.0f) : glm::vec2(texCoords[c.index[1] * 2], 1.0f - texCoords[c.index[1] * 2 + 1]);
+			if (c.index[2] != OBJ_ABSENT)
+			{
+				v.normal = glm::vec3(normals[c.index[2] * 3], normals[c.index[2] * 3 + 1], normals[c.index[2] * 3 + 2]);
+				*slot = mesh.vertices.size();
+			}
+			else
+			{
+				const corner* face = &corners[i - (i % 3)];
+				glm::vec3 p[3];
+				for (int k = 0; k < 3; k++)
+				{
+					size_t index = std::min<size_t>(face[k].index[0], counts[0] - 1) * 3;
+					p[k] = glm::vec3(positions[index], positions[index + 1], positions[index + 2]);
+				}
+				glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+				v.normal = glm::length(n) > 0.0f ? glm::normalize(n) : glm::vec3(0.0f, 0.0f, 1.0f);
+			}
+			mesh.indices[i - seg.first] = mesh.vertices.size();
+			mesh.vertices.push_back(v);
+			vertexCorners.push_back(i);
+		}
+	});
+	if (outOfRange)
+	{
+		std::cerr << "OBJ " << path << ": a face refers to a vertex the file does not have\n";
+		meshes.clear();
+		return false;
+	}
+	stats.corners = corners.size();
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		stats.vertices += meshes[i].vertices.size();
+	}
+	stats.mergeMs = elapsedMs(parsed, std::chrono::steady_clock::now());
+	return true;
+}
+
+const objLoadStats& ObjLoader::getStats() const
+{
+	return stats;
+}
+
+const std::vector<std::string>& ObjLoader::getLibraries() const
+{
+	return libraries;
+}
+
+//	runs on pool threads, only touches its own chunk; unknown statements (s, l, p, comments) are skipped
+void ObjLoader::parseChunk(chunk& c)
+{
+	c.lines = 0;
+	c.failed = false;
+	for (const char* p = c.begin; p < c.end && !c.failed; c.lines++)
+	{
+		const char* lineEnd = findLineEnd(p, c.end);
+		const char* q = skipSpaces(p, lineEnd);
+		if (lineEnd - q >= 2)
+		{
+			switch (*q)
+			{
+				case 'v':
+					if (isSpace(q[1]))
+					{
+						c.failed = !parseFloats(q + 2, lineEnd, 3, c.positions);
+					}
+					else if (q[1] == 't' && lineEnd - q > 2 && isSpace(q[2]))
+					{
+						c.failed = !parseFloats(q + 3, lineEnd, 2, c.texCoords);
+					}
+					else if (q[1] == 'n' && lineEnd - q > 2 && isSpace(q[2]))
+					{
+						c.failed = !parseFloats(q + 3, lineEnd, 3, c.normals);
+					}
+					break;
+				case 'f':
+					if (isSpace(q[1]))
+					{
+						c.failed = !parseFace(q + 2, lineEnd, c);
+					}
+					break;
+				case 'o':
+				case 'g':
+					if (isSpace(q[1]))
+					{
+						meshSwitch sw = { c.corners.size(), false, trim(q + 2, lineEnd) };
+						c.switches.push_back(sw);
+					}
+					break;
+				case 'u':
+					if (hasKeyword(q, lineEnd, "usemtl"))
+					{
+						meshSwitch sw = { c.corners.size(), true, trim(q + 7, lineEnd) };
+						c.switches.push_back(sw);
+					}
+					break;
+				case 'm':
+					if (hasKeyword(q, lineEnd, "mtllib"))
+					{
+						c.libraries.push_back(trim(q + 7, lineEnd));
+					}
+					break;
+			}
+		}
+		p = lineEnd + 1;
+	}
+}
+
+//	v, v/vt, v//vn or v/vt/vn per corner; polygons become a fan, lines and points are dropped
+bool ObjLoader::parseFace(const char* p, const char* end, chunk& c)
+{
+	const size_t counts[3] = { c.positions.size() / 3, c.texCoords.size() / 2, c.normals.size() / 3 };
+	corner polygon[2];
+	uint32_t polygonRelative[2] = { 0, 0 };
+	size_t vertices = 0;
+	for (p = skipSpaces(p, end); p < end; p = skipSpaces(p, end), vertices++)
+	{
+		corner current = { { OBJ_ABSENT, OBJ_ABSENT, OBJ_ABSENT } };
+		uint32_t relative = 0;
+		for (int a = 0; a < 3; a++)
+		{
+			if (a > 0)
+			{
+				if (p == end || *p != '/')
+				{
+					break;
+				}
+				p++;
+				if (a == 1 && p < end && *p == '/')
+				{
+					continue;
+				}
+			}
+			int64_t index = 0;
+			p = parseInt(p, end, index);
+			if (!p || index == 0)
+			{
+				return false;
+			}
+			if (index < 0)
+			{
+				relative |= 1u << a;
+			}
+			current.index[a] = (int32_t)(index > 0 ? index - 1 : (int64_t)counts[a] + index);
+		}
+		if (p < end && !isSpace(*p))
+		{
+			return false;
+		}
+
+		if (vertices >= 2)
+		{
+			const corner triangle[3] = { polygon[0], polygon[1], current };
+			const uint32_t triangleRelative[3] = { polygonRelative[0], polygonRelative[1], relative };
+			for (int k = 0; k < 3; k++)
+			{
+				for (int a = 0; a < 3; a++)
+				{
+					if (triangleRelative[k] & (1u << a))
+					{
+						c.relative.push_back((c.corners.size() * 3) + a);
+					}
+				}
+				c.corners.push_back(triangle[k]);
+			}
+		}
+		int keep = vertices == 0 ? 0 : 1;
+		polygon[keep] = current;
+		polygonRelative[keep] = relative;
+	}
+	return true;
+}
+
+//	map_Kd and map_Ks per newmtl, in the order the Assimp path gives them: diffuse maps first
+void ObjLoader::parseMaterials(const std::string& path, std::unordered_map<std::string, std::vector<texture> >& materials)
+{
+	mappedFile file(path);
+	if (!file.data)
+	{
+		std::cerr << "OBJ material library " << path << " not found\n";
+		return;
+	}
+	const char* p = (const char*)file.data;
+	const char* end = p + file.size;
+	std::vector<texture>* current = nullptr;
+	while (p < end)
+	{
+		const char* lineEnd = findLineEnd(p, end);
+		const char* q = skipSpaces(p, lineEnd);
+		if (hasKeyword(q, lineEnd, "newmtl"))
+		{
+			current = &materials[trim(q + 7, lineEnd)];
+		}
+		else if (current && (hasKeyword(q, lineEnd, "map_Kd") || hasKeyword(q, lineEnd, "map_Ks")))
+		{
+			texture t;
+			t.ID = 0;
+			t.type = q[5] == 'd' ? "diffuseTexture" : "specularTexture";
+			t.filename = mapFilename(q + 7, lineEnd);
+			if (t.type == "diffuseTexture")
+			{
+				std::vector<texture>::iterator specular = std::find_if(current->begin(), current->end(), [](const texture& other)
+				{
+					return other.type == "specularTexture";
+				});
+				current->insert(specular, t);
+			}
+			else
+			{
+				current->push_back(t);
+			}
+		}
+		p = lineEnd + 1;
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef _OBJ_LOADER_H
+#define _OBJ_LOADER_H
+
+#include "model_mesh.h"
+#include "thread_pool.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define OBJ_CHUNK_BYTES		(1 << 20)	//	a file is cut into chunks of about this size, parsed in parallel
+#define OBJ_ABSENT			-1
+
+//	what the last load() did, bytes are those of the OBJ file alone
+struct objLoadStats
+{
+	size_t bytes;
+	size_t chunks;
+	size_t corners;			//	face corners after triangulation
+	size_t vertices;		//	unique position/texture coordinate/normal combinations
+	double parseMs;
+	double mergeMs;
+};
+
+/**
+ * Wavefront OBJ and MTL reader that fills meshData directly, in place of Assimp for .obj files.
+ * The file is memory mapped and cut at line ends into chunks parsed on the pool; each chunk
+ * keeps its own attribute arrays and triangulated corners, indices relative to the end of the
+ * file so far (negative ones) are fixed up once the chunks' counts are known. A mesh starts at
+ * every o, g or usemtl that changes the object or material, and its corners are welded through
+ * a hash table on their index triple, so vertices come out shared as written in the file.
+ * The output matches MODEL_IMPORT_FLAGS: triangles, texture coordinates flipped vertically and
+ * flat normals where the file has none. Only map_Kd and map_Ks of the materials are read.
+ */
+class ObjLoader
+{
+	public:
+		explicit ObjLoader(ThreadPool&);
+		bool load(const std::string&, std::vector<meshData>&);
+		const objLoadStats& getStats() const;
+		const std::vector<std::string>& getLibraries() const;
+
+		static bool isObjPath(const std::string&);
+
+	private:
+		//	0-based once resolved, OBJ_ABSENT when the corner does not have the attribute
+		struct corner
+		{
+			int32_t index[3];	//	position, texture coordinates, normal
+		};
+
+		//	an o, g or usemtl line, taking effect at a corner of the chunk
+		struct meshSwitch
+		{
+			size_t corner;
+			bool material;
+			std::string name;
+		};
+
+		struct chunk
+		{
+			const char* begin;
+			const char* end;
+			std::vector<float> positions, texCoords, normals;	//	3, 2 and 3 floats per entry
+			std::vector<corner> corners;
+			std::vector<uint32_t> relative;		//	corner * 3 + attribute of the indices counted from the chunk end
+			std::vector<meshSwitch> switches;
+			std::vector<std::string> libraries;
+			size_t lines;
+			bool failed;
+		};
+
+		ThreadPool& threadPool;
+		objLoadStats stats;
+		std::vector<std::string> libraries;		//	paths of the MTL files the last load() read
+
+		static void parseChunk(chunk&);
+		static bool parseFace(const char*, const char*, chunk&);
+		static void parseMaterials(const std::string&, std::unordered_map<std::string, std::vector<texture> >&);
+};
+
+#endif
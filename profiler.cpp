@@ -0,0 +1,338 @@
+#include "profiler.h"
+#include "utils.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+	const char* counterNames[PROFILER_COUNTERS] = { "draw calls", "state changes", "triangles", "bytes uploaded", "ring overflows" };
+}
+
+Profiler& Profiler::get()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+Profiler::Profiler() :
+	epoch(std::chrono::steady_clock::now()),
+	gpuAttached(false),
+	frame(0), frameStart(0), eventsFrameStart(0), gpuFrameStart(0),
+	captureFirst(0), captureLast(0), capturing(false)
+{
+	for (int c = 0; c < PROFILER_COUNTERS; c++)
+	{
+		counters[c] = 0;
+	}
+	for (int i = 0; i < PROFILER_GPU_LATENCY; i++)
+	{
+		gpuFrames[i].frame = gpuFrames[i].start = 0;
+		gpuFrames[i].offset = 0;
+		gpuFrames[i].pending = false;
+	}
+	for (int i = 0; i < PROFILER_HISTORY; i++)
+	{
+		history[i] = profileFrame();
+	}
+}
+
+uint64_t Profiler::now() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+//	shown for the calling thread in the overlay and in traces; the name has to outlive the profiler
+void Profiler::setThreadName(const char* name)
+{
+	getThreadEvents()->name = name;
+}
+
+//	the zone is dropped when the ring is full, the frame will not be read before the thread finishes it
+void Profiler::addZone(const char* name, uint64_t start, uint64_t end)
+{
+	threadEvents* events = getThreadEvents();
+	uint32_t head = events->head.load(std::memory_order_relaxed);
+	if (head - events->tail.load(std::memory_order_acquire) >= PROFILER_THREAD_EVENTS)
+	{
+		return;
+	}
+	profileEvent& e = events->events[head & (PROFILER_THREAD_EVENTS - 1)];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	e.thread = events->index;
+	events->head.store(head + 1, std::memory_order_release);
+}
+
+//	~0u when the GPU is not attached or the frame has no queries left
+GLuint Profiler::beginGpuZone(const char* name)
+{
+	gpuFrame& g = gpuFrames[frame % PROFILER_GPU_LATENCY];
+	if (!gpuAttached || !g.pending || g.zones.size() >= PROFILER_GPU_ZONES)
+	{
+		return ~0u;
+	}
+	gpuZone zone = { name, (GLuint)(((frame % PROFILER_GPU_LATENCY) * PROFILER_GPU_ZONES + g.zones.size()) * 2) };
+	glQueryCounter(queries[zone.first], GL_TIMESTAMP);
+	g.zones.push_back(zone);
+	return g.zones.size() - 1;
+}
+
+void Profiler::endGpuZone(GLuint zone)
+{
+	gpuFrame& g = gpuFrames[frame % PROFILER_GPU_LATENCY];
+	if (zone < g.zones.size())
+	{
+		glQueryCounter(queries[g.zones[zone].first + 1], GL_TIMESTAMP);
+	}
+}
+
+void Profiler::count(profilerCounter counter, uint64_t value)
+{
+	counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+#ifdef PROFILER_ENABLED
+//	GPU zones are only timed between these two, the queries need the context current
+void Profiler::attachGpu()
+{
+	if (gpuAttached)
+	{
+		return;
+	}
+	queries.resize(PROFILER_GPU_LATENCY * PROFILER_GPU_ZONES * 2);
+	glGenQueries(queries.size(), queries.data());
+	gpuAttached = true;
+}
+
+void Profiler::detachGpu()
+{
+	if (!gpuAttached)
+	{
+		return;
+	}
+	glDeleteQueries(queries.size(), queries.data());
+	queries.clear();
+	for (int i = 0; i < PROFILER_GPU_LATENCY; i++)
+	{
+		gpuFrames[i].zones.clear();
+		gpuFrames[i].pending = false;
+	}
+	gpuAttached = false;
+}
+
+//	reads back the GPU zones of the frame PROFILER_GPU_LATENCY frames ago and opens this one
+void Profiler::beginFrame()
+{
+	uint64_t start = now();
+	if (frame > 0)
+	{
+		history[(frame - 1) % PROFILER_HISTORY].frameMs = (start - frameStart) / 1.0e6;
+	}
+	frameStart = start;
+	history[frame % PROFILER_HISTORY] = profileFrame();
+	if (!gpuAttached)
+	{
+		return;
+	}
+
+	gpuFrame& g = gpuFrames[frame % PROFILER_GPU_LATENCY];
+	if (g.pending)
+	{
+		resolveGpu(g);
+	}
+	g.zones.clear();
+	g.frame = frame;
+	g.start = start;
+	GLint64 gpuTime = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+	g.offset = (int64_t)now() - gpuTime;
+	g.pending = true;
+}
+
+//	collects the zones every thread finished during the frame and closes its counters
+void Profiler::endFrame()
+{
+	frameEvents.clear();
+	{
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		for (size_t i = 0; i < threads.size(); i++)
+		{
+			threadEvents& events = *threads[i];
+			uint32_t tail = events.tail.load(std::memory_order_relaxed);
+			uint32_t head = events.head.load(std::memory_order_acquire);
+			for (; tail != head; tail++)
+			{
+				frameEvents.push_back(events.events[tail & (PROFILER_THREAD_EVENTS - 1)]);
+			}
+			events.tail.store(tail, std::memory_order_release);
+		}
+	}
+	eventsFrameStart = frameStart;
+	profileFrame& entry = history[frame % PROFILER_HISTORY];
+	for (int c = 0; c < PROFILER_COUNTERS; c++)
+	{
+		entry.counters[c] = counters[c].exchange(0, std::memory_order_relaxed);
+	}
+
+	if (capturing && frame >= captureFirst && frame <= captureLast)
+	{
+		captured.insert(captured.end(), frameEvents.begin(), frameEvents.end());
+		counterSample sample;
+		sample.time = now();
+		std::copy(entry.counters, entry.counters + PROFILER_COUNTERS, sample.values);
+		capturedCounters.push_back(sample);
+	}
+	if (capturing && frame >= captureLast + (gpuAttached ? PROFILER_GPU_LATENCY : 0))
+	{
+		writeCapture();
+	}
+	frame++;
+}
+
+//	records the next frames and writes them to path once the GPU zones of the last one are in
+void Profiler::startCapture(const std::string& path, unsigned int frames)
+{
+	capturePath = path;
+	captureFirst = frame;
+	captureLast = frame + std::max(frames, 1u) - 1;
+	captured.clear();
+	capturedCounters.clear();
+	capturing = true;
+}
+
+bool Profiler::isCapturing() const
+{
+	return capturing;
+}
+#endif
+
+const std::vector<profileEvent>& Profiler::getFrameEvents() const
+{
+	return frameEvents;
+}
+
+const std::vector<profileEvent>& Profiler::getGpuEvents() const
+{
+	return gpuEvents;
+}
+
+//	start of the last finished frame, which getFrameEvents() belong to
+uint64_t Profiler::getFrameStart() const
+{
+	return eventsFrameStart;
+}
+
+//	CPU start of the frame the GPU events belong to
+uint64_t Profiler::getGpuFrameStart() const
+{
+	return gpuFrameStart;
+}
+
+//	ago = 1 is the last finished frame; GPU times trail by PROFILER_GPU_LATENCY frames
+const profileFrame& Profiler::getHistory(unsigned int ago) const
+{
+	return history[(frame + PROFILER_HISTORY - std::min(ago, (unsigned int)PROFILER_HISTORY - 1)) % PROFILER_HISTORY];
+}
+
+const char* Profiler::getThreadName(GLuint thread) const
+{
+	if (thread == PROFILER_GPU_THREAD)
+	{
+		return "GPU";
+	}
+	std::lock_guard<std::mutex> lock(threadsMutex);
+	const char* name = thread <= threads.size() ? threads[thread - 1]->name.load() : nullptr;
+	return name ? name : "thread";
+}
+
+GLuint Profiler::getThreadCount() const
+{
+	std::lock_guard<std::mutex> lock(threadsMutex);
+	return threads.size() + 1;
+}
+
+Profiler::threadEvents* Profiler::getThreadEvents()
+{
+	static thread_local threadEvents* local = nullptr;
+	if (!local)
+	{
+		std::unique_ptr<threadEvents> events(new threadEvents());
+		events->head = events->tail = 0;
+		events->name = nullptr;
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		events->index = threads.size() + 1;
+		local = events.get();
+		threads.push_back(std::move(events));
+	}
+	return local;
+}
+
+void Profiler::resolveGpu(gpuFrame& g)
+{
+	gpuEvents.clear();
+	uint64_t first = ~(uint64_t)0, last = 0;
+	for (size_t i = 0; i < g.zones.size(); i++)
+	{
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(queries[g.zones[i].first], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(queries[g.zones[i].first + 1], GL_QUERY_RESULT, &end);
+		profileEvent e;
+		e.name = g.zones[i].name;
+		e.start = (uint64_t)std::max<int64_t>(0, (int64_t)begin + g.offset);
+		e.end = (uint64_t)std::max<int64_t>(0, (int64_t)end + g.offset);
+		e.thread = PROFILER_GPU_THREAD;
+		gpuEvents.push_back(e);
+		first = std::min(first, e.start);
+		last = std::max(last, e.end);
+	}
+	gpuFrameStart = g.start;
+	if (!gpuEvents.empty())
+	{
+		history[g.frame % PROFILER_HISTORY].gpuMs = (last - first) / 1.0e6;
+	}
+	if (capturing && g.frame >= captureFirst && g.frame <= captureLast)
+	{
+		captured.insert(captured.end(), gpuEvents.begin(), gpuEvents.end());
+	}
+	g.pending = false;
+}
+
+//	Chrome trace event format: complete events per thread, GPU zones on a thread of their own, counters per frame
+void Profiler::writeCapture()
+{
+	capturing = false;
+	std::ofstream ofs(capturePath);
+	if (!ofs.is_open())
+	{
+		std::cerr << "Could not write " << capturePath << '\n';
+		return;
+	}
+	ofs << std::fixed << std::setprecision(3) << "{\"traceEvents\": [";
+	GLuint threadCount = getThreadCount();
+	for (GLuint t = 0; t < threadCount; t++)
+	{
+		ofs << (t ? ",\n\t" : "\n\t") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << t
+			<< ", \"args\": {\"name\": \"" << getThreadName(t) << "\"}}";
+	}
+	for (size_t i = 0; i < captured.size(); i++)
+	{
+		const profileEvent& e = captured[i];
+		ofs << ",\n\t{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.thread
+			<< ", \"ts\": " << e.start / 1000.0 << ", \"dur\": " << (e.end - e.start) / 1000.0 << "}";
+	}
+	for (size_t i = 0; i < capturedCounters.size(); i++)
+	{
+		for (int c = 0; c < PROFILER_COUNTERS; c++)
+		{
+			ofs << ",\n\t{\"name\": \"" << counterNames[c] << "\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << capturedCounters[i].time / 1000.0
+				<< ", \"args\": {\"value\": " << capturedCounters[i].values[c] << "}}";
+		}
+	}
+	ofs << "\n]}\n";
+	_log("Trace of " << capturedCounters.size() << " frames written to " << capturePath);
+	captured.clear();
+	capturedCounters.clear();
+}
@@ -0,0 +1,193 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <GL/glew.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define PROFILER_THREAD_EVENTS	4096	//	zones a thread can have pending between two frames, a power of two
+#define PROFILER_GPU_LATENCY	4		//	frames between issuing timestamp queries and reading them back
+#define PROFILER_GPU_ZONES		32		//	per frame, further zones are not timed
+#define PROFILER_HISTORY		240		//	frames kept for the overlay
+#define PROFILER_GPU_THREAD		0		//	thread index of GPU zones, CPU threads count from 1
+
+//	zones compile to nothing unless the build defines PROFILER_ENABLED (make PROFILER=1, the default)
+#define PROFILER_JOIN2(a, b)	a##b
+#define PROFILER_JOIN(a, b)		PROFILER_JOIN2(a, b)
+#ifdef PROFILER_ENABLED
+#define PROFILE_ZONE(name)				ProfileZone PROFILER_JOIN(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name)			GpuProfileZone PROFILER_JOIN(gpuProfileZone, __LINE__)(name)
+#define PROFILE_COUNT(counter, value)	Profiler::get().count(counter, value)
+#define PROFILE_THREAD(name)			Profiler::get().setThreadName(name)
+#else
+#define PROFILE_ZONE(name)				((void)0)
+#define PROFILE_GPU_ZONE(name)			((void)0)
+#define PROFILE_COUNT(counter, value)	((void)0)
+#define PROFILE_THREAD(name)			((void)0)
+#endif
+
+enum profilerCounter
+{
+	COUNTER_DRAW_CALLS,
+	COUNTER_STATE_CHANGES,
+	COUNTER_TRIANGLES,
+	COUNTER_UPLOAD_BYTES,
+	COUNTER_RING_OVERFLOWS,
+	PROFILER_COUNTERS
+};
+
+//	times are nanoseconds since the profiler started, GPU zones are moved onto the same clock
+struct profileEvent
+{
+	const char* name;
+	uint64_t start, end;
+	GLuint thread;
+};
+
+struct profileFrame
+{
+	double frameMs;		//	from this frame's start to the next one's
+	double gpuMs;		//	first GPU zone start to last end, once read back
+	uint64_t counters[PROFILER_COUNTERS];
+};
+
+/**
+ * Scoped CPU and GPU timing for every thread, plus per-frame counters.
+ * A CPU zone is written on its own thread into that thread's ring of events when it closes,
+ * with no locks: only that thread advances the head and only endFrame() advances the tail, so
+ * a full ring drops the zone instead of waiting. GPU zones are pairs of GL_TIMESTAMP queries
+ * from a pool per frame in flight, read back PROFILER_GPU_LATENCY frames later so reading
+ * never waits on the GPU, and placed on the CPU clock by a timestamp taken at frame start.
+ * A capture collects every event and counter over a number of frames and writes them as
+ * Chrome trace JSON (chrome://tracing, Perfetto).
+ */
+class Profiler
+{
+	public:
+		static Profiler& get();
+		Profiler(const Profiler&) = delete;
+		Profiler& operator=(const Profiler&) = delete;
+
+		uint64_t now() const;
+		void setThreadName(const char*);
+		void addZone(const char*, uint64_t, uint64_t);
+		GLuint beginGpuZone(const char*);
+		void endGpuZone(GLuint);
+		void count(profilerCounter, uint64_t);
+
+		//	on the GL thread; without PROFILER_ENABLED frames are not tracked and no queries are made
+#ifdef PROFILER_ENABLED
+		void attachGpu();
+		void detachGpu();
+		void beginFrame();
+		void endFrame();
+		void startCapture(const std::string&, unsigned int);
+		bool isCapturing() const;
+#else
+		void attachGpu() {}
+		void detachGpu() {}
+		void beginFrame() {}
+		void endFrame() {}
+		void startCapture(const std::string&, unsigned int) {}
+		bool isCapturing() const { return false; }
+#endif
+
+		//	what the last frames looked like, for the overlay
+		const std::vector<profileEvent>& getFrameEvents() const;
+		const std::vector<profileEvent>& getGpuEvents() const;
+		uint64_t getFrameStart() const;
+		uint64_t getGpuFrameStart() const;
+		const profileFrame& getHistory(unsigned int) const;
+		const char* getThreadName(GLuint) const;
+		GLuint getThreadCount() const;
+
+	private:
+		struct threadEvents
+		{
+			profileEvent events[PROFILER_THREAD_EVENTS];
+			std::atomic<uint32_t> head, tail;
+			GLuint index;
+			std::atomic<const char*> name;
+		};
+
+		struct gpuZone
+		{
+			const char* name;
+			GLuint first;			//	begin query in the pool, the end query follows
+		};
+
+		struct gpuFrame
+		{
+			std::vector<gpuZone> zones;
+			uint64_t frame;
+			uint64_t start;			//	CPU time of the frame start
+			int64_t offset;			//	CPU minus GPU time at the frame start
+			bool pending;
+		};
+
+		//	one capture sample of every counter, taken at the end of a frame
+		struct counterSample
+		{
+			uint64_t time;
+			uint64_t values[PROFILER_COUNTERS];
+		};
+
+		std::chrono::steady_clock::time_point epoch;
+		mutable std::mutex threadsMutex;		//	only taken when a thread records its first zone
+		std::vector<std::unique_ptr<threadEvents> > threads;
+		std::atomic<uint64_t> counters[PROFILER_COUNTERS];
+
+		bool gpuAttached;
+		std::vector<GLuint> queries;
+		gpuFrame gpuFrames[PROFILER_GPU_LATENCY];
+
+		uint64_t frame, frameStart;
+		uint64_t eventsFrameStart, gpuFrameStart;		//	of the frames the events were collected for
+		std::vector<profileEvent> frameEvents, gpuEvents;
+		profileFrame history[PROFILER_HISTORY];
+
+		std::string capturePath;
+		uint64_t captureFirst, captureLast;
+		bool capturing;
+		std::vector<profileEvent> captured;
+		std::vector<counterSample> capturedCounters;
+
+		Profiler();
+		threadEvents* getThreadEvents();
+		void resolveGpu(gpuFrame&);
+		void writeCapture();
+};
+
+//	times the enclosing scope on the calling thread, use PROFILE_ZONE
+class ProfileZone
+{
+	public:
+		explicit ProfileZone(const char* _name) : name(_name), start(Profiler::get().now()) {}
+		~ProfileZone() { Profiler::get().addZone(name, start, Profiler::get().now()); }
+		ProfileZone(const ProfileZone&) = delete;
+		ProfileZone& operator=(const ProfileZone&) = delete;
+
+	private:
+		const char* name;
+		uint64_t start;
+};
+
+//	times the GL commands issued in the enclosing scope, use PROFILE_GPU_ZONE on the GL thread
+class GpuProfileZone
+{
+	public:
+		explicit GpuProfileZone(const char* name) : zone(Profiler::get().beginGpuZone(name)) {}
+		~GpuProfileZone() { Profiler::get().endGpuZone(zone); }
+		GpuProfileZone(const GpuProfileZone&) = delete;
+		GpuProfileZone& operator=(const GpuProfileZone&) = delete;
+
+	private:
+		GLuint zone;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "profiler_overlay.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+	//	a stable colour per zone name, so a zone keeps its colour from frame to frame
+	void zoneColor(const char* name, float* color)
+	{
+		uint32_t hash = 2166136261u;
+		for (; *name; name++)
+		{
+			hash = (hash ^ (unsigned char)*name) * 16777619u;
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			color[c] = 0.35f + 0.6f * ((hash >> (c * 8)) & 0xff) / 255.0f;
+		}
+	}
+}
+
+ProfilerOverlay::ProfilerOverlay(renderContext& _context, ProgramCache& _programs) :
+	context(_context), programs(_programs), resolved(0)
+{
+	programID = programs.add("shaders/overlay_vshader", "shaders/overlay_fshader");
+}
+
+//	after the scene, before RingBuffer::endFrame()
+void ProfilerOverlay::draw(const Profiler& profiler)
+{
+	GLuint program = programs.getProgram(programID);
+	if (!program)
+	{
+		return;
+	}
+	if (program != resolved)
+	{
+		GLuint block = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, "OverlayBlock");
+		if (block != GL_INVALID_INDEX)
+		{
+			glShaderStorageBlockBinding(program, block, OVERLAY_BLOCK_BINDING);
+		}
+		resolved = program;
+	}
+
+	rects.clear();
+	float x = OVERLAY_MARGIN, y = OVERLAY_MARGIN;
+	GLuint lanes = std::min<GLuint>(profiler.getThreadCount(), OVERLAY_MAX_LANES);
+	float top = y + OVERLAY_GRAPH_HEIGHT + OVERLAY_MARGIN + lanes * OVERLAY_LANE_HEIGHT;
+	addRect(x - 4, y - 4, x + OVERLAY_WIDTH + 4, top + 4, 0.0f, 0.0f, 0.0f, 0.6f);
+
+	//	oldest frame on the left, GPU time as a narrower bar inside the frame time
+	float barWidth = (float)OVERLAY_WIDTH / (PROFILER_HISTORY - 1);
+	for (unsigned int ago = PROFILER_HISTORY - 1; ago >= 1; ago--)
+	{
+		const profileFrame& frame = profiler.getHistory(ago);
+		float left = x + (PROFILER_HISTORY - 1 - ago) * barWidth;
+		float cpu = std::min((float)frame.frameMs / OVERLAY_GRAPH_MS, 1.0f) * OVERLAY_GRAPH_HEIGHT;
+		float gpu = std::min((float)frame.gpuMs / OVERLAY_GRAPH_MS, 1.0f) * OVERLAY_GRAPH_HEIGHT;
+		if (frame.frameMs <= 1000.0 / 60.0)
+		{
+			addRect(left, y, left + barWidth, y + cpu, 0.3f, 0.8f, 0.3f, 0.9f);
+		}
+		else if (frame.frameMs <= 1000.0 / 30.0)
+		{
+			addRect(left, y, left + barWidth, y + cpu, 0.9f, 0.8f, 0.2f, 0.9f);
+		}
+		else
+		{
+			addRect(left, y, left + barWidth, y + cpu, 0.9f, 0.3f, 0.2f, 0.9f);
+		}
+		addRect(left + barWidth * 0.25f, y, left + barWidth * 0.75f, y + gpu, 0.3f, 0.6f, 1.0f, 0.9f);
+	}
+	for (float fps = 60.0f; fps >= 30.0f; fps /= 2.0f)
+	{
+		float line = y + 1000.0f / fps / OVERLAY_GRAPH_MS * OVERLAY_GRAPH_HEIGHT;
+		addRect(x, line, x + OVERLAY_WIDTH, line + 1.0f, 1.0f, 1.0f, 1.0f, 0.35f);
+	}
+
+	//	the timeline is at least a 60 Hz frame wide, lanes alternate in shade
+	double span = std::max(profiler.getHistory(1).frameMs, 1000.0 / 60.0) * 1.0e6;
+	for (GLuint lane = 0; lane < lanes; lane++)
+	{
+		float shade = lane % 2 ? 0.12f : 0.18f;
+		addRect(x, top - (lane + 1) * OVERLAY_LANE_HEIGHT, x + OVERLAY_WIDTH, top - lane * OVERLAY_LANE_HEIGHT, shade, shade, shade, 0.8f);
+	}
+	addLanes(profiler.getFrameEvents(), profiler.getFrameStart(), span, top, lanes);
+	addLanes(profiler.getGpuEvents(), profiler.getGpuFrameStart(), span, top, lanes);
+
+	RingBuffer& stream = context.stream;
+	RenderState& state = context.state;
+	GLintptr offset = 0;
+	GLsizeiptr size = 4 * sizeof(float) + rects.size() * sizeof(rect);
+	float* data = (float*)stream.allocate(size, stream.getStorageAlignment(), offset);
+	if (!data)
+	{
+		return;
+	}
+	data[0] = (float)state.getViewportWidth();
+	data[1] = (float)state.getViewportHeight();
+	data[2] = data[3] = 0.0f;
+	memcpy(data + 4, rects.data(), rects.size() * sizeof(rect));
+
+	state.useProgram(program);
+	state.bindVertexArray(context.meshArena.getVAO());
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, OVERLAY_BLOCK_BINDING, stream.getBuffer(), offset, size);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDrawArrays(GL_TRIANGLES, 0, rects.size() * 6);
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+	state.countDraws(1, rects.size() * 2);
+}
+
+//	frame time, GPU time and the counters of the last finished frame, one line
+std::string ProfilerOverlay::getSummary(const Profiler& profiler)
+{
+	const profileFrame& last = profiler.getHistory(1);
+	std::ostringstream summary;
+	summary << std::fixed << std::setprecision(1) << last.frameMs << " ms, gpu " << profiler.getHistory(PROFILER_GPU_LATENCY).gpuMs << " ms, "
+		<< last.counters[COUNTER_DRAW_CALLS] << " draws, " << last.counters[COUNTER_STATE_CHANGES] << " binds, "
+		<< last.counters[COUNTER_TRIANGLES] / 1000 << "k triangles, " << last.counters[COUNTER_UPLOAD_BYTES] / 1024 << " KB uploaded";
+	if (last.counters[COUNTER_RING_OVERFLOWS])
+	{
+		summary << ", " << last.counters[COUNTER_RING_OVERFLOWS] << " ring overflows";
+	}
+	return summary.str();
+}
+
+void ProfilerOverlay::addRect(float x0, float y0, float x1, float y1, float r, float g, float b, float a)
+{
+	rect res = { { x0, y0, x1, y1 }, { r, g, b, a } };
+	rects.push_back(res);
+}
+
+//	longest zones first so nested ones are drawn over the zones that contain them
+void ProfilerOverlay::addLanes(const std::vector<profileEvent>& events, uint64_t frameStart, double span, float top, GLuint lanes)
+{
+	zones.assign(events.begin(), events.end());
+	std::sort(zones.begin(), zones.end(), [](const profileEvent& a, const profileEvent& b)
+	{
+		return a.end - a.start > b.end - b.start;
+	});
+	for (size_t i = 0; i < zones.size(); i++)
+	{
+		const profileEvent& zone = zones[i];
+		double from = std::max(0.0, ((double)zone.start - (double)frameStart) / span);
+		double to = std::min(1.0, ((double)zone.end - (double)frameStart) / span);
+		if (zone.thread >= lanes || from >= 1.0 || to <= 0.0)
+		{
+			continue;
+		}
+		float color[3];
+		zoneColor(zone.name, color);
+		float left = OVERLAY_MARGIN + (float)from * OVERLAY_WIDTH;
+		float right = std::max(OVERLAY_MARGIN + (float)to * OVERLAY_WIDTH, left + 1.0f);
+		float bottom = top - (zone.thread + 1) * OVERLAY_LANE_HEIGHT;
+		addRect(left, bottom + 1.0f, right, bottom + OVERLAY_LANE_HEIGHT - 1.0f, color[0], color[1], color[2], 0.9f);
+	}
+}
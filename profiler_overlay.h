@@ -0,0 +1,52 @@
+#ifndef _PROFILER_OVERLAY_H
+#define _PROFILER_OVERLAY_H
+
+#include "profiler.h"
+#include "program_cache.h"
+#include "render_context.h"
+
+#define OVERLAY_BLOCK_BINDING	7
+#define OVERLAY_MARGIN			10		//	pixels from the bottom left corner
+#define OVERLAY_WIDTH			480
+#define OVERLAY_GRAPH_HEIGHT	96
+#define OVERLAY_GRAPH_MS		50.0f	//	frame time at the top of the graph
+#define OVERLAY_LANE_HEIGHT		10
+#define OVERLAY_MAX_LANES		12
+
+/**
+ * Live view of the profiler drawn over the frame: a graph of the last PROFILER_HISTORY frame
+ * times with the GPU time of each frame next to it, and above it a timeline of the last frame
+ * with a lane per thread (the GPU lane trails by PROFILER_GPU_LATENCY frames). Everything is
+ * a list of rectangles streamed through the ring buffer and expanded by the vertex shader;
+ * the numbers go into getSummary() for the window title, there is no text rendering.
+ */
+class ProfilerOverlay
+{
+	public:
+		ProfilerOverlay(renderContext&, ProgramCache&);
+		ProfilerOverlay(const ProfilerOverlay&) = delete;
+		ProfilerOverlay& operator=(const ProfilerOverlay&) = delete;
+
+		void draw(const Profiler&);
+		static std::string getSummary(const Profiler&);
+
+	private:
+		//	std430 layout of one OverlayBlock entry, in pixels from the bottom left
+		struct rect
+		{
+			float bounds[4];
+			float color[4];
+		};
+
+		renderContext& context;
+		ProgramCache& programs;
+		GLuint programID;
+		GLuint resolved;			//	program the block binding was set on
+		std::vector<rect> rects;
+		std::vector<profileEvent> zones;
+
+		void addRect(float, float, float, float, float, float, float, float);
+		void addLanes(const std::vector<profileEvent>&, uint64_t, double, float, GLuint);
+};
+
+#endif
@@ -0,0 +1,399 @@
+#include "program_cache.h"
+#include "profiler.h"
+#include "utils.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+	uint64_t fnv1a(const std::string& str, uint64_t hash = 14695981039346656037ULL)
+	{
+		for (size_t i = 0; i < str.size(); i++)
+		{
+			hash ^= (unsigned char)str[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	//	on-disk layout of a cached binary, the binary itself follows
+	struct binaryHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t format;
+		uint32_t length;
+	};
+
+	std::string getString(GLenum name)
+	{
+		const GLubyte* str = glGetString(name);
+		return str ? std::string((const char*)str) : std::string();
+	}
+}
+
+ProgramCache::ProgramCache(const std::string& _cacheDirectory) :
+	cacheDirectory(_cacheDirectory), parallel(false), binaries(false), watchFd(-1), generation(0)
+{
+	//	binaries only load on the driver that wrote them
+	driver = getString(GL_VENDOR) + '\n' + getString(GL_RENDERER) + '\n' + getString(GL_VERSION);
+	if (GLEW_KHR_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsKHR(0xffffffffu);
+		parallel = true;
+	}
+	else if (GLEW_ARB_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsARB(0xffffffffu);
+		parallel = true;
+	}
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	binaries = formats > 0;
+}
+
+ProgramCache::~ProgramCache()
+{
+	for (size_t i = 0; i < programs.size(); i++)
+	{
+		discardPending(programs[i]);
+		if (programs[i].name)
+		{
+			glDeleteProgram(programs[i].name);
+		}
+	}
+	if (watchFd >= 0)
+	{
+		close(watchFd);
+	}
+}
+
+//	the same files and defines give the same id; compiling starts here and is not waited for
+GLuint ProgramCache::add(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines)
+{
+	std::string desc = vertexPath + '\n' + fragmentPath + '\n' + defines;
+	std::map<std::string, GLuint>::iterator it = programsByDesc.find(desc);
+	if (it != programsByDesc.end())
+	{
+		return it->second;
+	}
+
+	GLuint id = programs.size();
+	programs.resize(programs.size() + 1);
+	program& p = programs.back();
+	p.vertexPath = vertexPath;
+	p.fragmentPath = fragmentPath;
+	p.defines = defines;
+	p.key = p.pendingKey = 0;
+	p.name = p.pending = 0;
+	p.shaders[0] = p.shaders[1] = 0;
+	programsByDesc[desc] = id;
+	start(p);
+	return id;
+}
+
+//	GL name of the program in use, waits for the first link; 0 when it never linked
+GLuint ProgramCache::getProgram(GLuint id)
+{
+	program& p = programs[id];
+	if (!p.name && p.pending)
+	{
+		complete(p);
+	}
+	return p.name;
+}
+
+//	true when asking for the link status would not stall
+bool ProgramCache::isReady(GLuint id) const
+{
+	const program& p = programs[id];
+	if (!p.pending || !parallel)
+	{
+		return true;
+	}
+	GLint done = GL_FALSE;
+	glGetProgramiv(p.pending, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+//	waits for every pending program, meant for after the initial add() calls
+void ProgramCache::finish()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	unsigned int linked = 0, loaded = 0;
+	for (size_t i = 0; i < programs.size(); i++)
+	{
+		program& p = programs[i];
+		bool binary = p.pending && !p.shaders[0];
+		if (p.pending && complete(p))
+		{
+			linked++;
+			loaded += binary;
+		}
+	}
+	double ms = elapsedMs(start, std::chrono::steady_clock::now());
+	_log("Programs: " << linked << " ready in " << ms << " ms, " << loaded << " from cached binaries"
+		<< (parallel ? ", parallel compile" : ""));
+}
+
+//	non-recursive; files are matched as the directory given here plus '/' plus their name
+bool ProgramCache::watch(const std::string& directory)
+{
+	if (watchFd < 0)
+	{
+		watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	}
+	if (watchFd < 0 || inotify_add_watch(watchFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		std::cerr << "Could not watch " << directory << " for shader changes: " << strerror(errno) << '\n';
+		return false;
+	}
+	watchedDirectory = directory;
+	return true;
+}
+
+/**
+ * Once per frame: starts recompiling programs whose files changed and swaps in those that
+ * have finished. True when a program name changed, which also bumps the generation.
+ */
+bool ProgramCache::update()
+{
+	PROFILE_ZONE("shader reload");
+	if (watchFd >= 0)
+	{
+		alignas(inotify_event) char buffer[PROGRAM_WATCH_BUFFER];
+		std::vector<std::string> changed;
+		ssize_t length;
+		while ((length = read(watchFd, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* ptr = buffer; ptr < buffer + length; ptr += sizeof(inotify_event) + ((inotify_event*)ptr)->len)
+			{
+				const inotify_event* event = (const inotify_event*)ptr;
+				if (event->len > 0)
+				{
+					changed.push_back(watchedDirectory + '/' + event->name);
+				}
+			}
+		}
+		for (size_t i = 0; i < programs.size() && !changed.empty(); i++)
+		{
+			program& p = programs[i];
+			for (size_t j = 0; j < changed.size(); j++)
+			{
+				if (changed[j] == p.vertexPath || changed[j] == p.fragmentPath)
+				{
+					start(p);
+					break;
+				}
+			}
+		}
+	}
+
+	bool swapped = false;
+	for (size_t i = 0; i < programs.size(); i++)
+	{
+		if (programs[i].pending && isReady(i) && complete(programs[i]))
+		{
+			_log("Program " << programs[i].vertexPath << " + " << programs[i].fragmentPath << " reloaded");
+			swapped = true;
+		}
+	}
+	return swapped;
+}
+
+unsigned int ProgramCache::getGeneration() const
+{
+	return generation;
+}
+
+//	reads both files and issues the binary load or the compile and link; false when nothing was started
+bool ProgramCache::start(program& p)
+{
+	std::string vertexSource, fragmentSource;
+	if (!Shader::readSource(p.vertexPath, vertexSource) || !Shader::readSource(p.fragmentPath, fragmentSource))
+	{
+		std::cerr << "Could not read the shader files " << p.vertexPath << ", " << p.fragmentPath << '\n';
+		return false;
+	}
+	Shader::insertDefines(vertexSource, p.defines);
+	Shader::insertDefines(fragmentSource, p.defines);
+	uint64_t key = fnv1a(fragmentSource, fnv1a(vertexSource, fnv1a(driver)));
+	if ((p.pending && key == p.pendingKey) || (!p.pending && p.name && key == p.key))
+	{
+		return false;
+	}
+	discardPending(p);
+	if (p.name && key == p.key)
+	{
+		return false;
+	}
+
+	p.pendingKey = key;
+	if (binaries && loadBinary(p))
+	{
+		return true;
+	}
+	p.shaders[0] = compileShader(GL_VERTEX_SHADER, vertexSource);
+	p.shaders[1] = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+	p.pending = glCreateProgram();
+	glAttachShader(p.pending, p.shaders[0]);
+	glAttachShader(p.pending, p.shaders[1]);
+	if (binaries)
+	{
+		glProgramParameteri(p.pending, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(p.pending);
+	return true;
+}
+
+//	waits for the pending program; a failed one is dropped with its logs and the old one stays
+bool ProgramCache::complete(program& p)
+{
+	GLint linked = GL_FALSE;
+	glGetProgramiv(p.pending, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		if (p.shaders[0])
+		{
+			showShaderLog(p.shaders[0], p.vertexPath);
+			showShaderLog(p.shaders[1], p.fragmentPath);
+		}
+		GLint length = 0;
+		glGetProgramiv(p.pending, GL_INFO_LOG_LENGTH, &length);
+		std::string log(std::max(length, 1), '\0');
+		glGetProgramInfoLog(p.pending, log.size(), NULL, &log[0]);
+		std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED " << p.vertexPath << " + " << p.fragmentPath << '\n' << log.c_str() << '\n';
+		discardPending(p);
+		return false;
+	}
+
+	if (p.shaders[0] && binaries)
+	{
+		storeBinary(p.pending, p.pendingKey);
+	}
+	GLuint pending = p.pending;
+	p.pending = 0;
+	discardPending(p);
+	if (p.name)
+	{
+		glDeleteProgram(p.name);
+	}
+	p.name = pending;
+	p.key = p.pendingKey;
+	generation++;
+	return true;
+}
+
+void ProgramCache::discardPending(program& p)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		if (p.shaders[i])
+		{
+			glDeleteShader(p.shaders[i]);
+			p.shaders[i] = 0;
+		}
+	}
+	if (p.pending)
+	{
+		glDeleteProgram(p.pending);
+		p.pending = 0;
+	}
+}
+
+//	a binary the driver refuses (it was updated, or the file is torn) is compiled again and overwritten
+bool ProgramCache::loadBinary(program& p)
+{
+	std::ifstream ifs(getBinaryPath(p.pendingKey), std::ios::binary);
+	binaryHeader header;
+	if (!ifs.read((char*)&header, sizeof(header)) || header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION)
+	{
+		return false;
+	}
+	std::vector<char> binary(header.length);
+	if (!ifs.read(binary.data(), binary.size()))
+	{
+		return false;
+	}
+
+	GLuint name = glCreateProgram();
+	glProgramBinary(name, header.format, binary.data(), binary.size());
+	GLint linked = GL_FALSE;
+	glGetProgramiv(name, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		glDeleteProgram(name);
+		return false;
+	}
+	p.pending = name;
+	return true;
+}
+
+//	written next to the final file and renamed, so a crash never leaves a torn binary behind
+void ProgramCache::storeBinary(GLuint name, uint64_t key) const
+{
+	GLint length = 0;
+	glGetProgramiv(name, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+	binaryHeader header;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(name, length, NULL, &format, binary.data());
+	header.magic = PROGRAM_CACHE_MAGIC;
+	header.version = PROGRAM_CACHE_VERSION;
+	header.format = format;
+	header.length = length;
+
+	mkdir(cacheDirectory.c_str(), 0755);
+	std::string path = getBinaryPath(key), tmpPath = path + ".tmp";
+	std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+	ofs.write((const char*)&header, sizeof(header));
+	ofs.write(binary.data(), binary.size());
+	ofs.close();
+	if (!ofs || std::rename(tmpPath.c_str(), path.c_str()) != 0)
+	{
+		std::remove(tmpPath.c_str());
+	}
+}
+
+std::string ProgramCache::getBinaryPath(uint64_t key) const
+{
+	char name[24];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return cacheDirectory + '/' + name;
+}
+
+//	compile only, the status is read with the link status when the program is needed
+GLuint ProgramCache::compileShader(GLenum type, const std::string& source)
+{
+	GLuint shader = glCreateShader(type);
+	const char* str = source.c_str();
+	glShaderSource(shader, 1, &str, NULL);
+	glCompileShader(shader);
+	return shader;
+}
+
+void ProgramCache::showShaderLog(GLuint shader, const std::string& path)
+{
+	GLint compiled = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (compiled)
+	{
+		return;
+	}
+	GLint length = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+	std::string log(std::max(length, 1), '\0');
+	glGetShaderInfoLog(shader, log.size(), NULL, &log[0]);
+	std::cerr << "ERROR::SHADER::COMPILATION_FAILED " << path << '\n' << log.c_str() << '\n';
+}
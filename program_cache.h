@@ -0,0 +1,71 @@
+#ifndef _PROGRAM_CACHE_H
+#define _PROGRAM_CACHE_H
+
+#include "shader.h"
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#define PROGRAM_CACHE_DIRECTORY	"shader_cache"
+#define PROGRAM_CACHE_MAGIC		0x42475250u	//	"PRGB"
+#define PROGRAM_CACHE_VERSION	1
+#define PROGRAM_WATCH_BUFFER	4096		//	bytes of inotify events read per call
+
+/**
+ * Programs linked from a vertex and a fragment shader file plus a block of defines, added once
+ * and referred to by a stable id. A program is keyed on a hash of the driver and both sources
+ * with their defines; linked binaries are stored under that key (glGetProgramBinary) and
+ * loaded instead of compiling on later launches. Compiles are only issued by add(), status is
+ * queried when the program is needed, so with KHR/ARB_parallel_shader_compile every program
+ * added up front compiles at once on the driver's threads.
+ * watch() follows a shader directory through inotify: update() recompiles programs whose files
+ * have changed and swaps them in once linked, a program that fails keeps its last good version.
+ * The GL name of a program changes with every swap, users re-resolve against getGeneration().
+ */
+class ProgramCache
+{
+	public:
+		explicit ProgramCache(const std::string& = PROGRAM_CACHE_DIRECTORY);
+		~ProgramCache();
+		ProgramCache(const ProgramCache&) = delete;
+		ProgramCache& operator=(const ProgramCache&) = delete;
+
+		GLuint add(const std::string&, const std::string&, const std::string& = "");
+		GLuint getProgram(GLuint);
+		bool isReady(GLuint) const;
+		void finish();
+		bool watch(const std::string&);
+		bool update();
+		unsigned int getGeneration() const;
+
+	private:
+		struct program
+		{
+			std::string vertexPath, fragmentPath, defines;
+			uint64_t key;			//	of the linked program in use
+			uint64_t pendingKey;
+			GLuint name;			//	linked and in use, 0 until the first link succeeds
+			GLuint pending;			//	loading or linking, replaces name once complete
+			GLuint shaders[2];		//	of a pending compile, none when the binary was loaded
+		};
+
+		std::string cacheDirectory;
+		std::string driver;
+		bool parallel, binaries;
+		std::vector<program> programs;
+		std::map<std::string, GLuint> programsByDesc;
+		int watchFd;
+		std::string watchedDirectory;
+		unsigned int generation;
+
+		bool start(program&);
+		bool complete(program&);
+		void discardPending(program&);
+		bool loadBinary(program&);
+		void storeBinary(GLuint, uint64_t) const;
+		std::string getBinaryPath(uint64_t) const;
+		static GLuint compileShader(GLenum, const std::string&);
+		static void showShaderLog(GLuint, const std::string&);
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _RENDER_CONTEXT_H
+#define _RENDER_CONTEXT_H
+
+#include "thread_pool.h"
+#include "texture_library.h"
+#include "mesh_arena.h"
+#include "material.h"
+#include "render_state.h"
+#include "ring_buffer.h"
+
+//	services shared by every Model: loader threads, texture streaming, GPU storage, bindings and per-frame data
+struct renderContext
+{
+	ThreadPool& threadPool;
+	TextureLibrary& textures;
+	MeshArena& meshArena;
+	MaterialLibrary& materials;
+	RenderState& state;
+	RingBuffer& stream;
+};
+
+#endif
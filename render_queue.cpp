@@ -0,0 +1,216 @@
+#include "render_queue.h"
+#include "profiler.h"
+#include "utils.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+RenderQueue::RenderQueue(renderContext& _context) : context(_context)
+{
+	stats.tasks = stats.draws = stats.dropped = 0;
+	stats.recordMs = stats.mergeMs = stats.submitMs = 0.0;
+}
+
+void RenderQueue::add(Model& model, const glm::mat4& transform)
+{
+	add(model, &transform, 1);
+}
+
+void RenderQueue::add(Model& model, const std::vector<glm::mat4>& transforms)
+{
+	if (!transforms.empty())
+	{
+		add(model, transforms.data(), transforms.size());
+	}
+}
+
+//	e.g. a run of SceneGraph world matrices; they have to stay put until execute()
+void RenderQueue::add(Model& model, const glm::mat4* transforms, size_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	//	two items of one model would be recorded at once, both writing its level of detail state
+	bool first = model.enqueue();
+	assert(first && "a model may only be added once per frame");
+	if (first)
+	{
+		item i = { &model, transforms, count };
+		items.push_back(i);
+	}
+}
+
+/**
+ * Records, merges and draws everything added since the last call, then empties the queue.
+ * Uniforms and the ring buffer frame are the caller's, as for any other draw.
+ */
+cullingStats RenderQueue::execute(const programSet& programs, const glm::mat4& viewProjection)
+{
+	cullingStats culling = { 0, 0 };
+	stats.tasks = stats.draws = stats.dropped = 0;
+	stats.recordMs = stats.mergeMs = stats.submitMs = 0.0;
+	RenderState& state = context.state;
+	RingBuffer& stream = context.stream;
+	float projectionScale = glm::length(glm::vec3(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1]))
+		* state.getViewportHeight() * 0.5f;
+
+	//	tasks are cut on the GL thread, which also brings the commands of every model up to date and culls the sets of instances
+	tasks.clear();
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		size_t range = items[i].model->prepareRecording(viewProjection, items[i].transforms, items[i].count, culling);
+		size_t chunk = items[i].count > 1 ? INSTANCE_CHUNK : 1;
+		for (size_t first = 0; first < range; first += chunk)
+		{
+			task t;
+			t.item = i;
+			t.first = first;
+			t.last = std::min(first + chunk, range);
+			tasks.push_back(t);
+		}
+	}
+	if (batches.size() < tasks.size())
+	{
+		batches.resize(tasks.size());
+	}
+	stats.tasks = tasks.size();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	context.threadPool.parallelFor(tasks.size(), [this, &viewProjection, projectionScale](size_t i)
+	{
+		PROFILE_ZONE("record");
+		const task& t = tasks[i];
+		const item& it = items[t.item];
+		it.model->record(viewProjection, projectionScale, it.transforms, it.count, t.first, t.last, batches[i]);
+	});
+	std::chrono::steady_clock::time_point recorded = std::chrono::steady_clock::now();
+	stats.recordMs = elapsedMs(start, recorded);
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		items[i].model->dequeue();
+	}
+	items.clear();
+
+	//	batches go side by side within each variant
+	frameDraws draws;
+	std::fill(draws.drawCounts, draws.drawCounts + MATERIAL_VARIANTS, 0);
+	std::fill(draws.triangles, draws.triangles + MATERIAL_VARIANTS, 0);
+	size_t instanceCount = 0;
+	for (size_t i = 0; i < tasks.size(); i++)
+	{
+		const drawBatch& batch = batches[i];
+		culling.visible += batch.culling.visible;
+		culling.culled += batch.culling.culled;
+		tasks[i].firstInstance = instanceCount;
+		instanceCount += batch.instances.size();
+		for (size_t v = 0; v < MATERIAL_VARIANTS; v++)
+		{
+			tasks[i].firstDraws[v] = draws.drawCounts[v];
+			draws.drawCounts[v] += batch.variantDraws[v + 1] - batch.variantDraws[v];
+			draws.triangles[v] += batch.triangles[v];
+		}
+	}
+	for (size_t v = 0; v < MATERIAL_VARIANTS; v++)
+	{
+		stats.draws += draws.drawCounts[v];
+	}
+	if (instanceCount == 0)
+	{
+		return culling;
+	}
+
+	GLintptr instancesOffset = 0;
+	GLsizeiptr instancesSize = instanceCount * sizeof(instanceData);
+	instanceData* instances = (instanceData*)stream.allocate(instancesSize, stream.getStorageAlignment(), instancesOffset);
+	if (!instances || !allocateDraws(stream, draws))
+	{
+		stats.dropped = stats.draws;
+		return culling;
+	}
+	context.threadPool.parallelFor(tasks.size(), [&](size_t i)
+	{
+		PROFILE_ZONE("merge");
+		const drawBatch& batch = batches[i];
+		const task& t = tasks[i];
+		std::copy(batch.instances.begin(), batch.instances.end(), instances + t.firstInstance);
+		for (size_t v = 0; v < MATERIAL_VARIANTS; v++)
+		{
+			size_t draw = draws.firstDraws[v] + t.firstDraws[v];
+			for (size_t c = batch.variantDraws[v]; c < batch.variantDraws[v + 1]; c++, draw++)
+			{
+				draws.commands[draw] = batch.commands[c];
+				draws.records[draw] = batch.records[c];
+				draws.records[draw].firstInstance += t.firstInstance;
+			}
+		}
+	});
+	std::chrono::steady_clock::time_point merged = std::chrono::steady_clock::now();
+	stats.mergeMs = elapsedMs(recorded, merged);
+
+	//	no allocations and no name lookups from here on, repeated binds are filtered by the state
+	PROFILE_ZONE("submit");
+	context.materials.bind(state);
+	state.bindVertexArray(context.meshArena.getVAO());
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, INSTANCE_BLOCK_BINDING, stream.getBuffer(), instancesOffset, instancesSize);
+	submitDraws(context, programs, draws);
+	stats.submitMs = elapsedMs(merged, std::chrono::steady_clock::now());
+	return culling;
+}
+
+const renderQueueStats& RenderQueue::getStats() const
+{
+	return stats;
+}
+
+//	takes drawCounts, places the variants and allocates their commands and records; each variant's records start on a storage alignment
+bool RenderQueue::allocateDraws(RingBuffer& stream, frameDraws& draws)
+{
+	size_t recordAlignment = std::max<size_t>(1, stream.getStorageAlignment() / sizeof(drawRecord)), slots = 0;
+	for (size_t v = 0; v < MATERIAL_VARIANTS; v++)
+	{
+		draws.firstDraws[v] = slots;
+		slots += (draws.drawCounts[v] + recordAlignment - 1) / recordAlignment * recordAlignment;
+	}
+	draws.commandsOffset = draws.recordsOffset = 0;
+	draws.commands = (drawElementsIndirectCommand*)stream.allocate(slots * sizeof(drawElementsIndirectCommand), sizeof(GLuint), draws.commandsOffset);
+	draws.records = (drawRecord*)stream.allocate(slots * sizeof(drawRecord), stream.getStorageAlignment(), draws.recordsOffset);
+	return draws.commands && draws.records;
+}
+
+/**
+ * One multi-draw per variant with its program and its run of draw records. Materials, the
+ * vertex array and the instance block (and whatever else the programs read) are bound by the
+ * caller; no allocations and no name lookups here, repeated binds are filtered by the state.
+ */
+void RenderQueue::submitDraws(renderContext& context, const programSet& programs, const frameDraws& draws)
+{
+	RenderState& state = context.state;
+	GLuint buffer = context.stream.getBuffer();
+	state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+	for (size_t v = 0; v < MATERIAL_VARIANTS; v++)
+	{
+		if (draws.drawCounts[v] == 0 || !programs.programs[v])
+		{
+			continue;
+		}
+		GLintptr variantCommands = draws.commandsOffset + draws.firstDraws[v] * sizeof(drawElementsIndirectCommand);
+		state.useProgram(programs.programs[v]);
+		state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_BLOCK_BINDING, buffer,
+			draws.recordsOffset + draws.firstDraws[v] * sizeof(drawRecord), draws.drawCounts[v] * sizeof(drawRecord));
+		if (GLEW_ARB_shader_draw_parameters)
+		{
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)variantCommands, draws.drawCounts[v], 0);
+			state.countDraws(1, draws.triangles[v]);
+			continue;
+		}
+		state.countDraws(draws.drawCounts[v], draws.triangles[v]);
+
+		//	without gl_DrawIDARB the shader reads the draw index from uniform location 0
+		for (size_t i = 0; i < draws.drawCounts[v]; i++)
+		{
+			glUniform1i(DRAW_ID_FALLBACK_LOC, i);
+			glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)(variantCommands + i * sizeof(drawElementsIndirectCommand)));
+		}
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef _RENDER_QUEUE_H
+#define _RENDER_QUEUE_H
+
+#include "model.h"
+
+struct renderQueueStats
+{
+	unsigned int tasks;
+	unsigned int draws;			//	commands over all multi-draws
+	unsigned int dropped;		//	commands not drawn because the ring buffer was full
+	double recordMs;			//	culling, levels of detail and commands, on the pool
+	double mergeMs;				//	placing batches in the ring buffer, on the pool
+	double submitMs;			//	binds and draw calls on the GL thread
+};
+
+//	a frame's draws in the ring buffer, one run of commands and records per material variant
+struct frameDraws
+{
+	GLuint drawCounts[MATERIAL_VARIANTS];
+	unsigned long long triangles[MATERIAL_VARIANTS];
+
+	//	filled by RenderQueue::allocateDraws
+	GLuint firstDraws[MATERIAL_VARIANTS];
+	GLintptr commandsOffset, recordsOffset;
+	drawElementsIndirectCommand* commands;
+	drawRecord* records;
+};
+
+/**
+ * Collects the models drawn in a frame and draws them all with one multi-draw per material
+ * variant. execute() splits the models into recording tasks (one per model, the visible
+ * instances of a set into INSTANCE_CHUNK ranges) and records them on the pool into a drawBatch each; the batches
+ * are then copied side by side into the ring buffer, with instance offsets rebased, and the GL
+ * thread only binds the buffers and issues the draws.
+ * Transforms are read during execute(), they have to stay in place until then. A model may be
+ * added once per frame, its level of detail state is updated while recording; add() asserts
+ * this, and drops the repeat when asserts are compiled out.
+ */
+class RenderQueue
+{
+	public:
+		explicit RenderQueue(renderContext&);
+		RenderQueue(const RenderQueue&) = delete;
+		RenderQueue& operator=(const RenderQueue&) = delete;
+
+		void add(Model&, const glm::mat4&);
+		void add(Model&, const std::vector<glm::mat4>&);
+		void add(Model&, const glm::mat4*, size_t);
+		cullingStats execute(const programSet&, const glm::mat4&);
+		const renderQueueStats& getStats() const;
+
+		//	for other renderers drawing out of the ring buffer the same way
+		static bool allocateDraws(RingBuffer&, frameDraws&);
+		static void submitDraws(renderContext&, const programSet&, const frameDraws&);
+
+	private:
+		struct item
+		{
+			Model* model;
+			const glm::mat4* transforms;
+			size_t count;
+		};
+
+		struct task
+		{
+			GLuint item;
+			GLuint first, last;
+			GLuint firstInstance;				//	of the batch in the frame's instances
+			GLuint firstDraws[MATERIAL_VARIANTS];	//	of the batch in the frame's commands
+		};
+
+		renderContext& context;
+		std::vector<item> items;
+		std::vector<task> tasks;
+		std::vector<drawBatch> batches;			//	one per task, kept across frames
+		renderQueueStats stats;
+};
+
+#endif
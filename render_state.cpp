@@ -0,0 +1,185 @@
+#include "render_state.h"
+
+RenderState::RenderState() : issued(0), skipped(0), drawCalls(0), triangles(0)
+{
+	invalidate();
+	glGetIntegerv(GL_VIEWPORT, viewport);
+}
+
+//	~0 never matches a real name, so the first bind after invalidate() always goes through
+void RenderState::invalidate()
+{
+	program = vertexArray = drawIndirectBuffer = ~0u;
+	for (int i = 0; i < RENDER_STATE_TEXTURE_UNITS; i++)
+	{
+		textures[i] = ~0u;
+	}
+	for (int i = 0; i < RENDER_STATE_BUFFER_SLOTS; i++)
+	{
+		uniformBuffers[i].buffer = storageBuffers[i].buffer = ~0u;
+	}
+}
+
+//	names are per object type, so an entry of another type may be dropped too, which only costs a bind;
+//	programs need not be forgotten, a deleted program keeps its name for as long as it is in use
+void RenderState::forget(GLuint name)
+{
+	if (vertexArray == name)
+	{
+		vertexArray = ~0u;
+	}
+	if (drawIndirectBuffer == name)
+	{
+		drawIndirectBuffer = ~0u;
+	}
+	for (int i = 0; i < RENDER_STATE_TEXTURE_UNITS; i++)
+	{
+		if (textures[i] == name)
+		{
+			textures[i] = ~0u;
+		}
+	}
+	for (int i = 0; i < RENDER_STATE_BUFFER_SLOTS; i++)
+	{
+		if (uniformBuffers[i].buffer == name)
+		{
+			uniformBuffers[i].buffer = ~0u;
+		}
+		if (storageBuffers[i].buffer == name)
+		{
+			storageBuffers[i].buffer = ~0u;
+		}
+	}
+}
+
+bool RenderState::changed(GLuint& current, GLuint value)
+{
+	if (current == value)
+	{
+		skipped++;
+		return false;
+	}
+	current = value;
+	issued++;
+	return true;
+}
+
+void RenderState::useProgram(GLuint _program)
+{
+	if (changed(program, _program))
+	{
+		glUseProgram(_program);
+	}
+}
+
+void RenderState::bindVertexArray(GLuint _vertexArray)
+{
+	if (changed(vertexArray, _vertexArray))
+	{
+		glBindVertexArray(_vertexArray);
+	}
+}
+
+void RenderState::bindTexture(GLuint unit, GLuint texture)
+{
+	if (unit >= RENDER_STATE_TEXTURE_UNITS)
+	{
+		glBindTextureUnit(unit, texture);
+		issued++;
+		return;
+	}
+	if (changed(textures[unit], texture))
+	{
+		glBindTextureUnit(unit, texture);
+	}
+}
+
+void RenderState::bindBuffer(GLenum target, GLuint buffer)
+{
+	if (target != GL_DRAW_INDIRECT_BUFFER)
+	{
+		glBindBuffer(target, buffer);
+		issued++;
+		return;
+	}
+	if (changed(drawIndirectBuffer, buffer))
+	{
+		glBindBuffer(target, buffer);
+	}
+}
+
+void RenderState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	rangeBinding* slots = target == GL_UNIFORM_BUFFER ? uniformBuffers : target == GL_SHADER_STORAGE_BUFFER ? storageBuffers : nullptr;
+	if (slots && index < RENDER_STATE_BUFFER_SLOTS)
+	{
+		rangeBinding& slot = slots[index];
+		if (slot.buffer == buffer && slot.offset == offset && slot.size == size)
+		{
+			skipped++;
+			return;
+		}
+		slot.buffer = buffer;
+		slot.offset = offset;
+		slot.size = size;
+	}
+	glBindBufferRange(target, index, buffer, offset, size);
+	issued++;
+}
+
+void RenderState::countDraws(unsigned int calls, unsigned long long _triangles)
+{
+	drawCalls += calls;
+	triangles += _triangles;
+}
+
+unsigned int RenderState::getIssued() const
+{
+	return issued;
+}
+
+unsigned int RenderState::getSkipped() const
+{
+	return skipped;
+}
+
+unsigned int RenderState::getDrawCalls() const
+{
+	return drawCalls;
+}
+
+unsigned long long RenderState::getTriangles() const
+{
+	return triangles;
+}
+
+void RenderState::resetCounters()
+{
+	issued = skipped = drawCalls = 0;
+	triangles = 0;
+}
+
+void RenderState::setViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height)
+	{
+		skipped++;
+		return;
+	}
+	viewport[0] = x;
+	viewport[1] = y;
+	viewport[2] = width;
+	viewport[3] = height;
+	issued++;
+	glViewport(x, y, width, height);
+}
+
+GLsizei RenderState::getViewportWidth() const
+{
+	return viewport[2];
+}
+
+GLsizei RenderState::getViewportHeight() const
+{
+	return viewport[3];
+}
@@ -0,0 +1,62 @@
+#ifndef _RENDER_STATE_H
+#define _RENDER_STATE_H
+
+#include <GL/glew.h>
+
+#define RENDER_STATE_TEXTURE_UNITS	16
+#define RENDER_STATE_BUFFER_SLOTS	8
+
+/**
+ * Shadow copy of the GL bindings the render path touches; every bind goes through here and
+ * is dropped when it would not change anything. Textures are bound with glBindTextureUnit so
+ * the active texture unit is never part of the tracked state.
+ * Code that binds behind its back must call invalidate(), and code that deletes a buffer,
+ * texture or vertex array it may have bound here must call forget() first, or a recycled name
+ * would match the stale entry and its bind be dropped. The viewport is read back once on
+ * construction and then only changes through setViewport(); LOD selection sizes errors with it and
+ * light clusters are laid over it. Draws are counted here as well, so one resetCounters()
+ * per frame gives all per-frame submission numbers.
+ */
+class RenderState
+{
+	public:
+		RenderState();
+		void useProgram(GLuint);
+		void bindVertexArray(GLuint);
+		void bindTexture(GLuint, GLuint);
+		void bindBuffer(GLenum, GLuint);
+		void bindBufferRange(GLenum, GLuint, GLuint, GLintptr, GLsizeiptr);
+		void setViewport(GLint, GLint, GLsizei, GLsizei);
+		void invalidate();
+		void forget(GLuint);
+
+		void countDraws(unsigned int, unsigned long long);
+
+		unsigned int getIssued() const;
+		unsigned int getSkipped() const;
+		unsigned int getDrawCalls() const;
+		unsigned long long getTriangles() const;
+		GLsizei getViewportWidth() const;
+		GLsizei getViewportHeight() const;
+		void resetCounters();
+
+	private:
+		struct rangeBinding
+		{
+			GLuint buffer;
+			GLintptr offset;
+			GLsizeiptr size;
+		};
+
+		GLuint program, vertexArray, drawIndirectBuffer;
+		GLuint textures[RENDER_STATE_TEXTURE_UNITS];
+		rangeBinding uniformBuffers[RENDER_STATE_BUFFER_SLOTS];
+		rangeBinding storageBuffers[RENDER_STATE_BUFFER_SLOTS];
+		GLint viewport[4];
+		unsigned int issued, skipped, drawCalls;
+		unsigned long long triangles;
+
+		bool changed(GLuint&, GLuint);
+};
+
+#endif
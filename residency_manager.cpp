@@ -0,0 +1,346 @@
+#include "residency_manager.h"
+#include "profiler.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+
+ResidencyManager::ResidencyManager(renderContext& _context, GLsizeiptr _gpuBudget, size_t _hostBudget) :
+	context(_context), gpuBudget(_gpuBudget), hostBudget(_hostBudget), results(THREAD_POOL_QUEUE_SIZE), inFlight(0), frame(0)
+{
+	stats.models = stats.resident = stats.loading = stats.evicted = 0;
+	stats.gpuBytes = 0;
+	stats.hostBytes = 0;
+}
+
+//	jobs hold pointers to our models, wait for them and drop whatever they bring back
+ResidencyManager::~ResidencyManager()
+{
+	loadResult result;
+	while (inFlight > 0)
+	{
+		while (results.pop(result))
+		{
+			inFlight--;
+		}
+		std::this_thread::yield();
+	}
+}
+
+//	nothing is loaded here, the model is ranked from the next update() on
+GLuint ResidencyManager::add(const std::string& path, const glm::mat4& transform)
+{
+	entries.emplace_back();
+	entry& e = entries.back();
+	e.model.reset(new Model(path, context, true));
+	e.transform = transform;
+	e.state = ENTRY_UNLOADED;
+	e.stagedBytes = 0;
+	e.packed = false;
+	e.known = false;
+	e.gpuBytes = 0;
+	e.priority = 0.0f;
+	e.visible = false;
+	e.lastVisible = 0;
+	return entries.size() - 1;
+}
+
+void ResidencyManager::setTransform(GLuint id, const glm::mat4& transform)
+{
+	entries[id].transform = transform;
+}
+
+//	once per frame on the context thread, after the camera has moved and before rendering
+void ResidencyManager::update(const Camera& camera, const glm::mat4& viewProjection)
+{
+	PROFILE_ZONE("residency");
+	frame++;
+	collect();
+	rank(camera, viewProjection);
+	startLoads();
+	uploadStaged();
+	requestTextures();
+	enforceBudgets();
+}
+
+//	resident models are drawn with the rest of the frame, culled per part while recording
+void ResidencyManager::enqueue(RenderQueue& queue) const
+{
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (entries[i].state == ENTRY_RESIDENT)
+		{
+			queue.add(*entries[i].model, entries[i].transform);
+		}
+	}
+}
+
+const residencyStats& ResidencyManager::getStats() const
+{
+	return stats;
+}
+
+/**
+ * Priority is the size in pixels a model's bounding sphere would have at its distance from the
+ * camera, so near and large models come first. Models never loaded are ranked by their placement alone.
+ */
+void ResidencyManager::rank(const Camera& camera, const glm::mat4& viewProjection)
+{
+	float projectionScale = glm::length(glm::vec3(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1]))
+		* context.state.getViewportHeight() * 0.5f;
+	order.clear();
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		entry& e = entries[i];
+		if (e.state == ENTRY_FAILED)
+		{
+			continue;
+		}
+		boundingVolume bounds;
+		if (e.known)
+		{
+			bounds = e.model->getBounds();
+		}
+		else
+		{
+			bounds.center = glm::vec3(0.0f);
+			bounds.radius = RESIDENCY_UNKNOWN_RADIUS;
+			bounds.min = glm::vec3(-RESIDENCY_UNKNOWN_RADIUS);
+			bounds.max = glm::vec3(RESIDENCY_UNKNOWN_RADIUS);
+		}
+
+		glm::mat3 basis(e.transform);
+		float radius = bounds.radius * std::max(glm::length(basis[0]), std::max(glm::length(basis[1]), glm::length(basis[2])));
+		glm::vec3 center = glm::vec3(e.transform * glm::vec4(bounds.center, 1.0f));
+		float distance = std::max(glm::distance(camera.position, center) - radius, 0.001f);
+		e.visible = Frustum(viewProjection * e.transform).intersects(bounds);
+		if (e.visible)
+		{
+			e.lastVisible = frame;
+		}
+		e.priority = 2.0f * radius * projectionScale / distance * (e.visible ? 1.0f : RESIDENCY_OFFSCREEN_WEIGHT);
+		order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [this](GLuint a, GLuint b)
+	{
+		return entries[a].priority > entries[b].priority;
+	});
+}
+
+//	finished jobs; a model that failed to import is not tried again
+void ResidencyManager::collect()
+{
+	loadResult result;
+	while (results.pop(result))
+	{
+		inFlight--;
+		entry& e = entries[result.entry];
+		if (!result.loaded)
+		{
+			e.state = ENTRY_FAILED;
+			continue;
+		}
+		e.staged.swap(result.meshes);
+		e.stagedBytes = getStagedBytes(e.staged);
+		e.packed = true;
+		e.state = ENTRY_STAGED;
+		e.gpuBytes = 0;
+		for (size_t i = 0; i < e.staged.size(); i++)
+		{
+			e.gpuBytes += e.staged[i].packed.data.size() + e.staged[i].indices.size() * sizeof(GLuint);
+		}
+	}
+}
+
+//	imports, or packs a host copy again, best ranked first; models off screen only into room the budget has left
+void ResidencyManager::startLoads()
+{
+	GLsizeiptr used = getGpuBytes();
+	for (size_t i = 0; i < order.size() && inFlight < RESIDENCY_MAX_LOADS; i++)
+	{
+		entry& e = entries[order[i]];
+		if (e.state != ENTRY_UNLOADED && (e.state != ENTRY_STAGED || e.packed))
+		{
+			continue;
+		}
+		if (!e.visible && used + e.gpuBytes > gpuBudget)
+		{
+			continue;
+		}
+		used += e.gpuBytes;
+
+		std::shared_ptr<std::vector<meshData> > meshes = std::make_shared<std::vector<meshData> >();
+		meshes->swap(e.staged);
+		e.stagedBytes = 0;
+		e.state = ENTRY_LOADING;
+		inFlight++;
+		context.threadPool.submit(std::bind(&ResidencyManager::load, this, order[i], e.model.get(), meshes));
+	}
+}
+
+//	worker thread; meshes holds a host copy to pack, or nothing when the model has to be imported
+void ResidencyManager::load(GLuint id, Model* model, std::shared_ptr<std::vector<meshData> > meshes)
+{
+	loadResult result;
+	result.entry = id;
+	result.meshes.swap(*meshes);
+	result.loaded = !result.meshes.empty() || model->importMeshes(result.meshes);
+	if (result.loaded)
+	{
+		model->packMeshes(result.meshes);
+	}
+	while (!results.push(std::move(result)))
+	{
+		std::this_thread::yield();
+	}
+}
+
+//	GL uploads until the time budget is spent (at least one per call), best ranked first
+void ResidencyManager::uploadStaged()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	GLsizeiptr used = getGpuBytes();
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		entry& e = entries[order[i]];
+		if (e.state != ENTRY_STAGED || !e.packed || (!e.visible && used + e.gpuBytes > gpuBudget))
+		{
+			continue;
+		}
+		e.model->upload(e.staged);
+		e.stagedBytes = 0;
+		e.packed = false;
+		e.known = true;
+		e.state = ENTRY_RESIDENT;
+		e.gpuBytes = e.model->getResidentBytes();
+		used += e.gpuBytes;
+		if (elapsedMs(start, std::chrono::steady_clock::now()) >= RESIDENCY_UPLOAD_BUDGET_MS)
+		{
+			break;
+		}
+	}
+}
+
+//	lowest ranked first, so a texture shared by several models ends up with the wish of the largest one on screen
+void ResidencyManager::requestTextures()
+{
+	for (size_t i = order.size(); i-- > 0;)
+	{
+		entry& e = entries[order[i]];
+		if (e.state != ENTRY_RESIDENT)
+		{
+			continue;
+		}
+		bool full = e.priority >= TEXTURE_STREAM_LOW_SIZE;
+		textureSlots.clear();
+		e.model->getTextureSlots(textureSlots);
+		for (size_t j = 0; j < textureSlots.size(); j++)
+		{
+			context.textures.request(textureSlots[j], full, frame);
+		}
+	}
+}
+
+/**
+ * Over the GPU budget, texture levels nobody wants are dropped first, then models not visible
+ * this frame are evicted, least recently visible first. Over the host budget, host copies of
+ * evicted models are dropped in the same order.
+ */
+void ResidencyManager::enforceBudgets()
+{
+	GLsizeiptr gpuUsed = getGpuBytes();
+	if (gpuUsed > gpuBudget)
+	{
+		gpuUsed -= context.textures.demote(gpuUsed - gpuBudget);
+	}
+
+	std::vector<GLuint> candidates;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (entries[i].state == ENTRY_RESIDENT && !entries[i].visible)
+		{
+			candidates.push_back(i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](GLuint a, GLuint b)
+	{
+		const entry& ea = entries[a];
+		const entry& eb = entries[b];
+		return ea.lastVisible != eb.lastVisible ? ea.lastVisible < eb.lastVisible : ea.priority < eb.priority;
+	});
+	stats.evicted = 0;
+	for (size_t i = 0; i < candidates.size() && gpuUsed > gpuBudget; i++)
+	{
+		evict(entries[candidates[i]]);
+		gpuUsed = getGpuBytes();
+		stats.evicted++;
+	}
+
+	size_t hostUsed = 0;
+	candidates.clear();
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		const entry& e = entries[i];
+		hostUsed += e.stagedBytes + (e.state == ENTRY_RESIDENT ? e.model->getHostBytes() : 0);
+		if (e.state == ENTRY_STAGED)
+		{
+			candidates.push_back(i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](GLuint a, GLuint b)
+	{
+		const entry& ea = entries[a];
+		const entry& eb = entries[b];
+		return ea.lastVisible != eb.lastVisible ? ea.lastVisible < eb.lastVisible : ea.priority < eb.priority;
+	});
+	for (size_t i = 0; i < candidates.size() && hostUsed > hostBudget; i++)
+	{
+		entry& e = entries[candidates[i]];
+		hostUsed -= e.stagedBytes;
+		std::vector<meshData>().swap(e.staged);
+		e.stagedBytes = 0;
+		e.packed = false;
+		e.state = ENTRY_UNLOADED;
+	}
+
+	stats.models = entries.size();
+	stats.resident = 0;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		stats.resident += entries[i].state == ENTRY_RESIDENT;
+	}
+	stats.loading = inFlight;
+	stats.gpuBytes = gpuUsed;
+	stats.hostBytes = hostUsed;
+}
+
+//	the CPU side data becomes the host copy, unpacked; gpuBytes is kept to judge room for a return
+void ResidencyManager::evict(entry& e)
+{
+	e.model->unload(e.staged);
+	e.stagedBytes = getStagedBytes(e.staged);
+	e.packed = false;
+	e.state = ENTRY_STAGED;
+}
+
+GLsizeiptr ResidencyManager::getGpuBytes() const
+{
+	GLsizeiptr bytes = context.textures.getResidentBytes();
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (entries[i].state == ENTRY_RESIDENT)
+		{
+			bytes += entries[i].gpuBytes;
+		}
+	}
+	return bytes;
+}
+
+size_t ResidencyManager::getStagedBytes(const std::vector<meshData>& meshes)
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		bytes += meshes[i].vertices.size() * sizeof(vertex) + meshes[i].indices.size() * sizeof(GLuint) + meshes[i].packed.data.size();
+	}
+	return bytes;
+}
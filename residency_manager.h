@@ -0,0 +1,104 @@
+#ifndef _RESIDENCY_MANAGER_H
+#define _RESIDENCY_MANAGER_H
+
+#include "render_queue.h"
+#include "camera.h"
+#include <memory>
+
+#define RESIDENCY_GPU_BUDGET		((GLsizeiptr)256 << 20)	//	arena allocations and texture levels
+#define RESIDENCY_HOST_BUDGET		((size_t)512 << 20)		//	CPU copies of resident models and of evicted ones kept for a quick return
+#define RESIDENCY_MAX_LOADS			2		//	models importing on the pool at once
+#define RESIDENCY_UPLOAD_BUDGET_MS	4.0
+#define RESIDENCY_OFFSCREEN_WEIGHT	0.25f	//	priority of a model outside the frustum, relative to its screen size
+#define RESIDENCY_UNKNOWN_RADIUS	1.0f	//	bounding radius assumed before a model has been loaded once
+
+struct residencyStats
+{
+	unsigned int models, resident, loading;
+	GLsizeiptr gpuBytes;
+	size_t hostBytes;
+	unsigned int evicted;	//	models dropped from the GPU during the last update
+};
+
+/**
+ * Loads models in the background and keeps as many of them resident as the budgets allow.
+ * Every update() ranks the models by projected size on screen (distance from the camera
+ * and bounding radius, models outside the frustum weigh less), imports the best ranked
+ * ones on the pool and uploads finished ones within a time budget, most wanted first.
+ * Textures of models larger on screen than TEXTURE_STREAM_LOW_SIZE are requested at full
+ * resolution, the others keep their low levels. Over the GPU budget, unwanted texture levels
+ * are demoted first, then the least recently visible models are evicted; their CPU side data
+ * stays as a host copy while the host budget allows, and is read from the mesh cache again
+ * otherwise. Models visible this frame are never evicted.
+ */
+class ResidencyManager
+{
+	public:
+		ResidencyManager(renderContext&, GLsizeiptr = RESIDENCY_GPU_BUDGET, size_t = RESIDENCY_HOST_BUDGET);
+		~ResidencyManager();
+		ResidencyManager(const ResidencyManager&) = delete;
+		ResidencyManager& operator=(const ResidencyManager&) = delete;
+
+		GLuint add(const std::string&, const glm::mat4&);
+		void setTransform(GLuint, const glm::mat4&);
+		void update(const Camera&, const glm::mat4&);
+		void enqueue(RenderQueue&) const;
+		const residencyStats& getStats() const;
+
+	private:
+		enum entryState
+		{
+			ENTRY_UNLOADED,
+			ENTRY_LOADING,
+			ENTRY_STAGED,		//	CPU side data ready, packed when it came from a load
+			ENTRY_RESIDENT,
+			ENTRY_FAILED
+		};
+
+		struct entry
+		{
+			std::unique_ptr<Model> model;
+			glm::mat4 transform;
+			entryState state;
+			std::vector<meshData> staged;
+			size_t stagedBytes;
+			bool packed;
+			bool known;					//	bounds come from a load, not guessed
+			GLsizeiptr gpuBytes;		//	of the last residency, 0 before the first
+			float priority;
+			bool visible;
+			unsigned int lastVisible;
+		};
+
+		//	handed back from the pool; staged data is moved through so entries never change under a job
+		struct loadResult
+		{
+			GLuint entry;
+			bool loaded;
+			std::vector<meshData> meshes;
+		};
+
+		renderContext& context;
+		GLsizeiptr gpuBudget;
+		size_t hostBudget;
+		std::vector<entry> entries;
+		std::vector<GLuint> order;
+		std::vector<GLuint> textureSlots;
+		LockFreeQueue<loadResult> results;
+		std::atomic<int> inFlight;
+		unsigned int frame;
+		residencyStats stats;
+
+		void rank(const Camera&, const glm::mat4&);
+		void collect();
+		void startLoads();
+		void uploadStaged();
+		void requestTextures();
+		void enforceBudgets();
+		void evict(entry&);
+		GLsizeiptr getGpuBytes() const;
+		void load(GLuint, Model*, std::shared_ptr<std::vector<meshData> >);
+		static size_t getStagedBytes(const std::vector<meshData>&);
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "ring_buffer.h"
+#include "profiler.h"
+#include <iostream>
+
+RingBuffer::RingBuffer(GLsizeiptr _regionSize) :
+	mapped(nullptr), regionSize(_regionSize), storageAlignment(256), uniformAlignment(256), head(0), region(0), frame(0), completed(0), overflows(0), overflowReported(false)
+{
+	GLint alignment = 256;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	storageAlignment = alignment;
+	alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	uniformAlignment = alignment;
+	for (int i = 0; i < RING_BUFFER_FRAMES; i++)
+	{
+		fences[i] = 0;
+	}
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	buffer = GLBuffer::create();
+	glNamedBufferStorage(buffer.get(), regionSize * RING_BUFFER_FRAMES, nullptr, flags);
+	mapped = (unsigned char*)glMapNamedBufferRange(buffer.get(), 0, regionSize * RING_BUFFER_FRAMES, flags);
+	if (!mapped)
+	{
+		std::cerr << "Could not map the ring buffer\n";
+	}
+}
+
+RingBuffer::~RingBuffer()
+{
+	for (int i = 0; i < RING_BUFFER_FRAMES; i++)
+	{
+		if (fences[i])
+		{
+			glDeleteSync(fences[i]);
+		}
+	}
+	if (mapped)
+	{
+		glUnmapNamedBuffer(buffer.get());
+	}
+}
+
+//	blocks only when the GPU is more than RING_BUFFER_FRAMES - 1 frames behind
+void RingBuffer::beginFrame()
+{
+	GLsync& fence = fences[region];
+	if (fence)
+	{
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+		{
+		}
+		glDeleteSync(fence);
+		fence = 0;
+		completed = frame - RING_BUFFER_FRAMES + 1;
+	}
+	head = 0;
+}
+
+void RingBuffer::endFrame()
+{
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	region = (region + 1) % RING_BUFFER_FRAMES;
+	frame++;
+	head = 0;
+}
+
+//	offset is relative to the start of the buffer; nullptr when this frame's region is full
+void* RingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset)
+{
+	GLintptr start = (head + alignment - 1) / alignment * alignment;
+	if (!mapped || start + size > regionSize)
+	{
+		overflows++;
+		PROFILE_COUNT(COUNTER_RING_OVERFLOWS, 1);
+		if (!overflowReported)
+		{
+			std::cerr << "Ring buffer region of " << regionSize << " bytes is full in frame " << frame << " (" << size
+				<< " more bytes asked for), raise RING_BUFFER_SIZE; later overflows are only counted\n";
+			overflowReported = true;
+		}
+		return nullptr;
+	}
+	head = start + size;
+	PROFILE_COUNT(COUNTER_UPLOAD_BYTES, size);
+	offset = region * regionSize + start;
+	return mapped + offset;
+}
+
+GLuint RingBuffer::getBuffer() const
+{
+	return buffer.get();
+}
+
+//	alignment of shader storage ranges bound out of the buffer
+GLsizeiptr RingBuffer::getStorageAlignment() const
+{
+	return storageAlignment;
+}
+
+//	alignment of uniform block ranges bound out of the buffer
+GLsizeiptr RingBuffer::getUniformAlignment() const
+{
+	return uniformAlignment;
+}
+
+//	number of the frame being recorded
+unsigned long long RingBuffer::getFrame() const
+{
+	return frame;
+}
+
+//	every frame numbered below this has finished on the GPU; only moves on in beginFrame()
+unsigned long long RingBuffer::getCompletedFrames() const
+{
+	return completed;
+}
+
+//	allocations refused since the buffer was created
+unsigned long long RingBuffer::getOverflows() const
+{
+	return overflows;
+}
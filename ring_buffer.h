@@ -0,0 +1,48 @@
+#ifndef _RING_BUFFER_H
+#define _RING_BUFFER_H
+
+#include "gl_handle.h"
+
+#define RING_BUFFER_FRAMES	3			//	frames the CPU may run ahead of the GPU
+#define RING_BUFFER_SIZE	(16 << 20)	//	bytes per frame
+
+/**
+ * Persistently mapped, coherent buffer for data written once per frame (instances, draw
+ * commands, uniform blocks). It is split into one region per frame in flight; beginFrame() waits on the
+ * fence of the region it is about to reuse, so the CPU never overwrites data the GPU
+ * may still read, and endFrame() fences the region just filled.
+ * Allocations are bump pointers and are only valid until the matching endFrame().
+ * Frames are numbered from 0; anything a frame's commands used can be released once
+ * getCompletedFrames() has gone past its number. An allocation that does not fit fails and
+ * is counted, whatever it was for is dropped by the caller.
+ */
+class RingBuffer
+{
+	public:
+		explicit RingBuffer(GLsizeiptr = RING_BUFFER_SIZE);
+		~RingBuffer();
+		RingBuffer(const RingBuffer&) = delete;
+		RingBuffer& operator=(const RingBuffer&) = delete;
+
+		void beginFrame();
+		void endFrame();
+		void* allocate(GLsizeiptr, GLsizeiptr, GLintptr&);
+		GLuint getBuffer() const;
+		GLsizeiptr getStorageAlignment() const;
+		GLsizeiptr getUniformAlignment() const;
+		unsigned long long getFrame() const;
+		unsigned long long getCompletedFrames() const;
+		unsigned long long getOverflows() const;
+
+	private:
+		GLBuffer buffer;
+		unsigned char* mapped;
+		GLsizeiptr regionSize, storageAlignment, uniformAlignment;
+		GLintptr head;
+		unsigned int region;
+		unsigned long long frame, completed, overflows;
+		GLsync fences[RING_BUFFER_FRAMES];
+		bool overflowReported;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "scene_graph.h"
+#include "profiler.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#ifdef __SSE2__
+#include <xmmintrin.h>
+#endif
+
+SceneGraph::SceneGraph()
+{
+	statics.firstDirty = dynamics.firstDirty = 0;
+}
+
+//	the parent has to exist already; the world matrix is valid after the next update()
+GLuint SceneGraph::addNode(const glm::mat4& local, GLuint parent, bool dynamic)
+{
+	dynamic = dynamic || (parent != SCENE_NODE_NONE && (parent & SCENE_NODE_DYNAMIC));
+	partition& p = dynamic ? dynamics : statics;
+	GLuint index = p.parents.size();
+	p.parents.push_back(parent);
+	p.locals.push_back(local);
+	p.worlds.push_back(local);
+	p.dirty.push_back(1);
+	p.firstDirty = std::min(p.firstDirty, (size_t)index);
+	return dynamic ? index | SCENE_NODE_DYNAMIC : index;
+}
+
+void SceneGraph::setLocal(GLuint node, const glm::mat4& local)
+{
+	partition& p = getPartition(node);
+	GLuint index = node & ~SCENE_NODE_DYNAMIC;
+	p.locals[index] = local;
+	p.dirty[index] = 1;
+	p.firstDirty = std::min(p.firstDirty, (size_t)index);
+}
+
+const glm::mat4& SceneGraph::getLocal(GLuint node) const
+{
+	return getPartition(node).locals[node & ~SCENE_NODE_DYNAMIC];
+}
+
+const glm::mat4& SceneGraph::getWorld(GLuint node) const
+{
+	return getPartition(node).worlds[node & ~SCENE_NODE_DYNAMIC];
+}
+
+//	the world matrices from a node on, in the order its partition got them
+const glm::mat4* SceneGraph::getWorlds(GLuint node) const
+{
+	return &getPartition(node).worlds[node & ~SCENE_NODE_DYNAMIC];
+}
+
+//	number of world matrices recomputed; static changes are rare, so they rescan every dynamic node
+size_t SceneGraph::update()
+{
+	PROFILE_ZONE("scene graph");
+	size_t staticFrom = statics.firstDirty, dynamicFrom = dynamics.firstDirty;
+	size_t updated = updatePartition(statics, staticFrom);
+	if (updated > 0)
+	{
+		dynamicFrom = 0;
+	}
+	updated += updatePartition(dynamics, dynamicFrom);
+
+	//	flags are only cleared now, dynamic nodes read those of their static parents
+	std::fill(statics.dirty.begin() + staticFrom, statics.dirty.end(), 0);
+	std::fill(dynamics.dirty.begin() + dynamicFrom, dynamics.dirty.end(), 0);
+	statics.firstDirty = statics.parents.size();
+	dynamics.firstDirty = dynamics.parents.size();
+	return updated;
+}
+
+size_t SceneGraph::getNodeCount() const
+{
+	return statics.parents.size() + dynamics.parents.size();
+}
+
+SceneGraph::partition& SceneGraph::getPartition(GLuint node)
+{
+	return node & SCENE_NODE_DYNAMIC ? dynamics : statics;
+}
+
+const SceneGraph::partition& SceneGraph::getPartition(GLuint node) const
+{
+	return node & SCENE_NODE_DYNAMIC ? dynamics : statics;
+}
+
+bool SceneGraph::isDirty(GLuint node) const
+{
+	return node != SCENE_NODE_NONE && getPartition(node).dirty[node & ~SCENE_NODE_DYNAMIC];
+}
+
+//	dirtiness is carried down first, then the dirty nodes are multiplied in order, so every parent is done before its children
+size_t SceneGraph::updatePartition(partition& p, size_t from)
+{
+	batch.clear();
+	for (size_t i = from; i < p.parents.size(); i++)
+	{
+		if (p.dirty[i] || isDirty(p.parents[i]))
+		{
+			p.dirty[i] = 1;
+			batch.push_back(i);
+		}
+	}
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		GLuint index = batch[i], parent = p.parents[index];
+		if (parent == SCENE_NODE_NONE)
+		{
+			p.worlds[index] = p.locals[index];
+		}
+		else
+		{
+			multiply(getWorld(parent), p.locals[index], p.worlds[index]);
+		}
+	}
+	return batch.size();
+}
+
+//	column major: every column of the result is the parent's columns weighted by a column of the local matrix
+void SceneGraph::multiply(const glm::mat4& parent, const glm::mat4& local, glm::mat4& result)
+{
+#ifdef __SSE2__
+	const float* a = glm::value_ptr(parent);
+	const float* b = glm::value_ptr(local);
+	float* r = glm::value_ptr(result);
+	__m128 c0 = _mm_loadu_ps(a), c1 = _mm_loadu_ps(a + 4), c2 = _mm_loadu_ps(a + 8), c3 = _mm_loadu_ps(a + 12);
+	for (int j = 0; j < 4; j++)
+	{
+		__m128 column = _mm_mul_ps(c0, _mm_set1_ps(b[j * 4]));
+		column = _mm_add_ps(column, _mm_mul_ps(c1, _mm_set1_ps(b[j * 4 + 1])));
+		column = _mm_add_ps(column, _mm_mul_ps(c2, _mm_set1_ps(b[j * 4 + 2])));
+		column = _mm_add_ps(column, _mm_mul_ps(c3, _mm_set1_ps(b[j * 4 + 3])));
+		_mm_storeu_ps(r + j * 4, column);
+	}
+#else
+	result = parent * local;
+#endif
+}
@@ -0,0 +1,53 @@
+#ifndef _SCENE_GRAPH_H
+#define _SCENE_GRAPH_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#define SCENE_NODE_NONE		(~0u)			//	parent of a root
+#define SCENE_NODE_DYNAMIC	0x80000000u		//	set in the handles of nodes in the dynamic partition
+
+/**
+ * Transform hierarchy kept as flat arrays (parent, local and world matrix, dirty flag per
+ * node) in topological order: a node can only be added below one that exists, so parents
+ * always come first and update() is a single forward pass that carries dirtiness down to
+ * the children and recomputes only what is dirty, gathered first and multiplied in a batch
+ * with SSE. Nodes are split in two partitions. Static ones are expected to be set once, and
+ * cost nothing while none of them changes; dynamic ones are scanned from the first one made
+ * dirty since the last update. A node below a dynamic parent is dynamic itself. World
+ * matrices of nodes added one after another to a partition are contiguous, so a run of them
+ * can be drawn as instances straight from getWorlds() until the next addNode().
+ */
+class SceneGraph
+{
+	public:
+		SceneGraph();
+		GLuint addNode(const glm::mat4&, GLuint = SCENE_NODE_NONE, bool = false);
+		void setLocal(GLuint, const glm::mat4&);
+		const glm::mat4& getLocal(GLuint) const;
+		const glm::mat4& getWorld(GLuint) const;
+		const glm::mat4* getWorlds(GLuint) const;
+		size_t update();
+		size_t getNodeCount() const;
+		static void multiply(const glm::mat4&, const glm::mat4&, glm::mat4&);
+
+	private:
+		struct partition
+		{
+			std::vector<GLuint> parents;		//	handles, so a dynamic node may hang below a static one
+			std::vector<glm::mat4> locals, worlds;
+			std::vector<unsigned char> dirty;
+			size_t firstDirty;					//	the node count when nothing is dirty
+		};
+
+		partition statics, dynamics;
+		std::vector<GLuint> batch;
+
+		partition& getPartition(GLuint);
+		const partition& getPartition(GLuint) const;
+		bool isDirty(GLuint) const;
+		size_t updatePartition(partition&, size_t);
+};
+
+#endif
@@ -1,27 +1,41 @@
 #include "shader.h"
+#include <sstream>
 
-Shader::Shader(GLint _shaderType, const std::string& filepath): type(_shaderType)
+Shader::Shader(GLint _shaderType, const std::string& filepath, const std::string& defines): type(_shaderType)
 {
-	source = "";
-    if (filepath.size() != 0)
+    if (filepath.size() != 0 && !readSource(filepath, source))
     {
-        std::ifstream ifs(filepath);
-        std::string line;
-        if (!ifs.is_open())
-        {
-            std::cerr << "Could not read the shader file" << '\n';
-        }
-
-        while (!ifs.eof())
-        {
-            std::getline(ifs, line);
-            source.append(line + '\n');
-        }
-        ifs.close();
+        std::cerr << "Could not read the shader file " << filepath << '\n';
     }
+    insertDefines(source, defines);
     ID = glCreateShader(_shaderType);
 }
 
+//  the whole file in one read
+bool Shader::readSource(const std::string& filepath, std::string& source)
+{
+    std::ifstream ifs(filepath, std::ios::binary);
+    if (!ifs.is_open())
+    {
+        source.clear();
+        return false;
+    }
+    std::ostringstream contents;
+    contents << ifs.rdbuf();
+    source = contents.str();
+    return true;
+}
+
+//  defines are inserted right after the #version line, which has to stay first
+void Shader::insertDefines(std::string& source, const std::string& defines)
+{
+    if (!defines.empty())
+    {
+        size_t lineEnd = source.compare(0, 8, "#version") == 0 ? source.find('\n') : std::string::npos;
+        source.insert(lineEnd == std::string::npos ? 0 : lineEnd + 1, defines);
+    }
+}
+
 std::string Shader::getSource() const
 {
     return source;
@@ -12,7 +12,9 @@
 class Shader
 {
     public:
-        explicit Shader(GLint, const std::string&);
+        explicit Shader(GLint, const std::string&, const std::string& = "");
+        static bool readSource(const std::string&, std::string&);
+        static void insertDefines(std::string&, const std::string&);
         std::string getSource() const;
         GLint getType() const;
         GLuint getID() const;
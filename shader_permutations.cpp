@@ -0,0 +1,45 @@
+#include "shader_permutations.h"
+#include "frame_uniforms.h"
+#include "light_clusters.h"
+#include <algorithm>
+
+ShaderPermutations::ShaderPermutations(ProgramCache& _programs, const std::string& vertexPath, const std::string& fragmentPath,
+	const std::string& defines, const sceneFeatures& features) : programs(_programs)
+{
+	for (GLuint i = 0; i < MATERIAL_VARIANTS; i++)
+	{
+		variants[i] = programs.add(vertexPath, fragmentPath, defines + getDefines(features, i));
+	}
+}
+
+//	names change when the cache swaps in a reloaded program, so this is called again after ProgramCache::update()
+void ShaderPermutations::getPrograms(programSet& set)
+{
+	for (GLuint i = 0; i < MATERIAL_VARIANTS; i++)
+	{
+		set.programs[i] = programs.getProgram(variants[i]);
+	}
+}
+
+std::string ShaderPermutations::getDefines(const sceneFeatures& features, GLuint variant)
+{
+	std::string defines = "#define DIR_LIGHTS_NUM " + std::to_string(std::min(features.dirLights, (unsigned int)FRAME_DIR_LIGHTS)) + "\n" +
+		FrameUniforms::getShaderDefines();
+	if (features.clusteredLights)
+	{
+		defines += "#define CLUSTERED_LIGHTS\n" + LightClusters::getShaderDefines();
+	}
+	if (variant & MATERIAL_DIFFUSE_MAP)
+	{
+		defines += "#define DIFFUSE_MAP\n";
+	}
+	if (variant & MATERIAL_SPECULAR_MAP)
+	{
+		defines += "#define SPECULAR_MAP\n";
+	}
+	if (features.format == VERTEX_FORMAT_QUANTIZED)
+	{
+		defines += "#define DEQUANTIZE_VERTICES\n";
+	}
+	return defines;
+}
@@ -0,0 +1,36 @@
+#ifndef _SHADER_PERMUTATIONS_H
+#define _SHADER_PERMUTATIONS_H
+
+#include "program_cache.h"
+#include "material.h"
+#include "vertex_format.h"
+
+//	what every program of a scene shares; materials choose among the variants of one setup
+struct sceneFeatures
+{
+	unsigned int dirLights;		//	at most FRAME_DIR_LIGHTS
+	bool clusteredLights;		//	point lights binned by LightClusters, any number of them
+	vertexFormat format;		//	of the mesh arena, quantized vertices need the dequantization transforms
+};
+
+/**
+ * Specialised programs built from one vertex and one fragment source: a variant per
+ * combination of material textures (MATERIAL_DIFFUSE_MAP, MATERIAL_SPECULAR_MAP) over the
+ * light setup and vertex format of the scene, passed to the shaders as defines. Every
+ * variant is added to the program cache on construction, so they compile together, come
+ * from cached binaries on later launches and are all linked before the first frame; a
+ * material streamed in later never waits for a compile.
+ */
+class ShaderPermutations
+{
+	public:
+		ShaderPermutations(ProgramCache&, const std::string&, const std::string&, const std::string&, const sceneFeatures&);
+		void getPrograms(programSet&);
+		static std::string getDefines(const sceneFeatures&, GLuint);
+
+	private:
+		ProgramCache& programs;
+		GLuint variants[MATERIAL_VARIANTS];		//	program cache ids
+};
+
+#endif
@@ -0,0 +1,370 @@
+#include "skinned_model.h"
+#include "render_queue.h"
+#include "profiler.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+
+SkinnedModel::SkinnedModel(const std::string& _absPath, renderContext& _context) : context(_context), absPath(_absPath), animated(0)
+{
+	stats.animateMs = stats.skinMs = 0.0;
+	stats.vertices = 0;
+	std::fill(variantParts, variantParts + MATERIAL_VARIANTS + 1, 0);
+	std::vector<skinnedMeshData> meshes;
+	if (import(meshes))
+	{
+		upload(meshes);
+	}
+}
+
+//	for rigs built in code, which have no textures to load
+SkinnedModel::SkinnedModel(renderContext& _context, Skeleton&& _skeleton, std::vector<animationClip>&& _clips, std::vector<skinnedMeshData>&& meshes) :
+	context(_context), skeleton(std::move(_skeleton)), clips(std::move(_clips)), animated(0)
+{
+	stats.animateMs = stats.skinMs = 0.0;
+	stats.vertices = 0;
+	std::fill(variantParts, variantParts + MATERIAL_VARIANTS + 1, 0);
+	upload(meshes);
+}
+
+//	the vertex arrays were bound through RenderState
+SkinnedModel::~SkinnedModel()
+{
+	context.state.forget(skinnedArray.get());
+	context.state.forget(transformedArray.get());
+}
+
+/**
+ * Samples the clips of every instance, blends them and builds its palette, one instance per
+ * pool task. Cursors are updated in place, so the instances have to be kept from frame to frame.
+ */
+void SkinnedModel::animate(std::vector<animationInstance>& instances)
+{
+	PROFILE_ZONE("animate");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t bones = skeleton.getBoneCount();
+	poses.resize(instances.size() * bones * 2);
+	worlds.resize(instances.size() * bones);
+	palettes.resize(instances.size() * bones);
+	context.threadPool.parallelFor(instances.size(), [this, &instances, bones](size_t i)
+	{
+		animationInstance& instance = instances[i];
+		boneTransform* pose = &poses[i * bones * 2];
+		boneTransform* blended = pose + bones;
+		if (clips.empty())
+		{
+			std::copy(skeleton.getBindPose().begin(), skeleton.getBindPose().end(), pose);
+		}
+		else
+		{
+			skeleton.sample(clips[instance.clips[0] % clips.size()], instance.times[0], instance.cursors[0], pose);
+			if (instance.blend > 0.0f)
+			{
+				skeleton.sample(clips[instance.clips[1] % clips.size()], instance.times[1], instance.cursors[1], blended);
+				Skeleton::blend(pose, blended, instance.blend, bones, pose);
+			}
+		}
+		skeleton.buildPalette(pose, &worlds[i * bones], &palettes[i * bones]);
+	});
+	animated = instances.size();
+	stats.animateMs = elapsedMs(start, std::chrono::steady_clock::now());
+}
+
+//	transforms place the instances of the last animate(), at most as many as it had; uniforms and the ring frame are the caller's
+void SkinnedModel::draw(const programSet& programs, const glm::mat4* transforms, size_t count, skinningMode mode)
+{
+	count = std::min(count, animated);
+	stats.skinMs = 0.0;
+	stats.vertices = 0;
+	if (count == 0 || parts.empty())
+	{
+		return;
+	}
+	RenderState& state = context.state;
+	RingBuffer& stream = context.stream;
+	size_t bones = skeleton.getBoneCount();
+	bool cpu = mode == SKINNING_CPU;
+
+	//	the vertex shader path draws each part once for all instances, the CPU path each instance's own vertices
+	size_t drawsPerPart = cpu ? count : 1;
+	frameDraws draws;
+	for (size_t v = 0; v < MATERIAL_VARIANTS; v++)
+	{
+		draws.drawCounts[v] = (variantParts[v + 1] - variantParts[v]) * drawsPerPart;
+		draws.triangles[v] = 0;
+		for (size_t p = variantParts[v]; p < variantParts[v + 1]; p++)
+		{
+			draws.triangles[v] += parts[p].triangles * count;
+		}
+	}
+
+	//	skinned vertices are placed on a whole vertex, so the draws reach them through baseVertex
+	GLintptr instancesOffset = 0, palettesOffset = 0, skinnedOffset = 0;
+	GLsizeiptr instancesSize = count * sizeof(instanceData), palettesSize = count * bones * sizeof(glm::mat4);
+	instanceData* instances = (instanceData*)stream.allocate(instancesSize, stream.getStorageAlignment(), instancesOffset);
+	glm::mat4* framePalettes = cpu ? nullptr : (glm::mat4*)stream.allocate(palettesSize, stream.getStorageAlignment(), palettesOffset);
+	vertex* skinned = cpu ? (vertex*)stream.allocate(count * vertices.size() * sizeof(vertex), sizeof(vertex), skinnedOffset) : nullptr;
+	if (!instances || (cpu ? !skinned : !framePalettes) || !RenderQueue::allocateDraws(stream, draws))
+	{
+		return;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		instances[i].model = transforms[i];
+		instances[i].normalMatrix = Model::getNormalMatrix(transforms[i]);
+	}
+	if (cpu)
+	{
+		skin(count, skinned);
+	}
+	else
+	{
+		std::copy(palettes.begin(), palettes.begin() + count * bones, framePalettes);
+	}
+	GLint skinnedBase = skinnedOffset / sizeof(vertex);
+	for (size_t v = 0; v < MATERIAL_VARIANTS; v++)
+	{
+		size_t draw = draws.firstDraws[v];
+		for (size_t p = variantParts[v]; p < variantParts[v + 1]; p++)
+		{
+			const part& pt = parts[p];
+			for (size_t k = 0; k < drawsPerPart; k++, draw++)
+			{
+				drawElementsIndirectCommand& command = draws.commands[draw];
+				command.count = pt.indexCount;
+				command.instanceCount = cpu ? 1 : count;
+				command.firstIndex = pt.firstIndex;
+				command.baseVertex = cpu ? skinnedBase + k * vertices.size() + pt.baseVertex : pt.baseVertex;
+				command.baseInstance = 0;
+
+				drawRecord& record = draws.records[draw];
+				record.materialID = pt.materialID;
+				record.firstInstance = cpu ? k : 0;
+				record.boneCount = cpu ? 0 : bones;
+				record.padding = 0;
+				const float positionScale[4] = { 1.0f, 1.0f, 1.0f, 0.0f }, texCoordTransform[4] = { 1.0f, 1.0f, 0.0f, 0.0f };
+				std::copy(positionScale, positionScale + 4, record.positionScale);
+				std::fill(record.positionOffset, record.positionOffset + 4, 0.0f);
+				std::copy(texCoordTransform, texCoordTransform + 4, record.texCoordTransform);
+			}
+		}
+	}
+	stats.vertices = (unsigned long long)count * vertices.size();
+
+	PROFILE_ZONE("submit skinned");
+	context.materials.bind(state);
+	state.bindVertexArray(cpu ? transformedArray.get() : skinnedArray.get());
+	state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, INSTANCE_BLOCK_BINDING, stream.getBuffer(), instancesOffset, instancesSize);
+	if (!cpu)
+	{
+		state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, BONE_BLOCK_BINDING, stream.getBuffer(), palettesOffset, palettesSize);
+	}
+	RenderQueue::submitDraws(context, programs, draws);
+}
+
+const Skeleton& SkinnedModel::getSkeleton() const
+{
+	return skeleton;
+}
+
+const std::vector<animationClip>& SkinnedModel::getClips() const
+{
+	return clips;
+}
+
+size_t SkinnedModel::getVertexCount() const
+{
+	return vertices.size();
+}
+
+const skinningStats& SkinnedModel::getStats() const
+{
+	return stats;
+}
+
+std::string SkinnedModel::getShaderDefines()
+{
+	return "#define SKINNED_VERTICES\n";
+}
+
+//	only programs built with getShaderDefines() declare BoneBlock
+void SkinnedModel::resolveProgram(GLuint program)
+{
+	GLuint block = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, "BoneBlock");
+	if (block != GL_INVALID_INDEX)
+	{
+		glShaderStorageBlockBinding(program, block, BONE_BLOCK_BINDING);
+	}
+}
+
+bool SkinnedModel::import(std::vector<skinnedMeshData>& meshes)
+{
+	PROFILE_ZONE("import skinned model");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	directory = absPath.substr(0, absPath.find_last_of('/'));
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(absPath, MODEL_IMPORT_FLAGS | aiProcess_LimitBoneWeights);
+	if (!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+	{
+		std::cerr << "ERROR::ASSIMP::" << importer.GetErrorString() << '\n';
+		return false;
+	}
+	std::vector<std::pair<GLuint, GLuint> > sceneMeshes;
+	if (!importAnimation(scene, skeleton, clips, sceneMeshes))
+	{
+		return false;
+	}
+
+	//	inverse bind matrices are set here, serially; meshes sharing a bone agree on it
+	std::vector<std::vector<GLuint> > meshBones(sceneMeshes.size());
+	for (size_t i = 0; i < sceneMeshes.size(); i++)
+	{
+		const aiMesh* mesh = scene->mMeshes[sceneMeshes[i].first];
+		for (size_t b = 0; b < mesh->mNumBones; b++)
+		{
+			GLuint id = skeleton.findBone(mesh->mBones[b]->mName.C_Str());
+			if (id != SKELETON_NO_BONE)
+			{
+				skeleton.setInverseBind(id, toMat4(mesh->mBones[b]->mOffsetMatrix));
+			}
+			meshBones[i].push_back(id);
+		}
+	}
+
+	meshes.resize(sceneMeshes.size());
+	context.threadPool.parallelFor(sceneMeshes.size(), [&](size_t i)
+	{
+		const aiMesh* mesh = scene->mMeshes[sceneMeshes[i].first];
+		skinnedMeshData& data = meshes[i];
+		size_t count = mesh->mNumVertices;
+
+		//	aiProcess_LimitBoneWeights leaves at most SKIN_INFLUENCES per vertex
+		std::vector<GLuint> bones(count * SKIN_INFLUENCES);
+		std::vector<float> weights(count * SKIN_INFLUENCES);
+		std::vector<unsigned char> influences(count, 0);
+		for (size_t b = 0; b < mesh->mNumBones; b++)
+		{
+			const aiBone* meshBone = mesh->mBones[b];
+			for (size_t w = 0; w < meshBone->mNumWeights && meshBones[i][b] != SKELETON_NO_BONE; w++)
+			{
+				GLuint v = meshBone->mWeights[w].mVertexId;
+				if (v < count && influences[v] < SKIN_INFLUENCES)
+				{
+					bones[v * SKIN_INFLUENCES + influences[v]] = meshBones[i][b];
+					weights[v * SKIN_INFLUENCES + influences[v]++] = meshBone->mWeights[w].mWeight;
+				}
+			}
+		}
+
+		//	a mesh without bones follows the node holding it
+		GLuint nodeBone = sceneMeshes[i].second;
+		float full = 1.0f;
+		const aiVector3D* texCoords = mesh->mTextureCoords[0];
+		data.vertices.resize(count);
+		for (size_t v = 0; v < count; v++)
+		{
+			skinnedVertex& out = data.vertices[v];
+			out.position = glm::vec3(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z);
+			out.normal = glm::vec3(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z);
+			out.texCoord = texCoords ? glm::vec2(texCoords[v].x, texCoords[v].y) : glm::vec2(0.0f, 0.0f);
+			if (mesh->mNumBones > 0)
+			{
+				setInfluences(out, &bones[v * SKIN_INFLUENCES], &weights[v * SKIN_INFLUENCES], influences[v]);
+			}
+			else
+			{
+				setInfluences(out, &nodeBone, &full, 1);
+			}
+		}
+		for (size_t f = 0; f < mesh->mNumFaces; f++)
+		{
+			const aiFace& face = mesh->mFaces[f];
+			data.indices.insert(data.indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
+		}
+
+		const aiMaterial* mat = scene->mMaterials[mesh->mMaterialIndex];
+		data.textures = Model::loadMaterialTextures(mat, aiTextureType_DIFFUSE, "diffuseTexture");
+		std::vector<texture> specularMaps = Model::loadMaterialTextures(mat, aiTextureType_SPECULAR, "specularTexture");
+		data.textures.insert(data.textures.end(), specularMaps.begin(), specularMaps.end());
+	});
+	_log("Skinned model " << absPath << ": " << skeleton.getBoneCount() << " bones, " << clips.size() << " clips, imported in "
+		<< elapsedMs(start, std::chrono::steady_clock::now()) << " ms");
+	return true;
+}
+
+//	context thread only: every part goes into one vertex and one index buffer, grouped by material variant
+void SkinnedModel::upload(std::vector<skinnedMeshData>& meshes)
+{
+	PROFILE_ZONE("upload skinned model");
+	std::vector<GLuint> materialIDs(meshes.size()), variants(meshes.size());
+	std::vector<size_t> order(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		Model::loadTextures(context.textures, directory, loadedTextures, meshes[i].textures);
+		materialIDs[i] = context.materials.add(meshes[i].textures);
+		variants[i] = context.materials.getVariant(materialIDs[i]);
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&variants](size_t a, size_t b)
+	{
+		return variants[a] < variants[b];
+	});
+
+	std::vector<GLuint> indices;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		skinnedMeshData& mesh = meshes[order[i]];
+		part p;
+		p.firstIndex = indices.size();
+		p.indexCount = mesh.indices.size();
+		p.baseVertex = vertices.size();
+		p.materialID = materialIDs[order[i]];
+		p.triangles = mesh.indices.size() / 3;
+		parts.push_back(p);
+		variantParts[variants[order[i]] + 1]++;
+		vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+	}
+	for (size_t v = 0; v < MATERIAL_VARIANTS; v++)
+	{
+		variantParts[v + 1] += variantParts[v];
+	}
+	meshes.clear();
+	if (vertices.empty() || indices.empty())
+	{
+		parts.clear();
+		return;
+	}
+
+	vertexBuffer = GLBuffer::create();
+	glNamedBufferStorage(vertexBuffer.get(), vertices.size() * sizeof(skinnedVertex), vertices.data(), 0);
+	indexBuffer = GLBuffer::create();
+	glNamedBufferStorage(indexBuffer.get(), indices.size() * sizeof(GLuint), indices.data(), 0);
+
+	skinnedArray = GLVertexArray::create();
+	setupSkinnedVertexAttributes(skinnedArray.get());
+	glVertexArrayVertexBuffer(skinnedArray.get(), 0, vertexBuffer.get(), 0, sizeof(skinnedVertex));
+	glVertexArrayElementBuffer(skinnedArray.get(), indexBuffer.get());
+
+	//	what the CPU path writes into the ring buffer, instance after instance
+	transformedArray = GLVertexArray::create();
+	setupVertexAttributes(transformedArray.get(), VERTEX_FORMAT_FULL);
+	glVertexArrayVertexBuffer(transformedArray.get(), 0, context.stream.getBuffer(), 0, sizeof(vertex));
+	glVertexArrayElementBuffer(transformedArray.get(), indexBuffer.get());
+}
+
+//	out is the frame's range of the ring buffer, instance after instance; the pool writes it while the GPU reads older frames
+void SkinnedModel::skin(size_t count, vertex* out)
+{
+	PROFILE_ZONE("skin");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t vertexCount = vertices.size(), bones = skeleton.getBoneCount();
+	size_t chunks = (vertexCount + SKINNED_VERTEX_CHUNK - 1) / SKINNED_VERTEX_CHUNK;
+	context.threadPool.parallelFor(count * chunks, [this, out, vertexCount, bones, chunks](size_t task)
+	{
+		size_t instance = task / chunks, first = (task % chunks) * SKINNED_VERTEX_CHUNK;
+		size_t n = std::min<size_t>(SKINNED_VERTEX_CHUNK, vertexCount - first);
+		skinVertices(&palettes[instance * bones], &vertices[first], n, out + instance * vertexCount + first);
+	});
+	stats.skinMs = elapsedMs(start, std::chrono::steady_clock::now());
+}
@@ -0,0 +1,100 @@
+#ifndef _SKINNED_MODEL_H
+#define _SKINNED_MODEL_H
+
+#include "animation.h"
+#include "skinning.h"
+#include "model.h"
+
+#define SKINNED_VERTEX_CHUNK	4096	//	vertices per pool task on the CPU path
+#define BONE_BLOCK_BINDING		0		//	the one storage binding no other block uses, FrameBlock's 0 is a uniform binding
+
+//	CPU side result of importing one skinned mesh, indices are relative to its own vertices
+struct skinnedMeshData
+{
+	std::vector<skinnedVertex> vertices;
+	std::vector<GLuint> indices;
+	std::vector<texture> textures;
+};
+
+//	what one instance plays: two clips at their own times, blended, each with the cursor that keeps its sampling incremental
+struct animationInstance
+{
+	GLuint clips[2];
+	float times[2];
+	float blend;					//	weight of the second clip, 0 plays the first alone
+	animationCursor cursors[2];
+};
+
+enum skinningMode
+{
+	SKINNING_GPU,		//	the vertex shader blends the bone palette of its instance
+	SKINNING_CPU		//	skinVertices on the pool, the vertex shader only places the result
+};
+
+struct skinningStats
+{
+	double animateMs;				//	sampling, blending and palettes, on the pool
+	double skinMs;					//	skinVertices on the pool, CPU path only
+	unsigned long long vertices;	//	skinned by the last draw
+};
+
+/**
+ * Rigged model with its clips. Skinned vertices carry bone indices and weights, so they are kept
+ * in buffers of their own rather than in the MeshArena, and are drawn with the programs built
+ * with getShaderDefines() over VERTEX_FORMAT_FULL, one multi-draw per material variant.
+ * animate() samples, blends and turns into bone palettes the poses of every instance on the
+ * pool; draw() then either streams the palettes through the ring buffer for the vertex shader,
+ * or skins every instance on the pool straight into the ring buffer (SKINNING_CPU), which takes
+ * instances * getVertexCount() * sizeof(vertex) bytes of its frame region.
+ * Loading is synchronous: rigged assets are imported with Assimp and not cached.
+ */
+class SkinnedModel
+{
+	public:
+		SkinnedModel(const std::string&, renderContext&);
+		SkinnedModel(renderContext&, Skeleton&&, std::vector<animationClip>&&, std::vector<skinnedMeshData>&&);
+		~SkinnedModel();
+		SkinnedModel(const SkinnedModel&) = delete;
+		SkinnedModel& operator=(const SkinnedModel&) = delete;
+
+		void animate(std::vector<animationInstance>&);
+		void draw(const programSet&, const glm::mat4*, size_t, skinningMode);
+		const Skeleton& getSkeleton() const;
+		const std::vector<animationClip>& getClips() const;
+		size_t getVertexCount() const;
+		const skinningStats& getStats() const;
+		static std::string getShaderDefines();
+		static void resolveProgram(GLuint);
+
+	private:
+		struct part
+		{
+			GLuint firstIndex, indexCount;
+			GLint baseVertex;
+			GLuint materialID;
+			unsigned long long triangles;
+		};
+
+		renderContext& context;
+		std::string absPath, directory;
+		Skeleton skeleton;
+		std::vector<animationClip> clips;
+		std::unordered_map<std::string, TextureSlot> loadedTextures;
+		std::vector<part> parts;					//	grouped by material variant
+		GLuint variantParts[MATERIAL_VARIANTS + 1];
+		std::vector<skinnedVertex> vertices;		//	bind pose of every part, read by the CPU path
+		GLBuffer vertexBuffer, indexBuffer;
+		GLVertexArray skinnedArray, transformedArray;
+
+		//	per instance, from the last animate()
+		size_t animated;
+		std::vector<boneTransform> poses;
+		std::vector<glm::mat4> worlds, palettes;
+		skinningStats stats;
+
+		bool import(std::vector<skinnedMeshData>&);
+		void upload(std::vector<skinnedMeshData>&);
+		void skin(size_t, vertex*);
+};
+
+#endif
@@ -0,0 +1,110 @@
+#include "skinning.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstddef>
+#ifdef __SSE2__
+#include <xmmintrin.h>
+#endif
+
+static_assert(sizeof(skinnedVertex) == 40, "unexpected padding in skinnedVertex");
+static_assert(offsetof(vertex, normal) == 12 && offsetof(vertex, texCoord) == 24 && sizeof(vertex) == 32, "skinVertices stores whole SSE registers into vertex");
+
+void setInfluences(skinnedVertex& v, const GLuint* bones, const float* weights, size_t count)
+{
+	size_t order[SKIN_INFLUENCES];
+	size_t kept = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		//	insertion into the strongest so far, the weakest falls off the end
+		size_t at = kept;
+		while (at > 0 && weights[order[at - 1]] < weights[i])
+		{
+			at--;
+		}
+		if (at == SKIN_INFLUENCES)
+		{
+			continue;
+		}
+		kept = std::min(kept + 1, (size_t)SKIN_INFLUENCES);
+		for (size_t j = kept - 1; j > at; j--)
+		{
+			order[j] = order[j - 1];
+		}
+		order[at] = i;
+	}
+
+	float sum = 0.0f;
+	for (size_t i = 0; i < kept; i++)
+	{
+		sum += weights[order[i]];
+	}
+	int total = 0;
+	for (size_t i = 0; i < SKIN_INFLUENCES; i++)
+	{
+		v.bones[i] = i < kept ? bones[order[i]] : 0;
+		v.weights[i] = i < kept && sum > 0.0f ? (unsigned char)(weights[order[i]] / sum * 255.0f + 0.5f) : 0;
+		total += v.weights[i];
+	}
+
+	//	rounding leftovers go to the strongest bone, a vertex without weights follows bone 0
+	v.weights[0] = (unsigned char)(v.weights[0] + 255 - total);
+}
+
+void setupSkinnedVertexAttributes(GLuint vao)
+{
+	glVertexArrayAttribFormat(vao, POSITION_LOC, 3, GL_FLOAT, GL_FALSE, offsetof(skinnedVertex, position));
+	glVertexArrayAttribFormat(vao, NORMAL_LOC, 3, GL_FLOAT, GL_FALSE, offsetof(skinnedVertex, normal));
+	glVertexArrayAttribFormat(vao, TEXTCOORD_LOC, 2, GL_FLOAT, GL_FALSE, offsetof(skinnedVertex, texCoord));
+	glVertexArrayAttribIFormat(vao, BONE_INDICES_LOC, 4, GL_UNSIGNED_BYTE, offsetof(skinnedVertex, bones));
+	glVertexArrayAttribFormat(vao, BONE_WEIGHTS_LOC, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(skinnedVertex, weights));
+
+	const GLuint locations[] = { POSITION_LOC, NORMAL_LOC, TEXTCOORD_LOC, BONE_INDICES_LOC, BONE_WEIGHTS_LOC };
+	for (size_t i = 0; i < sizeof(locations) / sizeof(locations[0]); i++)
+	{
+		glVertexArrayAttribBinding(vao, locations[i], 0);
+		glEnableVertexArrayAttrib(vao, locations[i]);
+	}
+}
+
+void skinVertices(const glm::mat4* palette, const skinnedVertex* src, size_t count, vertex* dst)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const skinnedVertex& v = src[i];
+		vertex& out = dst[i];
+#ifdef __SSE2__
+		__m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+		for (size_t k = 0; k < SKIN_INFLUENCES && v.weights[k]; k++)
+		{
+			const float* m = glm::value_ptr(palette[v.bones[k]]);
+			__m128 weight = _mm_set1_ps(v.weights[k] * (1.0f / 255.0f));
+			c0 = _mm_add_ps(c0, _mm_mul_ps(_mm_loadu_ps(m), weight));
+			c1 = _mm_add_ps(c1, _mm_mul_ps(_mm_loadu_ps(m + 4), weight));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(_mm_loadu_ps(m + 8), weight));
+			c3 = _mm_add_ps(c3, _mm_mul_ps(_mm_loadu_ps(m + 12), weight));
+		}
+		__m128 position = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.position.x)), _mm_mul_ps(c1, _mm_set1_ps(v.position.y))),
+			_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(v.position.z)), c3));
+		__m128 normal = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.normal.x)), _mm_mul_ps(c1, _mm_set1_ps(v.normal.y))),
+			_mm_mul_ps(c2, _mm_set1_ps(v.normal.z)));
+
+		//	each store spills one float into the next field, which is written after it
+		_mm_storeu_ps(&out.position.x, position);
+		_mm_storeu_ps(&out.normal.x, normal);
+#else
+		glm::mat4 skin(0.0f);
+		for (size_t k = 0; k < SKIN_INFLUENCES && v.weights[k]; k++)
+		{
+			float weight = v.weights[k] * (1.0f / 255.0f);
+			const glm::mat4& m = palette[v.bones[k]];
+			skin[0] += m[0] * weight;
+			skin[1] += m[1] * weight;
+			skin[2] += m[2] * weight;
+			skin[3] += m[3] * weight;
+		}
+		out.position = glm::vec3(skin * glm::vec4(v.position, 1.0f));
+		out.normal = glm::mat3(skin) * v.normal;
+#endif
+		out.texCoord = v.texCoord;
+	}
+}
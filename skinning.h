@@ -0,0 +1,37 @@
+#ifndef _SKINNING_H
+#define _SKINNING_H
+
+#include "vertex_format.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#define SKIN_INFLUENCES		4
+#define BONE_INDICES_LOC	3
+#define BONE_WEIGHTS_LOC	4
+
+//	bind pose vertex and the bones moving it, strongest first; weights are unorm bytes summing to 255
+struct skinnedVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 texCoord;
+	unsigned char bones[SKIN_INFLUENCES];
+	unsigned char weights[SKIN_INFLUENCES];
+};
+
+//	keeps the SKIN_INFLUENCES strongest of any number of bone weights, renormalized
+void setInfluences(skinnedVertex&, const GLuint*, const float*, size_t);
+
+//	binding 0 of the VAO reads skinnedVertex, bone indices as integers and weights normalized
+void setupSkinnedVertexAttributes(GLuint);
+
+/**
+ * Linear blend skinning on the CPU, for targets where the vertex shader should not do it
+ * (software rasterizers, headless runs). The weighted palette matrices of a vertex are summed
+ * column by column with SSE2 where available, then position and normal are transformed by
+ * the sum, the normal by its upper 3x3 as in the vertex shader. Writes full precision
+ * vertices, laid out as VERTEX_FORMAT_FULL.
+ */
+void skinVertices(const glm::mat4*, const skinnedVertex*, size_t, vertex*);
+
+#endif
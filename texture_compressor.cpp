@@ -0,0 +1,296 @@
+#include "texture_compressor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	uint16_t pack565(const float color[3])
+	{
+		int r = (int)std::floor(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+		int g = (int)std::floor(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+		int b = (int)std::floor(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	//	expanded the way the hardware does, by repeating the top bits
+	void unpack565(uint16_t packed, float color[3])
+	{
+		int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (float)((r << 3) | (r >> 2));
+		color[1] = (float)((g << 2) | (g >> 4));
+		color[2] = (float)((b << 3) | (b >> 2));
+	}
+
+	void write16(unsigned char* out, uint16_t value)
+	{
+		out[0] = value & 0xff;
+		out[1] = value >> 8;
+	}
+
+	//	indices for the palette of two endpoints, the squared error of the block is returned
+	float fitColorIndices(const float pixels[16][3], uint16_t c0, uint16_t c1, uint32_t& indices)
+	{
+		float palette[4][3];
+		unpack565(c0, palette[0]);
+		unpack565(c1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+		float error = 0.0f;
+		indices = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			float best = 1e30f;
+			uint32_t bestIndex = 0;
+			for (uint32_t k = 0; k < 4; k++)
+			{
+				float dr = pixels[i][0] - palette[k][0], dg = pixels[i][1] - palette[k][1], db = pixels[i][2] - palette[k][2];
+				float d = dr * dr + dg * dg + db * db;
+				if (d < best)
+				{
+					best = d;
+					bestIndex = k;
+				}
+			}
+			indices |= bestIndex << (i * 2);
+			error += best;
+		}
+		return error;
+	}
+
+	//	always in four colour mode: c0 > c1, or both equal with every index 0
+	void encodeColorBlock(const float pixels[16][3], unsigned char* out)
+	{
+		float mean[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				mean[c] += pixels[i][c] / 16.0f;
+			}
+		}
+		float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+		{
+			float d[3] = { pixels[i][0] - mean[0], pixels[i][1] - mean[1], pixels[i][2] - mean[2] };
+			covariance[0] += d[0] * d[0];
+			covariance[1] += d[0] * d[1];
+			covariance[2] += d[0] * d[2];
+			covariance[3] += d[1] * d[1];
+			covariance[4] += d[1] * d[2];
+			covariance[5] += d[2] * d[2];
+		}
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 6; iteration++)
+		{
+			float next[3] = { covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+				covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+				covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+			float length = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+			if (length < 1e-6f)
+			{
+				break;
+			}
+			for (int c = 0; c < 3; c++)
+			{
+				axis[c] = next[c] / length;
+			}
+		}
+		float lowest = 1e30f, highest = -1e30f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2];
+			lowest = std::min(lowest, t);
+			highest = std::max(highest, t);
+		}
+		float e0[3], e1[3];
+		for (int c = 0; c < 3; c++)
+		{
+			e0[c] = mean[c] + axis[c] * highest;
+			e1[c] = mean[c] + axis[c] * lowest;
+		}
+		uint16_t c0 = pack565(e0), c1 = pack565(e1);
+		uint32_t indices = 0;
+		float error = fitColorIndices(pixels, std::max(c0, c1), std::min(c0, c1), indices);
+
+		//	least squares endpoints for the indices just chosen, kept when they do better
+		static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+		{
+			float a = weights[(indices >> (i * 2)) & 3], b = 1.0f - a;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < 3; c++)
+			{
+				ax[c] += a * pixels[i][c];
+				bx[c] += b * pixels[i][c];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) > 1e-6f)
+		{
+			float r0[3], r1[3];
+			for (int c = 0; c < 3; c++)
+			{
+				r0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+				r1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+			}
+			uint16_t refined0 = pack565(r0), refined1 = pack565(r1);
+			uint32_t refinedIndices = 0;
+			float refinedError = fitColorIndices(pixels, std::max(refined0, refined1), std::min(refined0, refined1), refinedIndices);
+			if (refinedError < error)
+			{
+				c0 = refined0;
+				c1 = refined1;
+				indices = refinedIndices;
+				error = refinedError;
+			}
+		}
+
+		if (c0 < c1)
+		{
+			std::swap(c0, c1);
+		}
+		if (c0 == c1)
+		{
+			indices = 0;
+		}
+		write16(out, c0);
+		write16(out + 2, c1);
+		for (int i = 0; i < 4; i++)
+		{
+			out[4 + i] = (indices >> (i * 8)) & 0xff;
+		}
+	}
+
+	//	BC4: eight values between the extremes, stored high first so the decoder picks that mode
+	void encodeChannelBlock(const unsigned char values[16], unsigned char* out)
+	{
+		unsigned char high = *std::max_element(values, values + 16), low = *std::min_element(values, values + 16);
+		memset(out, 0, 8);
+		out[0] = high;
+		out[1] = low;
+		if (high == low)
+		{
+			return;
+		}
+		float palette[8];
+		palette[0] = high;
+		palette[1] = low;
+		for (int k = 2; k < 8; k++)
+		{
+			palette[k] = ((8 - k) * high + (k - 1) * low) / 7.0f;
+		}
+		uint64_t bits = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			float best = 1e30f;
+			uint64_t bestIndex = 0;
+			for (int k = 0; k < 8; k++)
+			{
+				float d = std::fabs(values[i] - palette[k]);
+				if (d < best)
+				{
+					best = d;
+					bestIndex = k;
+				}
+			}
+			bits |= bestIndex << (i * 3);
+		}
+		for (int i = 0; i < 6; i++)
+		{
+			out[2 + i] = (bits >> (i * 8)) & 0xff;
+		}
+	}
+}
+
+bool isCompressedFormat(GLenum format)
+{
+	return format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_BC3 || format == TEXTURE_FORMAT_BC5;
+}
+
+//	the unsized format KTX files name next to the internal one
+GLenum getBaseFormat(GLenum format)
+{
+	switch (format)
+	{
+		case TEXTURE_FORMAT_BC3:
+			return GL_RGBA;
+		case TEXTURE_FORMAT_BC5:
+			return GL_RG;
+		default:
+			return GL_RGB;
+	}
+}
+
+const char* getTextureFormatName(GLenum format)
+{
+	switch (format)
+	{
+		case TEXTURE_FORMAT_BC1:
+			return "BC1";
+		case TEXTURE_FORMAT_BC3:
+			return "BC3";
+		case TEXTURE_FORMAT_BC5:
+			return "BC5";
+		default:
+			return "RGB8";
+	}
+}
+
+//	bytes of one image of the format, compressed ones are padded to whole blocks
+GLsizeiptr getImageBytes(GLenum format, GLsizei width, GLsizei height)
+{
+	if (!isCompressedFormat(format))
+	{
+		return (GLsizeiptr)width * height * 3;
+	}
+	GLsizeiptr blocks = (GLsizeiptr)((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (format == TEXTURE_FORMAT_BC1 ? 8 : 16);
+}
+
+void compressImage(GLenum format, const unsigned char* rgba, GLsizei width, GLsizei height, unsigned char* out, ThreadPool& pool)
+{
+	GLsizei blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+	size_t blockBytes = format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+	pool.parallelFor(blocksHigh, [&](size_t by)
+	{
+		for (GLsizei bx = 0; bx < blocksWide; bx++)
+		{
+			float colors[16][3];
+			unsigned char first[16], second[16];
+			for (int i = 0; i < 16; i++)
+			{
+				GLsizei x = std::min<GLsizei>(bx * 4 + i % 4, width - 1), y = std::min<GLsizei>(by * 4 + i / 4, height - 1);
+				const unsigned char* pixel = rgba + ((size_t)y * width + x) * 4;
+				for (int c = 0; c < 3; c++)
+				{
+					colors[i][c] = pixel[c];
+				}
+				first[i] = format == TEXTURE_FORMAT_BC5 ? pixel[0] : pixel[3];
+				second[i] = pixel[1];
+			}
+			unsigned char* block = out + ((size_t)by * blocksWide + bx) * blockBytes;
+			if (format == TEXTURE_FORMAT_BC1)
+			{
+				encodeColorBlock(colors, block);
+			}
+			else if (format == TEXTURE_FORMAT_BC3)
+			{
+				encodeChannelBlock(first, block);
+				encodeColorBlock(colors, block + 8);
+			}
+			else
+			{
+				encodeChannelBlock(first, block);
+				encodeChannelBlock(second, block + 8);
+			}
+		}
+	});
+}
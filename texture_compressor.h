@@ -0,0 +1,26 @@
+#ifndef _TEXTURE_COMPRESSOR_H
+#define _TEXTURE_COMPRESSOR_H
+
+#include "thread_pool.h"
+#include <GL/glew.h>
+
+//	texture formats the library stores: GL_RGB8 as decoded, the block compressed ones as cooked
+#define TEXTURE_FORMAT_BC1	GL_COMPRESSED_RGB_S3TC_DXT1_EXT		//	opaque colour, 8 bytes per 4x4 block
+#define TEXTURE_FORMAT_BC3	GL_COMPRESSED_RGBA_S3TC_DXT5_EXT	//	colour with alpha, 16 bytes per block
+#define TEXTURE_FORMAT_BC5	GL_COMPRESSED_RG_RGTC2				//	two channel tangent space normals, 16 bytes per block
+
+bool isCompressedFormat(GLenum);
+GLenum getBaseFormat(GLenum);
+const char* getTextureFormatName(GLenum);
+GLsizeiptr getImageBytes(GLenum, GLsizei, GLsizei);
+
+/**
+ * Offline block compression of one RGBA8 image into BC1, BC3 or BC5, a row of blocks per
+ * pool task. Colour endpoints are fitted along the principal axis of each block and refined
+ * once by least squares against the chosen indices; alpha and the normal map channels use
+ * the eight value mode of BC4 between the block's extremes. Edge blocks of sizes that are not
+ * a multiple of four repeat their last row and column. Output is getImageBytes() long.
+ */
+void compressImage(GLenum, const unsigned char*, GLsizei, GLsizei, unsigned char*, ThreadPool&);
+
+#endif
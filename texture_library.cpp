@@ -0,0 +1,593 @@
+#include "texture_library.h"
+#include "profiler.h"
+#include "texture_compressor.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+TextureLibrary::TextureLibrary(ThreadPool& pool, RenderState& _state, const RingBuffer& _stream, bool allowBindless) :
+	loader(pool, GLEW_EXT_texture_compression_s3tc && GLEW_ARB_texture_compression_rgtc), state(_state), stream(_stream),
+	backend(allowBindless && GLEW_ARB_bindless_texture && GLEW_NV_gpu_shader5 ? TEXTURE_BACKEND_BINDLESS : TEXTURE_BACKEND_ARRAYS), generation(0), tickets(0), bucketMisses(0), residentBytes(0)
+{
+	static const unsigned char placeholder[3] = {128, 128, 128};
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	slots.resize(1);
+	slot& s = slots[TEXTURE_PLACEHOLDER_SLOT];
+	s.refCount = 1;
+	s.ticket = 0;
+	s.pending = false;
+	s.loaded = true;
+	s.wantFull = true;
+	s.lastWanted = 0;
+	s.format = GL_RGB8;
+	s.width = s.height = s.levels = 1;
+	s.baseLevel = s.cappedLevel = 0;
+	s.bucket = s.layer = 0;
+	s.handle = 0;
+	if (backend == TEXTURE_BACKEND_BINDLESS)
+	{
+		s.texture = createStorage(GL_TEXTURE_2D, GL_RGB8, 1, 1, 1, 0);
+		glTextureSubImage2D(s.texture.get(), 0, 0, 0, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, placeholder);
+		s.handle = glGetTextureHandleARB(s.texture.get());
+		glMakeTextureHandleResidentARB(s.handle);
+	}
+	else
+	{
+		//	bucket 0 is reserved for the placeholder
+		buckets.resize(1);
+		bucket& b = buckets[0];
+		b.format = GL_RGB8;
+		b.width = b.height = b.levels = b.capacity = b.used = 1;
+		b.array = createStorage(GL_TEXTURE_2D_ARRAY, GL_RGB8, 1, 1, 1, 1);
+		glTextureSubImage3D(b.array.get(), 0, 0, 0, 0, 1, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, placeholder);
+	}
+}
+
+TextureLibrary::~TextureLibrary()
+{
+	collectRetired(true);
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		if (slots[i].handle)
+		{
+			glMakeTextureHandleNonResidentARB(slots[i].handle);
+		}
+	}
+}
+
+//	one slot per path; the image is decoded in the background and the slot shows the placeholder until then
+GLuint TextureLibrary::acquire(const std::string& path)
+{
+	std::unordered_map<std::string, GLuint>::iterator it = slotsByPath.find(path);
+	if (it != slotsByPath.end())
+	{
+		slots[it->second].refCount++;
+		return it->second;
+	}
+
+	GLuint id;
+	if (!freeSlots.empty())
+	{
+		id = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		id = slots.size();
+		slots.resize(slots.size() + 1);
+	}
+	slot& s = slots[id];
+	s.path = path;
+	s.refCount = 1;
+	s.pending = true;
+	s.loaded = false;
+	s.wantFull = true;
+	s.lastWanted = 0;
+	s.format = GL_RGB8;
+	s.width = s.height = s.levels = 0;
+	s.baseLevel = s.cappedLevel = 0;
+	s.bucket = s.layer = 0;
+	s.handle = 0;
+	s.ticket = ++tickets;
+	slotsByPath[path] = id;
+	loader.request(path, id, s.ticket);
+	return id;
+}
+
+//	cancels a decode still in flight, so the slot can be recycled at once
+void TextureLibrary::release(GLuint id)
+{
+	if (id == TEXTURE_PLACEHOLDER_SLOT || --slots[id].refCount > 0)
+	{
+		return;
+	}
+	slot& s = slots[id];
+	slotsByPath.erase(s.path);
+	unload(s);
+	s.ticket = 0;
+	s.pending = false;
+	freeSlots.push_back(id);
+}
+
+//	context thread only; a slot wanted at full resolution that only has its low levels is decoded again, and shows them meanwhile
+void TextureLibrary::request(GLuint id, bool full, unsigned int frame)
+{
+	if (id == TEXTURE_PLACEHOLDER_SLOT)
+	{
+		return;
+	}
+	slot& s = slots[id];
+	s.wantFull = full;
+	if (!full)
+	{
+		return;
+	}
+	s.lastWanted = frame;
+	if (s.loaded && s.baseLevel > s.cappedLevel && !s.pending)
+	{
+		s.pending = true;
+		s.ticket = ++tickets;
+		loader.request(s.path, id, s.ticket);
+	}
+}
+
+//	drops the top levels of slots nobody wants at full resolution, least recently wanted first, until bytes are freed
+GLsizeiptr TextureLibrary::demote(GLsizeiptr bytes)
+{
+	std::vector<GLuint> candidates;
+	for (size_t i = TEXTURE_PLACEHOLDER_SLOT + 1; i < slots.size(); i++)
+	{
+		const slot& s = slots[i];
+		if (s.refCount > 0 && s.loaded && !s.wantFull && s.baseLevel < getLowLevel(s.width, s.height, s.levels))
+		{
+			candidates.push_back(i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](GLuint a, GLuint b)
+	{
+		return slots[a].lastWanted < slots[b].lastWanted;
+	});
+
+	GLsizeiptr before = residentBytes;
+	for (size_t i = 0; i < candidates.size() && before - residentBytes < bytes; i++)
+	{
+		demoteSlot(slots[candidates[i]]);
+	}
+	return before - residentBytes;
+}
+
+//	context thread only; uploads decoded images until the time budget is spent (at least one per call)
+size_t TextureLibrary::pump(double budgetMs)
+{
+	PROFILE_ZONE("texture uploads");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	collectRetired(false);
+	size_t uploaded = 0;
+	decodedImage image;
+	while (loader.poll(image))
+	{
+		upload(image);
+		uploaded++;
+		if (elapsedMs(start, std::chrono::steady_clock::now()) >= budgetMs)
+		{
+			break;
+		}
+	}
+	return uploaded;
+}
+
+bool TextureLibrary::idle() const
+{
+	return loader.idle();
+}
+
+//	bindless textures are resident and need no binding at all
+void TextureLibrary::bind() const
+{
+	for (size_t i = 0; i < buckets.size(); i++)
+	{
+		state.bindTexture(i, buckets[i].array.get());
+	}
+}
+
+//	[bucket, layer] with texture arrays, [low, high] words of the handle with bindless
+void TextureLibrary::getReference(GLuint id, GLuint reference[2]) const
+{
+	const slot& s = slots[id].loaded ? slots[id] : slots[TEXTURE_PLACEHOLDER_SLOT];
+	if (backend == TEXTURE_BACKEND_BINDLESS)
+	{
+		reference[0] = (GLuint)(s.handle & 0xffffffffu);
+		reference[1] = (GLuint)(s.handle >> 32);
+	}
+	else
+	{
+		reference[0] = s.bucket;
+		reference[1] = s.layer;
+	}
+}
+
+unsigned int TextureLibrary::getGeneration() const
+{
+	return generation;
+}
+
+//	textures kept below the resolution wanted, or not at all, because no bucket was left for their size
+unsigned int TextureLibrary::getBucketMisses() const
+{
+	return bucketMisses;
+}
+
+//	bytes of the mip levels on the GPU, not counting unused layers of the arrays
+GLsizeiptr TextureLibrary::getResidentBytes() const
+{
+	return residentBytes;
+}
+
+textureBackend TextureLibrary::getBackend() const
+{
+	return backend;
+}
+
+//	prepended to shaders that sample through references
+std::string TextureLibrary::getShaderDefines() const
+{
+	std::string defines = "#define TEXTURE_BUCKETS " + std::to_string(TEXTURE_BUCKETS) + "\n";
+	if (backend == TEXTURE_BACKEND_BINDLESS)
+	{
+		defines += "#define BINDLESS_TEXTURES\n";
+	}
+	if (GLEW_NV_gpu_shader5)
+	{
+		//	materials differ within a multi-draw, so sampler indices and handles are not dynamically uniform
+		defines += "#define NONUNIFORM_SAMPLERS\n";
+	}
+	return defines;
+}
+
+void TextureLibrary::upload(decodedImage& image)
+{
+	//	the slot was released while decoding, and may hold another texture by now
+	slot& s = slots[image.slot];
+	if (image.ticket != s.ticket)
+	{
+		return;
+	}
+	s.pending = false;
+	if (image.levels == 0)
+	{
+		std::cerr << "Could not load texture " << image.path << '\n';
+		return;
+	}
+
+	//	a promotion replaces the low levels, which stay in place if the new storage cannot be had
+	GLsizei baseLevel = s.wantFull ? 0 : getLowLevel(image.width, image.height, image.levels);
+	bool promotion = s.loaded;
+	if (promotion && baseLevel >= s.baseLevel)
+	{
+		return;
+	}
+	GLuint oldBucket = s.bucket, oldLayer = s.layer;
+	GLuint64 oldHandle = s.handle;
+	GLTexture oldTexture = std::move(s.texture);
+	GLsizeiptr oldBytes = promotion ? getLevelBytes(s.format, s.width, s.height, s.levels, s.baseLevel) : 0;
+	s.loaded = false;
+	if (backend == TEXTURE_BACKEND_BINDLESS)
+	{
+		uploadBindless(s, image, baseLevel);
+	}
+	else
+	{
+		uploadToArray(s, image, baseLevel);
+	}
+	if (!s.loaded)
+	{
+		s.bucket = oldBucket;
+		s.layer = oldLayer;
+		s.handle = oldHandle;
+		s.texture = std::move(oldTexture);
+		s.loaded = promotion;
+		return;
+	}
+
+	if (promotion && backend == TEXTURE_BACKEND_ARRAYS)
+	{
+		buckets[oldBucket].freeLayers.push_back(oldLayer);
+	}
+	if (promotion)
+	{
+		retire(oldTexture, oldHandle);
+	}
+	s.format = image.format;
+	s.width = image.width;
+	s.height = image.height;
+	s.levels = image.levels;
+	s.baseLevel = baseLevel;
+	residentBytes += getLevelBytes(s.format, s.width, s.height, s.levels, s.baseLevel) - oldBytes;
+	generation++;
+}
+
+//	levels before baseLevel are left out, the array is sized for the first one uploaded; baseLevel goes up when the buckets ran out
+void TextureLibrary::uploadToArray(slot& s, const decodedImage& image, GLsizei& baseLevel)
+{
+	GLsizei wanted = baseLevel;
+	GLuint index = findBucketFrom(image.format, image.width, image.height, image.levels, baseLevel);
+	if (index == ~0u)
+	{
+		std::cerr << "Texture " << image.path << " (" << image.width << 'x' << image.height << ' ' << getTextureFormatName(image.format)
+			<< ") needs more than " << TEXTURE_BUCKETS << " texture sizes, keeping the placeholder\n";
+		return;
+	}
+	if (baseLevel > wanted)
+	{
+		std::cerr << "Texture " << image.path << " (" << image.width << 'x' << image.height << ' ' << getTextureFormatName(image.format)
+			<< ") needs more than " << TEXTURE_BUCKETS << " texture sizes, keeping it at " << std::max(image.width >> baseLevel, 1)
+			<< 'x' << std::max(image.height >> baseLevel, 1) << '\n';
+		s.cappedLevel = baseLevel;
+	}
+
+	GLsizei levels = image.levels - baseLevel;
+	bucket& b = buckets[index];
+	GLuint layer = allocateLayer(b);
+	for (GLsizei level = 0; level < levels; level++)
+	{
+		uploadLevel(b.array.get(), GL_TEXTURE_2D_ARRAY, level, layer, image, baseLevel + level);
+	}
+	s.bucket = index;
+	s.layer = layer;
+	s.loaded = true;
+}
+
+void TextureLibrary::uploadBindless(slot& s, const decodedImage& image, GLsizei baseLevel)
+{
+	GLsizei levels = image.levels - baseLevel;
+	s.texture = createStorage(GL_TEXTURE_2D, image.format, levels, std::max(image.width >> baseLevel, 1), std::max(image.height >> baseLevel, 1), 0);
+	for (GLsizei level = 0; level < levels; level++)
+	{
+		uploadLevel(s.texture.get(), GL_TEXTURE_2D, level, 0, image, baseLevel + level);
+	}
+
+	//	the texture is immutable from here on
+	s.handle = glGetTextureHandleARB(s.texture.get());
+	glMakeTextureHandleResidentARB(s.handle);
+	s.loaded = true;
+}
+
+//	GPU side copy of the low levels into smaller storage, nothing is decoded again
+bool TextureLibrary::demoteSlot(slot& s)
+{
+	GLsizei baseLevel = getLowLevel(s.width, s.height, s.levels);
+	GLuint index = 0;
+	if (backend == TEXTURE_BACKEND_ARRAYS)
+	{
+		index = findBucketFrom(s.format, s.width, s.height, s.levels, baseLevel);
+		if (index == ~0u)
+		{
+			return false;
+		}
+	}
+	GLsizei levels = s.levels - baseLevel;
+	GLsizei skipped = baseLevel - s.baseLevel;
+	GLsizei width = std::max(s.width >> baseLevel, 1), height = std::max(s.height >> baseLevel, 1);
+	if (backend == TEXTURE_BACKEND_BINDLESS)
+	{
+		GLTexture texture = createStorage(GL_TEXTURE_2D, s.format, levels, width, height, 0);
+		for (GLsizei level = 0; level < levels; level++)
+		{
+			glCopyImageSubData(s.texture.get(), GL_TEXTURE_2D, skipped + level, 0, 0, 0, texture.get(), GL_TEXTURE_2D, level, 0, 0, 0,
+				std::max(width >> level, 1), std::max(height >> level, 1), 1);
+		}
+		retire(s.texture, s.handle);
+		s.texture = std::move(texture);
+		s.handle = glGetTextureHandleARB(s.texture.get());
+		glMakeTextureHandleResidentARB(s.handle);
+	}
+	else
+	{
+		GLuint layer = allocateLayer(buckets[index]);
+		for (GLsizei level = 0; level < levels; level++)
+		{
+			glCopyImageSubData(buckets[s.bucket].array.get(), GL_TEXTURE_2D_ARRAY, skipped + level, 0, 0, s.layer,
+				buckets[index].array.get(), GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, std::max(width >> level, 1), std::max(height >> level, 1), 1);
+		}
+		buckets[s.bucket].freeLayers.push_back(s.layer);
+		s.bucket = index;
+		s.layer = layer;
+	}
+	residentBytes -= getLevelBytes(s.format, s.width, s.height, s.levels, s.baseLevel) - getLevelBytes(s.format, s.width, s.height, s.levels, baseLevel);
+	s.baseLevel = baseLevel;
+	generation++;
+	return true;
+}
+
+void TextureLibrary::unload(slot& s)
+{
+	if (s.loaded)
+	{
+		residentBytes -= getLevelBytes(s.format, s.width, s.height, s.levels, s.baseLevel);
+	}
+	if (s.loaded && backend == TEXTURE_BACKEND_ARRAYS)
+	{
+		buckets[s.bucket].freeLayers.push_back(s.layer);
+	}
+	retire(s.texture, s.handle);
+	s.handle = 0;
+	s.loaded = false;
+}
+
+//	takes the storage out of the slot; arrays only ever hand in empty storage
+void TextureLibrary::retire(GLTexture& texture, GLuint64 handle)
+{
+	if (!texture.get() && !handle)
+	{
+		return;
+	}
+	retiredTexture r;
+	r.texture = std::move(texture);
+	r.handle = handle;
+	r.frame = stream.getFrame();
+	retired.push_back(std::move(r));
+}
+
+//	storage retired during a frame is released once that frame has finished, or at once when all is
+void TextureLibrary::collectRetired(bool all)
+{
+	while (!retired.empty() && (all || retired.front().frame < stream.getCompletedFrames()))
+	{
+		if (retired.front().handle)
+		{
+			glMakeTextureHandleNonResidentARB(retired.front().handle);
+		}
+		retired.pop_front();
+	}
+}
+
+//	~0 when every bucket is taken by other sizes or formats
+GLuint TextureLibrary::findBucket(GLenum format, GLsizei width, GLsizei height, GLsizei levels)
+{
+	for (size_t i = 1; i < buckets.size(); i++)
+	{
+		if (buckets[i].format == format && buckets[i].width == width && buckets[i].height == height && buckets[i].levels == levels)
+		{
+			return i;
+		}
+	}
+	if (buckets.size() >= TEXTURE_BUCKETS)
+	{
+		return ~0u;
+	}
+
+	buckets.resize(buckets.size() + 1);
+	bucket& b = buckets.back();
+	b.format = format;
+	b.width = width;
+	b.height = height;
+	b.levels = levels;
+	b.capacity = TEXTURE_BUCKET_INITIAL;
+	b.used = 0;
+	b.array = createStorage(GL_TEXTURE_2D_ARRAY, format, levels, width, height, b.capacity);
+	return buckets.size() - 1;
+}
+
+/**
+ * Bucket for the levels of a width x height image with levels mips from baseLevel on. With every
+ * bucket taken, the smaller levels are tried in turn and baseLevel is moved to the first one
+ * whose size has a bucket already; each of these, and each image with no bucket at all, is
+ * counted as a miss.
+ */
+GLuint TextureLibrary::findBucketFrom(GLenum format, GLsizei width, GLsizei height, GLsizei levels, GLsizei& baseLevel)
+{
+	for (GLsizei level = baseLevel; level < levels; level++)
+	{
+		GLuint index = findBucket(format, std::max(width >> level, 1), std::max(height >> level, 1), levels - level);
+		if (index != ~0u)
+		{
+			bucketMisses += level > baseLevel;
+			baseLevel = level;
+			return index;
+		}
+	}
+	bucketMisses++;
+	return ~0u;
+}
+
+GLuint TextureLibrary::allocateLayer(bucket& b)
+{
+	if (!b.freeLayers.empty())
+	{
+		GLuint layer = b.freeLayers.back();
+		b.freeLayers.pop_back();
+		return layer;
+	}
+	if (b.used == b.capacity)
+	{
+		growBucket(b);
+	}
+	return b.used++;
+}
+
+//	only the array name changes, bind() picks that up; the old name may come back for another texture
+void TextureLibrary::growBucket(bucket& b)
+{
+	GLsizei capacity = b.capacity * 2;
+	GLTexture array = createStorage(GL_TEXTURE_2D_ARRAY, b.format, b.levels, b.width, b.height, capacity);
+	for (GLsizei level = 0; level < b.levels; level++)
+	{
+		GLsizei width = std::max(b.width >> level, 1), height = std::max(b.height >> level, 1);
+		glCopyImageSubData(b.array.get(), GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+			array.get(), GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, width, height, b.used);
+	}
+	state.forget(b.array.get());
+	b.array = std::move(array);
+	b.capacity = capacity;
+}
+
+//	immutable storage; layers is ignored for GL_TEXTURE_2D
+GLTexture TextureLibrary::createStorage(GLenum target, GLenum format, GLsizei levels, GLsizei width, GLsizei height, GLsizei layers)
+{
+	GLuint id;
+	glCreateTextures(target, 1, &id);
+	if (target == GL_TEXTURE_2D_ARRAY)
+	{
+		glTextureStorage3D(id, levels, format, width, height, layers);
+	}
+	else
+	{
+		glTextureStorage2D(id, levels, format, width, height);
+	}
+	glTextureParameteri(id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTextureParameteri(id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return GLTexture(id);
+}
+
+//	one level of the image into a level (and layer, for arrays) of the texture; cooked blocks go from the mapping as they are
+void TextureLibrary::uploadLevel(GLuint texture, GLenum target, GLsizei level, GLuint layer, const decodedImage& image, GLsizei imageLevel)
+{
+	GLsizei width = std::max(image.width >> imageLevel, 1), height = std::max(image.height >> imageLevel, 1);
+	GLsizeiptr bytes = getImageBytes(image.format, width, height);
+	if (!isCompressedFormat(image.format))
+	{
+		if (target == GL_TEXTURE_2D_ARRAY)
+		{
+			glTextureSubImage3D(texture, level, 0, 0, layer, width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, image.getLevel(imageLevel));
+		}
+		else
+		{
+			glTextureSubImage2D(texture, level, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, image.getLevel(imageLevel));
+		}
+	}
+	else if (target == GL_TEXTURE_2D_ARRAY)
+	{
+		glCompressedTextureSubImage3D(texture, level, 0, 0, layer, width, height, 1, image.format, bytes, image.getLevel(imageLevel));
+	}
+	else
+	{
+		glCompressedTextureSubImage2D(texture, level, 0, 0, width, height, image.format, bytes, image.getLevel(imageLevel));
+	}
+	PROFILE_COUNT(COUNTER_UPLOAD_BYTES, (uint64_t)bytes);
+}
+
+//	first level whose larger side fits TEXTURE_STREAM_LOW_SIZE, the last level if none does
+GLsizei TextureLibrary::getLowLevel(GLsizei width, GLsizei height, GLsizei levels)
+{
+	GLsizei level = 0;
+	while (level + 1 < levels && std::max(width >> level, height >> level) > TEXTURE_STREAM_LOW_SIZE)
+	{
+		level++;
+	}
+	return level;
+}
+
+//	bytes of levels [baseLevel, levels) in the format
+GLsizeiptr TextureLibrary::getLevelBytes(GLenum format, GLsizei width, GLsizei height, GLsizei levels, GLsizei baseLevel)
+{
+	GLsizeiptr bytes = 0;
+	for (GLsizei level = baseLevel; level < levels; level++)
+	{
+		bytes += getImageBytes(format, std::max(width >> level, 1), std::max(height >> level, 1));
+	}
+	return bytes;
+}
@@ -0,0 +1,169 @@
+#ifndef _TEXTURE_LIBRARY_H
+#define _TEXTURE_LIBRARY_H
+
+#include "gl_handle.h"
+#include "render_state.h"
+#include "ring_buffer.h"
+#include "texture_loader.h"
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define TEXTURE_UPLOAD_BUDGET_MS	2.0
+#define TEXTURE_BUCKETS				16	//	sampler array size in the array backend, bucket i is bound to unit i
+#define TEXTURE_BUCKET_INITIAL		4	//	layers per bucket before its first growth
+#define TEXTURE_PLACEHOLDER_SLOT	0	//	grey 1x1, also stands in for "no texture"
+#define TEXTURE_STREAM_LOW_SIZE		128	//	largest mip level kept by a texture that is not wanted at full resolution
+
+enum textureBackend
+{
+	TEXTURE_BACKEND_ARRAYS,
+	TEXTURE_BACKEND_BINDLESS
+};
+
+/**
+ * Every texture used by loaded models, shared and reference counted by path. A texture is
+ * addressed by a stable slot; what the shader needs to sample a slot is its reference:
+ * bucket and layer of a GL_TEXTURE_2D_ARRAY holding all images of one size and format (RGB8
+ * as decoded, or the block compressed format it was cooked to), or a resident
+ * ARB_bindless_texture handle split into two words. A slot refers to the placeholder until
+ * its image has been decoded and uploaded by pump(), so users cache references against
+ * getGeneration(). Buckets grow by copying into a larger array; layers keep their index.
+ * Residency is streamed in two steps: a slot nobody wants at full resolution only keeps the
+ * mip levels up to TEXTURE_STREAM_LOW_SIZE. request() says which one a slot needs, full
+ * resolution is decoded again when it is missing, and demote() drops the top levels of
+ * the least recently wanted slots on the GPU when memory is short. Slots start out wanted
+ * at full resolution, so users that never call request() see every level. Bindless storage
+ * that is replaced or unloaded stays resident until the ring buffer's fences show that no
+ * frame in flight can sample it. Once all TEXTURE_BUCKETS sizes are taken, a texture whose
+ * size has no bucket goes into the bucket of one of its smaller levels, and is kept at that
+ * level; getBucketMisses() counts these, and the textures left on the placeholder.
+ */
+class TextureLibrary
+{
+	public:
+		TextureLibrary(ThreadPool&, RenderState&, const RingBuffer&, bool = true);
+		~TextureLibrary();
+		TextureLibrary(const TextureLibrary&) = delete;
+		TextureLibrary& operator=(const TextureLibrary&) = delete;
+
+		GLuint acquire(const std::string&);
+		void release(GLuint);
+		void request(GLuint, bool, unsigned int);
+		GLsizeiptr demote(GLsizeiptr);
+		size_t pump(double = TEXTURE_UPLOAD_BUDGET_MS);
+		bool idle() const;
+		void bind() const;
+		void getReference(GLuint, GLuint[2]) const;
+		unsigned int getGeneration() const;
+		GLsizeiptr getResidentBytes() const;
+		unsigned int getBucketMisses() const;
+		textureBackend getBackend() const;
+		std::string getShaderDefines() const;
+
+	private:
+		struct slot
+		{
+			std::string path;
+			int refCount;
+			unsigned int ticket;			//	of the request in flight, 0 once none is wanted
+			bool pending, loaded;
+			bool wantFull;
+			unsigned int lastWanted;		//	frame of the last request at full resolution
+			GLenum format;
+			GLsizei width, height, levels;	//	of the full image, the GPU holds levels from baseLevel on
+			GLsizei baseLevel;
+			GLsizei cappedLevel;			//	lowest base level a bucket was found for, 0 unless the buckets ran out
+			GLuint bucket, layer;
+			GLTexture texture;
+			GLuint64 handle;
+		};
+
+		struct bucket
+		{
+			GLenum format;
+			GLsizei width, height, levels, capacity, used;
+			GLTexture array;
+			std::vector<GLuint> freeLayers;
+		};
+
+		//	storage replaced while frames in flight may still sample its handle
+		struct retiredTexture
+		{
+			GLTexture texture;
+			GLuint64 handle;
+			unsigned long long frame;
+		};
+
+		TextureLoader loader;
+		RenderState& state;
+		const RingBuffer& stream;
+		textureBackend backend;
+		std::vector<slot> slots;
+		std::vector<GLuint> freeSlots;
+		std::unordered_map<std::string, GLuint> slotsByPath;
+		std::vector<bucket> buckets;
+		std::deque<retiredTexture> retired;
+		unsigned int generation, tickets, bucketMisses;
+		GLsizeiptr residentBytes;
+
+		void upload(decodedImage&);
+		void uploadToArray(slot&, const decodedImage&, GLsizei&);
+		void uploadBindless(slot&, const decodedImage&, GLsizei);
+		bool demoteSlot(slot&);
+		void unload(slot&);
+		void retire(GLTexture&, GLuint64);
+		void collectRetired(bool);
+		GLuint findBucket(GLenum, GLsizei, GLsizei, GLsizei);
+		GLuint findBucketFrom(GLenum, GLsizei, GLsizei, GLsizei, GLsizei&);
+		GLuint allocateLayer(bucket&);
+		void growBucket(bucket&);
+		static GLTexture createStorage(GLenum, GLenum, GLsizei, GLsizei, GLsizei, GLsizei);
+		static void uploadLevel(GLuint, GLenum, GLsizei, GLuint, const decodedImage&, GLsizei);
+		static GLsizei getLowLevel(GLsizei, GLsizei, GLsizei);
+		static GLsizeiptr getLevelBytes(GLenum, GLsizei, GLsizei, GLsizei, GLsizei);
+};
+
+/**
+ * Move-only reference on one TextureLibrary slot; releases it on destruction.
+ */
+class TextureSlot
+{
+	public:
+		TextureSlot() : library(nullptr), id(0) {}
+		TextureSlot(TextureLibrary& _library, GLuint _id) : library(&_library), id(_id) {}
+		~TextureSlot() { reset(); }
+		TextureSlot(const TextureSlot&) = delete;
+		TextureSlot& operator=(const TextureSlot&) = delete;
+
+		TextureSlot(TextureSlot&& other) : library(other.library), id(other.id) { other.library = nullptr; }
+		TextureSlot& operator=(TextureSlot&& other)
+		{
+			if (this != &other)
+			{
+				reset();
+				library = other.library;
+				id = other.id;
+				other.library = nullptr;
+			}
+			return *this;
+		}
+
+		void reset()
+		{
+			if (library)
+			{
+				library->release(id);
+				library = nullptr;
+			}
+		}
+
+		GLuint getID() const { return id; }
+
+	private:
+		TextureLibrary* library;
+		GLuint id;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "texture_loader.h"
+#include "asset_cook.h"
+#include "ktx_file.h"
+#include "profiler.h"
+#include <SOIL.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+//	compressed says whether the context can take the BC formats of cooked files
+TextureLoader::TextureLoader(ThreadPool& _pool, bool _compressed) :
+	pool(_pool), decoded(THREAD_POOL_QUEUE_SIZE), overflowed(false), inFlight(0), compressed(_compressed)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+	//	jobs hold a pointer to us, wait for them and drop whatever was not collected yet
+	decodedImage image;
+	while (inFlight > 0)
+	{
+		while (poll(image))
+		{
+		}
+		std::this_thread::yield();
+	}
+}
+
+//	slot and ticket are passed back untouched with the decoded image
+void TextureLoader::request(const std::string& path, GLuint slot, unsigned int ticket)
+{
+	inFlight++;
+	pool.submit(std::bind(&TextureLoader::decode, this, slot, ticket, path));
+}
+
+//	context thread only; an image that failed to decode comes back with no levels
+bool TextureLoader::poll(decodedImage& image)
+{
+	if (!decoded.pop(image))
+	{
+		if (!overflowed.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(overflowMutex);
+		if (overflow.empty())
+		{
+			return false;
+		}
+		image = std::move(overflow.back());
+		overflow.pop_back();
+		overflowed.store(!overflow.empty(), std::memory_order_release);
+	}
+	inFlight--;
+	return true;
+}
+
+bool TextureLoader::idle() const
+{
+	return inFlight == 0;
+}
+
+//	worker thread, no GL calls here
+void TextureLoader::decode(GLuint slot, unsigned int ticket, const std::string& path)
+{
+	PROFILE_ZONE("decode texture");
+	decodedImage image;
+	image.slot = slot;
+	image.ticket = ticket;
+	image.format = GL_RGB8;
+	image.path = path;
+	image.width = image.height = image.levels = 0;
+	if (!(compressed && AssetCook::isCooked(path) && loadCooked(image)))
+	{
+		unsigned char* pixels = SOIL_load_image(path.c_str(), &image.width, &image.height, 0, SOIL_LOAD_RGB);
+		if (pixels)
+		{
+			image.pixels.assign(pixels, pixels + (size_t)image.width * image.height * 3);
+			SOIL_free_image_data(pixels);
+			buildMipChain(image.pixels, image.levelOffsets, image.width, image.height, 3);
+			image.levels = image.levelOffsets.size();
+		}
+	}
+	if (!decoded.push(std::move(image)))
+	{
+		std::lock_guard<std::mutex> lock(overflowMutex);
+		overflow.push_back(std::move(image));
+		overflowed.store(true, std::memory_order_release);
+	}
+}
+
+//	the mapping is faulted in here, so the upload on the context thread does not wait for the disk
+bool TextureLoader::loadCooked(decodedImage& image)
+{
+	std::shared_ptr<mappedFile> mapping = std::make_shared<mappedFile>(AssetCook::getCookedPath(image.path));
+	ktxLayout layout;
+	if (!readKtxFile(*mapping, layout))
+	{
+		std::cerr << "Ignoring unreadable cooked texture " << AssetCook::getCookedPath(image.path) << '\n';
+		return false;
+	}
+	volatile unsigned char touched = 0;
+	for (size_t offset = 0; offset < mapping->size; offset += 4096)
+	{
+		touched = touched + mapping->data[offset];
+	}
+	image.format = layout.format;
+	image.width = layout.width;
+	image.height = layout.height;
+	image.levels = layout.levelOffsets.size();
+	image.levelOffsets = layout.levelOffsets;
+	image.mapping = mapping;
+	return true;
+}
+
+//	2x2 box filter of level 0 (at offset 0) down to 1x1, appending a level and its offset each time; odd edges reuse their last row/column
+void TextureLoader::buildMipChain(std::vector<unsigned char>& pixels, std::vector<size_t>& levelOffsets, int width, int height, int channels)
+{
+	levelOffsets.assign(1, 0);
+	while (width > 1 || height > 1)
+	{
+		int nextWidth = std::max(width / 2, 1), nextHeight = std::max(height / 2, 1);
+		size_t source = levelOffsets.back();
+		size_t target = pixels.size();
+		levelOffsets.push_back(target);
+		pixels.resize(target + (size_t)nextWidth * nextHeight * channels);
+
+		const unsigned char* src = &pixels[source];
+		unsigned char* dst = &pixels[target];
+		for (int y = 0; y < nextHeight; y++)
+		{
+			int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+			for (int x = 0; x < nextWidth; x++)
+			{
+				int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+				for (int c = 0; c < channels; c++)
+				{
+					unsigned int sum = src[(y0 * width + x0) * channels + c] + src[(y0 * width + x1) * channels + c] +
+						src[(y1 * width + x0) * channels + c] + src[(y1 * width + x1) * channels + c];
+					*dst++ = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		width = nextWidth;
+		height = nextHeight;
+	}
+}
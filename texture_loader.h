@@ -0,0 +1,64 @@
+#ifndef _TEXTURE_LOADER_H
+#define _TEXTURE_LOADER_H
+
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include <GL/glew.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//	an image with its full mip chain, level 0 first: decoded RGB8 pixels, or the blocks of a cooked file left in its mapping
+struct decodedImage
+{
+	GLuint slot;
+	unsigned int ticket;			//	of the request, the owner drops images of requests it has cancelled
+	GLenum format;
+	int width, height, levels;		//	no levels when the image could not be loaded
+	std::vector<unsigned char> pixels;
+	std::shared_ptr<mappedFile> mapping;
+	std::vector<size_t> levelOffsets;
+	std::string path;
+
+	const unsigned char* getLevel(int level) const
+	{
+		return (mapping ? mapping->data : pixels.data()) + levelOffsets[level];
+	}
+};
+
+/**
+ * Asynchronous texture decoding: images are decoded and mipmapped on the thread pool and
+ * handed back through a lock-free queue; when more are finished than it holds, the rest wait
+ * in a locked overflow list, since a job run inline on the context thread (ThreadPool::submit
+ * with a full queue) must not wait for poll(). No GL calls are made here; the context thread
+ * collects finished images with poll() and uploads them wherever they belong. With block
+ * compression supported, a texture cooked by AssetCook that is not older than its source
+ * is mapped instead and its levels go to GL as they are in the file.
+ */
+class TextureLoader
+{
+	public:
+		TextureLoader(ThreadPool&, bool);
+		~TextureLoader();
+		TextureLoader(const TextureLoader&) = delete;
+		TextureLoader& operator=(const TextureLoader&) = delete;
+		void request(const std::string&, GLuint, unsigned int);
+		bool poll(decodedImage&);
+		bool idle() const;
+
+		static void buildMipChain(std::vector<unsigned char>&, std::vector<size_t>&, int, int, int);
+
+	private:
+		ThreadPool& pool;
+		LockFreeQueue<decodedImage> decoded;
+		std::mutex overflowMutex;
+		std::vector<decodedImage> overflow;
+		std::atomic<bool> overflowed;
+		std::atomic<int> inFlight;
+		bool compressed;
+		void decode(GLuint, unsigned int, const std::string&);
+		static bool loadCooked(decodedImage&);
+};
+
+#endif
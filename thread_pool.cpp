@@ -0,0 +1,191 @@
+#include "thread_pool.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int threadCount) : jobs(THREAD_POOL_QUEUE_SIZE), running(true), sleeping(0), parallelism(0)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::work, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		running = false;
+	}
+	idle.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+	if (!jobs.push(std::move(job)))
+	{
+		job();	//	queue is full, run on the caller rather than block it
+		return;
+	}
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		idle.notify_one();
+	}
+}
+
+/**
+ * Runs fn(0) .. fn(count - 1) across the pool and returns when all calls are done.
+ * Every participant starts on an even share of the range and takes indices from its front;
+ * one that runs out steals the back half of the largest share left, so uneven items and
+ * workers that join late even out. A share is [begin, end) packed into one word, so taking
+ * and stealing are both a single CAS. The caller takes part too, so this also makes progress
+ * when every worker is busy.
+ */
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	size_t helpers = std::min<size_t>(workers.size(), count - 1);
+	unsigned int limit = parallelism.load(std::memory_order_relaxed);
+	if (limit > 0)
+	{
+		helpers = std::min<size_t>(helpers, limit - 1);
+	}
+
+	struct alignas(64) share
+	{
+		std::atomic<uint64_t> bounds;
+	};
+	struct loopState
+	{
+		std::unique_ptr<share[]> shares;
+		size_t participants;
+		std::atomic<size_t> joined;
+		std::atomic<size_t> done;
+	};
+	std::shared_ptr<loopState> state = std::make_shared<loopState>();
+	state->participants = helpers + 1;
+	state->shares.reset(new share[state->participants]);
+	for (size_t i = 0; i < state->participants; i++)
+	{
+		state->shares[i].bounds.store((uint64_t)(i * count / state->participants) << 32 | ((i + 1) * count / state->participants));
+	}
+	state->joined = 0;
+	state->done = 0;
+
+	const std::function<void(size_t)>* body = &fn;
+	std::function<void()> runner = [state, body]()
+	{
+		size_t self = state->joined++;
+		if (self >= state->participants)
+		{
+			return;
+		}
+		std::atomic<uint64_t>& own = state->shares[self].bounds;
+		for (;;)
+		{
+			uint64_t bounds = own.load(std::memory_order_acquire);
+			while ((bounds >> 32) < (bounds & 0xffffffffu))
+			{
+				if (own.compare_exchange_weak(bounds, bounds + ((uint64_t)1 << 32), std::memory_order_acq_rel))
+				{
+					(*body)(bounds >> 32);
+					state->done++;
+					bounds = own.load(std::memory_order_acquire);
+				}
+			}
+
+			//	out of work: split the largest share left, done once every share is empty
+			size_t victim = 0;
+			uint64_t victimBounds = 0, most = 0;
+			for (size_t i = 0; i < state->participants; i++)
+			{
+				uint64_t b = state->shares[i].bounds.load(std::memory_order_acquire);
+				uint64_t left = (b & 0xffffffffu) > (b >> 32) ? (b & 0xffffffffu) - (b >> 32) : 0;
+				if (left > most)
+				{
+					victim = i;
+					victimBounds = b;
+					most = left;
+				}
+			}
+			if (most == 0)
+			{
+				return;
+			}
+			uint64_t end = victimBounds & 0xffffffffu, middle = end - (most + 1) / 2;
+			if (state->shares[victim].bounds.compare_exchange_strong(victimBounds, (victimBounds >> 32) << 32 | middle, std::memory_order_acq_rel))
+			{
+				//	thieves skip empty shares, so nobody else writes ours until it is refilled
+				own.store(middle << 32 | end, std::memory_order_release);
+			}
+		}
+	};
+
+	for (size_t i = 0; i < helpers; i++)
+	{
+		submit(runner);
+	}
+	runner();
+	while (state->done < count)
+	{
+		std::this_thread::yield();
+	}
+}
+
+//	threads a parallelFor runs on, the caller included; 0 uses every worker
+void ThreadPool::setParallelism(unsigned int threads)
+{
+	parallelism = threads;
+}
+
+unsigned int ThreadPool::size() const
+{
+	return workers.size();
+}
+
+void ThreadPool::work()
+{
+	PROFILE_THREAD("worker");
+	std::function<void()> job;
+	while (running)
+	{
+		if (jobs.pop(job))
+		{
+			job();
+			job = nullptr;
+			continue;
+		}
+
+		//	park; the queue is checked again after announcing ourselves so a submit cannot be missed
+		std::unique_lock<std::mutex> lock(idleMutex);
+		sleeping++;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (jobs.pop(job))
+		{
+			sleeping--;
+			lock.unlock();
+			job();
+			job = nullptr;
+			continue;
+		}
+		if (running)
+		{
+			idle.wait(lock);
+		}
+		sleeping--;
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include "lockfree_queue.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define THREAD_POOL_QUEUE_SIZE 4096
+
+/**
+ * Fixed set of worker threads fed from a lock-free job queue.
+ * Workers only touch the mutex/condition variable to park when there is nothing to do.
+ * parallelFor splits its range between the caller and the workers that pick it up, and
+ * balances it by work stealing.
+ */
+class ThreadPool
+{
+	public:
+		explicit ThreadPool(unsigned int = 0);
+		~ThreadPool();
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		void submit(std::function<void()>);
+		void parallelFor(size_t, const std::function<void(size_t)>&);
+		void setParallelism(unsigned int);
+		unsigned int size() const;
+
+	private:
+		LockFreeQueue<std::function<void()> > jobs;
+		std::vector<std::thread> workers;
+		std::atomic<bool> running;
+		std::atomic<int> sleeping;
+		std::atomic<unsigned int> parallelism;
+		std::mutex idleMutex;
+		std::condition_variable idle;
+		void work();
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef _TRIPLE_BUFFER_H
+#define _TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/**
+ * Hands the latest value from one writer thread to one reader thread without locks or waiting.
+ * The writer fills its own slot and swaps it with the middle one, the reader swaps the middle
+ * slot for its own when it has been written since; a value the reader never got to is simply
+ * replaced, so the reader always sees the newest complete value and neither side stalls.
+ */
+template <typename T>
+class TripleBuffer
+{
+	public:
+		explicit TripleBuffer(const T& initial = T()) : middle(1), back(0), front(2)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				slots[i].value = initial;
+			}
+		}
+		TripleBuffer(const TripleBuffer&) = delete;
+		TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+		//	writer thread only
+		void write(const T& value)
+		{
+			slots[back].value = value;
+			back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+		}
+
+		//	reader thread only; true when the value is newer than the one read before
+		bool read(T& value)
+		{
+			bool fresh = (middle.load(std::memory_order_relaxed) & FRESH) != 0;
+			if (fresh)
+			{
+				front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+			}
+			value = slots[front].value;
+			return fresh;
+		}
+
+	private:
+		static const unsigned int FRESH = 4;	//	set on the middle index once written, cleared by the reader
+
+		//	writer and reader each keep their slot on a separate cache line
+		struct alignas(64) slot
+		{
+			T value;
+		};
+
+		slot slots[3];
+		alignas(64) std::atomic<unsigned int> middle;
+		alignas(64) unsigned int back;
+		alignas(64) unsigned int front;
+};
+
+#endif
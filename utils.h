@@ -1,5 +1,18 @@
+#ifndef _UTILS_H
+#define _UTILS_H
+
 /**
  * ...
  */
 
-#define _log(a) std::cout << a << std::endl
\ No newline at end of file
+#include <chrono>
+
+#define _log(a) std::cout << a << std::endl
+
+//	milliseconds between two points of the steady clock
+inline double elapsedMs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+	return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+#endif
@@ -0,0 +1,415 @@
+#include "vertex_format.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	struct compactVertex
+	{
+		glm::vec3 position;
+		GLuint normal;			//	GL_INT_2_10_10_10_REV
+		GLushort texCoord[2];	//	GL_HALF_FLOAT
+	};
+
+	struct quantizedVertex
+	{
+		GLushort position[4];	//	unorm over the mesh box, w unused
+		GLuint normal;
+		GLushort texCoord[2];	//	unorm over the mesh texture coordinate range
+	};
+
+	GLuint packSnorm10(float value)
+	{
+		return (GLuint)std::lrint(std::min(std::max(value, -1.0f), 1.0f) * 511.0f) & 0x3FF;
+	}
+
+	//	GL 4.2 rule: c / 511, clamped so that -512 maps to -1 as well
+	float unpackSnorm10(GLuint bits)
+	{
+		int value = bits & 0x3FF;
+		return std::max((value & 0x200 ? value - 0x400 : value) / 511.0f, -1.0f);
+	}
+
+	GLuint packNormal(const glm::vec3& normal)
+	{
+		return packSnorm10(normal.x) | packSnorm10(normal.y) << 10 | packSnorm10(normal.z) << 20;
+	}
+
+	GLushort packUnorm16(float value, float offset, float invScale)
+	{
+		return (GLushort)std::lrint(std::min(std::max((value - offset) * invScale, 0.0f), 1.0f) * 65535.0f);
+	}
+
+	GLuint asBits(float value)
+	{
+		GLuint bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	float asFloat(GLuint bits)
+	{
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	//	round to nearest even; overflow goes to infinity, values below the half range to denormals
+	GLushort floatToHalf(float value)
+	{
+		const GLuint infinity = 255u << 23, halfOverflow = (127u + 16) << 23, halfNormal = (127u - 14) << 23;
+		const GLuint denormalMagic = ((127u - 15) + (23 - 10) + 1) << 23;
+		GLuint bits = asBits(value), sign = bits & 0x80000000u;
+		bits ^= sign;
+
+		GLuint res;
+		if (bits >= halfOverflow)
+		{
+			res = bits > infinity ? 0x7E00 : 0x7C00;
+		}
+		else if (bits < halfNormal)
+		{
+			//	the float adder shifts the mantissa into place and rounds it
+			res = asBits(asFloat(bits) + asFloat(denormalMagic)) - denormalMagic;
+		}
+		else
+		{
+			GLuint mantissaOdd = (bits >> 13) & 1;
+			bits = bits - ((127u - 15) << 23) + 0xFFF + mantissaOdd;
+			res = bits >> 13;
+		}
+		return (GLushort)(res | sign >> 16);
+	}
+
+	float halfToFloat(GLushort half)
+	{
+		int exponent = (half >> 10) & 0x1F, mantissa = half & 0x3FF;
+		float value;
+		if (exponent == 0)
+		{
+			value = std::ldexp((float)mantissa, -24);
+		}
+		else if (exponent == 31)
+		{
+			value = mantissa ? NAN : INFINITY;
+		}
+		else
+		{
+			value = std::ldexp((float)(mantissa | 0x400), exponent - 25);
+		}
+		return half & 0x8000 ? -value : value;
+	}
+
+#ifdef __SSE2__
+	__m128i packSnorm10x4(__m128 x, __m128 y, __m128 z)
+	{
+		const __m128 lower = _mm_set1_ps(-1.0f), upper = _mm_set1_ps(1.0f), range = _mm_set1_ps(511.0f);
+		const __m128i mask = _mm_set1_epi32(0x3FF);
+		__m128i qx = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(x, lower), upper), range)), mask);
+		__m128i qy = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(y, lower), upper), range)), mask);
+		__m128i qz = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(z, lower), upper), range)), mask);
+		return _mm_or_si128(qx, _mm_or_si128(_mm_slli_epi32(qy, 10), _mm_slli_epi32(qz, 20)));
+	}
+
+	__m128i packUnorm16x4(__m128 value, float offset, float invScale)
+	{
+		__m128 t = _mm_mul_ps(_mm_sub_ps(value, _mm_set1_ps(offset)), _mm_set1_ps(invScale));
+		t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		return _mm_cvtps_epi32(_mm_mul_ps(t, _mm_set1_ps(65535.0f)));
+	}
+
+	//	floatToHalf on four lanes with integer compares instead of branches; results in the low 16 bits
+	__m128i floatToHalfx4(__m128 value)
+	{
+		const __m128i infinity = _mm_set1_epi32(255 << 23), halfOverflow = _mm_set1_epi32((127 + 16) << 23);
+		const __m128i halfNormal = _mm_set1_epi32((127 - 14) << 23), denormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+		const __m128i normalBias = _mm_set1_epi32((int)(0xFFFu - ((127u - 15) << 23)));
+
+		__m128i bits = _mm_castps_si128(value);
+		__m128i sign = _mm_and_si128(bits, _mm_set1_epi32((int)0x80000000u));
+		bits = _mm_xor_si128(bits, sign);
+
+		__m128i isNaN = _mm_cmpgt_epi32(bits, infinity);
+		__m128i isFinite = _mm_cmpgt_epi32(halfOverflow, bits);
+		__m128i isDenormal = _mm_cmpgt_epi32(halfNormal, bits);
+		__m128i special = _mm_or_si128(_mm_set1_epi32(0x7C00), _mm_and_si128(isNaN, _mm_set1_epi32(0x200)));
+
+		__m128i denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(bits), _mm_castsi128_ps(denormalMagic))), denormalMagic);
+		__m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1));
+		__m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bits, normalBias), mantissaOdd), 13);
+
+		__m128i res = _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+		res = _mm_or_si128(_mm_and_si128(isFinite, res), _mm_andnot_si128(isFinite, special));
+		return _mm_or_si128(res, _mm_srli_epi32(sign, 16));
+	}
+#endif
+
+	void packCompact(const vertex* vertices, size_t count, compactVertex* out)
+	{
+		size_t i = 0;
+#ifdef __SSE2__
+		GLuint normals[4], texCoords[4];
+		for (; i + 4 <= count; i += 4)
+		{
+			//	two rows per vertex, transposed into one register per component
+			const float* f = &vertices[i].position.x;
+			__m128 px = _mm_loadu_ps(f), py = _mm_loadu_ps(f + 8), pz = _mm_loadu_ps(f + 16), nx = _mm_loadu_ps(f + 24);
+			__m128 ny = _mm_loadu_ps(f + 4), nz = _mm_loadu_ps(f + 12), u = _mm_loadu_ps(f + 20), v = _mm_loadu_ps(f + 28);
+			_MM_TRANSPOSE4_PS(px, py, pz, nx);
+			_MM_TRANSPOSE4_PS(ny, nz, u, v);
+
+			_mm_storeu_si128((__m128i*)normals, packSnorm10x4(nx, ny, nz));
+			__m128i halfU = _mm_and_si128(floatToHalfx4(u), _mm_set1_epi32(0xFFFF));
+			_mm_storeu_si128((__m128i*)texCoords, _mm_or_si128(halfU, _mm_slli_epi32(floatToHalfx4(v), 16)));
+			for (int k = 0; k < 4; k++)
+			{
+				out[i + k].position = vertices[i + k].position;
+				out[i + k].normal = normals[k];
+				out[i + k].texCoord[0] = (GLushort)texCoords[k];
+				out[i + k].texCoord[1] = (GLushort)(texCoords[k] >> 16);
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			out[i].position = vertices[i].position;
+			out[i].normal = packNormal(vertices[i].normal);
+			out[i].texCoord[0] = floatToHalf(vertices[i].texCoord.x);
+			out[i].texCoord[1] = floatToHalf(vertices[i].texCoord.y);
+		}
+	}
+
+	void packQuantized(const vertex* vertices, size_t count, const glm::vec3& positionOffset, const glm::vec3& positionInvScale,
+		const glm::vec2& texCoordOffset, const glm::vec2& texCoordInvScale, quantizedVertex* out)
+	{
+		size_t i = 0;
+#ifdef __SSE2__
+		GLuint normals[4], x[4], y[4], z[4], u[4], v[4];
+		for (; i + 4 <= count; i += 4)
+		{
+			const float* f = &vertices[i].position.x;
+			__m128 px = _mm_loadu_ps(f), py = _mm_loadu_ps(f + 8), pz = _mm_loadu_ps(f + 16), nx = _mm_loadu_ps(f + 24);
+			__m128 ny = _mm_loadu_ps(f + 4), nz = _mm_loadu_ps(f + 12), tu = _mm_loadu_ps(f + 20), tv = _mm_loadu_ps(f + 28);
+			_MM_TRANSPOSE4_PS(px, py, pz, nx);
+			_MM_TRANSPOSE4_PS(ny, nz, tu, tv);
+
+			_mm_storeu_si128((__m128i*)normals, packSnorm10x4(nx, ny, nz));
+			_mm_storeu_si128((__m128i*)x, packUnorm16x4(px, positionOffset.x, positionInvScale.x));
+			_mm_storeu_si128((__m128i*)y, packUnorm16x4(py, positionOffset.y, positionInvScale.y));
+			_mm_storeu_si128((__m128i*)z, packUnorm16x4(pz, positionOffset.z, positionInvScale.z));
+			_mm_storeu_si128((__m128i*)u, packUnorm16x4(tu, texCoordOffset.x, texCoordInvScale.x));
+			_mm_storeu_si128((__m128i*)v, packUnorm16x4(tv, texCoordOffset.y, texCoordInvScale.y));
+			for (int k = 0; k < 4; k++)
+			{
+				quantizedVertex& res = out[i + k];
+				res.position[0] = (GLushort)x[k];
+				res.position[1] = (GLushort)y[k];
+				res.position[2] = (GLushort)z[k];
+				res.position[3] = 0;
+				res.normal = normals[k];
+				res.texCoord[0] = (GLushort)u[k];
+				res.texCoord[1] = (GLushort)v[k];
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			quantizedVertex& res = out[i];
+			for (int c = 0; c < 3; c++)
+			{
+				res.position[c] = packUnorm16(vertices[i].position[c], positionOffset[c], positionInvScale[c]);
+			}
+			res.position[3] = 0;
+			res.normal = packNormal(vertices[i].normal);
+			res.texCoord[0] = packUnorm16(vertices[i].texCoord.x, texCoordOffset.x, texCoordInvScale.x);
+			res.texCoord[1] = packUnorm16(vertices[i].texCoord.y, texCoordOffset.y, texCoordInvScale.y);
+		}
+	}
+
+	//	a flat range quantizes everything to 0, which the offset alone restores
+	float invertRange(float range)
+	{
+		return range > 0.0f ? 1.0f / range : 0.0f;
+	}
+
+	//	angle between the source normal and the one the shader sees after normalising the decoded one
+	float normalError(const glm::vec3& source, GLuint packed)
+	{
+		double a[3] = { source.x, source.y, source.z };
+		double b[3] = { unpackSnorm10(packed), unpackSnorm10(packed >> 10), unpackSnorm10(packed >> 20) };
+		double cross[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+		double sine = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+		double cosine = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+		if (sine == 0.0 && cosine == 0.0)
+		{
+			return 0.0f;
+		}
+		return (float)(std::atan2(sine, cosine) * 180.0 / M_PI);
+	}
+}
+
+static_assert(sizeof(vertex) == 32, "packing kernels read a vertex as 8 consecutive floats");
+static_assert(sizeof(compactVertex) == 20 && sizeof(quantizedVertex) == 16, "unexpected padding in packed vertices");
+
+GLsizei getVertexStride(vertexFormat format)
+{
+	switch (format)
+	{
+		case VERTEX_FORMAT_COMPACT:		return sizeof(compactVertex);
+		case VERTEX_FORMAT_QUANTIZED:	return sizeof(quantizedVertex);
+		default:						return sizeof(vertex);
+	}
+}
+
+const char* getVertexFormatName(vertexFormat format)
+{
+	switch (format)
+	{
+		case VERTEX_FORMAT_COMPACT:		return "compact";
+		case VERTEX_FORMAT_QUANTIZED:	return "quantized";
+		default:						return "full";
+	}
+}
+
+bool parseVertexFormat(const char* name, vertexFormat& format)
+{
+	const vertexFormat formats[] = { VERTEX_FORMAT_FULL, VERTEX_FORMAT_COMPACT, VERTEX_FORMAT_QUANTIZED };
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+	{
+		if (!strcmp(name, getVertexFormatName(formats[i])))
+		{
+			format = formats[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+void setupVertexAttributes(GLuint vao, vertexFormat format)
+{
+	switch (format)
+	{
+		case VERTEX_FORMAT_COMPACT:
+			glVertexArrayAttribFormat(vao, POSITION_LOC, 3, GL_FLOAT, GL_FALSE, offsetof(compactVertex, position));
+			glVertexArrayAttribFormat(vao, NORMAL_LOC, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(compactVertex, normal));
+			glVertexArrayAttribFormat(vao, TEXTCOORD_LOC, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(compactVertex, texCoord));
+			break;
+		case VERTEX_FORMAT_QUANTIZED:
+			glVertexArrayAttribFormat(vao, POSITION_LOC, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(quantizedVertex, position));
+			glVertexArrayAttribFormat(vao, NORMAL_LOC, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(quantizedVertex, normal));
+			glVertexArrayAttribFormat(vao, TEXTCOORD_LOC, 2, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(quantizedVertex, texCoord));
+			break;
+		default:
+			glVertexArrayAttribFormat(vao, POSITION_LOC, 3, GL_FLOAT, GL_FALSE, offsetof(vertex, position));
+			glVertexArrayAttribFormat(vao, NORMAL_LOC, 3, GL_FLOAT, GL_FALSE, offsetof(vertex, normal));
+			glVertexArrayAttribFormat(vao, TEXTCOORD_LOC, 2, GL_FLOAT, GL_FALSE, offsetof(vertex, texCoord));
+			break;
+	}
+
+	const GLuint locations[] = { POSITION_LOC, NORMAL_LOC, TEXTCOORD_LOC };
+	for (size_t i = 0; i < sizeof(locations) / sizeof(locations[0]); i++)
+	{
+		glVertexArrayAttribBinding(vao, locations[i], 0);
+		glEnableVertexArrayAttrib(vao, locations[i]);
+	}
+}
+
+void packVertices(vertexFormat format, const vertex* vertices, size_t count, packedVertices& res)
+{
+	vertexDequantization& dequantization = res.dequantization;
+	dequantization.positionScale = glm::vec3(1.0f);
+	dequantization.positionOffset = glm::vec3(0.0f);
+	dequantization.texCoordScale = glm::vec2(1.0f);
+	dequantization.texCoordOffset = glm::vec2(0.0f);
+	res.data.resize(count * getVertexStride(format));
+	if (count == 0)
+	{
+		return;
+	}
+
+	if (format == VERTEX_FORMAT_COMPACT)
+	{
+		packCompact(vertices, count, (compactVertex*)res.data.data());
+		return;
+	}
+	if (format != VERTEX_FORMAT_QUANTIZED)
+	{
+		memcpy(res.data.data(), vertices, count * sizeof(vertex));
+		return;
+	}
+
+	glm::vec3 positionMin = vertices[0].position, positionMax = positionMin;
+	glm::vec2 texCoordMin = vertices[0].texCoord, texCoordMax = texCoordMin;
+	for (size_t i = 1; i < count; i++)
+	{
+		positionMin = glm::min(positionMin, vertices[i].position);
+		positionMax = glm::max(positionMax, vertices[i].position);
+		texCoordMin = glm::min(texCoordMin, vertices[i].texCoord);
+		texCoordMax = glm::max(texCoordMax, vertices[i].texCoord);
+	}
+	dequantization.positionScale = positionMax - positionMin;
+	dequantization.positionOffset = positionMin;
+	dequantization.texCoordScale = texCoordMax - texCoordMin;
+	dequantization.texCoordOffset = texCoordMin;
+	const glm::vec3& positionRange = dequantization.positionScale;
+	const glm::vec2& texCoordRange = dequantization.texCoordScale;
+	packQuantized(vertices, count, positionMin, glm::vec3(invertRange(positionRange.x), invertRange(positionRange.y), invertRange(positionRange.z)),
+		texCoordMin, glm::vec2(invertRange(texCoordRange.x), invertRange(texCoordRange.y)), (quantizedVertex*)res.data.data());
+}
+
+void measureVertexError(vertexFormat format, const vertex* vertices, size_t count, const packedVertices& packed, vertexErrorReport& report)
+{
+	if (format == VERTEX_FORMAT_FULL || count == 0)
+	{
+		return;
+	}
+
+	glm::vec3 positionMin = vertices[0].position, positionMax = positionMin;
+	for (size_t i = 1; i < count; i++)
+	{
+		positionMin = glm::min(positionMin, vertices[i].position);
+		positionMax = glm::max(positionMax, vertices[i].position);
+	}
+	glm::vec3 extent = positionMax - positionMin;
+	float largestExtent = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1.0e-6f));
+
+	const vertexDequantization& dequantization = packed.dequantization;
+	for (size_t i = 0; i < count; i++)
+	{
+		const vertex& source = vertices[i];
+		glm::vec3 position;
+		glm::vec2 texCoord;
+		GLuint normal;
+		if (format == VERTEX_FORMAT_COMPACT)
+		{
+			const compactVertex& v = ((const compactVertex*)packed.data.data())[i];
+			position = v.position;
+			normal = v.normal;
+			texCoord = glm::vec2(halfToFloat(v.texCoord[0]), halfToFloat(v.texCoord[1]));
+		}
+		else
+		{
+			const quantizedVertex& v = ((const quantizedVertex*)packed.data.data())[i];
+			position = glm::vec3(v.position[0], v.position[1], v.position[2]) / 65535.0f * dequantization.positionScale + dequantization.positionOffset;
+			normal = v.normal;
+			texCoord = glm::vec2(v.texCoord[0], v.texCoord[1]) / 65535.0f * dequantization.texCoordScale + dequantization.texCoordOffset;
+		}
+
+		glm::vec3 positionDelta = glm::abs(position - source.position);
+		glm::vec2 texCoordDelta = glm::abs(texCoord - source.texCoord);
+		report.position = std::max(report.position, std::max(std::max(positionDelta.x, positionDelta.y), positionDelta.z) / largestExtent);
+		report.normal = std::max(report.normal, normalError(source.normal, normal));
+		report.texCoord = std::max(report.texCoord, std::max(texCoordDelta.x, texCoordDelta.y));
+	}
+}
+
+bool withinTolerance(const vertexErrorReport& report)
+{
+	return report.position <= VERTEX_POSITION_TOLERANCE && report.normal <= VERTEX_NORMAL_TOLERANCE
+		&& report.texCoord <= VERTEX_TEXCOORD_TOLERANCE;
+}
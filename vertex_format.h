@@ -0,0 +1,75 @@
+#ifndef _VERTEX_FORMAT_H
+#define _VERTEX_FORMAT_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#define POSITION_LOC  0
+#define NORMAL_LOC	  1
+#define TEXTCOORD_LOC 2
+
+//	worst errors packVertices may introduce before a model is reported as out of tolerance
+#define VERTEX_POSITION_TOLERANCE	1.0e-4f			//	relative to the largest extent of the mesh
+#define VERTEX_NORMAL_TOLERANCE		0.5f			//	degrees
+#define VERTEX_TEXCOORD_TOLERANCE	(1.0f / 1024)	//	absolute, a quarter texel at 256
+
+//	full precision vertex as imported and cached; what the GPU stores depends on the vertexFormat
+struct vertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 texCoord;
+};
+
+enum vertexFormat
+{
+	VERTEX_FORMAT_FULL,			//	32 bytes: float position, normal and texture coordinates
+	VERTEX_FORMAT_COMPACT,		//	20 bytes: float position, 2_10_10_10 normal, half float texture coordinates
+	VERTEX_FORMAT_QUANTIZED		//	16 bytes: 16 bit position and texture coordinates over the mesh range, 2_10_10_10 normal
+};
+
+#define VERTEX_FORMAT_DEFAULT	VERTEX_FORMAT_QUANTIZED
+
+//	maps stored attributes back to object space: value * scale + offset; identity unless quantized
+struct vertexDequantization
+{
+	glm::vec3 positionScale;
+	glm::vec3 positionOffset;
+	glm::vec2 texCoordScale;
+	glm::vec2 texCoordOffset;
+};
+
+struct packedVertices
+{
+	std::vector<unsigned char> data;
+	vertexDequantization dequantization;
+};
+
+//	worst case over every vertex measured, in the units of the tolerances above
+struct vertexErrorReport
+{
+	float position;
+	float normal;
+	float texCoord;
+};
+
+GLsizei getVertexStride(vertexFormat);
+const char* getVertexFormatName(vertexFormat);
+bool parseVertexFormat(const char*, vertexFormat&);
+
+//	binding 0 of the VAO reads interleaved vertices of the given format
+void setupVertexAttributes(GLuint, vertexFormat);
+
+/**
+ * Converts full precision vertices into the interleaved GPU layout of a format, four vertices
+ * per SSE2 iteration where available. Quantized formats map positions and texture coordinates
+ * onto the range the mesh actually covers and return the transform that undoes it.
+ */
+void packVertices(vertexFormat, const vertex*, size_t, packedVertices&);
+
+//	decodes packed vertices the way the GPU does and folds the worst errors into the report
+void measureVertexError(vertexFormat, const vertex*, size_t, const packedVertices&, vertexErrorReport&);
+bool withinTolerance(const vertexErrorReport&);
+
+#endif